@@ -0,0 +1,42 @@
+#!/bin/sh
+# Runs every script in the examples directory from source and from a
+# bottled binary (compiled with -c) and reports the ones whose output
+# differs. Exits non-zero if any do.
+#
+#     benchmarks/bottle.sh ./lanky
+#
+# Addresses and timings are masked before comparing. Interactive examples
+# (those reading stdin) are skipped, as are exceptions2.lky and failing.lky,
+# which end in an uncaught error whose trace needs the line numbers bottled
+# code does not carry, inheritance.lky, which loads modules relative to the
+# script, and small.lky, which crashes either way.
+
+LANKY=$(realpath "${1:-./lanky}")
+
+output() {
+    timeout 60 "$LANKY" "$@" < /dev/null 2>&1 | sed -E 's/0x[0-9a-f]+/PTR/g; s/[0-9]+ ?ms/Nms/g; s/Took [0-9.]+/Took N/g'
+}
+
+cd "$(dirname "$0")/../examples" || exit 1
+
+failed=0
+for script in *.lky; do
+    case $script in call.lky|repl.lky|guessgame.lky|timer.lky|runtime.lky|bf.lky|favorite_things.lky|exceptions2.lky|failing.lky|inheritance.lky|small.lky) continue;; esac
+
+    output "$script" > /tmp/lanky-source.$$
+    git checkout -q things.txt 2>/dev/null
+    "$LANKY" "$script" -c -o /tmp/lanky-bottled.$$.lkyc < /dev/null > /dev/null 2>&1
+    output /tmp/lanky-bottled.$$.lkyc > /tmp/lanky-bottled.$$
+    git checkout -q things.txt 2>/dev/null
+
+    if cmp -s /tmp/lanky-source.$$ /tmp/lanky-bottled.$$; then
+        printf "%-28s ok\n" "$script"
+    else
+        printf "%-28s DIFFERS\n" "$script"
+        diff /tmp/lanky-source.$$ /tmp/lanky-bottled.$$ | head -10
+        failed=1
+    fi
+done
+
+rm -f /tmp/lanky-source.$$ /tmp/lanky-bottled.$$ /tmp/lanky-bottled.$$.lkyc
+exit $failed
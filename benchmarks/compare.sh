@@ -0,0 +1,33 @@
+#!/bin/sh
+# Compares two interpreter builds on the benchmark scripts.
+#
+#     benchmarks/compare.sh ./lanky-before ./lanky-after [script.lky ...]
+#
+# Without script arguments every .lky file in benchmarks/ is run. Set RUNS to
+# change the number of runs averaged for each script (default 5).
+
+BEFORE=${1:-./lanky-before}
+AFTER=${2:-./lanky-after}
+RUNS=${RUNS:-5}
+shift 2 2>/dev/null
+
+run() {
+    start=$(date +%s%N)
+    i=0
+    while [ $i -lt $RUNS ]; do
+        "$1" "$2" > /dev/null
+        i=$((i + 1))
+    done
+    end=$(date +%s%N)
+    echo $(( (end - start) / 1000000 / RUNS ))
+}
+
+if [ $# -eq 0 ]; then
+    set -- benchmarks/*.lky
+fi
+
+for script in "$@"; do
+    b=$(run "$BEFORE" "$script")
+    a=$(run "$AFTER" "$script")
+    echo "$script: before ${b}ms, after ${a}ms (average of $RUNS runs)"
+done
@@ -0,0 +1,29 @@
+#!/bin/sh
+# Compares the switch dispatch loop against threaded (computed goto) dispatch.
+#
+# Build the two interpreters first, e.g.
+#     make clean && make && cp lanky lanky-switch
+#     make clean && make COMPUTED_GOTO=1 && cp lanky lanky-threaded
+# and then run
+#     benchmarks/dispatch.sh ./lanky-switch ./lanky-threaded
+
+SWITCH=${1:-./lanky-switch}
+THREADED=${2:-./lanky-threaded}
+RUNS=${RUNS:-5}
+
+run() {
+    start=$(date +%s%N)
+    i=0
+    while [ $i -lt $RUNS ]; do
+        "$1" "$2" > /dev/null
+        i=$((i + 1))
+    done
+    end=$(date +%s%N)
+    echo $(( (end - start) / 1000000 / RUNS ))
+}
+
+for script in examples/tight-loop.lky examples/factorial.lky; do
+    s=$(run "$SWITCH" "$script")
+    t=$(run "$THREADED" "$script")
+    echo "$script: switch ${s}ms, threaded ${t}ms (average of $RUNS runs)"
+done
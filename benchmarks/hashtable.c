@@ -0,0 +1,86 @@
+/* Lanky -- Scripting Language and Virtual Machine
+ * Copyright (C) 2014  Sam Olsen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Microbenchmark for src/stdlib/hashtable.c: put, get and remove on a
+// million keys, with both integer keys (custom hash and equality, like
+// Table uses) and string keys (the defaults). Build and run with
+//
+//     cc -O2 -Isrc/stdlib benchmarks/hashtable.c src/stdlib/hashtable.c -o hst-bench
+//     ./hst-bench [entries]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "hashtable.h"
+
+static long int_hash(void *key, void *data)
+{
+    return (long)key;
+}
+
+static int int_equ(void *a, void *b)
+{
+    return a == b;
+}
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+#define PHASE(name, code) do { \
+        double start_ = now(); \
+        code \
+        printf("%-24s %8.1fms\n", name, now() - start_); \
+    } while(0)
+
+int main(int argc, char *argv[])
+{
+    long n = argc > 1 ? atol(argv[1]) : 1000000;
+    long i, found = 0;
+
+    hashtable ht = hst_create();
+    PHASE("int put", for(i = 1; i <= n; i++) hst_put(&ht, (void *)(i * 7), (void *)i, int_hash, int_equ););
+    PHASE("int get (half misses)", for(i = 1; i <= n * 2; i++) found += !!hst_get(&ht, (void *)(i * 7), int_hash, int_equ););
+    PHASE("int remove", for(i = 1; i <= n; i += 2) hst_remove_key(&ht, (void *)(i * 7), int_hash, int_equ););
+    PHASE("int get after remove", for(i = 1; i <= n; i++) found += !!hst_get(&ht, (void *)(i * 7), int_hash, int_equ););
+    hst_free(&ht);
+
+    char **keys = malloc(sizeof(char *) * n);
+    for(i = 0; i < n; i++)
+    {
+        keys[i] = malloc(24);
+        sprintf(keys[i], "key%ld", i);
+    }
+
+    ht = hst_create();
+    ht.duplicate_keys = 1;
+    PHASE("string put", for(i = 0; i < n; i++) hst_put(&ht, keys[i], (void *)(i + 1), NULL, NULL););
+    PHASE("string get", for(i = 0; i < n; i++) found += !!hst_get(&ht, keys[i], NULL, NULL););
+    PHASE("string remove", for(i = 0; i < n; i++) hst_remove_key(&ht, keys[i], NULL, NULL););
+    hst_free(&ht);
+
+    for(i = 0; i < n; i++)
+        free(keys[i]);
+    free(keys);
+
+    printf("(%ld hits)\n", found);
+    return 0;
+}
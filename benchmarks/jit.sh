@@ -0,0 +1,43 @@
+#!/bin/sh
+# Runs every script in the examples directory with the interpreter alone
+# (--no-jit) and with the native code compiler (--jit) and reports the ones
+# whose output differs. Exits non-zero if any do.
+#
+# Only functions called MACH_JIT_THRESHOLD times are compiled, so to put as
+# much code as possible through the compiler build with a threshold of 1:
+#     make clean && make JIT_THRESHOLD=1
+#     benchmarks/jit.sh ./lanky
+#
+# Extra flags for both runs (e.g. --register-ops) can be given in ARGS.
+# Addresses and timings are masked before comparing. Interactive examples
+# (those reading stdin) and tight-loop.lky, whose last line varies from run
+# to run, are skipped.
+
+LANKY=$(realpath "${1:-./lanky}")
+
+output() {
+    timeout 60 "$LANKY" "$@" < /dev/null 2>&1 | sed -E 's/0x[0-9a-f]+/PTR/g; s/[0-9]+ ?ms/Nms/g; s/Took [0-9.]+/Took N/g'
+}
+
+cd "$(dirname "$0")/../examples" || exit 1
+
+failed=0
+for script in *.lky; do
+    case $script in call.lky|repl.lky|guessgame.lky|timer.lky|runtime.lky|bf.lky|favorite_things.lky|tight-loop.lky) continue;; esac
+
+    output "$script" --no-jit $ARGS > /tmp/lanky-nojit.$$
+    git checkout -q things.txt 2>/dev/null
+    output "$script" --jit $ARGS > /tmp/lanky-jit.$$
+    git checkout -q things.txt 2>/dev/null
+
+    if cmp -s /tmp/lanky-nojit.$$ /tmp/lanky-jit.$$; then
+        printf "%-28s ok\n" "$script"
+    else
+        printf "%-28s DIFFERS\n" "$script"
+        diff /tmp/lanky-nojit.$$ /tmp/lanky-jit.$$ | head -10
+        failed=1
+    fi
+done
+
+rm -f /tmp/lanky-nojit.$$ /tmp/lanky-jit.$$
+exit $failed
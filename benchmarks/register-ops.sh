@@ -0,0 +1,44 @@
+#!/bin/sh
+# Compares stack bytecode against register form bytecode (--register-ops) on
+# the examples directory: executed instructions and wall time.
+#
+# Instruction counts need an interpreter built with instruction profiling:
+#     make clean && make PROFILE_OPS=1 && cp lanky lanky-profile
+#     make clean && make
+#     benchmarks/register-ops.sh ./lanky-profile ./lanky
+#
+# Interactive examples (those reading stdin) are skipped.
+
+PROFILE=$(realpath "${1:-./lanky-profile}")
+LANKY=$(realpath "${2:-./lanky}")
+RUNS=${RUNS:-3}
+
+count() {
+    "$PROFILE" "$@" < /dev/null 2>&1 > /dev/null | sed -n 's/^Executed \([0-9]*\) instructions\.$/\1/p'
+}
+
+run() {
+    start=$(date +%s%N)
+    i=0
+    while [ $i -lt $RUNS ]; do
+        "$LANKY" "$@" < /dev/null > /dev/null 2>&1
+        i=$((i + 1))
+    done
+    end=$(date +%s%N)
+    echo $(( (end - start) / 1000000 / RUNS ))
+}
+
+cd "$(dirname "$0")/../examples" || exit 1
+
+printf "%-28s %14s %14s %9s %9s\n" script "stack ops" "register ops" "stack" "register"
+for script in *.lky; do
+    case $script in call.lky|repl.lky|guessgame.lky|timer.lky|runtime.lky|bf.lky) continue;; esac
+
+    s=$(count "$script")
+    r=$(count "$script" --register-ops)
+    st=$(run "$script")
+    rt=$(run "$script" --register-ops)
+    printf "%-28s %14s %14s %7sms %7sms\n" "$script" "$s" "$r" "$st" "$rt"
+done
+
+git checkout -q things.txt 2>/dev/null
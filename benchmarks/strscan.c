@@ -0,0 +1,140 @@
+/* Lanky -- Scripting Language and Virtual Machine
+ * Copyright (C) 2014  Sam Olsen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Microbenchmark for src/stdlib/strscan.c: finds every match of a one byte
+// needle and of a longer one in log-like text from 1KB to 100MB, with
+// memmem in a loop (how split and replacing searched before) and with each
+// level of the scan this machine supports. Prints GB/s. Build and run with
+//
+//     cc -O2 -Isrc/stdlib benchmarks/strscan.c src/stdlib/strscan.c -o scn-bench
+//     ./scn-bench [largest size in bytes]
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "strscan.h"
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static long memmem_all(char *hay, long n, char *needle, long m)
+{
+    long found = 0;
+    char *loc = hay, *end = hay + n;
+    while(loc < end && (loc = memmem(loc, end - loc, needle, m)))
+    {
+        found++;
+        loc += m;
+    }
+
+    return found;
+}
+
+static char *make_text(long n)
+{
+    static const char *words[] = { "GET", "POST", "/index.html", "/api/v1/items", "200", "404",
+            "192.168.0.1", "Mozilla/5.0", "-", "2014-08-01T12:00:00" };
+    char *text = malloc(n + 1);
+    long i = 0;
+    unsigned seed = 1;
+    while(i < n)
+    {
+        seed = seed * 1103515245 + 12345;
+        const char *w = words[(seed >> 16) % 10];
+        long len = strlen(w);
+        if(i + len + 1 > n)
+            len = n - i - 1 > 0 ? n - i - 1 : 0;
+
+        memcpy(text + i, w, len);
+        i += len;
+        if(i < n)
+            text[i++] = (seed >> 8) % 13 ? ' ' : '\n';
+    }
+
+    text[n] = '\0';
+    return text;
+}
+
+int main(int argc, char *argv[])
+{
+    long largest = argc > 1 ? atol(argv[1]) : 100L * 1024 * 1024;
+    scn_level best = scn_get_level();
+    char *needles[] = { "\n", "ERROR 500" , "/api/v1/" };
+    const char *levels[] = { "scalar", "sse2", "avx2" };
+
+    printf("%-10s %-12s %8s", "size", "needle", "memmem");
+    int lv;
+    for(lv = SCN_SCALAR; lv <= best; lv++)
+        printf(" %8s", levels[lv]);
+    printf("   (GB/s)\n");
+
+    long size;
+    for(size = 1024; size <= largest; size *= 10)
+    {
+        char *text = make_text(size);
+        long reps = 200L * 1024 * 1024 / size;
+        if(reps < 3)
+            reps = 3;
+
+        int k;
+        for(k = 0; k < 3; k++)
+        {
+            char *needle = needles[k];
+            long m = strlen(needle);
+            long r, found = 0;
+
+            printf("%-10ld %-12s", size, k ? needle : "\\n");
+
+            double start = now();
+            for(r = 0; r < reps; r++)
+                found += memmem_all(text, size, needle, m);
+            printf(" %8.2f", size * (double)reps / (now() - start) / 1e6);
+
+            for(lv = SCN_SCALAR; lv <= best; lv++)
+            {
+                scn_set_level(lv);
+                scn_matches all = {NULL, 0, 0};
+                long hits = 0;
+
+                start = now();
+                for(r = 0; r < reps; r++)
+                {
+                    all.count = 0;
+                    hits += scn_find_all(text, size, needle, m, &all);
+                }
+                printf(" %8.2f", size * (double)reps / (now() - start) / 1e6);
+
+                if(hits != found)
+                    printf(" (found %ld, memmem %ld)", hits, found);
+                scn_matches_free(&all);
+            }
+
+            printf("\n");
+        }
+
+        free(text);
+    }
+
+    return 0;
+}
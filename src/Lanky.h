@@ -197,7 +197,10 @@ void print_ops(char *ops, int tape_len);
 // lobj_builtin.h
 // =================================================
 
-#define OBJ_NUM_UNWRAP(obj) (((lky_object_builtin *)obj)->type == LBI_FLOAT ? ((lky_object_builtin *)obj)->value.d : ((lky_object_builtin *)obj)->value.i)
+#define OBJ_IS_TAGGED(obj) ((uintptr_t)(obj) & 3)
+#define OBJ_IS_TAGGED_INT(obj) ((uintptr_t)(obj) & 1)
+#define OBJ_IS_FLONUM(obj) (((uintptr_t)(obj) & 3) == 2)
+#define OBJ_NUM_UNWRAP(obj) (OBJ_IS_TAGGED_INT(obj) ? (long)((intptr_t)(obj) >> 1) : OBJ_IS_FLONUM(obj) ? lobjb_flonum_value((lky_object *)(obj)) : (((lky_object_builtin *)obj)->type == LBI_FLOAT ? ((lky_object_builtin *)obj)->value.d : ((lky_object_builtin *)obj)->value.i))
 #define BIN_ARGS lky_object *a, lky_object *b
 #define BI_CAST(o, n) lky_object_builtin * n = (lky_object_builtin *) o
 #define GET_VA_ARGS(func) (lobj_get_member((lky_object *)func->bucket, "_va_args"))
@@ -308,6 +311,7 @@ typedef struct {
 lky_object *lobjb_call(lky_object *func, lky_object_seq *args);
 lky_object *lobjb_build_int(long value);
 lky_object *lobjb_build_float(double value);
+double lobjb_flonum_value(lky_object *obj);
 lky_object *lobjb_build_error(char *name, char *text);
 lky_object_custom *lobjb_build_custom(size_t extra_size);
 lky_object *lobjb_build_func(lky_object_code *code, int argc, arraylist inherited, mach_interp *interp);
@@ -109,6 +109,8 @@ int main(int argc, char *argv[])
     stlos_init(argc, argv);
 
     lky_object_code *code = (lky_object_code *)srl_deserialize_object(lky_bottled_bytecode_data_);
+    if(!code)
+        return 1;
 
     if(hst_contains_key(&args, "-S", NULL, NULL))
         exec_from_code(code, argv[1], 0);
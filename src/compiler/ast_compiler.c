@@ -41,6 +41,8 @@
 #include "lkyobj_builtin.h"
 #include "hashmap.h"
 #include "bytecode_analyzer.h"
+#include "ast_optimizer.h"
+#include "lky_symbol.h"
 #include "stl_string.h"
 #include "stl_units.h"
 #include "stl_regex.h"
@@ -50,6 +52,13 @@
 #include <lkyobj_builtin.h>
 
 
+// Set by the --register-ops flag; see lower_to_register_ops below.
+int compile_register_ops_ = 0;
+// Cleared by the --no-superinstructions flag; see fuse_superinstructions.
+int compile_superinstructions_ = 1;
+// Set by the -O flag; see ast_optimize in ast_optimizer.c.
+int compile_optimize_ = 0;
+
 // A compiler wrapper to reduce global state.
 // This struct allows us to compile in
 // different contexts (for example a nested
@@ -57,12 +66,13 @@
 typedef struct {
     arraylist rops; // The arraylist for the instructions (think RunningOPerationS)
     arraylist rcon; // The arraylist for the constants (think RunningCONstants)
+    Hashmap rcon_index; // Maps the constant_key of number and string constants to their index in rcon + 1
     arraylist rnames; // The arraylist for the names (think RunningNAMES)
     arraylist loop_start_stack; // A stack for continue/jump directives
     arraylist loop_end_stack; // A stack for break directives
-    Hashmap saved_locals; // A set of locals (not currently used)
+    Hashmap saved_locals; // Maps names to their local slots
     char save_val; // Used to determine if we want to save the result of an operation or pop it.
-    int local_idx; // Current local slot (not currently used)
+    int local_idx; // The next free local slot
     int ifTag; // The index of the tagging system described above 
     int name_idx; // The index of the current name
     int classargc; // The number of arguments for class instantiation.
@@ -70,8 +80,15 @@ typedef struct {
     arraylist rindices;
     int repl;
     char *impl_name;
+    int member_caches; // The number of member access inline caches handed out
+    arraylist bound_names; // Names the caller binds into the first local slots
+    char *bound_close; // Flags the bound names captured by a nested function
 } compiler_wrapper;
 
+// Records where a name was used as a local so that the site can be switched
+// over to a closure variable if a nested function captures the name. A
+// negative idx stands for bound slot -idx - 1 (see bind_locals), which has
+// no instruction to rewrite.
 typedef struct {
     compiler_wrapper *owner;
     char *name;
@@ -88,6 +105,7 @@ void compile_set_index(compiler_wrapper *cw, ast_node *root);
 int find_prev_name(compiler_wrapper *cw, char *name);
 void int_to_byte_array(unsigned char *buffer, int val);
 void append_op(compiler_wrapper *cw, long ins, long lineno);
+void append_member_cache(compiler_wrapper *cw, long lineno);
 
 // A struct used to represent 'tags' in the
 // intermediate code; we use this struct to
@@ -146,11 +164,7 @@ void free_tag_nodes(tag_node *node)
     }
 }
 
-// Returns the index of the next local. This
-// is merely used as a count for local variables.
-// Currently we only use closure variables for
-// simplicity's sake (at the cost of slower
-// performance)
+// Returns the index of the next local slot.
 int get_next_local(compiler_wrapper *cw)
 {
     return cw->local_idx++;
@@ -158,6 +172,13 @@ int get_next_local(compiler_wrapper *cw)
 
 char switch_to_close(compiler_wrapper *cw, char *sid, int idx)
 {
+    if(idx < 0)
+    {
+        char was = cw->bound_close[-idx - 1];
+        cw->bound_close[-idx - 1] = 1;
+        return !was;
+    }
+
     lky_object *o = arr_get(&cw->rops, idx);
     lky_instruction istr = OBJ_NUM_UNWRAP(o);
 
@@ -189,6 +210,9 @@ char switch_to_close(compiler_wrapper *cw, char *sid, int idx)
 
 char is_close(compiler_wrapper *cw, int idx)
 {
+    if(idx < 0)
+        return cw->bound_close[-idx - 1];
+
     lky_object *o = arr_get(&cw->rops, idx);
     lky_instruction istr = OBJ_NUM_UNWRAP(o);
 
@@ -278,6 +302,59 @@ void append_var_info(compiler_wrapper *cw, char *ch, char load, int lineno)
     arr_append(&cw->used_names, wrap);
 }
 
+// The caller binds the parameters (followed by va_args_ and the refname) into
+// the first local slots, so they are registered here before the body is
+// compiled.
+void bind_locals(compiler_wrapper *cw)
+{
+    long i;
+    for(i = 0; i < cw->bound_names.count; i++)
+    {
+        char *name = arr_get(&cw->bound_names, i);
+        lky_object *obj = lobjb_build_int(get_next_local(cw));
+        pool_add(&ast_memory_pool, obj);
+        hm_put(&cw->saved_locals, name, obj);
+
+        name_wrapper *wrap = malloc(sizeof(name_wrapper));
+        pool_add(&ast_memory_pool, wrap);
+        wrap->idx = -i - 1;
+        wrap->name = name;
+        wrap->owner = cw;
+        arr_append(&cw->used_names, wrap);
+    }
+}
+
+// Writes a BIND_CLOSE to 'out' for every bound slot captured by a nested
+// function (out needs room for nine bytes per bound name). Returns the
+// number of bytes written.
+int close_bindings(compiler_wrapper *cw, unsigned char *out)
+{
+    int len = 0;
+    long i;
+    for(i = 0; i < cw->bound_names.count; i++)
+    {
+        if(!cw->bound_close[i])
+            continue;
+
+        char *name = arr_get(&cw->bound_names, i);
+        int ni = find_prev_name(cw, name);
+        if(ni < 0)
+        {
+            char *nsid = malloc(strlen(name) + 1);
+            strcpy(nsid, name);
+            ni = (int)cw->rnames.count;
+            arr_append(&cw->rnames, nsid);
+        }
+
+        out[len] = LI_BIND_CLOSE;
+        int_to_byte_array(out + len + 1, (int)i);
+        int_to_byte_array(out + len + 5, ni);
+        len += 9;
+    }
+
+    return len;
+}
+
 // Gets the object value of a wrapped value
 lky_object *wrapper_to_obj(ast_value_wrapper wrap)
 {
@@ -362,6 +439,18 @@ void append_op(compiler_wrapper *cw, long ins, long lineno)
     arr_append(&cw->rindices, idx);
 }
 
+// Gives the member access instruction just appended an inline
+// cache of its own.
+void append_member_cache(compiler_wrapper *cw, long lineno)
+{
+    unsigned char buf[4];
+    int_to_byte_array(buf, cw->member_caches++);
+    append_op(cw, buf[0], lineno);
+    append_op(cw, buf[1], lineno);
+    append_op(cw, buf[2], lineno);
+    append_op(cw, buf[3], lineno);
+}
+
 arraylist copy_arraylist(arraylist in)
 {
     arraylist nlist = arr_create(in.count + 10);
@@ -399,6 +488,59 @@ lky_instruction instr_for_char(char op)
     return LI_IGNORE;
 }
 
+// Whether evaluating 'n' can run any code of the program's own.
+int concat_operand_is_plain(ast_node *n)
+{
+    if(n->type == AMEMBER_ACCESS)
+        return concat_operand_is_plain(((ast_member_access_node *)n)->object);
+
+    return n->type == AVALUE;
+}
+
+// Compiles the operands of a '+' chain left to right.
+void compile_concat_operands(compiler_wrapper *cw, ast_node *n)
+{
+    if(n->type != ABINARY_EXPRESSION || ((ast_binary_node *)n)->opt != '+')
+    {
+        compile(cw, n);
+        return;
+    }
+
+    compile_concat_operands(cw, ((ast_binary_node *)n)->left);
+    compile(cw, ((ast_binary_node *)n)->right);
+}
+
+// Compiles a chain of additions that starts with a string literal
+// ("a" + b + c) to a single CONCAT. The other operands must be plain
+// values: CONCAT stringifies them only once they have all been
+// evaluated, which would otherwise be noticeable. Returns 0 (having
+// emitted nothing) if the node is not such a chain.
+int compile_concat(compiler_wrapper *cw, ast_binary_node *node)
+{
+    ast_node *n = (ast_node *)node;
+    unsigned int count = 1;
+    for(; n->type == ABINARY_EXPRESSION && ((ast_binary_node *)n)->opt == '+'; n = ((ast_binary_node *)n)->left)
+    {
+        if(!concat_operand_is_plain(((ast_binary_node *)n)->right))
+            return 0;
+        count++;
+    }
+
+    if(n->type != AVALUE || ((ast_value_node *)n)->value_type != VSTRING)
+        return 0;
+
+    compile_concat_operands(cw, (ast_node *)node);
+
+    append_op(cw, LI_CONCAT, node->lineno);
+    unsigned char buf[4];
+    int_to_byte_array(buf, count);
+    append_op(cw, buf[0], node->lineno);
+    append_op(cw, buf[1], node->lineno);
+    append_op(cw, buf[2], node->lineno);
+    append_op(cw, buf[3], node->lineno);
+    return 1;
+}
+
 void compile_binary(compiler_wrapper *cw, ast_node *root)
 {
     ast_binary_node *node = (ast_binary_node *)root;
@@ -437,6 +579,9 @@ void compile_binary(compiler_wrapper *cw, ast_node *root)
         return;
     }
 
+    if(node->opt == '+' && compile_concat(cw, node))
+        return;
+
     // Handle the generic '=' case for compilation
     if(node->opt != '=')
         compile(cw, node->left);
@@ -578,12 +723,16 @@ void compile_loop(compiler_wrapper *cw, ast_node *root)
 
     int start = (int)cw->rops.count; // The start location (for loop jumps)
 
-    compile(cw, node->condition); // Append the tag for the unknown end location
-    append_op(cw, LI_JUMP_FALSE, node->lineno);
-    append_op(cw, tagOut, node->lineno);
-    append_op(cw, -1, node->lineno); // Note that we use for bytes to represent jump locations.
-    append_op(cw, -1, node->lineno); // This allows us to index locations beyond 255 in the
-    append_op(cw, -1, node->lineno); // interpreter.
+    // The optimizer removes conditions that are always true (see prune_loop).
+    if(node->condition)
+    {
+        compile(cw, node->condition); // Append the tag for the unknown end location
+        append_op(cw, LI_JUMP_FALSE, node->lineno);
+        append_op(cw, tagOut, node->lineno);
+        append_op(cw, -1, node->lineno); // Note that we use for bytes to represent jump locations.
+        append_op(cw, -1, node->lineno); // This allows us to index locations beyond 255 in the
+        append_op(cw, -1, node->lineno); // interpreter.
+    }
     
     lky_object *wrapLoop = lobjb_build_int(tagLoop);
     lky_object *wrapOut = lobjb_build_int(tagOut);
@@ -876,7 +1025,7 @@ void compile_object(compiler_wrapper *cw, ast_node *n)
         if(strcmp(w->name, node->refname))
             continue;   
 
-        switch_to_close(cw, node->refname, w->idx);
+        switch_to_close(w->owner, node->refname, w->idx);
     }
 
     int ct = 0;
@@ -1008,6 +1157,7 @@ void compile_triple_set(compiler_wrapper *cw, ast_node *n)
         append_op(cw, buf[1], node->lineno);
         append_op(cw, buf[2], node->lineno);
         append_op(cw, buf[3], node->lineno);
+        append_member_cache(cw, node->lineno);
 
         compile(cw, node->new_val);
         append_op(cw, instr_for_char(node->op), node->lineno);
@@ -1019,6 +1169,7 @@ void compile_triple_set(compiler_wrapper *cw, ast_node *n)
         append_op(cw, buf[1], node->lineno);
         append_op(cw, buf[2], node->lineno);
         append_op(cw, buf[3], node->lineno);
+        append_member_cache(cw, node->lineno);
     }
 }
 
@@ -1100,6 +1251,7 @@ void compile_member_access(compiler_wrapper *cw, ast_node *n)
     append_op(cw, buf[1], node->lineno);
     append_op(cw, buf[2], node->lineno);
     append_op(cw, buf[3], node->lineno);
+    append_member_cache(cw, node->lineno);
 }
 
 void compile_set_member(compiler_wrapper *cw, ast_node *root)
@@ -1127,6 +1279,7 @@ void compile_set_member(compiler_wrapper *cw, ast_node *root)
     append_op(cw, buf[1], root->lineno);
     append_op(cw, buf[2], root->lineno);
     append_op(cw, buf[3], root->lineno);
+    append_member_cache(cw, root->lineno);
 }
 
 void compile_set_index(compiler_wrapper *cw, ast_node *root)
@@ -1198,9 +1351,51 @@ void compile_unary(compiler_wrapper *cw, ast_node *root)
         append_op(cw, extra, node->lineno);
 }
 
+// Builds the key under which a number or string constant is filed in
+// rcon_index; NULL for any other object. Integers, floats (by their bits)
+// and strings get distinct prefixes, so a key only matches a constant that
+// lobjb_quick_compare would also match.
+char *constant_key(lky_object *obj)
+{
+    char *key;
+    if(OBJ_IS_INTEGER(obj))
+    {
+        key = malloc(32);
+        sprintf(key, "i%ld", OBJ_INT_UNWRAP(obj));
+    }
+    else if(OBJ_IS_FLOAT(obj))
+    {
+        double d = OBJ_NUM_UNWRAP(obj);
+        unsigned long long bits;
+        memcpy(&bits, &d, sizeof(bits));
+
+        key = malloc(32);
+        sprintf(key, "f%llx", bits);
+    }
+    else if(lobj_is_of_class(obj, stlstr_get_class()))
+    {
+        char *str = stlstr_unwrap(obj);
+        key = malloc(strlen(str) + 2);
+        key[0] = 's';
+        strcpy(key + 1, str);
+    }
+    else
+        return NULL;
+
+    return key;
+}
+
 // Used to find and reuse previous constants.
 long find_prev_const(compiler_wrapper *cw, lky_object *obj)
 {
+    char *key = constant_key(obj);
+    if(key)
+    {
+        long idx = (long)hm_get(&cw->rcon_index, key, NULL) - 1;
+        free(key);
+        return idx;
+    }
+
     long i;
     for(i = 0; i < cw->rcon.count; i++)
     {
@@ -1255,6 +1450,13 @@ void compile_value(compiler_wrapper *cw, ast_node *root)
     {
         idx = cw->rcon.count;
         arr_append(&cw->rcon, obj);
+
+        char *key = constant_key(obj);
+        if(key)
+        {
+            hm_put(&cw->rcon_index, key, (void *)(idx + 1));
+            free(key);
+        }
     }
 
     append_op(cw, LI_LOAD_CONST, node->lineno);
@@ -1318,6 +1520,7 @@ void compile_function(compiler_wrapper *cw, ast_node *root)
     nw.rnames = arr_create(10);
     nw.rindices = arr_create(100);
     nw.used_names = copy_arraylist(cw->used_names);
+    nw.bound_names = arr_create(10);
     nw.repl = 0;
     nw.impl_name = node->impl_name;
     
@@ -1332,9 +1535,16 @@ void compile_function(compiler_wrapper *cw, ast_node *root)
         strcpy(nid, idf);
 
         arr_append(&nw.rnames, nid);
+        arr_append(&nw.bound_names, nid);
 
        argc++;
     }
+
+    // Extra arguments and the bound object follow the parameters (see
+    // lobjb_default_callable).
+    arr_append(&nw.bound_names, "va_args_");
+    if(node->refname)
+        arr_append(&nw.bound_names, node->refname);
     
     nw.save_val = 0;
     lky_object_code *code = compile_ast_ext(node->payload->next, &nw);
@@ -1585,6 +1795,222 @@ void replace_tags(compiler_wrapper *cw)
     free_tag_nodes(tags);
 }
 
+// Stores the register operand (see instruction_set.h) for the instruction
+// at code[i] in 'reg' if it loads a local slot or a constant.
+int register_operand_at(unsigned char *code, int i, int len, unsigned int *reg)
+{
+    if(i + 5 > len)
+        return 0;
+
+    unsigned int idx = *(unsigned int *)(code + i + 1);
+    switch(code[i])
+    {
+        case LI_LOAD_LOCAL:
+            *reg = idx;
+            return 1;
+        case LI_LOAD_CONST:
+            *reg = idx | LKY_REG_CONST;
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// Turns stack code of the form
+//
+//     LOAD_LOCAL/LOAD_CONST a; LOAD_LOCAL/LOAD_CONST b; BINARY_*
+//
+// into a single REG_BINARY_PUSH, or (with --register-ops) into REG_BINARY
+// when the result is only stored to a local (SAVE_LOCAL d; POP). This runs
+// once a unit has been compiled completely, since only then do we know
+// which names stayed in local slots rather than being switched over to
+// closure variables.
+int lower_to_register_ops(unsigned char *code, char *entry, int i, int len, unsigned char *out, int *consumed)
+{
+    unsigned int lhs, rhs;
+    if(!register_operand_at(code, i, len, &lhs) || entry[i + 5] || !register_operand_at(code, i + 5, len, &rhs))
+        return 0;
+
+    int bin = i + 10;
+    if(bin >= len || entry[bin] || code[bin] < LI_BINARY_ADD || code[bin] > LI_BINARY_BRSHIFT)
+        return 0;
+
+    int save = bin + 1;
+    char stores = compile_register_ops_ && save + 6 <= len && !entry[save] && !entry[save + 5] &&
+                  code[save] == LI_SAVE_LOCAL && code[save + 5] == LI_POP;
+
+    out[0] = stores ? LI_REG_BINARY : LI_REG_BINARY_PUSH;
+    out[1] = code[bin];
+    int_to_byte_array(out + 2, (int)lhs);
+    int_to_byte_array(out + 6, (int)rhs);
+
+    if(!stores)
+    {
+        *consumed = 11;
+        return 10;
+    }
+
+    memcpy(out + 10, code + save + 1, 4);
+    *consumed = 17;
+    return 14;
+}
+
+// The parts of a counting loop found by match_for_loop.
+typedef struct {
+    int step; // Where the step starts
+    int exit; // The IGNORE the loop exits to
+    unsigned char cmp; // The test's BINARY_* op
+    unsigned char op; // The step's BINARY_* op
+    unsigned int counter; // The counter's local slot
+    unsigned int bound; // Register operands (see instruction_set.h)
+    unsigned int by;
+} for_loop_match;
+
+// Recognizes the code compile_loop emits for a loop of the form
+// 'for i = a; i < b; i += c' whose test starts at code[head]:
+//
+//     head: LOAD_LOCAL i; LOAD_* b; BINARY_LT; JUMP_FALSE exit
+//           ...body...
+//           IGNORE
+//     step: LOAD_LOCAL i; LOAD_* c; BINARY_ADD; SAVE_LOCAL i; POP; JUMP head
+//     exit: IGNORE
+//
+// The bound and the step have to be locals or constants, so that nothing
+// but the loop's own code runs between the step and the next test. The test
+// may also be any of <=, >, >= and !=, and the step may subtract. The test
+// and the step are replaced separately (see fuse_for_loop), each after
+// matching the whole loop from its head, so either both are or neither is.
+int match_for_loop(unsigned char *code, char *entry, int head, int len, for_loop_match *m)
+{
+    #define operand_(at) (*(unsigned int *)(code + (at) + 1))
+
+    if(head + 16 > len || code[head] != LI_LOAD_LOCAL || entry[head + 5] || entry[head + 10] || entry[head + 11] ||
+            !register_operand_at(code, head + 5, len, &m->bound) || code[head + 11] != LI_JUMP_FALSE)
+        return 0;
+
+    m->counter = operand_(head);
+    m->cmp = code[head + 10];
+    if(m->cmp != LI_BINARY_LT && m->cmp != LI_BINARY_LTE && m->cmp != LI_BINARY_GT &&
+            m->cmp != LI_BINARY_GTE && m->cmp != LI_BINARY_NE)
+        return 0;
+
+    m->exit = (int)operand_(head + 11);
+    m->step = m->exit - 22;
+    if(m->exit >= len || m->step <= head + 16 || code[m->exit] != LI_IGNORE || code[m->step - 1] != LI_IGNORE)
+        return 0;
+
+    // The body has to end on an instruction boundary right before the step.
+    int i;
+    for(i = head + 16; i < m->step; i += instruction_length(code, i));
+    if(i != m->step)
+        return 0;
+
+    int s = m->step;
+    m->op = code[s + 10];
+    if(entry[s + 5] || entry[s + 10] || entry[s + 11] || entry[s + 16] || entry[s + 17] ||
+            code[s] != LI_LOAD_LOCAL || operand_(s) != m->counter || !register_operand_at(code, s + 5, len, &m->by) ||
+            (m->op != LI_BINARY_ADD && m->op != LI_BINARY_SUBTRACT) ||
+            code[s + 11] != LI_SAVE_LOCAL || operand_(s + 11) != m->counter || code[s + 16] != LI_POP ||
+            code[s + 17] != LI_JUMP || operand_(s + 17) != (unsigned int)head)
+        return 0;
+
+    return 1;
+
+    #undef operand_
+}
+
+// Replaces the test of a counting loop (see match_for_loop) at code[i] with
+// FOR_RANGE, or its step and the jump back with FOR_STEP. FOR_STEP carries
+// the location right after FOR_RANGE, which rewrite_bytecode maps like any
+// other since the body starts with an instruction of its own.
+int fuse_for_loop(unsigned char *code, char *entry, int i, int len, unsigned char *out, int *consumed)
+{
+    for_loop_match m;
+    if(code[i] != LI_LOAD_LOCAL)
+        return 0;
+
+    if(match_for_loop(code, entry, i, len, &m))
+    {
+        out[0] = LI_FOR_RANGE;
+        out[1] = m.cmp;
+        int_to_byte_array(out + 2, (int)m.counter);
+        int_to_byte_array(out + 6, (int)m.bound);
+        int_to_byte_array(out + 10, m.exit);
+        *consumed = 16;
+        return 14;
+    }
+
+    int head = i + 22 <= len && code[i + 17] == LI_JUMP ? (int)*(unsigned int *)(code + i + 18) : i;
+    if(head >= i || !match_for_loop(code, entry, head, len, &m) || m.step != i)
+        return 0;
+
+    out[0] = LI_FOR_STEP;
+    out[1] = m.op;
+    out[2] = m.cmp;
+    int_to_byte_array(out + 3, (int)m.counter);
+    int_to_byte_array(out + 7, (int)m.by);
+    int_to_byte_array(out + 11, (int)m.bound);
+    int_to_byte_array(out + 15, head + 16);
+    *consumed = 22;
+    return 19;
+}
+
+// Peephole pass run over every finished unit (see rewrite_bytecode). The
+// fused sequences were picked from the pair counts printed by interpreters
+// built with LKY_PROFILE_OPS (compile with --no-superinstructions to see the
+// unfused pairs):
+//
+//     LOAD_*; LOAD_*; BINARY_*    -> REG_BINARY_PUSH (lower_to_register_ops)
+//     SAVE_LOCAL; POP             -> SAVE_LOCAL_POP
+//     BINARY_*; JUMP_FALSE        -> BINARY_JUMP_FALSE
+//     LOAD_LOCAL; LOAD_MEMBER     -> LOAD_LOCAL_MEMBER
+//
+// Counting loops are turned into FOR_RANGE and FOR_STEP first (see
+// fuse_for_loop), as their test and step would otherwise be lowered to
+// register ops.
+int fuse_superinstructions(unsigned char *code, char *entry, int i, int len, unsigned char *out, int *consumed, void *data)
+{
+    int produced = compile_superinstructions_ ? fuse_for_loop(code, entry, i, len, out, consumed) : 0;
+    if(*consumed)
+        return produced;
+
+    produced = lower_to_register_ops(code, entry, i, len, out, consumed);
+    if(*consumed || !compile_superinstructions_)
+        return produced;
+
+    int next = i + instruction_length(code, i);
+    if(next >= len || entry[next])
+        return 0;
+
+    if(code[i] == LI_SAVE_LOCAL && code[next] == LI_POP)
+    {
+        out[0] = LI_SAVE_LOCAL_POP;
+        memcpy(out + 1, code + i + 1, 4);
+        *consumed = 6;
+        return 5;
+    }
+
+    if(code[i] >= LI_BINARY_ADD && code[i] <= LI_BINARY_BRSHIFT && code[next] == LI_JUMP_FALSE)
+    {
+        out[0] = LI_BINARY_JUMP_FALSE;
+        out[1] = code[i];
+        memcpy(out + 2, code + next + 1, 4);
+        *consumed = 6;
+        return 6;
+    }
+
+    if(code[i] == LI_LOAD_LOCAL && code[next] == LI_LOAD_MEMBER)
+    {
+        out[0] = LI_LOAD_LOCAL_MEMBER;
+        memcpy(out + 1, code + i + 1, 4);
+        memcpy(out + 5, code + next + 1, 8);
+        *consumed = 14;
+        return 13;
+    }
+
+    return 0;
+}
+
 // Finalize the constants into an array
 void **make_cons_array(compiler_wrapper *cw)
 {
@@ -1607,10 +2033,7 @@ char **make_names_array(compiler_wrapper *cw)
     long i;
     for(i = 0; i < cw->rnames.count; i++)
     {
-        char *txt = arr_get(&cw->rnames, i);
-        char *nw = malloc(strlen(txt) + 1);
-        strcpy(nw, txt);
-        names[i] = nw;
+        names[i] = sym_intern(arr_get(&cw->rnames, i));
     }
 
     return names;
@@ -1623,9 +2046,13 @@ lky_object_code *compile_ast_repl(ast_node *root)
     cw.local_idx = 0;
     cw.rnames = arr_create(10);
     cw.used_names = arr_create(10);
+    cw.bound_names = arr_create(1);
     cw.repl = 1;
     cw.impl_name = "main";
 
+    if(compile_optimize_)
+        root = ast_optimize(root);
+
     return compile_ast_ext(root, &cw);
 }
 
@@ -1637,10 +2064,12 @@ lky_object_code *compile_ast_ext(ast_node *root, compiler_wrapper *incw)
     compiler_wrapper cw;
     cw.rops = arr_create(50);
     cw.rcon = arr_create(10);
+    cw.rcon_index = hm_create(64, 1);
     cw.loop_start_stack = arr_create(10);
     cw.loop_end_stack = arr_create(10);
     cw.rindices = arr_create(100);
     cw.ifTag = 1000;
+    cw.member_caches = 0;
     cw.save_val = 0;
     cw.name_idx = 0;
     cw.classargc = 0;
@@ -1651,6 +2080,7 @@ lky_object_code *compile_ast_ext(ast_node *root, compiler_wrapper *incw)
         cw.local_idx = incw->local_idx;
         cw.rnames = incw->rnames;
         cw.used_names = incw->used_names;
+        cw.bound_names = incw->bound_names;
         cw.repl = incw->repl;
         cw.impl_name = incw->impl_name;
     }
@@ -1660,23 +2090,32 @@ lky_object_code *compile_ast_ext(ast_node *root, compiler_wrapper *incw)
         cw.local_idx = 0;
         cw.rnames = arr_create(50);
         cw.used_names = arr_create(20);
+        cw.bound_names = arr_create(1);
         cw.repl = 0;
         cw.impl_name = NULL;
     }
 
+    cw.bound_close = calloc(cw.bound_names.count + 1, 1);
+    bind_locals(&cw);
+
     compile_compound(&cw, root);
     replace_tags(&cw);
 
+    // Captured parameters are copied into the closure bucket on entry.
+    unsigned char prologue[cw.bound_names.count * 9 + 1];
+    int prologue_len = close_bindings(&cw, prologue);
+
     // We want to propogate the classargc
     // (number of args passed to build_)
     // back up to the caller.
     if(incw)
         incw->classargc = cw.classargc;
     
+    // An empty body (root is NULL) just returns nil.
     if(cw.rops.count == 0 || OBJ_NUM_UNWRAP(arr_get(&cw.rops, cw.rops.count - 1)) != LI_RETURN)
     {
-        append_op(&cw, LI_PUSH_NIL, root->lineno);
-        append_op(&cw, LI_RETURN, root->lineno);
+        append_op(&cw, LI_PUSH_NIL, root ? root->lineno : 0);
+        append_op(&cw, LI_RETURN, root ? root->lineno : 0);
     }
 
     // Build the resultant code object.
@@ -1690,19 +2129,44 @@ lky_object_code *compile_ast_ext(ast_node *root, compiler_wrapper *incw)
     code->indices = finalize_indices(&cw);
     code->ops = finalize_ops(&cw);
     code->op_len = cw.rops.count;
-    code->locals = malloc(sizeof(void *) * cw.local_idx);
+
+    if(compile_superinstructions_ || compile_register_ops_)
+    {
+        int len = (int)code->op_len;
+        code->ops = rewrite_bytecode(code->ops, &code->indices, &len, fuse_superinstructions, NULL);
+        code->op_len = len;
+    }
+
+    if(prologue_len)
+    {
+        int len = (int)code->op_len;
+        code->ops = prepend_bytecode(code->ops, &code->indices, &len, prologue, prologue_len);
+        code->op_len = len;
+    }
+
     code->names = make_names_array(&cw);
     code->refname = NULL;
-    code->stack_size = calculate_max_stack_depth(code->ops, (int)code->op_len);
-    code->catch_size = calculate_max_catch_depth(code->ops, (int)code->op_len);
+    code->member_caches = calloc(calculate_member_cache_count(code->ops, (int)code->op_len), sizeof(lky_member_cache));
+    code->tape = NULL;
+    code->tape_indices = NULL;
+    code->jit = NULL;
+    code->jit_size = 0;
+    code->jit_calls = 0;
     
     cw.impl_name = cw.impl_name ? cw.impl_name : "Anonymous Function";
     code->impl_name = malloc(strlen(cw.impl_name) + 1);
     strcpy(code->impl_name, cw.impl_name);
 
-    int i;
-    for(i = 0; i < cw.local_idx; i++)
-        code->locals[i] = NULL;
+    free(cw.bound_close);
+    hm_free(&cw.rcon_index);
+
+    // Anything the verifier rejects here is a bug in the compiler.
+    const char *err = load_bytecode(code);
+    if(err)
+    {
+        printf("Internal compiler error in %s: %s\n", code->impl_name, err);
+        exit(1);
+    }
 
     return code;
 }
@@ -1712,6 +2176,8 @@ lky_object_code *compile_ast(ast_node *root)
 {
     int backup = lobjb_uses_pointer_tags_;
     lobjb_uses_pointer_tags_ = 0;
+    if(compile_optimize_)
+        root = ast_optimize(root);
     lky_object_code *ret = compile_ast_ext(root, NULL);
     lobjb_uses_pointer_tags_ = backup;
     return ret;
@@ -21,8 +21,14 @@
 
 #include "ast.h"
 #include "lkyobj_builtin.h"
+#include "instruction_set.h"
+
+extern int compile_register_ops_;
+extern int compile_superinstructions_;
+extern int compile_optimize_;
 
 lky_object_code *compile_ast(ast_node *root);
 lky_object_code *compile_ast_repl(ast_node *root);
+lky_instruction instr_for_char(char op);
 
 #endif
@@ -0,0 +1,471 @@
+/* Lanky -- Scripting Language and Virtual Machine
+ * Copyright (C) 2014  Sam Olsen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// ast_optimizer.c
+// ================================
+// An optional pass, switched on by the -O flag, that rewrites the syntax tree
+// before it is compiled. It does two things. First, an operation whose operands
+// are all literals is replaced by a literal of its result. The result is
+// computed by the interpreter's own operator functions (see mach_binary_op), so
+// the constant is the value the instruction would have pushed; operations
+// that would raise (integer division by zero) or dispatch to a class (strings
+// other than "a" + "b", units) are left for run time. Second, code that can
+// never run is dropped: the clauses of an if/elif/else chain, the arm of a
+// ternary or of an && / || chain and the body of a loop whose condition is a
+// literal, and the statements that follow a ret, raise, break or continue.
+
+#include <stdlib.h>
+#include <string.h>
+#include "ast_optimizer.h"
+#include "ast_compiler.h"
+#include "tools.h"
+#include "lky_machine.h"
+#include "mach_unary_ops.h"
+#include "stl_string.h"
+
+static ast_node *optimize_node(ast_node *node);
+static ast_node *optimize_block(ast_node *head);
+
+// Allocates a node of the given size in the AST memory pool that takes the
+// place of 'at'.
+static void *make_node(size_t size, ast_type type, ast_node *at)
+{
+    ast_node *node = MALLOC(size);
+    pool_add(&ast_memory_pool, node);
+    node->type = type;
+    node->next = NULL;
+    node->lineno = at->lineno;
+
+    return node;
+}
+
+static ast_node *make_value(ast_node *at, ast_value_type type, ast_value_union value)
+{
+    ast_value_node *node = make_node(sizeof(ast_value_node), AVALUE, at);
+    node->value_type = type;
+    node->value = value;
+
+    return (ast_node *)node;
+}
+
+// Builds the nil, yes or no literal (opt '0', 'Y' or 'N'; see compile_unary).
+static ast_node *make_singleton(ast_node *at, char opt)
+{
+    ast_unary_node *node = make_node(sizeof(ast_unary_node), AUNARY_EXPRESSION, at);
+    node->target = NULL;
+    node->opt = opt;
+
+    return (ast_node *)node;
+}
+
+// Returns the object a number, yes, no or nil literal evaluates to, or NULL
+// if the node is anything else.
+static lky_object *literal_object(ast_node *node)
+{
+    if(node->type == AVALUE)
+    {
+        ast_value_node *v = (ast_value_node *)node;
+        switch(v->value_type)
+        {
+            case VINT: return lobjb_build_int(v->value.i);
+            case VDOUBLE: return lobjb_build_float(v->value.d);
+            default: return NULL;
+        }
+    }
+
+    if(node->type == AUNARY_EXPRESSION && !((ast_unary_node *)node)->target)
+    {
+        switch(((ast_unary_node *)node)->opt)
+        {
+            case 'Y': return &lky_yes;
+            case 'N': return &lky_no;
+            case '0': return &lky_nil;
+        }
+    }
+
+    return NULL;
+}
+
+// The inverse of literal_object. Returns NULL if the object has no literal
+// form.
+static ast_node *literal_for(lky_object *obj, ast_node *at)
+{
+    ast_value_union u;
+
+    if(obj == &lky_nil)
+        return make_singleton(at, '0');
+    if(obj == &lky_yes)
+        return make_singleton(at, 'Y');
+    if(obj == &lky_no)
+        return make_singleton(at, 'N');
+
+    if(OBJ_IS_INTEGER(obj))
+    {
+        u.i = OBJ_INT_UNWRAP(obj);
+        return make_value(at, VINT, u);
+    }
+    if(OBJ_IS_FLOAT(obj))
+    {
+        u.d = OBJ_NUM_UNWRAP(obj);
+        return make_value(at, VDOUBLE, u);
+    }
+
+    return NULL;
+}
+
+static int is_string_literal(ast_node *node)
+{
+    return node->type == AVALUE && ((ast_value_node *)node)->value_type == VSTRING;
+}
+
+// Returns 1 or 0 if the node is a literal that JUMP_FALSE would take as true
+// or false, and -1 if its value is only known at run time. Strings and units
+// are objects, which are always true.
+static int literal_truth(ast_node *node)
+{
+    lky_object *obj = literal_object(node);
+    if(obj)
+        return LKY_CTEST_FAST(obj);
+
+    if(node->type == AUNIT || is_string_literal(node))
+        return 1;
+
+    return -1;
+}
+
+// Folds "a" + "b". String constants are unescaped when they are created and
+// stlstr_add builds its result with stlstr_cinit, which unescapes again, so
+// the folded literal is the concatenation of the unescaped operands.
+static ast_node *fold_concatenation(ast_binary_node *node)
+{
+    char *a = stlstr_copy_and_escape(((ast_value_node *)node->left)->value.s);
+    char *b = stlstr_copy_and_escape(((ast_value_node *)node->right)->value.s);
+
+    char *str = MALLOC(strlen(a) + strlen(b) + 1);
+    pool_add(&ast_memory_pool, str);
+    strcpy(str, a);
+    strcat(str, b);
+
+    free(a);
+    free(b);
+
+    ast_value_union u;
+    u.s = str;
+    return make_value((ast_node *)node, VSTRING, u);
+}
+
+static ast_node *fold_binary(ast_binary_node *node)
+{
+    if(node->opt == '+' && is_string_literal(node->left) && is_string_literal(node->right))
+        return fold_concatenation(node);
+
+    lky_instruction instr = instr_for_char(node->opt);
+    lky_object *a = literal_object(node->left);
+    lky_object *b = a ? literal_object(node->right) : NULL;
+    if(instr == LI_IGNORE || !b)
+        return (ast_node *)node;
+
+    // Integer division and modulo by zero raise; let them do so at run time.
+    if((instr == LI_BINARY_DIVIDE || instr == LI_BINARY_MODULO) &&
+            OBJ_IS_INTEGER(a) && OBJ_IS_INTEGER(b) && !OBJ_INT_UNWRAP(b))
+        return (ast_node *)node;
+
+    ast_node *folded = literal_for(mach_binary_op(instr, a, b, NULL), (ast_node *)node);
+    return folded ? folded : (ast_node *)node;
+}
+
+static ast_node *fold_unary(ast_unary_node *node)
+{
+    if(!node->target || (node->opt != '-' && node->opt != '!'))
+        return (ast_node *)node;
+
+    lky_object *obj = literal_object(node->target);
+    if(!obj)
+        return (ast_node *)node;
+
+    obj = node->opt == '-' ? lobjb_unary_negative(obj) : lobjb_unary_not(obj, NULL);
+
+    ast_node *folded = literal_for(obj, (ast_node *)node);
+    return folded ? folded : (ast_node *)node;
+}
+
+// a && b is a if a is false and b otherwise; a || b the other way around.
+static ast_node *prune_cond(ast_cond_node *node)
+{
+    node->left = optimize_node(node->left);
+    node->right = optimize_node(node->right);
+
+    int truth = literal_truth(node->left);
+    if(truth < 0 || (node->opt != '&' && node->opt != '|'))
+        return (ast_node *)node;
+
+    return truth == (node->opt == '|') ? node->left : node->right;
+}
+
+static ast_node *prune_ternary(ast_ternary_node *node)
+{
+    node->condition = optimize_node(node->condition);
+
+    int truth = literal_truth(node->condition);
+    if(truth > 0)
+        return optimize_node(node->first);
+    if(!truth)
+        return optimize_node(node->second);
+
+    node->first = optimize_node(node->first);
+    node->second = optimize_node(node->second);
+    return (ast_node *)node;
+}
+
+// Drops the clauses of an if/elif/else chain whose condition is false, and
+// the ones after a clause whose condition is true, which then stands as the
+// else. Returns NULL if no clause is left.
+static ast_node *prune_if(ast_if_node *node)
+{
+    ast_node *head = NULL;
+    ast_node **link = &head;
+
+    ast_if_node *clause;
+    for(clause = node; clause; clause = (ast_if_node *)clause->next_if)
+    {
+        int truth = 1;
+        if(clause->condition)
+        {
+            clause->condition = optimize_node(clause->condition);
+            truth = literal_truth(clause->condition);
+        }
+
+        if(!truth)
+            continue;
+
+        clause->payload->next = optimize_block(clause->payload->next);
+        *link = (ast_node *)clause;
+        link = &clause->next_if;
+
+        if(truth > 0)
+        {
+            clause->condition = NULL;
+            break;
+        }
+    }
+
+    *link = NULL;
+    return head;
+}
+
+// A loop whose condition is false leaves only the init of a for loop. One
+// whose condition is true loses the condition, which compile_loop then
+// leaves out.
+static ast_node *prune_loop(ast_loop_node *node)
+{
+    if(node->init)
+        node->init = optimize_node(node->init);
+
+    node->condition = optimize_node(node->condition);
+    int truth = literal_truth(node->condition);
+    if(!truth)
+        return node->init;
+    if(truth > 0)
+        node->condition = NULL;
+
+    if(node->onloop)
+        node->onloop = optimize_node(node->onloop);
+    node->payload->next = optimize_block(node->payload->next);
+
+    return (ast_node *)node;
+}
+
+// Optimizes a list of expressions chained through next, such as the
+// arguments of a call or the items of an array.
+static ast_node *optimize_list(ast_node *head)
+{
+    ast_node **link;
+    for(link = &head; *link; link = &(*link)->next)
+    {
+        ast_node *next = (*link)->next;
+        *link = optimize_node(*link);
+        (*link)->next = next;
+    }
+
+    return head;
+}
+
+// Whether nothing after the statement in the same block can run.
+static int ends_block(ast_node *node)
+{
+    if(node->type == AONEOFF)
+        return 1;
+
+    if(node->type == AUNARY_EXPRESSION)
+    {
+        char opt = ((ast_unary_node *)node)->opt;
+        return opt == 'r' || opt == 't';
+    }
+
+    return 0;
+}
+
+// Optimizes a list of statements, leaving out the ones that were pruned
+// away entirely and the ones that follow a ret, raise, break or continue.
+static ast_node *optimize_block(ast_node *head)
+{
+    ast_node *out = NULL;
+    ast_node **link = &out;
+
+    ast_node *node, *next;
+    for(node = head; node; node = next)
+    {
+        next = node->next;
+
+        ast_node *opt = optimize_node(node);
+        if(!opt)
+            continue;
+
+        *link = opt;
+        link = &opt->next;
+
+        if(ends_block(opt))
+            break;
+    }
+
+    *link = NULL;
+    return out;
+}
+
+// Returns the node that replaces 'node', which is 'node' itself unless it
+// was folded or pruned. Only if and loop statements can be pruned away
+// entirely, in which case NULL is returned.
+static ast_node *optimize_node(ast_node *node)
+{
+    switch(node->type)
+    {
+        case ABINARY_EXPRESSION:
+        {
+            ast_binary_node *n = (ast_binary_node *)node;
+            n->left = optimize_node(n->left);
+            n->right = optimize_node(n->right);
+            return fold_binary(n);
+        }
+        case AUNARY_EXPRESSION:
+        {
+            ast_unary_node *n = (ast_unary_node *)node;
+            if(n->target)
+                n->target = optimize_node(n->target);
+            return fold_unary(n);
+        }
+        case ACOND_CHAIN:
+            return prune_cond((ast_cond_node *)node);
+        case ATERNARY:
+            return prune_ternary((ast_ternary_node *)node);
+        case AIF:
+            return prune_if((ast_if_node *)node);
+        case ALOOP:
+            return prune_loop((ast_loop_node *)node);
+        case AITERLOOP:
+        {
+            ast_loop_node *n = (ast_loop_node *)node;
+            n->onloop = optimize_node(n->onloop);
+            n->payload->next = optimize_block(n->payload->next);
+            break;
+        }
+        case AFUNC_DECL:
+        {
+            ast_func_decl_node *n = (ast_func_decl_node *)node;
+            n->payload->next = optimize_block(n->payload->next);
+            break;
+        }
+        case ACLASS_DECL:
+        {
+            ast_class_decl_node *n = (ast_class_decl_node *)node;
+            ast_node *member;
+            for(member = n->members->next; member; member = member->next)
+            {
+                ast_class_member_node *m = (ast_class_member_node *)member;
+                m->payload = optimize_node(m->payload);
+            }
+
+            if(n->super)
+                n->super = optimize_node(n->super);
+            if(n->init)
+            {
+                ast_class_member_node *m = (ast_class_member_node *)n->init;
+                m->payload = optimize_node(m->payload);
+            }
+            break;
+        }
+        case AFUNC_CALL:
+        {
+            ast_func_call_node *n = (ast_func_call_node *)node;
+            n->ident = optimize_node(n->ident);
+            n->arguments = optimize_list(n->arguments);
+            break;
+        }
+        case AMEMBER_ACCESS:
+        {
+            ast_member_access_node *n = (ast_member_access_node *)node;
+            n->object = optimize_node(n->object);
+            break;
+        }
+        case AARRAY:
+            ((ast_array_node *)node)->list = optimize_list(((ast_array_node *)node)->list);
+            break;
+        case ATABLE:
+            ((ast_table_node *)node)->list = optimize_list(((ast_table_node *)node)->list);
+            break;
+        case AINDEX:
+        {
+            ast_index_node *n = (ast_index_node *)node;
+            n->target = optimize_node(n->target);
+            n->indexer = optimize_node(n->indexer);
+            break;
+        }
+        case AOBJDECL:
+        {
+            ast_object_decl_node *n = (ast_object_decl_node *)node;
+            n->payload = optimize_list(n->payload);
+            if(n->obj)
+                n->obj = optimize_node(n->obj);
+            break;
+        }
+        case ATRIPLESET:
+        {
+            ast_triple_set_node *n = (ast_triple_set_node *)node;
+            n->index_node = optimize_node(n->index_node);
+            n->new_val = optimize_node(n->new_val);
+            break;
+        }
+        case ATRYCATCH:
+        {
+            ast_try_catch_node *n = (ast_try_catch_node *)node;
+            n->tryblock->next = optimize_block(n->tryblock->next);
+            n->catchblock->next = optimize_block(n->catchblock->next);
+            break;
+        }
+        default:
+            break;
+    }
+
+    return node;
+}
+
+// Optimizes the statements starting at root (see the top of this file) and
+// returns the first of the statements left.
+ast_node *ast_optimize(ast_node *root)
+{
+    return optimize_block(root);
+}
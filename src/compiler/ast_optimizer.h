@@ -16,28 +16,12 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
-#ifndef GC_HASHSET_H
-#define GC_HASHSET_H
+#ifndef AST_OPTIMIZER_H
+#define AST_OPTIMIZER_H
 
-typedef void(*gchs_pointer_function)(void *data);
+#include "ast.h"
 
-typedef struct _node {
-    void *value;
-    struct _node *next;
-} gc_hashlist;
-
-typedef struct {
-    struct _node **buckets;
-    int hash_size;
-    int count;
-} gc_hashset;
-
-gc_hashset gchs_create(int hash_size);
-void gchs_add(gc_hashset *set, void *obj);
-int gchs_contains(gc_hashset *set, void *obj);
-void gchs_remove(gc_hashset *set, void *obj);
-void gchs_for_each(gc_hashset *set, gchs_pointer_function callback);
-void gchs_free(gc_hashset *set);
-void **gchs_to_list(gc_hashset *set);
+// See ast_optimize in ast_optimizer.c
+ast_node *ast_optimize(ast_node *root);
 
 #endif
@@ -16,27 +16,12 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "bytecode_analyzer.h"
 #include "instruction_set.h"
-
-int stack_effect_for(lky_instruction op, int *skip, unsigned char *code, int i);
-
-int calculate_max_stack_depth(unsigned char *code, int len)
-{
-    int max, current;
-    max = current = 0;
-    int i;
-    for(i = 0; i < len; i++)
-    {
-        int skip;
-        current += stack_effect_for(code[i], &skip, code, i);
-        i += skip;
-
-        max = current > max ? current : max;
-    }
-
-    return max;
-}
+#include "lkyobj_builtin.h"
 
 // This function is highly erroneous, but in this case if the
 // value it returns is wrong, the wrong value will *always* be
@@ -53,87 +38,767 @@ int calculate_max_catch_depth(unsigned char *code, int len)
     return max;
 }
 
-int stack_effect_for(lky_instruction op, int *skip, unsigned char *code, int i)
+// Returns the number of member access inline caches the code needs; each
+// LOAD_MEMBER, SAVE_MEMBER and LOAD_LOCAL_MEMBER names its own cache.
+int calculate_member_cache_count(unsigned char *code, int len)
 {
-    *skip = 0;
-    switch(op)
+    int count = 0;
+    int i;
+    for(i = 0; i < len; i += instruction_length(code, i))
+    {
+        unsigned int idx;
+        switch(code[i])
+        {
+            case LI_LOAD_MEMBER:
+            case LI_SAVE_MEMBER:
+                idx = *(unsigned int *)(code + i + 5);
+                break;
+            case LI_LOAD_LOCAL_MEMBER:
+                idx = *(unsigned int *)(code + i + 9);
+                break;
+            default:
+                continue;
+        }
+
+        if(idx + 1 > count)
+            count = idx + 1;
+    }
+
+    return count;
+}
+
+// Returns the length in bytes (including the opcode itself) of the
+// instruction starting at code[i].
+int instruction_length(unsigned char *code, int i)
+{
+    switch(code[i])
     {
+        case LI_PUSH_BOOL:
+        case LI_CALL_FUNC:
+        case LI_MAKE_FUNCTION:
+            return 2;
+        case LI_LOAD_CONST:
         case LI_JUMP_FALSE:
         case LI_JUMP_TRUE:
-        case LI_SAVE_MEMBER:
-            *skip = 4;
-        case LI_BINARY_ADD: 
-        case LI_BINARY_SUBTRACT:
-        case LI_BINARY_MULTIPLY:
-        case LI_BINARY_DIVIDE:
-        case LI_BINARY_MODULO:
-        case LI_BINARY_POWER:
-        case LI_BINARY_LT:
-        case LI_BINARY_GT:
-        case LI_BINARY_EQUAL:
-        case LI_BINARY_LTE:
-        case LI_BINARY_GTE:
-        case LI_BINARY_NE:
-        case LI_BINARY_AND:
-        case LI_BINARY_OR:
-        case LI_BINARY_NC:
-        case LI_BINARY_BAND:
-        case LI_BINARY_BOR:
-        case LI_BINARY_BXOR:
-        case LI_BINARY_BLSHIFT:
-        case LI_BINARY_BRSHIFT:
-        case LI_PRINT:
-        case LI_POP:
-        case LI_RETURN:
-            return -1;
-        case LI_LOAD_CONST:
+        case LI_JUMP:
+        case LI_JUMP_FALSE_ELSE_POP:
+        case LI_JUMP_TRUE_ELSE_POP:
+        case LI_SAVE_LOCAL:
         case LI_LOAD_LOCAL:
+        case LI_SAVE_CLOSE:
         case LI_LOAD_CLOSE:
-        case LI_LOAD_INDEX:
         case LI_MAKE_ARRAY:
         case LI_MAKE_TABLE:
-        case LI_PUSH_BOOL:
+        case LI_CONCAT:
+        case LI_NEXT_ITER_OR_JUMP:
         case LI_LOAD_MODULE:
-            *skip = 1;
-        case LI_SDUPLICATE:
-        case LI_PUSH_NIL:
-        case LI_PUSH_NEW_OBJECT:
-        case LI_ITER_INDEX:
+        case LI_PUSH_CATCH:
+        case LI_SAVE_LOCAL_POP:
+            return 5;
+        case LI_BINARY_JUMP_FALSE:
+        case LI_BINARY_JUMP_FALSE_INT:
+        case LI_BINARY_JUMP_FALSE_FLOAT:
+            return 6;
+        case LI_LOAD_MEMBER:
+        case LI_SAVE_MEMBER:
+        case LI_BIND_CLOSE:
+            return 9;
+        case LI_LOAD_LOCAL_MEMBER:
+            return 13;
+        case LI_MAKE_CLASS:
+            return 3 + code[i + 1] * 5;
         case LI_MAKE_OBJECT:
+            return 5 + *(unsigned int *)(code + i + 1) * 4;
+        case LI_REG_BINARY:
+        case LI_REG_BINARY_INT:
+        case LI_REG_BINARY_FLOAT:
+            return 14;
+        case LI_REG_BINARY_PUSH:
+        case LI_REG_BINARY_PUSH_INT:
+        case LI_REG_BINARY_PUSH_FLOAT:
+            return 10;
+        case LI_FOR_RANGE:
+            return 14;
+        case LI_FOR_STEP:
+            return 19;
+        default:
             return 1;
+    }
+}
+
+// Returns the offset (from i) of the four byte code location carried by the
+// instruction at code[i], or 0 if it does not jump.
+int instruction_jump_offset(unsigned char *code, int i)
+{
+    switch(code[i])
+    {
+        case LI_JUMP_FALSE:
+        case LI_JUMP_TRUE:
+        case LI_JUMP:
+        case LI_JUMP_FALSE_ELSE_POP:
+        case LI_JUMP_TRUE_ELSE_POP:
         case LI_NEXT_ITER_OR_JUMP:
-            *skip = 4;
+        case LI_PUSH_CATCH:
             return 1;
-        case LI_JUMP_TRUE_ELSE_POP:
-        case LI_JUMP_FALSE_ELSE_POP:
+        case LI_BINARY_JUMP_FALSE:
+        case LI_BINARY_JUMP_FALSE_INT:
+        case LI_BINARY_JUMP_FALSE_FLOAT:
+            return 2;
+        case LI_FOR_RANGE:
+            return 10;
+        case LI_FOR_STEP:
+            return 15;
+        default:
+            return 0;
+    }
+}
+
+// Returns where execution continues when the instruction at code[i] takes
+// its branch (or, for PUSH_CATCH, where its handler starts), or -1 if it
+// does not branch. Forward jumps resume after the location they carry (the
+// compiler leaves an IGNORE there), except that JUMP and NEXT_ITER_OR_JUMP
+// resume at the location itself when it lies behind them, and FOR_STEP
+// always does.
+static long instruction_continuation(unsigned char *code, int i)
+{
+    int off = instruction_jump_offset(code, i);
+    if(!off)
+        return -1;
+
+    unsigned int t = *(unsigned int *)(code + i + off);
+    if(code[i] == LI_JUMP)
+        return t && t >= i + 4 ? (long)t + 1 : t;
+    if(code[i] == LI_NEXT_ITER_OR_JUMP)
+        return t >= i + 4 ? (long)t + 1 : t;
+    if(code[i] == LI_FOR_STEP)
+        return t;
+
+    return (long)t + 1;
+}
+
+// Walks the instructions in code and lets 'fn' replace runs of them. The
+// rewriter is handed every instruction start along with a map of the
+// locations execution can enter at (jump targets); it returns the number of
+// bytes it wrote to 'out' and sets 'consumed' to the number of bytes of
+// input it replaced, or to 0 to keep the instruction as is. Replacements
+// must not swallow an entry point other than their first instruction, and
+// must not replace IGNORE instructions (the interpreter lands on those when
+// jumping forward). A replacement may not be longer than what it replaces.
+//
+// Jump locations are remapped and the line number table in 'indices' is
+// rewritten to match. Returns the new code; 'len' is updated in place.
+unsigned char *rewrite_bytecode(unsigned char *code, long **indices, int *len, bytecode_rewriter fn, void *data)
+{
+    int olen = *len;
+    char *entry = calloc(olen + 1, 1);
+    int *newpos = malloc(sizeof(int) * (olen + 1));
+    unsigned char *out = malloc(olen);
+    long *nindices = malloc(sizeof(long) * olen);
+
+    int i;
+    entry[0] = 1;
+    for(i = 0; i < olen; i += instruction_length(code, i))
+    {
+        long c = instruction_continuation(code, i);
+        if(c >= 0 && c <= olen)
+            entry[c] = 1;
+    }
+
+    int n = 0;
+    for(i = 0; i < olen;)
+    {
+        int consumed = 0;
+        int produced = fn(code, entry, i, olen, out + n, &consumed, data);
+
+        if(!consumed)
+        {
+            consumed = instruction_length(code, i);
+            memcpy(out + n, code + i, consumed);
+            produced = consumed;
+        }
+
+        int j;
+        for(j = 0; j < consumed; j++)
+            newpos[i + j] = n;
+        for(j = 0; j < produced; j++)
+            nindices[n + j] = (*indices)[i];
+
+        i += consumed;
+        n += produced;
+    }
+    newpos[olen] = n;
+
+    for(i = 0; i < n; i += instruction_length(out, i))
+    {
+        int off = instruction_jump_offset(out, i);
+        if(!off)
+            continue;
+
+        unsigned int *t = (unsigned int *)(out + i + off);
+        if(*t < olen)
+            *t = newpos[*t];
+    }
+
+    free(entry);
+    free(newpos);
+    free(code);
+    free(*indices);
+
+    *indices = nindices;
+    *len = n;
+    return out;
+}
+
+// Puts 'prefix' (which must not jump) in front of code, moving the jump
+// locations along. The prefix takes the line number of the first
+// instruction. Returns the new code; 'len' is updated in place.
+unsigned char *prepend_bytecode(unsigned char *code, long **indices, int *len, unsigned char *prefix, int plen)
+{
+    int n = *len + plen;
+    unsigned char *out = malloc(n);
+    long *nindices = malloc(sizeof(long) * n);
+
+    memcpy(out, prefix, plen);
+    memcpy(out + plen, code, *len);
+
+    int i;
+    for(i = 0; i < plen; i++)
+        nindices[i] = *len ? (*indices)[0] : 0;
+    memcpy(nindices + plen, *indices, sizeof(long) * *len);
+
+    for(i = plen; i < n; i += instruction_length(out, i))
+    {
+        int off = instruction_jump_offset(out, i);
+        if(!off)
+            continue;
+
+        *(unsigned int *)(out + i + off) += plen;
+    }
+
+    free(code);
+    free(*indices);
+
+    *indices = nindices;
+    *len = n;
+    return out;
+}
+
+static int is_generic_binary(int op)
+{
+    return op >= LI_BINARY_ADD && op <= LI_BINARY_BRSHIFT;
+}
+
+// Sets the number of values the instruction at code[i] takes off the data
+// stack and the number it leaves there for the instruction after it.
+// Returns 0 if execution never goes on to the next instruction.
+static int stack_use_for(unsigned char *code, int i, long *pops, long *pushes)
+{
+    *pops = *pushes = 0;
+    switch(code[i])
+    {
         case LI_JUMP:
+            return 0;
+        case LI_RETURN:
+        case LI_RAISE:
+            *pops = 1;
+            return 0;
+        case LI_LOAD_CONST:
+        case LI_LOAD_LOCAL:
+        case LI_LOAD_CLOSE:
+        case LI_LOAD_MODULE:
+        case LI_LOAD_LOCAL_MEMBER:
+        case LI_PUSH_NIL:
+        case LI_PUSH_BOOL:
+        case LI_PUSH_NEW_OBJECT:
+        case LI_REG_BINARY_PUSH:
+        case LI_REG_BINARY_PUSH_INT:
+        case LI_REG_BINARY_PUSH_FLOAT:
+            *pushes = 1;
+            break;
+        case LI_PRINT:
+        case LI_POP:
+        case LI_SAVE_LOCAL_POP:
+        case LI_JUMP_FALSE:
+        case LI_JUMP_FALSE_ELSE_POP:
+        case LI_JUMP_TRUE_ELSE_POP:
+            *pops = 1;
+            break;
+        case LI_UNARY_NOT:
+        case LI_UNARY_NEGATIVE:
         case LI_SAVE_LOCAL:
         case LI_SAVE_CLOSE:
         case LI_LOAD_MEMBER:
-            *skip = 1;
-        case LI_IGNORE:
-        case LI_CALL_FUNC:
         case LI_MAKE_FUNCTION:
-        case LI_SAVE_INDEX:
-        case LI_UNARY_NOT:
-        case LI_UNARY_NEGATIVE:
-        case LI_RAISE:
-        case LI_POP_CATCH:
         case LI_MAKE_ITER:
-        case LI_PUSH_CATCH:
-        case LI_SINK_FIRST:
-        case LI_FLIP_TWO:
-            return 0;
+            *pops = *pushes = 1;
+            break;
+        case LI_BINARY_JUMP_FALSE:
+        case LI_BINARY_JUMP_FALSE_INT:
+        case LI_BINARY_JUMP_FALSE_FLOAT:
+            *pops = 2;
+            break;
+        case LI_SAVE_MEMBER:
+        case LI_LOAD_INDEX:
+            *pops = 2;
+            *pushes = 1;
+            break;
+        case LI_SAVE_INDEX:
+            *pops = 3;
+            *pushes = 1;
+            break;
+        case LI_SDUPLICATE:
+        case LI_NEXT_ITER_OR_JUMP:
+        case LI_ITER_INDEX:
+            *pops = 1;
+            *pushes = 2;
+            break;
         case LI_DDUPLICATE:
-            return 2;
+            *pops = 2;
+            *pushes = 4;
+            break;
+        case LI_FLIP_TWO:
+            *pops = *pushes = 2;
+            break;
+        case LI_SINK_FIRST:
+            *pops = *pushes = 3;
+            break;
+        case LI_CALL_FUNC:
+            *pops = code[i + 1] + 1;
+            *pushes = 1;
+            break;
+        case LI_MAKE_ARRAY:
+        case LI_CONCAT:
+            *pops = *(unsigned int *)(code + i + 1);
+            *pushes = 1;
+            break;
+        case LI_MAKE_TABLE:
+            *pops = 2 * (long)*(unsigned int *)(code + i + 1);
+            *pushes = 1;
+            break;
+        case LI_MAKE_OBJECT:
+            *pops = 1 + (long)*(unsigned int *)(code + i + 1);
+            *pushes = 1;
+            break;
+        case LI_MAKE_CLASS:
+            *pops = code[i + 1] + (code[i + 2] & 1) + ((code[i + 2] >> 1) & 1);
+            *pushes = 1;
+            break;
+        default:
+            if(is_generic_binary(code[i]) || (code[i] >= LI_BINARY_ADD_INT && code[i] <= LI_BINARY_MULTIPLY_FLOAT))
+            {
+                *pops = 2;
+                *pushes = 1;
+            }
+            break;
+    }
+
+    return 1;
+}
+
+// The depth of the data stack where the instruction at code[i] branches to,
+// given its depth before the instruction.
+static long branch_depth_for(unsigned char *code, int i, long depth)
+{
+    switch(code[i])
+    {
+        case LI_JUMP_FALSE:
+            return depth - 1;
+        case LI_BINARY_JUMP_FALSE:
+        case LI_BINARY_JUMP_FALSE_INT:
+        case LI_BINARY_JUMP_FALSE_FLOAT:
+            return depth - 2;
+        case LI_PUSH_CATCH:
+            // The handler starts with the exception pushed (see
+            // mach_unwind_error).
+            return depth + 1;
+        default:
+            return depth;
+    }
+}
+
+// Checks the operands of the instruction at code[i], which is 'len' bytes
+// long, against the code object's tables. 'prev' is where the instruction
+// before it starts, or -1. Returns NULL if they are in range.
+static const char *check_operands(lky_object_code *code, int i, long len, int prev)
+{
+    unsigned char *ops = code->ops;
+    lky_instruction op = ops[i];
+
+    #define operand_(at) (*(unsigned int *)(ops + i + (at)))
+    #define in_range_(v, n) ((unsigned long)(v) < (unsigned long)(n))
+    #define register_ok_(r) ((r) & LKY_REG_CONST ? in_range_((r) & ~LKY_REG_CONST, code->num_constants) : \
+            in_range_((r), code->num_locals))
+
+    switch(op)
+    {
+        case LI_LOAD_CONST:
+            return in_range_(operand_(1), code->num_constants) ? NULL : "constant out of range";
+        case LI_LOAD_LOCAL:
+        case LI_SAVE_LOCAL:
+        case LI_SAVE_LOCAL_POP:
+            return in_range_(operand_(1), code->num_locals) ? NULL : "local out of range";
+        case LI_LOAD_CLOSE:
+        case LI_SAVE_CLOSE:
+        case LI_LOAD_MODULE:
+        case LI_LOAD_MEMBER:
+        case LI_SAVE_MEMBER:
+            return in_range_(operand_(1), code->num_names) ? NULL : "name out of range";
+        case LI_LOAD_LOCAL_MEMBER:
+        case LI_BIND_CLOSE:
+            if(!in_range_(operand_(1), code->num_locals))
+                return "local out of range";
+            return in_range_(operand_(5), code->num_names) ? NULL : "name out of range";
+        case LI_CALL_FUNC:
+            return ops[i + 1] < 128 ? NULL : "negative argument count";
+        case LI_CONCAT:
+            return operand_(1) >= 2 ? NULL : "CONCAT of fewer than two operands";
+        case LI_MAKE_FUNCTION:
+        {
+            // The function's code is always the constant loaded just before.
+            lky_object *c = prev == i - 5 && ops[prev] == LI_LOAD_CONST &&
+                    in_range_(operand_(-4), code->num_constants) ? code->constants[operand_(-4)] : NULL;
+            return c && !OBJ_IS_TAGGED(c) && c->type == LBI_CODE && ops[i + 1] < 128 ? NULL :
+                "MAKE_FUNCTION without a function";
+        }
         case LI_MAKE_CLASS:
         {
-            int howmany = code[++i];
-            *skip = howmany * 2 + 1;
-            return howmany;
+            int j;
+            for(j = 3; j < len; j += 5)
+                if(!in_range_(operand_(j + 1), code->num_names))
+                    return "name out of range";
+            return NULL;
+        }
+        case LI_MAKE_OBJECT:
+        {
+            int j;
+            for(j = 5; j < len; j += 4)
+                if(!in_range_(operand_(j), code->num_names))
+                    return "name out of range";
+            return NULL;
         }
+        case LI_BINARY_JUMP_FALSE:
+        case LI_BINARY_JUMP_FALSE_INT:
+        case LI_BINARY_JUMP_FALSE_FLOAT:
+            return is_generic_binary(ops[i + 1]) ? NULL : "bad binary operation";
+        case LI_REG_BINARY:
+        case LI_REG_BINARY_INT:
+        case LI_REG_BINARY_FLOAT:
+            if(!in_range_(operand_(10), code->num_locals))
+                return "local out of range";
+        case LI_REG_BINARY_PUSH:
+        case LI_REG_BINARY_PUSH_INT:
+        case LI_REG_BINARY_PUSH_FLOAT:
+            if(!is_generic_binary(ops[i + 1]))
+                return "bad binary operation";
+            return register_ok_(operand_(2)) && register_ok_(operand_(6)) ? NULL : "register out of range";
+        case LI_FOR_RANGE:
+            if(ops[i + 1] < LI_BINARY_LT || ops[i + 1] > LI_BINARY_NE)
+                return "bad comparison";
+            if(!in_range_(operand_(2), code->num_locals))
+                return "local out of range";
+            return register_ok_(operand_(6)) ? NULL : "register out of range";
+        case LI_FOR_STEP:
+            if(ops[i + 1] != LI_BINARY_ADD && ops[i + 1] != LI_BINARY_SUBTRACT)
+                return "bad binary operation";
+            if(ops[i + 2] < LI_BINARY_LT || ops[i + 2] > LI_BINARY_NE)
+                return "bad comparison";
+            if(!in_range_(operand_(3), code->num_locals))
+                return "local out of range";
+            return register_ok_(operand_(7)) && register_ok_(operand_(11)) ? NULL : "register out of range";
+        default:
+            return NULL;
     }
-    return 0;
+
+    #undef operand_
+    #undef in_range_
+    #undef register_ok_
 }
 
+// Checks that the code object's instructions are safe to run: every
+// instruction is complete and known to the interpreter, every operand names
+// something that exists, every branch lands on the start of an instruction
+// and execution never runs off the end of the tape. The data stack is
+// followed down every path; it must never be popped when empty and must be
+// the same depth whichever way an instruction is reached. That depth is what
+// lets the interpreter size the stack once per frame (*depth is set to the
+// deepest it gets). Exception handlers start one deeper than the PUSH_CATCH
+// that installs them, as mach_unwind_error drops what the protected code
+// left on the stack.
+//
+// Returns NULL if the code is valid, or else what is wrong with it; *at is
+// set to the offending instruction.
+const char *verify_bytecode(lky_object_code *code, int *depth, int *at)
+{
+    unsigned char *ops = code->ops;
+    int len = (int)code->op_len;
+    const char *err = NULL;
+
+    // Each instruction start is marked with 1 in 'start'; 'depths' holds the
+    // stack depth before each instruction once a path to it is found.
+    char *start = calloc(len + 1, 1);
+    long *depths = malloc(sizeof(long) * (len + 1));
+    int *work = malloc(sizeof(int) * (len + 1));
+    int nwork = 0;
+
+    int i, prev = -1;
+    long l = 1;
+    for(i = 0; i < len && !err; prev = i, i += (int)l)
+    {
+        *at = i;
+        start[i] = 1;
+        depths[i] = -1;
+
+        if(ops[i] <= LI_FIRST_ || ops[i] >= LI_LAST_ || ops[i] == LI_JUMP_TRUE)
+        {
+            err = "unknown instruction";
+            break;
+        }
+
+        l = ops[i] == LI_MAKE_CLASS || ops[i] == LI_MAKE_OBJECT ? 5 : 1;
+        if(i + l > len)
+        {
+            err = "truncated instruction";
+            break;
+        }
 
+        if(ops[i] == LI_MAKE_CLASS)
+            l = 3 + ops[i + 1] * 5L;
+        else if(ops[i] == LI_MAKE_OBJECT)
+            l = 5 + *(unsigned int *)(ops + i + 1) * 4L;
+        else
+            l = instruction_length(ops, i);
+
+        if(i + l > len)
+            err = "truncated instruction";
+        else
+            err = check_operands(code, i, l, prev);
+    }
+
+    // Follow the paths through the code from its entry.
+    if(!err && len)
+    {
+        depths[0] = 0;
+        work[nwork++] = 0;
+    }
+
+    *depth = 0;
+    while(nwork && !err)
+    {
+        i = work[--nwork];
+        *at = i;
+
+        long pops, pushes;
+        long d = depths[i];
+        int falls = stack_use_for(ops, i, &pops, &pushes);
+        if(d < pops)
+        {
+            err = "stack underflow";
+            break;
+        }
+
+        long next[2] = { falls ? i + instruction_length(ops, i) : -1, instruction_continuation(ops, i) };
+        long nd[2] = { d - pops + pushes, branch_depth_for(ops, i, d) };
+
+        if(nd[0] > *depth)
+            *depth = (int)nd[0];
+        if(nd[1] > *depth)
+            *depth = (int)nd[1];
+
+        int k;
+        for(k = 0; k < 2 && !err; k++)
+        {
+            long t = next[k];
+            if(t < 0)
+                continue;
+
+            if(t >= len)
+                err = "execution runs off the end";
+            else if(!start[t])
+                err = "branch into the middle of an instruction";
+            else if(k && ops[t] == LI_MAKE_FUNCTION)
+                err = "branch separates MAKE_FUNCTION from its function";
+            else if(depths[t] < 0)
+            {
+                depths[t] = nd[k];
+                work[nwork++] = (int)t;
+            }
+            else if(depths[t] != nd[k])
+                err = "stack depth differs between paths";
+        }
+    }
+
+    free(start);
+    free(depths);
+    free(work);
+    return err;
+}
+
+// Returns the length in words (including the opcode) of the instruction at
+// tape[i] in decoded code (see decode_bytecode).
+int tape_instruction_length(int *tape, long i)
+{
+    lky_instruction op = tape[i];
+    switch(op)
+    {
+        case LI_MAKE_CLASS:
+            return 3 + 2 * tape[i + 1];
+        case LI_MAKE_OBJECT:
+            return 2 + tape[i + 1];
+        case LI_PUSH_BOOL:
+        case LI_CALL_FUNC:
+        case LI_MAKE_FUNCTION:
+            return 2;
+        case LI_BINARY_JUMP_FALSE:
+        case LI_BINARY_JUMP_FALSE_INT:
+        case LI_BINARY_JUMP_FALSE_FLOAT:
+            return 3;
+        case LI_REG_BINARY:
+        case LI_REG_BINARY_INT:
+        case LI_REG_BINARY_FLOAT:
+        case LI_FOR_RANGE:
+            return 5;
+        case LI_FOR_STEP:
+            return 7;
+        case LI_REG_BINARY_PUSH:
+        case LI_REG_BINARY_PUSH_INT:
+        case LI_REG_BINARY_PUSH_FLOAT:
+        case LI_LOAD_LOCAL_MEMBER:
+            return 4;
+        case LI_LOAD_MEMBER:
+        case LI_SAVE_MEMBER:
+        case LI_BIND_CLOSE:
+            return 3;
+        default:
+        {
+            // Every other instruction has a single four byte operand or none.
+            unsigned char byte = op;
+            return instruction_length(&byte, 0) == 5 ? 2 : 1;
+        }
+    }
+}
+
+// Decodes verified code into the tape the interpreter runs: an int per
+// opcode followed by an int per operand, each four byte operand and each one
+// byte operand getting a word of its own. Branch operands are replaced by the
+// word position execution continues at, less one (the interpreter advances
+// the pc before fetching), so taking a branch is a single store to the pc.
+// The line number table is expanded to match, unless 'indices' is NULL.
+int *decode_bytecode(unsigned char *code, long *indices, int len, long **tape_indices, long *tape_len)
+{
+    long *word_at = malloc(sizeof(long) * (len + 1));
+
+    int i;
+    long n = 0;
+    for(i = 0; i < len; i += instruction_length(code, i))
+    {
+        word_at[i] = n;
+        if(code[i] == LI_MAKE_CLASS)
+            n += 3 + 2 * code[i + 1];
+        else if(code[i] == LI_MAKE_OBJECT)
+            n += 2 + *(unsigned int *)(code + i + 1);
+        else
+        {
+            int op = code[i];
+            n += tape_instruction_length(&op, 0);
+        }
+    }
+    word_at[len] = n;
+
+    int *tape = malloc(sizeof(int) * (n + 1));
+    *tape_indices = indices ? malloc(sizeof(long) * (n + 1)) : NULL;
+    *tape_len = n;
+
+    for(i = 0; i < len; i += instruction_length(code, i))
+    {
+        int *w = tape + word_at[i];
+        long words = word_at[i + instruction_length(code, i)] - word_at[i];
+        w[0] = code[i];
+
+        int j;
+        switch(code[i])
+        {
+            case LI_PUSH_BOOL:
+            case LI_CALL_FUNC:
+            case LI_MAKE_FUNCTION:
+                w[1] = code[i + 1];
+                break;
+            case LI_MAKE_CLASS:
+                w[1] = code[i + 1];
+                w[2] = code[i + 2];
+                for(j = 0; j < code[i + 1]; j++)
+                {
+                    w[3 + 2 * j] = code[i + 3 + 5 * j];
+                    w[4 + 2 * j] = *(unsigned int *)(code + i + 4 + 5 * j);
+                }
+                break;
+            case LI_BINARY_JUMP_FALSE:
+            case LI_BINARY_JUMP_FALSE_INT:
+            case LI_BINARY_JUMP_FALSE_FLOAT:
+            case LI_REG_BINARY:
+            case LI_REG_BINARY_INT:
+            case LI_REG_BINARY_FLOAT:
+            case LI_REG_BINARY_PUSH:
+            case LI_REG_BINARY_PUSH_INT:
+            case LI_REG_BINARY_PUSH_FLOAT:
+            case LI_FOR_RANGE:
+                w[1] = code[i + 1];
+                for(j = 2; j < words; j++)
+                    w[j] = *(unsigned int *)(code + i + 2 + 4 * (j - 2));
+                break;
+            case LI_FOR_STEP:
+                w[1] = code[i + 1];
+                w[2] = code[i + 2];
+                for(j = 3; j < words; j++)
+                    w[j] = *(unsigned int *)(code + i + 3 + 4 * (j - 3));
+                break;
+            default:
+                for(j = 1; j < words; j++)
+                    w[j] = *(unsigned int *)(code + i + 1 + 4 * (j - 1));
+                break;
+        }
+
+        // The branch operand is always an instruction's last.
+        long c = instruction_continuation(code, i);
+        if(c >= 0)
+            w[words - 1] = (int)(word_at[c] - 1);
+
+        if(*tape_indices)
+            for(j = 0; j < words; j++)
+                (*tape_indices)[word_at[i] + j] = indices[i];
+    }
+
+    // Nothing runs this word; it keeps the interpreter's look ahead at the
+    // next opcode (see vmpush_or_branch_ in lky_machine.c) inside the tape.
+    tape[n] = LI_IGNORE;
+    if(*tape_indices)
+        (*tape_indices)[n] = len ? indices[len - 1] : 0;
+
+    free(word_at);
+    return tape;
+}
+
+// Verifies code (see verify_bytecode) and decodes it for the interpreter
+// (see decode_bytecode), sizing its data and catch stacks to match. Every
+// code object is loaded before it runs, whether it comes from the compiler
+// or was deserialized, and is reloaded if its instructions are changed.
+// Returns NULL, or what is wrong with the code.
+const char *load_bytecode(lky_object_code *code)
+{
+    static char message[100];
+
+    int depth, at;
+    const char *err = verify_bytecode(code, &depth, &at);
+    if(err)
+    {
+        sprintf(message, "%s (at offset %d)", err, at);
+        return message;
+    }
+
+    free(code->tape);
+    free(code->tape_indices);
+
+    code->stack_size = depth;
+    code->catch_size = calculate_max_catch_depth(code->ops, (int)code->op_len);
+    code->tape = decode_bytecode(code->ops, code->indices, (int)code->op_len, &code->tape_indices, &code->tape_len);
+    return NULL;
+}
@@ -19,7 +19,22 @@
 #ifndef BYTECODE_ANALYZER_H
 #define BYTECODE_ANALYZER_H
 
-int calculate_max_stack_depth(unsigned char *code, int len);
+#include "lkyobj_builtin.h"
+
 int calculate_max_catch_depth(unsigned char *code, int len);
+int calculate_member_cache_count(unsigned char *code, int len);
+int instruction_length(unsigned char *code, int i);
+int instruction_jump_offset(unsigned char *code, int i);
+
+// See rewrite_bytecode in bytecode_analyzer.c
+typedef int (*bytecode_rewriter)(unsigned char *code, char *entry, int i, int len, unsigned char *out, int *consumed, void *data);
+unsigned char *rewrite_bytecode(unsigned char *code, long **indices, int *len, bytecode_rewriter fn, void *data);
+unsigned char *prepend_bytecode(unsigned char *code, long **indices, int *len, unsigned char *prefix, int plen);
+
+// See load_bytecode in bytecode_analyzer.c
+const char *verify_bytecode(lky_object_code *code, int *depth, int *at);
+int *decode_bytecode(unsigned char *code, long *indices, int len, long **tape_indices, long *tape_len);
+int tape_instruction_length(int *tape, long i);
+const char *load_bytecode(lky_object_code *code);
 
 #endif
@@ -68,7 +68,7 @@ void pool_drain(lky_mempool *pool)
         void *data = node->data;
         if(pool->free_func)
             pool->free_func(data);
-        else if(!((uintptr_t)(data) & 1) && !aqua_is_managed_pointer(data))
+        else if(!((uintptr_t)(data) & 3) && !aqua_is_managed_pointer(data))
             FREE(data);
         struct poolnode *cur = node;
         node = node->next;
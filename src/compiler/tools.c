@@ -64,26 +64,26 @@ int next_pow_two(int x)
     return x + 1;
 }
 
-void auto_cat(char **buf, char *cat)
+void auto_cat_len(auto_buffer *buf, char *bytes, size_t len)
 {
-    size_t clen = strlen(cat);
-    size_t blen = *buf ? strlen(*buf) : 0;
-    int np = next_pow_two(blen);
-
-    if(blen + clen + 1 > np || np == 0)
+    if(buf->length + len + 1 > buf->capacity)
     {
-        char *next = malloc(2 * (np > 0 ? np : 1));
-        if(*buf)
-        {
-            strcpy(next, *buf);
-            free(*buf);
-        }
-        else
-            strcpy(next, "");
-        *buf = next;
+        size_t cap = buf->capacity ? buf->capacity : 16;
+        while(cap < buf->length + len + 1)
+            cap *= 2;
+
+        buf->str = realloc(buf->str, cap);
+        buf->capacity = cap;
     }
 
-    strcat(*buf, cat);
+    memcpy(buf->str + buf->length, bytes, len);
+    buf->length += len;
+    buf->str[buf->length] = '\0';
+}
+
+void auto_cat(auto_buffer *buf, char *cat)
+{
+    auto_cat_len(buf, cat, strlen(cat));
 }
 
 int file_is_binary(char *filename)
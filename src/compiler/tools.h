@@ -19,6 +19,8 @@
 #ifndef TOOLS_H
 #define TOOLS_H
 
+#include <stddef.h>
+
 #define MALLOC(size) malloc(size); malloc_add();
 #define FREE(obj) free(obj); free_add();
 
@@ -27,7 +29,18 @@ void malloc_add();
 int get_malloc_count();
 void free_add();
 int get_free_count();
-void auto_cat(char **buf, char *cat);
+
+// A NUL terminated buffer that auto_cat grows as needed. Start it zeroed;
+// 'str' is malloc'd and belongs to whoever holds the buffer.
+typedef struct {
+    char *str;
+    size_t length;
+    size_t capacity;
+} auto_buffer;
+
+void auto_cat(auto_buffer *buf, char *cat);
+void auto_cat_len(auto_buffer *buf, char *bytes, size_t len);
+
 int file_is_binary(char *filename);
 
 #endif
@@ -16,80 +16,117 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#define _POSIX_C_SOURCE 200112L
+
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdint.h>
 #include "aquarium.h"
-#include "lkyobj_builtin.h"
-
-#define LARGE_SIZE 128
-#define LARGE_COUNT 100000
+#include "hashtable.h"
+
+// Blocks are carved out of chunks of AQUA_CHUNK_SIZE bytes that are aligned
+// to their own size. Each chunk holds blocks of a single size class and
+// starts with its aqua_tide_pool header, so the pool owning a block is
+// found by masking the block's address.
+#define AQUA_CHUNK_SIZE (64 * 1024)
+#define AQUA_HEADER_SIZE ((sizeof(aqua_tide_pool) + 15) & ~(size_t)15)
+#define AQUA_POOL_OF(ptr) ((aqua_tide_pool *)((uintptr_t)(ptr) & ~(uintptr_t)(AQUA_CHUNK_SIZE - 1)))
+
+// The size classes are picked to fit the object structs: lky_object_builtin
+// and lky_object_seq (32), lky_object and lky_object_iterable (64),
+// lky_object_custom, lky_object_class and lky_object_error (88) and
+// lky_object_function (128).
+static const size_t aqua_class_sizes[AQUA_CLASS_COUNT] = { 32, 48, 64, 96, 128, 192, 256 };
 
-// #define SCRUB_POOL
-// #define FULL_OUTPUT
 // #define DEBUG
 
 typedef struct aqua_tide_pool_ {
     struct aqua_tide_pool_ *next;
-    void *inlet;
+    struct aqua_tide_pool_ *prev;
     void *outlet;
+    void *shore;
     size_t fish_size;
     size_t count;
-    size_t free;
     size_t used;
+    int size_class;
 } aqua_tide_pool;
 
-static aqua_tide_pool *large_pool = NULL;
+// Every size class keeps the pools that still have room in a doubly linked
+// list; full pools are unlinked until a block in them is released.
+typedef struct {
+    aqua_tide_pool *open;
+    size_t pools;
+    size_t used;
+} aqua_school;
+
+static aqua_school schools[AQUA_CLASS_COUNT];
+static unsigned char class_for_size[AQUA_MAX_SIZE / 16 + 1];
+static hashtable chunks;
 
 int aqua_use_system_malloc_free_ = 0;
 
-aqua_tide_pool *aqua_find_pool_of(void *ptr, aqua_tide_pool **prev)
+static long aqua_chunk_hash(void *chunk, void *data)
 {
-    aqua_tide_pool *pool = large_pool;
-    aqua_tide_pool *tprev = NULL;
-    int count = 0;
-    for(; pool; pool = pool->next)
-    {
-        if(ptr >= pool->inlet && ptr < pool->inlet + (pool->count * pool->fish_size))
-        {
-            if(prev)
-                *prev = tprev;
-            return pool;
-        }
-        count++;
-        tprev = pool;
-    }
+    return (long)((uintptr_t)chunk / AQUA_CHUNK_SIZE);
+}
 
-    return NULL;
+static int aqua_chunk_equal(void *a, void *b)
+{
+    return a == b;
+}
+
+static void aqua_link_open(aqua_school *school, aqua_tide_pool *pool)
+{
+    pool->prev = NULL;
+    pool->next = school->open;
+    if(school->open)
+        school->open->prev = pool;
+    school->open = pool;
 }
 
-aqua_tide_pool *aqua_init_pool(size_t size, size_t count)
+static void aqua_unlink_open(aqua_school *school, aqua_tide_pool *pool)
 {
-    int i;
-    void *here;
-    void *next;
+    if(pool->prev)
+        pool->prev->next = pool->next;
+    else
+        school->open = pool->next;
 
-    aqua_tide_pool *pool = malloc(sizeof(aqua_tide_pool));
+    if(pool->next)
+        pool->next->prev = pool->prev;
+
+    pool->next = pool->prev = NULL;
+}
+
+aqua_tide_pool *aqua_init_pool(int size_class)
+{
+    void *chunk;
+    if(posix_memalign(&chunk, AQUA_CHUNK_SIZE, AQUA_CHUNK_SIZE))
+    {
+        printf("Error requesting memory! Out of memory!\n");
+        exit(1);
+    }
+
+    aqua_tide_pool *pool = chunk;
 
     pool->next = NULL;
-    pool->fish_size = size;
-    pool->count = count;
-    pool->free = count;
+    pool->prev = NULL;
+    pool->fish_size = aqua_class_sizes[size_class];
+    pool->count = (AQUA_CHUNK_SIZE - AQUA_HEADER_SIZE) / pool->fish_size;
     pool->used = 0;
-    pool->inlet = malloc(pool->fish_size * pool->count);
-    pool->outlet = pool->inlet;
+    pool->size_class = size_class;
 
-    here = pool->inlet;
+    // Blocks that were never handed out are taken from the shore; released
+    // blocks are chained through the outlet.
+    pool->outlet = NULL;
+    pool->shore = (char *)chunk + AQUA_HEADER_SIZE;
 
-    for(i = 0; i < pool->count - 1; i++)
-    {
-        next = here + pool->fish_size;
-        memcpy(here, &next, sizeof(void *));
-#ifdef FULL_OUTPUT
-        printf("Chain: %p; Actual: %p\n", next, *(void **)(here));
+    hst_put(&chunks, chunk, chunk, aqua_chunk_hash, aqua_chunk_equal);
+    schools[size_class].pools++;
+
+#ifdef DEBUG
+    printf("Allocating new pool of %zu byte blocks\n", pool->fish_size);
 #endif
-        here += pool->fish_size;
-    }
 
     return pool;
 }
@@ -99,44 +136,50 @@ void aqua_init()
     if(aqua_use_system_malloc_free_)
         return;
 
-    large_pool = aqua_init_pool(LARGE_SIZE, LARGE_COUNT);
-#ifdef SCRUB_POOL
-    printf("Init pool: %p\nCount: %d; Block size: %d\n", large_pool->inlet, large_pool->count, large_pool->fish_size);
-#endif
+    int i, c = 0;
+    for(i = 0; i <= AQUA_MAX_SIZE / 16; i++)
+    {
+        while(aqua_class_sizes[c] < i * 16)
+            c++;
+        class_for_size[i] = c;
+    }
+
+    chunks = hst_create();
 }
 
 void *aqua_request_next_block(size_t size)
 {   
     if(aqua_use_system_malloc_free_)
         return malloc(size);
-    else if(size > LARGE_SIZE)
+    else if(size > AQUA_MAX_SIZE)
     {
         printf("Error requesting memory! Block size too big!\n");
         exit(1);
     }
 
-    aqua_tide_pool *pool = large_pool;
-    aqua_tide_pool *prev = NULL;
-    for(; pool && !pool->free; prev = pool, pool = pool->next);
+    int size_class = class_for_size[(size + 15) / 16];
+    aqua_school *school = &schools[size_class];
+    aqua_tide_pool *pool = school->open;
 
     if(!pool)
     {
-        pool = aqua_init_pool(LARGE_SIZE, LARGE_COUNT);
-        prev->next = pool;
-#ifdef DEBUG
-        printf("Allocating new pool\n");
-#endif
+        pool = aqua_init_pool(size_class);
+        aqua_link_open(school, pool);
     }
 
-
     void *ptr = pool->outlet;
-    memcpy(&pool->outlet, ptr, sizeof(void *));
-    pool->used++;
-    pool->free--;
+    if(ptr)
+        memcpy(&pool->outlet, ptr, sizeof(void *));
+    else
+    {
+        ptr = pool->shore;
+        pool->shore = (char *)pool->shore + pool->fish_size;
+    }
 
-#ifdef SCRUB_POOL
-    printf("Allocating object: %p\nFree: %d; Used: %d; Next: %p\n", ptr, pool->free, pool->used, pool->outlet);
-#endif
+    pool->used++;
+    school->used++;
+    if(pool->used == pool->count)
+        aqua_unlink_open(school, pool);
 
     return ptr;
 }
@@ -149,49 +192,64 @@ void aqua_release(void *block)
         return;
     }
 
-    aqua_tide_pool *prev = NULL;
-    aqua_tide_pool *pool = aqua_find_pool_of(block, &prev);
+    aqua_tide_pool *pool = AQUA_POOL_OF(block);
+    aqua_school *school = &schools[pool->size_class];
 
-    if(!pool)
-    {
-        printf("%p\n", block);
-        exit(1); // This is a critical error;
-        return;
-    }
+    if(pool->used == pool->count)
+        aqua_link_open(school, pool);
 
     memcpy(block, &pool->outlet, sizeof(void *));
     pool->outlet = block;
     pool->used--;
-    pool->free++;
+    school->used--;
 
-    if(!pool->used)
+    // Keep one open pool around so that a single allocation and release
+    // do not keep mapping and unmapping a chunk.
+    if(!pool->used && (pool->prev || pool->next))
     {
 #ifdef DEBUG
         printf("Freeing pool\n");
 #endif
-        aqua_tide_pool *next = pool->next;
-        free(pool->inlet);
+        aqua_unlink_open(school, pool);
+        hst_remove_key(&chunks, pool, aqua_chunk_hash, aqua_chunk_equal);
+        school->pools--;
         free(pool);
-        if(prev)
-            prev->next = next;
     }
 }
 
 int aqua_is_managed_pointer(void *ptr)
 {
-    return !aqua_use_system_malloc_free_ && !!aqua_find_pool_of(ptr, NULL);
+    return !aqua_use_system_malloc_free_ &&
+        hst_contains_key(&chunks, AQUA_POOL_OF(ptr), aqua_chunk_hash, aqua_chunk_equal);
 }
 
-void aqua_teardown()
+int aqua_size_class_count()
 {
-    aqua_tide_pool *next = NULL;
-    aqua_tide_pool *pool = large_pool;
-    while(pool)
-    {
-        next = pool->next;
-        free(pool->inlet);
-        free(pool);
-        pool = next;
-    }
+    return AQUA_CLASS_COUNT;
+}
+
+aqua_class_stats aqua_stats_for_class(int size_class)
+{
+    aqua_school *school = &schools[size_class];
+    aqua_class_stats stats;
+    size_t per_pool = (AQUA_CHUNK_SIZE - AQUA_HEADER_SIZE) / aqua_class_sizes[size_class];
+
+    stats.block_size = aqua_class_sizes[size_class];
+    stats.pools = school->pools;
+    stats.used = school->used;
+    stats.free = school->pools * per_pool - school->used;
+
+    return stats;
 }
 
+static void aqua_free_chunk(void *key, void *val, void *data)
+{
+    free(key);
+}
+
+void aqua_teardown()
+{
+    hst_for_each(&chunks, aqua_free_chunk, NULL);
+    hst_free(&chunks);
+    memset(schools, 0, sizeof(schools));
+}
@@ -21,11 +21,26 @@
 
 #include <stdlib.h>
 
+#define AQUA_CLASS_COUNT 7
+
+// The largest block aqua_request_next_block hands out.
+#define AQUA_MAX_SIZE 256
+
+// Occupancy of one size class, as reported by aqua_stats_for_class.
+typedef struct {
+    size_t block_size;
+    size_t pools;
+    size_t used;
+    size_t free;
+} aqua_class_stats;
+
 void aqua_init();
 void aqua_teardown();
 void *aqua_request_next_block(size_t size);
 void aqua_release(void *block);
 int aqua_is_managed_pointer(void *ptr);
+int aqua_size_class_count();
+aqua_class_stats aqua_stats_for_class(int size_class);
 
 extern int aqua_use_system_malloc_free_;
 
@@ -17,11 +17,29 @@
  */
 
 #include "class_builder.h"
+#include <string.h>
+
+// Calls 'init' with 'self' followed by the arguments of 'bundle'.
+static void clb_call_init(lky_object *init, lky_object *self, lky_func_bundle *bundle)
+{
+    if(!bundle->argv)
+    {
+        lky_object_seq *nx = lobjb_make_seq_node(self);
+        nx->next = bundle->args;
+        lobjb_call(init, nx, BUW_INTERP(bundle));
+        return;
+    }
+
+    lky_object *argv[bundle->argc + 1];
+    argv[0] = self;
+    memcpy(argv + 1, bundle->argv, sizeof(lky_object *) * bundle->argc);
+
+    lobjb_call_argv(init, bundle->argc + 1, argv, BUW_INTERP(bundle));
+}
 
 lky_object *clb_super_init_wrapper(lky_func_bundle *bundle)
 {
     lky_object_function *func = BUW_FUNC(bundle);
-    lky_object_seq *args = BUW_ARGS(bundle);
 
     lky_object *self = (lky_object *)func->bound;
 
@@ -34,9 +52,7 @@ lky_object *clb_super_init_wrapper(lky_func_bundle *bundle)
         if(sinit)
             lobj_set_member(self, "superInit", sinit);
 
-        lky_object_seq *nx = lobjb_make_seq_node(self);
-        nx->next = args;
-        lobjb_call(init, nx, BUW_INTERP(bundle));
+        clb_call_init(init, self, bundle);
     }
 
     return &lky_nil;
@@ -45,7 +61,6 @@ lky_object *clb_super_init_wrapper(lky_func_bundle *bundle)
 lky_object *clb_new_wrapper(lky_func_bundle *bundle)
 {
     lky_object_function *func = BUW_FUNC(bundle);
-    lky_object_seq *args = BUW_ARGS(bundle);
 
     lky_object *cls = (lky_object *)func->owner;
 
@@ -60,10 +75,7 @@ lky_object *clb_new_wrapper(lky_func_bundle *bundle)
         if(sinit)
             lobj_set_member(nobj, "superInit", sinit);
 
-        lky_object_seq *nx = lobjb_make_seq_node(nobj);
-        nx->next = args;
-
-        lobjb_call(init, nx, BUW_INTERP(bundle));
+        clb_call_init(init, nobj, bundle);
     }
 
     return nobj;
@@ -86,8 +98,8 @@ lky_object *clb_instantiate(lky_object *cls, clb_custom_init_func func, void *da
             if(sinit)
                 lobj_set_member(nobj, "superInit", sinit);
 
-            lky_object_seq *nx = lobjb_make_seq_node(nobj);
-            lobjb_call(init, nx, NULL);
+            lky_object *argv[] = { nobj };
+            lobjb_call_argv(init, 1, argv, NULL);
         }
     } 
 
@@ -47,7 +47,7 @@ void clb_add_member(lky_object *cls, char *refname, lky_object *obj, lky_class_p
     lky_object *cls_ = clb_init_class(init_func_, super);\
     int static_only_ = 0;\
     code\
-    if(static_only_) hst_remove_key(&cls_->members, "new", NULL, NULL);\
+    if(static_only_) lobj_remove_member(cls_, "new");\
     lky_object *name = cls_
 
 #define CLASS_STATIC_ONLY static_only_ = 1
@@ -56,23 +56,21 @@ void clb_add_member(lky_object *cls, char *refname, lky_object *obj, lky_class_p
 #define CLASS_PROTO_METHOD(name, ptr, argc) CLASS_PROTO(name, (lky_object *)lobjb_build_func_ex(NULL, argc, (lky_function_ptr)ptr))
 #define CLASS_STATIC_METHOD(name, ptr, argc) CLASS_STATIC(name, (lky_object *)lobjb_build_func_ex(NULL, argc, (lky_function_ptr)ptr))
 #define CLASS_MAKE_METHOD(name, ident, code...) lky_object * name (lky_func_bundle *bundle_) {\
-    lky_object_seq *args_ ATTRIB_NO_USE = BUW_ARGS(bundle_);\
     lky_object_function *func_ ATTRIB_NO_USE = BUW_FUNC(bundle_);\
     mach_interp *interp_ ATTRIB_NO_USE = BUW_INTERP(bundle_);\
     lky_object * ident ATTRIB_NO_USE = func_->bound;\
-    lky_object *$1 ATTRIB_NO_USE = args_ ? (lky_object *)args_->value : NULL;\
-    lky_object *$2 ATTRIB_NO_USE = args_ && args_->next ? (lky_object *)args_->next->value : NULL;\
-    lky_object *$3 ATTRIB_NO_USE = args_ && args_->next && args_->next->next ? (lky_object *) args_->next->next->value : NULL;\
+    lky_object *$1 ATTRIB_NO_USE = BUW_ARG(bundle_, 0);\
+    lky_object *$2 ATTRIB_NO_USE = BUW_ARG(bundle_, 1);\
+    lky_object *$3 ATTRIB_NO_USE = BUW_ARG(bundle_, 2);\
     code\
     return &lky_nil;}
 #define CLASS_MAKE_METHOD_EX(name, ident, type, key, code...) lky_object * name (lky_func_bundle *bundle_) {\
-    lky_object_seq *args_ ATTRIB_NO_USE = BUW_ARGS(bundle_);\
     lky_object_function *func_ ATTRIB_NO_USE = BUW_FUNC(bundle_);\
     mach_interp *interp_ ATTRIB_NO_USE = BUW_INTERP(bundle_);\
     lky_object * ident ATTRIB_NO_USE = func_->bound;\
-    lky_object *$1 ATTRIB_NO_USE = args_ ? (lky_object *)args_->value : NULL;\
-    lky_object *$2 ATTRIB_NO_USE = args_ && args_->next ? (lky_object *)args_->next->value : NULL;\
-    lky_object *$3 ATTRIB_NO_USE = args_ && args_->next && args_->next->next ? (lky_object *) args_->next->next->value : NULL;\
+    lky_object *$1 ATTRIB_NO_USE = BUW_ARG(bundle_, 0);\
+    lky_object *$2 ATTRIB_NO_USE = BUW_ARG(bundle_, 1);\
+    lky_object *$3 ATTRIB_NO_USE = BUW_ARG(bundle_, 2);\
     lky_object_builtin *raw_blob_ = (lky_object_builtin *)lobj_get_member(ident, #key);\
     type key ATTRIB_NO_USE = (type) raw_blob_ ? raw_blob_->value.b : NULL;\
     code\
@@ -85,13 +83,12 @@ void clb_add_member(lky_object *cls, char *refname, lky_object *obj, lky_class_p
 #define CLASS_SET_BLOB(obj, key, ptr, gc) (lobj_set_member(obj, key, lobjb_build_blob(ptr, (lobjb_void_ptr_function)gc)))
 
 #define CLASS_MAKE_INIT(name, code...) lky_object * name (lky_func_bundle *bundle_) {\
-    lky_object_seq *args_ ATTRIB_NO_USE = BUW_ARGS(bundle_);\
     lky_object_function *func_ ATTRIB_NO_USE = BUW_FUNC(bundle_);\
     mach_interp *interp_ ATTRIB_NO_USE = BUW_INTERP(bundle_);\
-    lky_object *self_ ATTRIB_NO_USE = (lky_object *)args_->value;\
-    lky_object *$1 ATTRIB_NO_USE = args_ && args_->next ? (lky_object *)args_->next->value : NULL;\
-    lky_object *$2 ATTRIB_NO_USE = args_ && args_->next && args_->next->next ? (lky_object *) args_->next->next->value : NULL;\
-    lky_object *$3 ATTRIB_NO_USE = args_ && args_->next && args_->next->next && args_->next->next->next ? (lky_object *) args_->next->next->next->value : NULL;\
+    lky_object *self_ ATTRIB_NO_USE = BUW_ARG(bundle_, 0);\
+    lky_object *$1 ATTRIB_NO_USE = BUW_ARG(bundle_, 1);\
+    lky_object *$2 ATTRIB_NO_USE = BUW_ARG(bundle_, 2);\
+    lky_object *$3 ATTRIB_NO_USE = BUW_ARG(bundle_, 3);\
     code\
     return &lky_nil;}
 
@@ -19,67 +19,164 @@
 #ifndef INSTRUCTION_SET_H
 #define INSTRUCTION_SET_H
 
+// The list of instructions is kept as an X-macro so that everything which
+// needs to enumerate the instruction set (the enum below, the threaded
+// dispatch table in lky_machine.c and the disassembler in stl_meta.c) is
+// generated from this one list by the preprocessor. New instructions must be
+// appended here; the numbering is part of the serialized bytecode format.
+//
+// The compiler emits (and the serializer stores) a byte tape, with operands
+// laid out as described below. Before any of it runs it is verified and
+// decoded into a tape of ints, one per opcode and per operand, with branch
+// operands resolved to the pc execution continues from (see load_bytecode
+// in bytecode_analyzer.c). Quickening works on the decoded tape.
+#define LKY_INSTRUCTION_LIST(X) \
+    X(BINARY_ADD) \
+    X(BINARY_SUBTRACT) \
+    X(BINARY_MULTIPLY) \
+    X(BINARY_DIVIDE) \
+    X(BINARY_MODULO) \
+    X(BINARY_POWER) \
+    X(BINARY_LT) \
+    X(BINARY_GT) \
+    X(BINARY_EQUAL) \
+    X(BINARY_LTE) \
+    X(BINARY_GTE) \
+    X(BINARY_NE) \
+    X(BINARY_AND) \
+    X(BINARY_OR) \
+    X(BINARY_NC) \
+    X(BINARY_BAND) \
+    X(BINARY_BOR) \
+    X(BINARY_BXOR) \
+    X(BINARY_BLSHIFT) \
+    X(BINARY_BRSHIFT) \
+    X(UNARY_NOT) \
+    X(UNARY_NEGATIVE) \
+    X(LOAD_CONST) \
+    X(PRINT) \
+    X(POP) \
+    X(JUMP_FALSE) \
+    X(JUMP_TRUE) \
+    X(JUMP) \
+    X(JUMP_FALSE_ELSE_POP) \
+    X(JUMP_TRUE_ELSE_POP) \
+    X(IGNORE) \
+    X(SAVE_LOCAL) \
+    X(LOAD_LOCAL) \
+    X(PUSH_NIL) \
+    X(PUSH_BOOL) \
+    X(PUSH_NEW_OBJECT) \
+    X(CALL_FUNC) \
+    X(RETURN) \
+    X(LOAD_MEMBER) \
+    X(SAVE_MEMBER) \
+    X(MAKE_FUNCTION) \
+    X(MAKE_CLASS) \
+    X(SAVE_CLOSE) \
+    X(LOAD_CLOSE) \
+    X(MAKE_ARRAY) \
+    X(MAKE_TABLE) \
+    X(MAKE_OBJECT) \
+    X(LOAD_INDEX) \
+    X(SAVE_INDEX) \
+    X(SDUPLICATE) \
+    X(DDUPLICATE) \
+    X(FLIP_TWO) \
+    X(SINK_FIRST) \
+    X(MAKE_ITER) \
+    X(NEXT_ITER_OR_JUMP) \
+    X(ITER_INDEX) \
+    X(LOAD_MODULE) \
+    X(PUSH_CATCH) \
+    X(POP_CATCH) \
+    X(RAISE) \
+    X(REG_BINARY) \
+    X(REG_BINARY_PUSH) \
+    X(SAVE_LOCAL_POP) \
+    X(BINARY_JUMP_FALSE) \
+    X(LOAD_LOCAL_MEMBER) \
+    X(BIND_CLOSE) \
+    X(BINARY_ADD_INT) \
+    X(BINARY_SUBTRACT_INT) \
+    X(BINARY_MULTIPLY_INT) \
+    X(BINARY_ADD_FLOAT) \
+    X(BINARY_SUBTRACT_FLOAT) \
+    X(BINARY_MULTIPLY_FLOAT) \
+    X(REG_BINARY_INT) \
+    X(REG_BINARY_FLOAT) \
+    X(REG_BINARY_PUSH_INT) \
+    X(REG_BINARY_PUSH_FLOAT) \
+    X(BINARY_JUMP_FALSE_INT) \
+    X(BINARY_JUMP_FALSE_FLOAT) \
+    X(FOR_RANGE) \
+    X(FOR_STEP) \
+    X(CONCAT)
+
+// Register form instructions address their operands directly instead of
+// going through the data stack. Each operand is four bytes wide and names a
+// local slot, or a constant if LKY_REG_CONST is set.
+//
+//   REG_BINARY       <BINARY_* op> <lhs> <rhs> <dst local>
+//   REG_BINARY_PUSH  <BINARY_* op> <lhs> <rhs>
+#define LKY_REG_CONST 0x80000000u
+
+// Superinstructions stand in for frequent instruction sequences (see
+// fuse_superinstructions in ast_compiler.c).
+//
+//   SAVE_LOCAL_POP     <local>              SAVE_LOCAL; POP
+//   BINARY_JUMP_FALSE  <BINARY_* op> <loc>  BINARY_*; JUMP_FALSE
+//   LOAD_LOCAL_MEMBER  <local> <name> <ic>  LOAD_LOCAL; LOAD_MEMBER
+
+// A counting loop (for i = a; i < b; i += c, with i a local and b and c
+// locals or constants) is run by a pair of instructions. FOR_RANGE tests the
+// counter against the bound on the way in and jumps to <exit> (a forward
+// location, as for JUMP_FALSE) if the test fails. FOR_STEP adds <step> to
+// the counter, tests it again and jumps back to <body>, the location right
+// after FOR_RANGE, while the test holds. Both re-read the bound each time.
+// The test is one of the BINARY_* comparisons and the step BINARY_ADD or
+// BINARY_SUBTRACT; the bound and the step are register operands.
+//
+//   FOR_RANGE  <cmp op> <counter local> <bound> <exit>
+//   FOR_STEP   <step op> <cmp op> <counter local> <step> <bound> <body>
+
+// A chain of additions that starts with a string literal ("a" + b + c) adds
+// strings all the way along, so it is compiled to one CONCAT of all of its
+// operands (see compile_concat in ast_compiler.c). It builds the result in a
+// single buffer instead of making a new string at every step.
+//
+//   CONCAT  <operand count>
+
+// Member access instructions carry a second four byte operand after the
+// name: the index of the inline cache (see lky_shape.h) owned by that
+// instruction in its code object's member_caches array.
+//
+//   LOAD_MEMBER  <name> <ic>
+//   SAVE_MEMBER  <name> <ic>
+
+// Parameters arrive in local slots. One that a nested function captures is
+// copied into the frame's own closure bucket on entry (unlike SAVE_CLOSE,
+// which would write through to an enclosing scope that uses the same name).
+//
+//   BIND_CLOSE  <local> <name>
+
+// Quickened instructions are never emitted by the compiler. The interpreter
+// rewrites a generic binary instruction into one of them in place once it
+// has seen two tagged integers (_INT) or two flonums (_FLOAT), and back when
+// the operands stop matching (see mach_quicken in lky_machine.c). Each has
+// the same operands as the instruction it stands in for. A quickened
+// REG_BINARY_PUSH followed by JUMP_FALSE branches without pushing.
+//
+//   BINARY_{ADD,SUBTRACT,MULTIPLY}_{INT,FLOAT}
+//   REG_BINARY_{INT,FLOAT}, REG_BINARY_PUSH_{INT,FLOAT}
+//   BINARY_JUMP_FALSE_{INT,FLOAT}
+
+#define LKY_INSTRUCTION_ENUM_(name) LI_ ## name,
+
 typedef enum {
-    LI_BINARY_ADD = 50,
-    LI_BINARY_SUBTRACT,
-    LI_BINARY_MULTIPLY,
-    LI_BINARY_DIVIDE,
-    LI_BINARY_MODULO,
-    LI_BINARY_POWER,
-    LI_BINARY_LT,
-    LI_BINARY_GT,
-    LI_BINARY_EQUAL,
-    LI_BINARY_LTE,
-    LI_BINARY_GTE,
-    LI_BINARY_NE,
-    LI_BINARY_AND,
-    LI_BINARY_OR,
-    LI_BINARY_NC,
-    LI_BINARY_BAND,
-    LI_BINARY_BOR,
-    LI_BINARY_BXOR,
-    LI_BINARY_BLSHIFT,
-    LI_BINARY_BRSHIFT,
-    LI_UNARY_NOT,
-    LI_UNARY_NEGATIVE,
-    LI_LOAD_CONST,
-    LI_PRINT,
-    LI_POP,
-    LI_JUMP_FALSE,
-    LI_JUMP_TRUE,
-    LI_JUMP,
-    LI_JUMP_FALSE_ELSE_POP,
-    LI_JUMP_TRUE_ELSE_POP,
-    LI_IGNORE,
-    LI_SAVE_LOCAL,
-    LI_LOAD_LOCAL,
-    LI_PUSH_NIL,
-    LI_PUSH_BOOL,
-    LI_PUSH_NEW_OBJECT,
-    LI_CALL_FUNC,
-    LI_RETURN,
-    LI_LOAD_MEMBER,
-    LI_SAVE_MEMBER,
-    LI_MAKE_FUNCTION,
-    LI_MAKE_CLASS,
-    LI_SAVE_CLOSE,
-    LI_LOAD_CLOSE,
-    LI_MAKE_ARRAY,
-    LI_MAKE_TABLE,
-    LI_MAKE_OBJECT,
-    LI_LOAD_INDEX,
-    LI_SAVE_INDEX,
-    LI_SDUPLICATE,
-    LI_DDUPLICATE,
-    LI_FLIP_TWO,
-    LI_SINK_FIRST,
-    LI_MAKE_ITER,
-    LI_NEXT_ITER_OR_JUMP,
-    LI_ITER_INDEX,
-    LI_LOAD_MODULE,
-    LI_PUSH_CATCH,
-    LI_POP_CATCH,
-    LI_RAISE
+    LI_FIRST_ = 49, // Instructions begin at 50
+    LKY_INSTRUCTION_LIST(LKY_INSTRUCTION_ENUM_)
+    LI_LAST_
 } lky_instruction;
 
 #endif
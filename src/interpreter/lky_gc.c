@@ -19,26 +19,48 @@
 #include "lky_gc.h"
 #include "lky_machine.h"
 #include "arraylist.h"
-#include "gc_hashset.h"
 #include "module.h"
 
+// The collector is generational. New objects are placed in the nursery and
+// a minor collection only sweeps the nursery, promoting whatever survives
+// into the old generation. Survivors keep their mark bit set
+// (GC_MARKED) between collections, so a minor mark stops as soon as it
+// reaches an old object. Stores of young objects into old ones are caught
+// by GC_WRITE_BARRIER, which puts the old object in the remembered set so
+// its children are traced on the next minor collection. Once the old
+// generation has grown past old_limit the next collection is a major one,
+// which clears every mark and sweeps both generations.
+
+#define GC_NURSERY_LIMIT 1600000
+#define GC_MIN_OLD_LIMIT (GC_NURSERY_LIMIT * 4)
+
 void gc_mark();
-void gc_collect();
+void gc_mark_children(lky_object *o);
 
 typedef struct gc_root_list {
     struct gc_root_list *next;
     void *value;
 } gc_root_list;
 
+// Objects are threaded through their gc_next field, so tracking an object
+// never allocates and freeing one never has to look it up.
+typedef struct {
+    lky_object *head;
+    lky_object *tail;
+} gc_list;
+
 typedef struct {
-    gc_hashset pool;
+    gc_list nursery;
+    gc_list old;
+    gc_list untracked;
+    arraylist remembered;
     gc_root_list *roots;
     stackframe *function_stacks;
-    size_t max_size;
-    size_t cur_size;
-    
-    size_t growth_size;
-    size_t marked_size;
+
+    size_t nursery_size;
+    size_t nursery_limit;
+    size_t old_size;
+    size_t old_limit;
 } gc_bundle;
 
 typedef struct {
@@ -49,6 +71,33 @@ typedef struct {
 gc_bundle bundle;
 char gc_started = 0;
 char gc_paused = 0;
+char gc_collecting = 0;
+char gc_initialized = 0;
+
+void gc_list_append(gc_list *list, lky_object *obj)
+{
+    obj->gc_next = NULL;
+    if(list->tail)
+        list->tail->gc_next = (struct lky_object *)obj;
+    else
+        list->head = obj;
+    list->tail = obj;
+}
+
+// Moves every object in 'from' to the end of 'to'.
+void gc_list_splice(gc_list *to, gc_list *from)
+{
+    if(!from->head)
+        return;
+
+    if(to->tail)
+        to->tail->gc_next = (struct lky_object *)from->head;
+    else
+        to->head = from->head;
+    to->tail = from->tail;
+
+    from->head = from->tail = NULL;
+}
 
 void gc_pause()
 {
@@ -75,16 +124,31 @@ void gc_add_func_stack(stackframe *frame)
     bundle.function_stacks = frame;
 }
 
+// Objects allocated while the collector is stopped are never swept, but
+// major collections still need to reset their marks.
+void gc_add_untracked(lky_object *obj)
+{
+    gc_list_append(&bundle.untracked, obj);
+}
+
 void gc_init()
 {
-    bundle.pool = gchs_create(8);
+    // Anything tracked by a previous gc_init is kept alive for good.
+    if(gc_initialized)
+    {
+        gc_list_splice(&bundle.untracked, &bundle.old);
+        gc_list_splice(&bundle.untracked, &bundle.nursery);
+        arr_free(&bundle.remembered);
+    }
+
+    bundle.remembered = arr_create(64);
     bundle.roots = NULL;
-    //    bundle.max_size = 16000000;
-    bundle.growth_size = 1600000;
-    bundle.marked_size = 0;
-    bundle.max_size = 1600000;
-    bundle.cur_size = 0;
+    bundle.nursery_size = 0;
+    bundle.nursery_limit = GC_NURSERY_LIMIT;
+    bundle.old_size = 0;
+    bundle.old_limit = GC_MIN_OLD_LIMIT;
     bundle.function_stacks = NULL;
+    gc_initialized = 1;
     gc_started = 1;
 }
 
@@ -148,66 +212,149 @@ size_t gc_determine_size_of(lky_object *obj)
 
 void gc_add_object(lky_object *obj)
 {
-    if(!gc_started || !obj)
+    if(!obj)
+        return;
+
+    if(!gc_started)
+    {
+        gc_add_untracked(obj);
         return;
+    }
     
-    gchs_add(&bundle.pool, obj);
-    bundle.cur_size += gc_determine_size_of(obj);
+    gc_list_append(&bundle.nursery, obj);
+    bundle.nursery_size += gc_determine_size_of(obj);
+}
+
+void gc_remember(lky_object *obj)
+{
+    if(obj->mem_count != GC_MARKED)
+        return;
+
+    obj->mem_count |= GC_REMEMBERED;
+    arr_append(&bundle.remembered, obj);
 }
 
 size_t gc_alloced()
 {
-    return bundle.cur_size;
+    return bundle.nursery_size + bundle.old_size;
 }
 
-void gc_gc()
+void gc_free_object(lky_object *o)
 {
-    if(bundle.cur_size < bundle.max_size)
-        return;
+    // TODO: This will need to change.
+    if(o->type == LBI_CUSTOM)
+    {
+        lky_object *func = lobj_get_member(o, "on_destroy_");
+        if(func)
+            lobjb_call(func, NULL, NULL);
+    }
 
-    if(gc_paused)
-        return;
-    
-    gc_mark();
-    gc_collect();
-    bundle.max_size = bundle.marked_size + bundle.growth_size;
+    lobj_dealloc(o);
 }
 
-void gc_collect()
+// Frees the unmarked objects in the nursery and moves the rest into the
+// old generation. Their marks are left set, which is what makes them old.
+void gc_sweep_nursery()
 {
-    bundle.marked_size = 0;
-    
-    gc_hashset pool = bundle.pool;
-    void **objs = gchs_to_list(&bundle.pool);
-    
-    int i;
-    for(i = pool.count - 1; i >= 0; i--)
+    // Detach the nursery first; destructors may allocate.
+    lky_object *o = bundle.nursery.head;
+    bundle.nursery.head = bundle.nursery.tail = NULL;
+    bundle.nursery_size = 0;
+
+    while(o)
     {
-        lky_object *o = objs[i];
-        if(!o->mem_count)
+        lky_object *next = (lky_object *)o->gc_next;
+        if(o->mem_count & GC_MARKED)
         {
-            bundle.cur_size -= gc_determine_size_of(o);
-            // TODO: This will need to change.
-
-            
-            if(o->type == LBI_CUSTOM)
-            {
-                lky_object *func = lobj_get_member(o, "on_destroy_");
-                if(func)
-                    lobjb_call(func, NULL, NULL);
-            }
-
-            lobj_dealloc(o);
-            gchs_remove(&bundle.pool, o);
+            gc_list_append(&bundle.old, o);
+            bundle.old_size += gc_determine_size_of(o);
         }
         else
+            gc_free_object(o);
+
+        o = next;
+    }
+}
+
+void gc_minor()
+{
+    gc_mark();
+
+    long i;
+    for(i = 0; i < bundle.remembered.count; i++)
+    {
+        lky_object *o = bundle.remembered.items[i];
+        o->mem_count &= ~GC_REMEMBERED;
+        gc_mark_children(o);
+    }
+
+    bundle.remembered.count = 0;
+    gc_sweep_nursery();
+}
+
+void gc_major()
+{
+    lky_object *o;
+    for(o = bundle.old.head; o; o = (lky_object *)o->gc_next)
+        o->mem_count = 0;
+    for(o = bundle.untracked.head; o; o = (lky_object *)o->gc_next)
+        o->mem_count = 0;
+
+    bundle.remembered.count = 0;
+
+    gc_mark();
+
+    o = bundle.old.head;
+    bundle.old.head = bundle.old.tail = NULL;
+    bundle.old_size = 0;
+
+    while(o)
+    {
+        lky_object *next = (lky_object *)o->gc_next;
+        if(o->mem_count)
         {
-            bundle.marked_size += gc_determine_size_of(o);
-            o->mem_count = 0;
+            gc_list_append(&bundle.old, o);
+            bundle.old_size += gc_determine_size_of(o);
         }
+        else
+            gc_free_object(o);
+
+        o = next;
     }
+
+    gc_sweep_nursery();
+
+    bundle.old_limit = bundle.old_size * 2;
+    if(bundle.old_limit < GC_MIN_OLD_LIMIT)
+        bundle.old_limit = GC_MIN_OLD_LIMIT;
+}
+
+void gc_gc()
+{
+    if(bundle.nursery_size < bundle.nursery_limit)
+        return;
+
+    if(gc_paused || gc_collecting)
+        return;
     
-    free(objs);
+    gc_collecting = 1;
+
+    if(bundle.old_size > bundle.old_limit)
+        gc_major();
+    else
+        gc_minor();
+
+    gc_collecting = 0;
+}
+
+void gc_collect()
+{
+    if(gc_collecting)
+        return;
+
+    gc_collecting = 1;
+    gc_major();
+    gc_collecting = 0;
 }
 
 void gc_mark_for_each(void *key, void *val, void *data)
@@ -217,14 +364,18 @@ void gc_mark_for_each(void *key, void *val, void *data)
 
 void gc_mark_object(lky_object *o)
 {
-    if(((uintptr_t)(o) & 1) || o->mem_count)
+    if(OBJ_IS_TAGGED(o) || (o->mem_count & GC_MARKED))
         return;
     
-    o->mem_count = 1;
+    o->mem_count |= GC_MARKED;
+    gc_mark_children(o);
+}
 
+void gc_mark_children(lky_object *o)
+{
     if(o->type != LBI_INTEGER && o->type != LBI_FLOAT && o->type != LBI_BLOB &&
             o->type != LBI_SEQUENCE && o->type != LBI_CODE && o->type != LBI_ITERABLE)
-        hst_for_each(&o->members, gc_mark_for_each, NULL);
+        shp_members_for_each(&o->members, gc_mark_for_each, NULL);
     //gc_mark_object(&o->parent);
     
     switch(o->type)
@@ -283,7 +434,8 @@ void gc_mark_object(lky_object *o)
         case LBI_ITERABLE:
         {
             lky_object_iterable *it = (lky_object_iterable *)o;
-            gc_mark_object(it->owner);
+            if(it->owner)
+                gc_mark_object(it->owner);
         }
             break;
         case LBI_BLOB:
@@ -298,15 +450,26 @@ void gc_mark_object(lky_object *o)
     }
 }
 
+// Roots and frame buckets are written to without a barrier, so their
+// children are traced even when they are already old.
+void gc_mark_root(lky_object *o)
+{
+    if(!o || OBJ_IS_TAGGED(o))
+        return;
+
+    o->mem_count |= GC_MARKED;
+    gc_mark_children(o);
+}
+
+// Local slots are filled in any order, so empty ones are skipped rather
+// than taken as the end of the live values.
 void gc_mark_stack(void **stack, int size)
 {
     int i;
     for(i = 0; i < size; i++)
     {
-        if(!stack[i])
-            break;
-        
-        gc_mark_object(stack[i]);
+        if(stack[i])
+            gc_mark_object(stack[i]);
     }
 }
 
@@ -314,9 +477,11 @@ void gc_mark_function_stack(stackframe *frame)
 {
     for(; frame; frame = frame->next)
     {
-        gc_mark_object(frame->bucket);
-        gc_mark_stack(frame->data_stack, (int)frame->stack_size);
+        gc_mark_root(frame->bucket);
+        gc_mark_stack(frame->data_stack, (int)frame->stack_pointer + 1);
         gc_mark_stack(frame->locals, (int)frame->locals_count);
+        if(frame->func)
+            gc_mark_object((lky_object *)frame->func);
         
         int i;
         for(i = 0; i < frame->parent_stack.count; i++)
@@ -332,7 +497,7 @@ void gc_mark()
     
     for(; list; list = list->next)
     {
-        gc_mark_object(list->value);
+        gc_mark_root(list->value);
         
     }
     
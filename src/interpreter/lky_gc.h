@@ -21,6 +21,21 @@
 
 #include "lkyobj_builtin.h"
 
+// Bits of an object's mem_count. GC_MARKED doubles as the old generation
+// flag between collections.
+#define GC_MARKED 1
+#define GC_REMEMBERED 2
+
+#define GC_IS_YOUNG(o) ((o) && !OBJ_IS_TAGGED(o) && !(((lky_object *)(o))->mem_count & GC_MARKED))
+
+// Must follow any store of 'val' into memory owned by 'obj' (members,
+// function fields, or the contents of a blob) so that minor collections
+// can see references from old objects to young ones.
+#define GC_WRITE_BARRIER(obj, val) do { \
+        if(((lky_object *)(obj))->mem_count == GC_MARKED && GC_IS_YOUNG(val)) \
+            gc_remember((lky_object *)(obj)); \
+    } while(0)
+
 void gc_init();
 void gc_pause();
 void gc_pause_collection();
@@ -30,8 +45,8 @@ void gc_add_func_stack(stackframe *frame);
 void gc_add_root_object(lky_object *obj);
 void gc_remove_root_object(lky_object *obj);
 void gc_add_object(lky_object *obj);
+void gc_remember(lky_object *obj);
 void gc_gc();
-void gc_mark();
 void gc_collect();
 void gc_mark_object(lky_object *o);
 size_t gc_alloced();
@@ -25,32 +25,39 @@
 // opposed to the register-based machine on which you are probably reading this
 // document) and as such has one data stack that the machine uses to keep track
 // of state. The machine reads the tap character by character and decides what
-// to do. A C stack frame is pushed every time a function is called, allowing
-// "native code" (i.e. the C api) to interact with lanky code as a standard
-// object. The interpretation unit has reached a rough stage of completion and
-// should be relatively stable.
+// to do. Calls from lanky code to lanky functions run in the same loop; a C
+// stack frame is only pushed when "native code" (i.e. the C api) calls into
+// lanky code, which lets it interact with lanky code as a standard object.
+// The interpretation unit has reached a rough stage of completion and should
+// be relatively stable.
 
 #include <stdio.h>
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <sys/resource.h>
 #include "arraylist.h"
 #include "instruction_set.h"
 #include "lkyobj_builtin.h"
 #include "mach_binary_ops.h"
 #include "mach_unary_ops.h"
 #include "lky_machine.h"
+#include "mach_jit.h"
 #include "lky_object.h"
 #include "lky_gc.h"
 #include "stl_array.h"
 #include "stl_table.h"
+#include "stl_string.h"
 #include "hashmap.h"
 #include "module.h"
 #include "runtime.h"
 #include "class_builder.h"
 
-//#define COMPUTED_GOTO
+// Threaded dispatch (labels as values) is enabled by defining COMPUTED_GOTO
+// at build time; see the makefile and CMakeLists.txt. Both dispatch modes
+// share the same opcode bodies (vmop) and the same safepoint checks, so the
+// only difference is how control reaches the next opcode.
 
 // Macros to abstract the notion of "pushing"
 // and "popping" from the state machine
@@ -59,59 +66,235 @@
 #define TOP() (top_node(frame))
 #define SECOND_TOP() (frame->data_stack[frame->stack_pointer - 1])
 
-#ifdef COMPUTED_GOTO
-    #define dispatch_() goto *dispatch_table_[frame->ops[++frame->pc] - 50]
-    #define vmop(op_, code_) LI_ ## op_ : do{\
-    code_\
-    if(frame->pc >= frame->tape_len || frame->ret)\
-        return;\
-    if(interp->error)\
+// The checks run at a safepoint: the tape end, a pending return, a pending
+// error (which unwinds to the nearest catch or out of the frame) and the
+// garbage collector. Only opcodes declared with vmop are followed by a
+// safepoint: calls, returns, backward jumps, allocating constructors and the
+// opcodes that raise. Opcodes declared with vmfast go straight to the next
+// opcode; if they call into code that may set interp->error they must check
+// for it with vmraised_(). Since every loop closes with a backward jump the
+// collector still runs at least once per iteration.
+//
+// A frame that finishes returns from mach_eval, unless CALL_FUNC started it
+// inline, in which case the caller carries on in the same loop.
+#define vmcheck_() do {\
+    if(frame->pc >= frame->tape_len || frame->ret || (interp->error && mach_unwind_error(frame)))\
     {\
-        lky_object *exc = interp->error;\
-        interp->error = NULL;\
-\
-        if(!frame->catch_pointer && !frame->prev)\
-        {\
-            char *errtxt = lobjb_stringify(exc, frame->interp);\
-            printf("Fatal error--\n%s\n\nHalting.\n", errtxt);\
-            free(errtxt);\
-            frame->ret = &lky_nil;\
+        if(frame->call_argc < 0)\
             return;\
-        }\
-        else if(!frame->catch_pointer)\
-        {\
-            frame->prev->thrown = exc;\
-            return;\
-        }\
-\
-        PUSH(exc);\
-        frame->pc = frame->catch_stack[--frame->catch_pointer];\
+        frame = mach_return_inline(frame);\
+        goto _opcode_whiplash_;\
     }\
-\
     gc_gc();\
-    dispatch_();}while(0);
+} while(0)
+
+// Fetches the next opcode. Profiling builds (LKY_PROFILE_OPS) also count
+// it; see mach_profile_report.
+#ifdef LKY_PROFILE_OPS
+    #define vmfetch_() (mach_profile_op(frame->ops[++frame->pc]))
+#else
+    #define vmfetch_() (frame->ops[++frame->pc])
+#endif
+
+// Fetches the next operand of the current instruction. The tape has been
+// decoded to a word per opcode and per operand (see decode_bytecode), and
+// branch operands already hold the pc to continue from.
+#define vmarg_() (frame->ops[++frame->pc])
+
+#ifdef COMPUTED_GOTO
+    #define LKY_DISPATCH_ENTRY_(name) &&LI_ ## name,
+    #define dispatch_() goto *dispatch_table_[vmfetch_() - LI_BINARY_ADD]
+    #define vmop(op, code) LI_ ## op : { code } vmcheck_(); dispatch_();
+    #define vmfast(op, code) LI_ ## op : { code } dispatch_();
     #define vmvm(code) dispatch_(); code
 #else
     #define vmop(op, code) case LI_ ## op : { code goto _opcode_whiplash_; } break;
-    #define vmvm(code) switch((op = frame->ops[++frame->pc])) { code default: printf("HIT DEFAULT. BUG!\n"); goto _opcode_whiplash_; break; }
-    #define dispatch_() goto _opcode_whiplash_
+    #define vmfast(op, code) case LI_ ## op : { code goto _opcode_dispatch_; } break;
+    #define vmvm(code) _opcode_dispatch_: switch((op = vmfetch_())) { code default: printf("HIT DEFAULT. BUG!\n"); goto _opcode_whiplash_; break; }
 #endif
 
+// Used to leave an opcode body early (e.g. after raising an error). This
+// always goes through the safepoint checks.
+#define vmbreak_() goto _opcode_whiplash_
+#define vmraised_() do { if(interp->error) vmbreak_(); } while(0)
+
 #define POP_TWO() lky_object *a = POP(); lky_object *b = POP()
 
+// Goes on to the next opcode without a safepoint.
+#ifdef COMPUTED_GOTO
+    #define vmnext_() dispatch_()
+#else
+    #define vmnext_() goto _opcode_dispatch_
+#endif
+
+// Quickening (see mach_quicken). vmquicken_ is used by the generic binary
+// instructions once they have run; vmdeopt_ is used by a quickened one whose
+// operands failed its tag check, and reruns the instruction at 'at' in its
+// generic form.
+#define vmquicken_(at, bop, l, r) do {\
+    if(mach_quickening_ && OBJ_IS_TAGGED(l) && OBJ_IS_TAGGED(r))\
+        mach_quicken(frame->ops + (at), bop, l, r);\
+} while(0)
+#define vmdeopt_(at, generic) do {\
+    frame->ops[(at)] = (generic);\
+    frame->pc = (at) - 1;\
+    vmnext_();\
+} while(0)
+
+// Pushes the result of a quickened REG_BINARY_PUSH, unless a JUMP_FALSE
+// consumes it right away, in which case that branch is taken directly.
+#define vmpush_or_branch_(obj) do {\
+    if(frame->ops[frame->pc + 1] == LI_JUMP_FALSE)\
+        frame->pc = LKY_CTEST_FAST(obj) ? frame->pc + 2 : frame->ops[frame->pc + 2];\
+    else\
+        PUSH(obj);\
+} while(0)
+
+// Body of a quickened stack form instruction. 'a' is the right hand operand,
+// as in POP_TWO.
+#define vmquick_binary_(generic, check, result) do {\
+    lky_object *a = TOP();\
+    lky_object *b = SECOND_TOP();\
+    if(!check(a) || !check(b))\
+        vmdeopt_(frame->pc, generic);\
+    frame->data_stack[frame->stack_pointer--] = NULL;\
+    frame->data_stack[frame->stack_pointer] = (result);\
+} while(0)
+
+// Reads the operand of a register form instruction (see instruction_set.h).
+#define REG_OPERAND(r) ((r) & LKY_REG_CONST ? (lky_object *)frame->constants[(r) & ~LKY_REG_CONST] : frame->locals[(r)])
+
 void mach_eval(stackframe *frame);
+int mach_unwind_error(stackframe *frame);
+
+// Set by the --max-depth flag.
+int mach_max_depth_ = 10000;
+
+// Cleared by the --no-quickening flag.
+int mach_quickening_ = 1;
+
+// How much of the native stack Lanky calls may use. Calls made from C (by
+// compiled code, or by builtins calling back into Lanky) recurse on the
+// native stack, so --max-depth alone cannot keep them from overflowing it.
+// Part of the stack limit is held back for the builtins and the collector.
+static long mach_native_stack_limit()
+{
+    static long limit = 0;
+    if(limit)
+        return limit;
+
+    struct rlimit rl;
+    long size = 8L << 20;
+    if(!getrlimit(RLIMIT_STACK, &rl) && rl.rlim_cur != RLIM_INFINITY && rl.rlim_cur > 0)
+        size = (long)rl.rlim_cur;
+
+    long reserve = size / 8 > (256L << 10) ? size / 8 : (256L << 10);
+    limit = size > 2 * reserve ? size - reserve : size / 2;
+    return limit;
+}
 
 int pushes = 0;
 
+#ifdef LKY_PROFILE_OPS
+unsigned long mach_op_counts_[256];
+unsigned long mach_op_pairs_[256][256];
+unsigned char mach_last_op_ = 0;
+
+// Counts 'op' and the pair it forms with the previously executed opcode.
+// Pairs are counted across calls and returns too, so pairs ending in
+// CALL_FUNC's callee or starting with RETURN are partly noise.
+unsigned char mach_profile_op(unsigned char op)
+{
+    mach_op_counts_[op]++;
+    mach_op_pairs_[mach_last_op_][op]++;
+    mach_last_op_ = op;
+    return op;
+}
+
+#define LKY_PROFILE_NAME_(name) [LI_ ## name] = #name,
+#define LKY_PROFILE_TOP_PAIRS 25
+
+typedef struct {
+    unsigned long count;
+    unsigned char first;
+    unsigned char second;
+} mach_profile_pair;
+
+int mach_profile_pair_compare(const void *a, const void *b)
+{
+    unsigned long ca = ((const mach_profile_pair *)a)->count;
+    unsigned long cb = ((const mach_profile_pair *)b)->count;
+    return ca < cb ? 1 : (ca > cb ? -1 : 0);
+}
+
+// Prints the number of times each instruction was executed, most frequent
+// first, followed by the most frequent pairs of consecutive instructions.
+// The pairs are the candidates for superinstructions (see
+// fuse_superinstructions in ast_compiler.c).
+void mach_profile_report()
+{
+    static const char *names[256] = { LKY_INSTRUCTION_LIST(LKY_PROFILE_NAME_) };
+    unsigned long total = 0;
+    char done[256] = {0};
+
+    int i, j;
+    for(i = 0; i < 256; i++)
+        total += mach_op_counts_[i];
+
+    fprintf(stderr, "Executed %lu instructions.\n", total);
+    if(!total)
+        return;
+
+    for(;;)
+    {
+        int best = -1;
+        for(i = 0; i < 256; i++)
+        {
+            if(!done[i] && mach_op_counts_[i] && (best < 0 || mach_op_counts_[i] > mach_op_counts_[best]))
+                best = i;
+        }
+
+        if(best < 0)
+            break;
+
+        done[best] = 1;
+        fprintf(stderr, "%12lu  %5.2f%%  %s\n", mach_op_counts_[best], 100.0 * mach_op_counts_[best] / total, names[best] ? names[best] : "?");
+    }
+
+    mach_profile_pair *sorted = malloc(sizeof(mach_profile_pair) * 256 * 256);
+    int count = 0;
+    for(i = 0; i < 256; i++)
+    {
+        for(j = 0; j < 256; j++)
+        {
+            if(!mach_op_pairs_[i][j] || !names[i])
+                continue;
+
+            sorted[count].count = mach_op_pairs_[i][j];
+            sorted[count].first = i;
+            sorted[count].second = j;
+            count++;
+        }
+    }
+    qsort(sorted, count, sizeof(mach_profile_pair), mach_profile_pair_compare);
+
+    fprintf(stderr, "\nMost frequent instruction pairs:\n");
+    for(i = 0; i < count && i < LKY_PROFILE_TOP_PAIRS; i++)
+    {
+        mach_profile_pair p = sorted[i];
+        fprintf(stderr, "%12lu  %5.2f%%  %s; %s\n", p.count, 100.0 * p.count / total, names[p.first], names[p.second] ? names[p.second] : "?");
+    }
+
+    free(sorted);
+}
+#endif
+
 void push_node(stackframe *frame, void *data)
 {
-    if(frame->stack_pointer >= frame->stack_size)
+    if(frame->stack_pointer + 1 >= frame->stack_size)
     {
-        // WE HAVE HAD A STACK OVERFLOW
-        // TODO: Make this an error.
-        
-        printf("Stack Overflow! Exiting.\n");
-        exit(0);
+        frame->interp->error = lobjb_build_error("StackOverflow", "Data stack overflow.", frame->interp);
+        return;
     }
     frame->data_stack[++frame->stack_pointer] = data;
     pushes++;
@@ -135,6 +318,145 @@ void *pop_node(stackframe *frame)
     return data;
 }
 
+// Applies the binary instruction 'op' to a and b. Used by the register form
+// instructions, which carry the operation as an operand.
+lky_object *mach_binary_op(lky_instruction op, lky_object *a, lky_object *b, struct interp *interp)
+{
+    switch(op)
+    {
+        case LI_BINARY_ADD: return lobjb_binary_add(a, b, interp);
+        case LI_BINARY_SUBTRACT: return lobjb_binary_subtract(a, b, interp);
+        case LI_BINARY_MULTIPLY: return lobjb_binary_multiply(a, b, interp);
+        case LI_BINARY_DIVIDE: return lobjb_binary_divide(a, b, interp);
+        case LI_BINARY_MODULO: return lobjb_binary_modulo(a, b, interp);
+        case LI_BINARY_POWER: return lobjb_binary_power(a, b, interp);
+        case LI_BINARY_LT: return lobjb_binary_lessthan(a, b, interp);
+        case LI_BINARY_GT: return lobjb_binary_greaterthan(a, b, interp);
+        case LI_BINARY_EQUAL: return lobjb_binary_equals(a, b, interp);
+        case LI_BINARY_LTE: return lobjb_binary_lessequal(a, b, interp);
+        case LI_BINARY_GTE: return lobjb_binary_greatequal(a, b, interp);
+        case LI_BINARY_NE: return lobjb_binary_notequal(a, b, interp);
+        case LI_BINARY_AND: return lobjb_binary_and(a, b, interp);
+        case LI_BINARY_OR: return lobjb_binary_or(a, b, interp);
+        case LI_BINARY_NC: return lobjb_binary_nc(a, b, interp);
+        case LI_BINARY_BAND: return lobjb_binary_band(a, b, interp);
+        case LI_BINARY_BOR: return lobjb_binary_bor(a, b, interp);
+        case LI_BINARY_BXOR: return lobjb_binary_bxor(a, b, interp);
+        case LI_BINARY_BLSHIFT: return lobjb_binary_blshift(a, b, interp);
+        case LI_BINARY_BRSHIFT: return lobjb_binary_brshift(a, b, interp);
+        default: return &lky_nil;
+    }
+}
+
+// Rewrites the binary instruction at 'op', which has just run on the operands
+// l and r, into the form specialized for them: the _INT forms when both are
+// tagged integers, the _FLOAT forms when both are flonums. 'bop' is the
+// operation it performs. Instructions that have no specialized form, or
+// whose operation the fast paths in mach_binary_ops.c do not cover, are left
+// alone.
+void mach_quicken(int *op, lky_instruction bop, lky_object *l, lky_object *r)
+{
+    char as_int = OBJ_IS_TAGGED_INT(l) && OBJ_IS_TAGGED_INT(r) && lobjb_binary_has_int_op(bop);
+    char as_float = OBJ_IS_FLONUM(l) && OBJ_IS_FLONUM(r) && lobjb_binary_has_float_op(bop);
+    if(!as_int && !as_float)
+        return;
+
+    switch(*op)
+    {
+        case LI_BINARY_ADD:
+            *op = as_int ? LI_BINARY_ADD_INT : LI_BINARY_ADD_FLOAT;
+            break;
+        case LI_BINARY_SUBTRACT:
+            *op = as_int ? LI_BINARY_SUBTRACT_INT : LI_BINARY_SUBTRACT_FLOAT;
+            break;
+        case LI_BINARY_MULTIPLY:
+            *op = as_int ? LI_BINARY_MULTIPLY_INT : LI_BINARY_MULTIPLY_FLOAT;
+            break;
+        case LI_REG_BINARY:
+            *op = as_int ? LI_REG_BINARY_INT : LI_REG_BINARY_FLOAT;
+            break;
+        case LI_REG_BINARY_PUSH:
+            *op = as_int ? LI_REG_BINARY_PUSH_INT : LI_REG_BINARY_PUSH_FLOAT;
+            break;
+        case LI_BINARY_JUMP_FALSE:
+            *op = as_int ? LI_BINARY_JUMP_FALSE_INT : LI_BINARY_JUMP_FALSE_FLOAT;
+            break;
+        default:
+            break;
+    }
+}
+
+// Looks up 'name' on obj for LOAD_MEMBER and friends, using the inline cache
+// of the instruction doing the lookup. Sets interp->error and returns NULL if
+// there is no such member.
+lky_object *mach_load_member(stackframe *frame, lky_object *obj, char *name, lky_member_cache *cache)
+{
+    mach_interp *interp = frame->interp;
+
+    if(obj == &lky_nil || obj == &lky_yes || obj == &lky_no || OBJ_IS_NUMBER(obj))
+    {
+        char str[200 + strlen(name)];
+        sprintf(str, "Requesting member '%s' from memberless-object.", name);
+        interp->error = lobjb_build_error(obj == &lky_nil ? "NullPointer" : "InvalidType", str, interp);
+        return NULL;
+    }
+
+    lky_object *val = lobj_get_member_cached(obj, name, cache);
+
+    if(!val)
+    {
+        char str[200 + strlen(name)];
+        sprintf(str, "Object has no member named '%s'.", name);
+        interp->error = lobjb_build_error("UndeclaredIdentifier", str, interp);
+        return NULL;
+    }
+
+    return val;
+}
+
+// Loads the closure variable 'name' for LOAD_CLOSE: the frame's own bucket
+// is searched first, then the enclosing scopes from the innermost out. Sets
+// interp->error and returns NULL if no scope has it.
+lky_object *mach_load_close(stackframe *frame, char *name)
+{
+    lky_object *obj = lobj_get_member_sym(frame->bucket, name);
+    arraylist ps = frame->parent_stack;
+
+    int i;
+    for(i = (int)ps.count - 1; i >= 0 && !obj; i--)
+        obj = lobj_get_member_sym(arr_get(&ps, i), name);
+
+    if(!obj)
+    {
+        mach_interp *interp = frame->interp;
+        char str[200 + strlen(name)];
+        sprintf(str, "Could not load closure variable '%s'.", name);
+        interp->error = lobjb_build_error("UndeclaredIdentifier", str, interp);
+    }
+
+    return obj;
+}
+
+// Stores a closure variable for SAVE_CLOSE: into the innermost enclosing
+// scope that already has 'name', or else into the frame's own bucket.
+void mach_save_close(stackframe *frame, char *name, lky_object *obj)
+{
+    lky_object *bk = NULL;
+    arraylist ps = frame->parent_stack;
+
+    int i;
+    for(i = (int)ps.count - 1; i >= 0 && !bk; i--)
+    {
+        lky_object *n = arr_get(&ps, i);
+        if(lobj_get_member_sym(n, name))
+            bk = n;
+    }
+
+    if(!bk)
+        bk = mach_frame_bucket(frame);
+
+    lobj_set_member_sym(bk, name, obj);
+}
 
 arraylist mach_build_trace(mach_interp *interp)
 {
@@ -149,158 +471,275 @@ arraylist mach_build_trace(mach_interp *interp)
     return out;
 }
 
-lky_object *mach_interrupt_exec(lky_object_function *func)
+// Frames get their closure bucket the first time something is bound in it or
+// a nested function captures them; most calls never need one.
+lky_object *mach_frame_bucket(stackframe *frame)
 {
-    mach_interp *interp = func->interp;
-    
+    if(!frame->bucket)
+        frame->bucket = lobj_alloc();
+
+    return frame->bucket;
+}
+
+// Carves 'count' slots out of the interpreter's value stack. Native code
+// holds argv pointers into it, so a segment never moves once allocated;
+// instead the stack grows by moving on to another segment when the current
+// one is full. Segments we leave behind are kept for reuse.
+void **mach_stack_alloc(mach_interp *interp, long count)
+{
+    mach_stack_segment *seg = interp->segment;
+    if(!seg || seg->top + count > seg->size)
+    {
+        mach_stack_segment *next = seg ? seg->next : interp->spare;
+        if(!next || next->size < count)
+        {
+            long size = count > MACH_SEGMENT_SLOTS ? count : MACH_SEGMENT_SLOTS;
+            mach_stack_segment *fresh = malloc(sizeof(mach_stack_segment) + sizeof(void *) * size);
+            fresh->size = size;
+            fresh->next = next;
+            next = fresh;
+        }
+
+        next->prev = seg;
+        next->top = 0;
+        if(seg)
+            seg->next = next;
+        interp->segment = seg = next;
+    }
+
+    void **slots = seg->slots + seg->top;
+    seg->top += count;
+    return slots;
+}
+
+void mach_stack_release(mach_interp *interp, long count)
+{
+    mach_stack_segment *seg = interp->segment;
+    seg->top -= count;
+
+    if(!seg->top)
+    {
+        interp->segment = seg->prev;
+        if(!seg->prev)
+            interp->spare = seg;
+    }
+}
+
+// Pushes a frame for func onto the interpreter's stack. Frame structs are
+// recycled through a free list and their locals, data stack and catch stack
+// are carved out of the value stack. Returns NULL (with interp->error set)
+// once the maximum recursion depth is reached.
+stackframe *mach_push_frame(mach_interp *interp, lky_object_function *func)
+{
+    if(interp->depth >= mach_max_depth_)
+    {
+        char str[100];
+        sprintf(str, "Maximum recursion depth (%d) exceeded.", mach_max_depth_);
+        interp->error = lobjb_build_error("StackOverflow", str, interp);
+        return NULL;
+    }
+
+    char here;
+    if(!interp->native_base)
+        interp->native_base = &here;
+    else if(labs(interp->native_base - &here) > mach_native_stack_limit())
+    {
+        interp->error = lobjb_build_error("StackOverflow", "Native stack exhausted.", interp);
+        return NULL;
+    }
+
     lky_object_code *code = func->code;
-    stackframe *frame = malloc(sizeof(stackframe));
-    
-    stackframe *curr = interp->stack;
-    
-    frame->parent_stack = curr->parent_stack;
-    frame->bucket = curr->bucket;
+
+    if(mach_jit_enabled_ && !code->jit && code->jit_calls >= 0 && ++code->jit_calls >= MACH_JIT_THRESHOLD)
+        mach_jit_compile(code);
+
+    stackframe *frame = interp->free_frames;
+    if(frame)
+        interp->free_frames = frame->next;
+    else
+        frame = malloc(sizeof(stackframe));
+
+    // The catch stack holds pairs of ints, which fit in the slots.
+    frame->slot_count = code->num_locals + code->stack_size + code->catch_size;
+    void **slots = mach_stack_alloc(interp, frame->slot_count);
+    memset(slots, 0, sizeof(void *) * code->num_locals);
+
+    frame->locals = slots;
+    frame->data_stack = slots + code->num_locals;
+    frame->catch_stack = (int *)(slots + code->num_locals + code->stack_size);
+
+    frame->func = func;
+    frame->parent_stack = func->parent_stack;
+    frame->bucket = NULL;
     frame->constants = code->constants;
-    frame->locals = code->locals;
     frame->pc = -1;
-    frame->ops = code->ops;
-    frame->indices = code->indices;
-    frame->tape_len = code->op_len;
+    frame->ops = code->tape;
+    frame->indices = code->tape_indices;
+    frame->tape_len = code->tape_len;
     frame->stack_pointer = -1;
     frame->stack_size = code->stack_size;
     frame->names = code->names;
+    frame->member_caches = code->member_caches;
     frame->ret = NULL;
+    frame->thrown = NULL;
     frame->interp = interp;
     frame->locals_count = code->num_locals;
     frame->catch_pointer = 0;
-    
-    frame->prev = interp->stack ? interp->stack : NULL;
-    frame->thrown = NULL;
+    frame->call_argc = -1;
+    frame->impl_name = code->impl_name;
+
+    frame->prev = interp->stack;
     frame->next = NULL;
 
-    frame->impl_name = code->impl_name;
-    
-    func->parent_stack = frame->parent_stack;
-    
     if(interp->stack)
         interp->stack->next = frame;
     else
         gc_add_func_stack(frame);
-    
+
     interp->stack = frame;
-    
-    void *stack[code->stack_size];
-    memset(stack, 0, sizeof(void *) * code->stack_size);
-    
-    int catch_stack[code->catch_size];
-    memset(catch_stack, 0, sizeof(int) * code->catch_size);
+    interp->depth++;
 
-    frame->data_stack = stack;
-    frame->catch_stack = catch_stack;
-    func->bucket = frame->bucket;
+    return frame;
+}
+
+void mach_pop_frame(stackframe *frame)
+{
+    mach_interp *interp = frame->interp;
+
+    interp->stack = frame->prev;
+    if(interp->stack)
+        interp->stack->next = NULL;
+    else
+        gc_add_func_stack(NULL);
+
+    mach_stack_release(interp, frame->slot_count);
+    interp->depth--;
+
+    frame->next = interp->free_frames;
+    interp->free_frames = frame;
+}
+
+// Binds a call's arguments into the new frame's first local slots: the
+// parameters, then va_args_ and the refname (see bind_locals in
+// ast_compiler.c).
+void mach_bind_args(stackframe *frame, lky_object_function *func, int argc, lky_object **argv)
+{
+    void **locals = frame->locals;
+    long params = func->callable.argc;
+
+    long i;
+    for(i = 0; i < argc && i < params; i++)
+        locals[i] = argv[i];
+
+    for(; i < params; i++)
+        locals[i] = &lky_nil;
+
+    if(argc > params)
+    {
+        arraylist list = arr_create(argc - i + 1);
+        for(; i < argc; i++)
+            arr_append(&list, argv[i]);
+
+        locals[params] = stlarr_cinit(list);
+    }
+    else
+        locals[params] = &lky_nil;
+
+    if(func->refname)
+    {
+        locals[params + 1] = func->bound ? func->bound : &lky_nil;
+        func->bound = NULL;
+    }
+}
+
+// Lanky functions called from Lanky code run in the caller's mach_eval loop
+// rather than through lobjb_call_argv (see CALL_FUNC). Those that have been
+// compiled to native code are called through mach_run instead.
+#define mach_runs_inline_(obj) (!OBJ_IS_TAGGED(obj) && (obj)->type == LBI_FUNCTION && \
+        ((lky_object_function *)(obj))->callable.function == (lky_function_ptr)lobjb_default_callable && \
+        !((lky_object_function *)(obj))->code->jit)
+
+// Finishes a frame CALL_FUNC ran inline: the frame is popped, the arguments
+// are dropped from the caller's stack and the return value (or the error
+// the frame handed back) is passed on. Returns the caller.
+stackframe *mach_return_inline(stackframe *frame)
+{
+    mach_interp *interp = frame->interp;
+    stackframe *caller = frame->prev;
+    lky_object *ret = frame->ret;
+
+    caller->stack_pointer -= frame->call_argc;
+    mach_pop_frame(frame);
+
+    if(caller->thrown)
+    {
+        interp->error = caller->thrown;
+        caller->thrown = NULL;
+    }
+    else
+        push_node(caller, ret ? ret : &lky_nil);
+
+    return caller;
+}
+
+lky_object *mach_interrupt_exec(lky_object_function *func)
+{
+    mach_interp *interp = func->interp;
+    stackframe *curr = interp->stack;
+
+    stackframe *frame = mach_push_frame(interp, func);
+    if(!frame)
+        return &lky_nil;
+
+    frame->parent_stack = curr->parent_stack;
+    frame->bucket = mach_frame_bucket(curr);
     
-    gc_add_root_object((lky_object *)func);
+    func->parent_stack = frame->parent_stack;
     
     mach_eval(frame);
     
-    gc_remove_root_object((lky_object *)func);
-    
-    func->bucket = NULL;
     func->parent_stack = arr_create(1);
     
-    // Pop the stackframe.
-    interp->stack = interp->stack->prev;
-    if(interp->stack)
-        interp->stack->next = NULL;
-    
     lky_object *ret = &lky_nil;
     if(frame->stack_pointer > -1)
         ret = frame->data_stack[frame->stack_pointer];
+
+    mach_pop_frame(frame);
     
-    lky_object_error *err = (lky_object_error *)frame->prev->thrown;
+    lky_object_error *err = (lky_object_error *)curr->thrown;
     if(err)
     { 
-        char *txt = lobjb_stringify((lky_object *)err, frame->interp);
+        char *txt = lobjb_stringify((lky_object *)err, interp);
         printf("Interrupt caught exception.\n%s\n", txt);
         free(txt);
-        frame->prev->thrown = NULL;
+        curr->thrown = NULL;
         
         ret = &lky_nil;
     }
-
-    free(frame);
     
     return ret;
 }
 
-lky_object *mach_execute(lky_object_function *func)
+// Runs a frame pushed for a call from C and pops it again.
+lky_object *mach_run(stackframe *frame)
 {
-    mach_interp *interp = func->interp;
-    
-    lky_object_code *code = func->code;
-    stackframe *frame = malloc(sizeof(stackframe));
-    frame->parent_stack = func->parent_stack;
-    if(func->bucket)
-        frame->bucket = func->bucket;
-    else
-        frame->bucket = lobj_alloc();
-    frame->constants = code->constants;
-    frame->locals = code->locals;
-    frame->pc = -1;
-    frame->ops = code->ops;
-    frame->tape_len = code->op_len;
-    frame->stack_pointer = -1;
-    frame->stack_size = code->stack_size;
-    frame->names = code->names;
-    frame->ret = NULL;
-    frame->thrown = NULL;
-    frame->catch_pointer = 0;
-
-    frame->indices = code->indices;
-    
-    frame->interp = interp;
-    frame->locals_count = code->num_locals;
+    mach_interp *interp = frame->interp;
 
-    frame->impl_name = code->impl_name;
-    
-    // Setup stackframe with the previous stack
-    frame->prev = interp->stack ? interp->stack : NULL;
-    frame->next = NULL;
-    
-    if(interp->stack)
-        interp->stack->next = frame;
+    if(frame->func->code->jit)
+        mach_jit_run(frame);
     else
-        gc_add_func_stack(frame);
-    
-    interp->stack = frame;
-
-    void *stack[code->stack_size];
-    memset(stack, 0, sizeof(void *) * code->stack_size);
-    
-    int catch_stack[code->catch_size];
-    memset(catch_stack, 0, sizeof(int) * code->catch_size);
-
-    frame->data_stack = stack;
-    frame->catch_stack = catch_stack;
-
-    frame->catch_pointer = 0;
-
-    func->bucket = frame->bucket;
-
-    gc_add_root_object((lky_object *)func);
-
-    mach_eval(frame);
+        mach_eval(frame);
 
     // Poll the runtime callbacks if we have nothing else to do.
-    if(!interp->stack->prev)
+    if(!frame->prev)
     {
         rt_event *event;
         while((event = rt_next((runtime *)interp->rtime)))
         {
             lobjb_call(event->callback, event->args, interp);
-            if(interp->stack->thrown)
+            if(frame->thrown)
             {
-                char *errtxt = lobjb_stringify(interp->stack->thrown, interp);
+                char *errtxt = lobjb_stringify(frame->thrown, interp);
                 printf("Fatal error--\n%s\n\nHalting.\n", errtxt);
                 free(errtxt);
                 return NULL;
@@ -310,233 +749,293 @@ lky_object *mach_execute(lky_object_function *func)
         }
     }
 
-    gc_remove_root_object((lky_object *)func);
-    func->bucket = NULL;
-    
-    // Pop the stackframe.
-    interp->stack = interp->stack->prev;
-    if(interp->stack)
-        interp->stack->next = NULL;
-
     lky_object *ret = frame->ret;
-    free(frame);
+    mach_pop_frame(frame);
     return ret;
 }
 
-void mach_eval(stackframe *frame)
+// Runs a unit of top level code (a script or module). Its bucket is taken
+// from func so the caller can seed it (with dirname_, for example).
+lky_object *mach_execute(lky_object_function *func)
 {
-    struct interp *interp = frame->interp;
-#ifdef COMPUTED_GOTO
-static void *dispatch_table_[] = {
-    &&LI_BINARY_ADD, &&LI_BINARY_SUBTRACT, &&LI_BINARY_MULTIPLY, &&LI_BINARY_DIVIDE, 
-    &&LI_BINARY_MODULO, &&LI_BINARY_POWER, &&LI_BINARY_LT, &&LI_BINARY_GT, &&LI_BINARY_EQUAL, 
-    &&LI_BINARY_LTE, &&LI_BINARY_GTE, &&LI_BINARY_NE, &&LI_BINARY_AND, &&LI_BINARY_OR, 
-    &&LI_BINARY_NC, &&LI_BINARY_BAND, &&LI_BINARY_BOR, &&LI_BINARY_BXOR, &&LI_BINARY_BLSHIFT, 
-    &&LI_BINARY_BRSHIFT, &&LI_UNARY_NOT, &&LI_UNARY_NEGATIVE, &&LI_LOAD_CONST, &&LI_PRINT, 
-    &&LI_POP, &&LI_JUMP_FALSE, &&LI_JUMP_TRUE, &&LI_JUMP, &&LI_JUMP_FALSE_ELSE_POP, 
-    &&LI_JUMP_TRUE_ELSE_POP, &&LI_IGNORE, &&LI_SAVE_LOCAL, &&LI_LOAD_LOCAL, &&LI_PUSH_NIL, &&LI_PUSH_BOOL,
-    &&LI_PUSH_NEW_OBJECT, &&LI_CALL_FUNC, &&LI_RETURN, &&LI_LOAD_MEMBER, &&LI_SAVE_MEMBER, 
-    &&LI_MAKE_FUNCTION, &&LI_MAKE_CLASS, &&LI_SAVE_CLOSE, &&LI_LOAD_CLOSE, &&LI_MAKE_ARRAY, 
-    &&LI_MAKE_TABLE, &&LI_MAKE_OBJECT, &&LI_LOAD_INDEX, &&LI_SAVE_INDEX, &&LI_SDUPLICATE, 
-    &&LI_DDUPLICATE, &&LI_FLIP_TWO, &&LI_SINK_FIRST, &&LI_MAKE_ITER, &&LI_NEXT_ITER_OR_JUMP, 
-    &&LI_ITER_INDEX, &&LI_LOAD_MODULE, &&LI_PUSH_CATCH, &&LI_POP_CATCH, &&LI_RAISE
-};
-#else
-lky_instruction op;
-_opcode_whiplash_:
-    if(frame->pc >= frame->tape_len || frame->ret)
-        return;
-    if(interp->error)
-    {
-        lky_object_error *exc = (lky_object_error *)interp->error;
-        interp->error = NULL;
+    stackframe *frame = mach_push_frame(func->interp, func);
+    if(!frame)
+        return &lky_nil;
 
-        if(!frame->catch_pointer && !frame->prev)
-        {
-            char *errtxt = lobjb_stringify((lky_object *)exc, frame->interp);
-            printf("Fatal error on line %ld--\n%s\nTrace:\n===============\n", (long)OBJ_NUM_UNWRAP(arr_get(&exc->trace, 0)), errtxt);
-            int i;
-            for(i = 0; i < exc->trace.count; i += 2)
-            {
-                printf("%ld\t(%s)\n", (long)OBJ_NUM_UNWRAP(arr_get(&exc->trace, i)), (char *)arr_get(&exc->trace, i + 1));
-            }
+    frame->bucket = func->bucket;
+    return mach_run(frame);
+}
 
-            free(errtxt);
-            frame->ret = &lky_nil;
-            return;
-        }
-        else if(!frame->catch_pointer)
+// Calls func from native code.
+lky_object *mach_call(lky_object_function *func, int argc, lky_object **argv)
+{
+    stackframe *frame = mach_push_frame(func->interp, func);
+    if(!frame)
+        return &lky_nil;
+
+    mach_bind_args(frame, func, argc, argv);
+    return mach_run(frame);
+}
+
+// Handles a pending interp->error for the given frame. If the frame has a
+// catch block the exception is pushed and control moves to the handler;
+// otherwise the error is handed to the previous frame or, at the top level,
+// reported with its trace. Returns non-zero when the frame must stop
+// executing.
+int mach_unwind_error(stackframe *frame)
+{
+    mach_interp *interp = frame->interp;
+    lky_object_error *exc = (lky_object_error *)interp->error;
+    interp->error = NULL;
+
+    if(!frame->catch_pointer && !frame->prev)
+    {
+        char *errtxt = lobjb_stringify((lky_object *)exc, frame->interp);
+        printf("Fatal error on line %ld--\n%s\nTrace:\n===============\n", (long)OBJ_NUM_UNWRAP(arr_get(&exc->trace, 0)), errtxt);
+        int i;
+        for(i = 0; i < exc->trace.count; i += 2)
         {
-            frame->prev->thrown = (lky_object *)exc;
-            return;
+            printf("%ld\t(%s)\n", (long)OBJ_NUM_UNWRAP(arr_get(&exc->trace, i)), (char *)arr_get(&exc->trace, i + 1));
         }
 
-        PUSH(exc);
-        frame->pc = frame->catch_stack[--frame->catch_pointer];
+        free(errtxt);
+        frame->ret = &lky_nil;
+        return 1;
+    }
+    else if(!frame->catch_pointer)
+    {
+        frame->prev->thrown = (lky_object *)exc;
+        return 1;
     }
 
-    gc_gc();
+    // The handler starts from the stack its PUSH_CATCH saw, which is what
+    // the verifier assumed (see verify_bytecode).
+    int *entry = frame->catch_stack + 2 * --frame->catch_pointer;
+    while(frame->stack_pointer > entry[1])
+        frame->data_stack[frame->stack_pointer--] = NULL;
+
+    PUSH(exc);
+    frame->pc = entry[0];
+    return 0;
+}
+
+void mach_eval(stackframe *frame)
+{
+    struct interp *interp = frame->interp;
+#ifdef COMPUTED_GOTO
+    // Generated from the instruction list in instruction_set.h.
+    static void *dispatch_table_[] = {
+        LKY_INSTRUCTION_LIST(LKY_DISPATCH_ENTRY_)
+    };
+#else
+    lky_instruction op;
 #endif
+
+_opcode_whiplash_:
+    vmcheck_();
+
     vmvm(
-        vmop(LOAD_CONST,
-            unsigned int idx = *(unsigned int *)(frame->ops + (++frame->pc));
-            frame->pc += 3;
+        vmfast(LOAD_CONST,
+            unsigned int idx = vmarg_();
             lky_object *obj = frame->constants[idx];
             PUSH(obj);
         )
-        vmop(BINARY_ADD,
+        vmfast(BINARY_ADD,
             POP_TWO();
             lky_object *obj = lobjb_binary_add(b, a, interp);
 
             PUSH(obj);
+            vmraised_();
+            vmquicken_(frame->pc, LI_BINARY_ADD, b, a);
         )
-        vmop(BINARY_SUBTRACT,
+        vmfast(BINARY_ADD_INT,
+            vmquick_binary_(LI_BINARY_ADD, OBJ_IS_TAGGED_INT, lobjb_build_int(OBJ_INT_UNWRAP(b) + OBJ_INT_UNWRAP(a)));
+        )
+        vmfast(BINARY_ADD_FLOAT,
+            vmquick_binary_(LI_BINARY_ADD, OBJ_IS_FLONUM, lobjb_build_float(OBJ_FLOAT_UNWRAP(b) + OBJ_FLOAT_UNWRAP(a)));
+        )
+        vmfast(BINARY_SUBTRACT,
             POP_TWO();
             lky_object *obj = lobjb_binary_subtract(b, a, interp);
 
             PUSH(obj);
+            vmraised_();
+            vmquicken_(frame->pc, LI_BINARY_SUBTRACT, b, a);
+        )
+        vmfast(BINARY_SUBTRACT_INT,
+            vmquick_binary_(LI_BINARY_SUBTRACT, OBJ_IS_TAGGED_INT, lobjb_build_int(OBJ_INT_UNWRAP(b) - OBJ_INT_UNWRAP(a)));
         )
-        vmop(BINARY_MULTIPLY,
+        vmfast(BINARY_SUBTRACT_FLOAT,
+            vmquick_binary_(LI_BINARY_SUBTRACT, OBJ_IS_FLONUM, lobjb_build_float(OBJ_FLOAT_UNWRAP(b) - OBJ_FLOAT_UNWRAP(a)));
+        )
+        vmfast(BINARY_MULTIPLY,
             POP_TWO();
             lky_object *obj = lobjb_binary_multiply(b, a, interp);
 
             PUSH(obj);
+            vmraised_();
+            vmquicken_(frame->pc, LI_BINARY_MULTIPLY, b, a);
+        )
+        vmfast(BINARY_MULTIPLY_INT,
+            vmquick_binary_(LI_BINARY_MULTIPLY, OBJ_IS_TAGGED_INT, lobjb_build_int(OBJ_INT_UNWRAP(b) * OBJ_INT_UNWRAP(a)));
+        )
+        vmfast(BINARY_MULTIPLY_FLOAT,
+            vmquick_binary_(LI_BINARY_MULTIPLY, OBJ_IS_FLONUM, lobjb_build_float(OBJ_FLOAT_UNWRAP(b) * OBJ_FLOAT_UNWRAP(a)));
         )
-        vmop(BINARY_DIVIDE,
+        vmfast(BINARY_DIVIDE,
             POP_TWO();
             lky_object *obj = lobjb_binary_divide(b, a, interp);
 
             PUSH(obj);
+            vmraised_();
         )
-        vmop(BINARY_MODULO,
+        vmfast(BINARY_MODULO,
             POP_TWO();
             lky_object *obj = lobjb_binary_modulo(b, a, interp);
 
             PUSH(obj);
+            vmraised_();
         )
-        vmop(BINARY_POWER,
+        vmfast(BINARY_POWER,
             POP_TWO();
             lky_object *obj = lobjb_binary_power(b, a, interp);
 
             PUSH(obj);
+            vmraised_();
         )
-        vmop(BINARY_LT,
+        vmfast(BINARY_LT,
             POP_TWO();
             lky_object *obj = lobjb_binary_lessthan(b, a, interp);
 
             PUSH(obj);
+            vmraised_();
         )
-        vmop(BINARY_GT,
+        vmfast(BINARY_GT,
             POP_TWO();
             lky_object *obj = lobjb_binary_greaterthan(b, a, interp);
 
             PUSH(obj);
+            vmraised_();
         )
-        vmop(BINARY_LTE,
+        vmfast(BINARY_LTE,
             POP_TWO();
             lky_object *obj = lobjb_binary_lessequal(b, a, interp);
 
             PUSH(obj);
+            vmraised_();
         )
-        vmop(BINARY_GTE,
+        vmfast(BINARY_GTE,
             POP_TWO();
             lky_object *obj = lobjb_binary_greatequal(b, a, interp);
 
             PUSH(obj);
+            vmraised_();
         )
-        vmop(BINARY_EQUAL,
+        vmfast(BINARY_EQUAL,
             POP_TWO();
             lky_object *obj = lobjb_binary_equals(b, a, interp);
 
             PUSH(obj);
+            vmraised_();
         )
-        vmop(BINARY_NE,
+        vmfast(BINARY_NE,
             POP_TWO();
             lky_object *obj = lobjb_binary_notequal(b, a, interp);
 
             PUSH(obj);
+            vmraised_();
         )
-        vmop(BINARY_AND,
+        vmfast(BINARY_AND,
             POP_TWO();
             lky_object *obj = lobjb_binary_and(b, a, interp);
 
             PUSH(obj);
+            vmraised_();
         )
-        vmop(BINARY_OR,
+        vmfast(BINARY_OR,
             POP_TWO();
             lky_object *obj = lobjb_binary_or(b, a, interp);
 
             PUSH(obj);
+            vmraised_();
         )
-        vmop(BINARY_NC,
+        vmfast(BINARY_NC,
             POP_TWO();
             lky_object *obj = lobjb_binary_nc(b, a, interp);
 
             PUSH(obj);
+            vmraised_();
         )
-        vmop(BINARY_BAND,
+        vmfast(BINARY_BAND,
             POP_TWO();
             lky_object *obj = lobjb_binary_band(b, a, interp);
 
             PUSH(obj);
+            vmraised_();
         )
-        vmop(BINARY_BOR,
+        vmfast(BINARY_BOR,
             POP_TWO();
             lky_object *obj = lobjb_binary_bor(b, a, interp);
 
             PUSH(obj);
+            vmraised_();
         )
-        vmop(BINARY_BXOR,
+        vmfast(BINARY_BXOR,
             POP_TWO();
             lky_object *obj = lobjb_binary_bxor(b, a, interp);
 
             PUSH(obj);
+            vmraised_();
         )
-        vmop(BINARY_BLSHIFT,
+        vmfast(BINARY_BLSHIFT,
             POP_TWO();
             lky_object *obj = lobjb_binary_blshift(b, a, interp);
 
             PUSH(obj);
+            vmraised_();
         )
-        vmop(BINARY_BRSHIFT,
+        vmfast(BINARY_BRSHIFT,
             POP_TWO();
             lky_object *obj = lobjb_binary_brshift(b, a, interp);
 
             PUSH(obj);
+            vmraised_();
         )
-        vmop(UNARY_NOT,
+        vmfast(UNARY_NOT,
             lky_object *a = POP();
             lky_object *obj = lobjb_unary_not(a, frame->interp);
 
             PUSH(obj);
+            vmraised_();
         )
-        vmop(UNARY_NEGATIVE,
+        vmfast(UNARY_NEGATIVE,
             lky_object *a = POP();
             lky_object *obj = lobjb_unary_negative(a);
 
             PUSH(obj);
+            vmraised_();
         )
-        vmop(PRINT,
+        vmfast(PRINT,
             lky_object *a = POP();
             lobjb_print(a, frame->interp);
+            vmraised_();
         )
-        vmop(POP,
+        vmfast(POP,
             POP();
         )
-        vmop(JUMP,
-            unsigned int idx = *(unsigned int *)(frame->ops + (++frame->pc));
-            frame->pc += 3;
-
-            if(!idx)
-                frame->pc = -1;
-            else
-                frame->pc = idx < frame->pc ? idx - 1 : idx;
+        vmfast(JUMP,
+            long at = frame->pc;
+            long idx = vmarg_();
+            frame->pc = idx;
+
+            // Backward jumps close loops, so they are safepoints.
+            if(idx < at)
+                vmbreak_();
         )
-        vmop(JUMP_FALSE,
+        vmfast(JUMP_FALSE,
             lky_object *obj = POP();
             
-            unsigned int idx = *(unsigned int *)(frame->ops + (++frame->pc));
-            frame->pc += 3;
+            long idx = vmarg_();
 
             /*
             char needs_jump = 0;
@@ -550,11 +1049,59 @@ _opcode_whiplash_:
             if(!LKY_CTEST_FAST(obj))
                 frame->pc = idx;
         )
-        vmop(JUMP_FALSE_ELSE_POP,
+        vmfast(BINARY_JUMP_FALSE,
+            long at = frame->pc;
+            POP_TWO();
+            lky_instruction bop = vmarg_();
+            long idx = vmarg_();
+
+            lky_object *obj = mach_binary_op(bop, b, a, interp);
+            vmraised_();
+            vmquicken_(at, bop, b, a);
+
+            if(!LKY_CTEST_FAST(obj))
+                frame->pc = idx;
+        )
+        vmfast(BINARY_JUMP_FALSE_INT,
+            long at = frame->pc;
+            lky_object *a = TOP();
+            lky_object *b = SECOND_TOP();
+            lky_instruction bop = vmarg_();
+            long idx = vmarg_();
+
+            lky_object *obj;
+            if(!OBJ_IS_TAGGED_INT(a) || !OBJ_IS_TAGGED_INT(b) ||
+                    !(obj = lobjb_binary_int_op(bop, OBJ_INT_UNWRAP(b), OBJ_INT_UNWRAP(a))))
+                vmdeopt_(at, LI_BINARY_JUMP_FALSE);
+
+            frame->data_stack[frame->stack_pointer--] = NULL;
+            frame->data_stack[frame->stack_pointer--] = NULL;
+
+            if(!LKY_CTEST_FAST(obj))
+                frame->pc = idx;
+        )
+        vmfast(BINARY_JUMP_FALSE_FLOAT,
+            long at = frame->pc;
+            lky_object *a = TOP();
+            lky_object *b = SECOND_TOP();
+            lky_instruction bop = vmarg_();
+            long idx = vmarg_();
+
+            lky_object *obj;
+            if(!OBJ_IS_FLONUM(a) || !OBJ_IS_FLONUM(b) ||
+                    !(obj = lobjb_binary_float_op(bop, OBJ_FLOAT_UNWRAP(b), OBJ_FLOAT_UNWRAP(a))))
+                vmdeopt_(at, LI_BINARY_JUMP_FALSE);
+
+            frame->data_stack[frame->stack_pointer--] = NULL;
+            frame->data_stack[frame->stack_pointer--] = NULL;
+
+            if(!LKY_CTEST_FAST(obj))
+                frame->pc = idx;
+        )
+        vmfast(JUMP_FALSE_ELSE_POP,
             lky_object *obj = TOP();
 
-            unsigned int idx = *(unsigned int *)(frame->ops + (++frame->pc));
-            frame->pc += 3;
+            long idx = vmarg_();
 
             /*
             char needs_jump = 0;
@@ -569,11 +1116,10 @@ _opcode_whiplash_:
             else
                 POP();
         )
-        vmop(JUMP_TRUE_ELSE_POP,
+        vmfast(JUMP_TRUE_ELSE_POP,
             lky_object *obj = TOP();
 
-            unsigned int idx = *(unsigned int *)(frame->ops + (++frame->pc));
-            frame->pc += 3;
+            long idx = vmarg_();
 
             /*
             char needs_jump = 0;
@@ -589,107 +1135,101 @@ _opcode_whiplash_:
                 POP();
 
         )
-        vmop(SAVE_LOCAL,
+        vmfast(SAVE_LOCAL,
             lky_object *obj = TOP();
-            unsigned int idx = *(unsigned int *)(frame->ops + (++frame->pc));
-            frame->pc += 3;
+            unsigned int idx = vmarg_();
 
             frame->locals[idx] = obj;
         )
-        vmop(LOAD_LOCAL,
-            unsigned int idx = *(unsigned int *)(frame->ops + (++frame->pc));
-            frame->pc += 3;
+        vmfast(SAVE_LOCAL_POP,
+            unsigned int idx = vmarg_();
+
+            frame->locals[idx] = POP();
+        )
+        vmfast(LOAD_LOCAL,
+            unsigned int idx = vmarg_();
             lky_object *obj = frame->locals[idx];
             PUSH(obj);
         )
-        vmop(PUSH_NIL,
+        vmfast(PUSH_NIL,
             PUSH(&lky_nil);
         )
-        vmop(PUSH_BOOL,
-            PUSH(LKY_TESTC_FAST(frame->ops[++frame->pc]));
+        vmfast(PUSH_BOOL,
+            PUSH(LKY_TESTC_FAST(vmarg_()));
         )
         vmop(PUSH_NEW_OBJECT,
             PUSH(lobj_alloc());
         )
         vmop(CALL_FUNC,
-            char ct = frame->ops[++frame->pc];
+            char ct = vmarg_();
             lky_object *obj = POP();
 
-            lky_object_seq *seq = NULL;
-            lky_object_seq *first = NULL;
-            int i;
-            for(i = 0; i < ct; i++)
-            {
-                lky_object *arg = POP();
-                lky_object_seq *ns = lobjb_make_seq_node(arg);
+            // The arguments are passed in place and stay on the stack (and
+            // so reachable) until the call returns.
+            lky_object **argv = (lky_object **)frame->data_stack + frame->stack_pointer - ct + 1;
 
-                if(!seq)
-                {
-                    seq = ns;
-                    gc_add_root_object((lky_object *)seq);
-                    first = seq;
-                }
-                else
+            if(mach_runs_inline_(obj))
+            {
+                stackframe *callee = mach_push_frame(interp, (lky_object_function *)obj);
+                if(!callee)
                 {
-                    ns->next = seq;
-                    seq = ns;
+                    frame->stack_pointer -= ct;
+                    vmbreak_();
                 }
+
+                mach_bind_args(callee, (lky_object_function *)obj, ct, argv);
+                callee->call_argc = ct;
+                frame = callee;
+                vmbreak_();
             }
 
-            lky_object *ret = lobjb_call(obj, seq, frame->interp);
+            lky_object *ret = lobjb_call_argv(obj, ct, argv, frame->interp);
+            frame->stack_pointer -= ct;
             if(frame->thrown)
             {
                 interp->error = frame->thrown;
                 frame->thrown = NULL;
-                dispatch_();
+                vmbreak_();
             }
 
-            if(seq)
-                gc_remove_root_object((lky_object *)first);
-
             PUSH(ret);
         )
         vmop(RETURN,
             lky_object *obj = POP();
             frame->ret = obj;
         )
-        vmop(LOAD_MEMBER,
+        vmfast(LOAD_MEMBER,
             lky_object *obj = POP();
 
-            unsigned int idx = *(unsigned int *)(frame->ops + (++frame->pc));
-            frame->pc += 3;
-            char *name = frame->names[idx];
-
-            if(obj == &lky_nil || obj == &lky_yes || obj == &lky_no || OBJ_IS_NUMBER(obj))
-            {
-                char str[200 + strlen(name)];
-                sprintf(str, "Requesting member '%s' from memberless-object.", name);
-                interp->error = lobjb_build_error(obj == &lky_nil ? "NullPointer" : "InvalidType", str, interp);
-                dispatch_();
-            }
+            unsigned int idx = vmarg_();
+            unsigned int cidx = vmarg_();
 
-            lky_object *val = lobj_get_member(obj, name);
-            
+            lky_object *val = mach_load_member(frame, obj, frame->names[idx], frame->member_caches + cidx);
             if(!val)
-            {
-                char str[200 + strlen(name)];
-                sprintf(str, "Object has no member named '%s'.", name);
-                interp->error = lobjb_build_error("UndeclaredIdentifier", str, interp);
-                dispatch_();
-            }
+                vmbreak_();
+
+            PUSH(val);
+        )
+        vmfast(LOAD_LOCAL_MEMBER,
+            unsigned int lidx = vmarg_();
+            unsigned int idx = vmarg_();
+            unsigned int cidx = vmarg_();
 
+            lky_object *val = mach_load_member(frame, frame->locals[lidx], frame->names[idx], frame->member_caches + cidx);
+            if(!val)
+                vmbreak_();
 
             PUSH(val);
         )
-        vmop(SAVE_MEMBER,
+        vmfast(SAVE_MEMBER,
             lky_object *obj = POP();
             lky_object *val = TOP();
 
-            unsigned int idx = *(unsigned int *)(frame->ops + (++frame->pc));
-            frame->pc += 3;
+            unsigned int idx = vmarg_();
             char *name = frame->names[idx];
+            unsigned int cidx = vmarg_();
 
-            lobj_set_member(obj, name, val);
+            lobj_set_member_cached(obj, name, val, frame->member_caches + cidx);
 
         )
         vmop(MAKE_FUNCTION,
@@ -705,16 +1245,16 @@ _opcode_whiplash_:
                 arr_append(&nplist, obk);
             }
 
-            arr_append(&nplist, frame->bucket);
+            arr_append(&nplist, mach_frame_bucket(frame));
 
-            char argc = frame->ops[++frame->pc];
+            char argc = vmarg_();
             lky_object *func = lobjb_build_func(code, argc, nplist, frame->interp);
 
             PUSH(func);
         )
         vmop(MAKE_CLASS,
-            int count = frame->ops[++frame->pc];
-            int has_init = frame->ops[++frame->pc];
+            int count = vmarg_();
+            int has_init = vmarg_();
 
             lky_object *init = has_init & 1 ? POP() : NULL;
             lky_object *super = has_init & 2 ? POP() : NULL;
@@ -724,9 +1264,8 @@ _opcode_whiplash_:
             int i;
             for(i = 0; i < count; i++)
             {
-                lky_class_prefix prfx = frame->ops[++frame->pc];
-                unsigned int idx = *(unsigned int *)(frame->ops + (++frame->pc));
-                frame->pc += 3;
+                lky_class_prefix prfx = vmarg_();
+                unsigned int idx = vmarg_();
                 
                 char *name = frame->names[idx];
                 clb_add_member(cls, name, POP(), prfx);
@@ -734,66 +1273,29 @@ _opcode_whiplash_:
 
             PUSH(cls);
         )
-        vmop(SAVE_CLOSE,
+        vmfast(SAVE_CLOSE,
             lky_object *obj = TOP();
-            unsigned int idx = *(unsigned int *)(frame->ops + (++frame->pc));
-            frame->pc += 3;
-
-            char *name = frame->names[idx];
-
-            lky_object *bk = NULL;
-            arraylist ps = frame->parent_stack;
-
-            int i;
-            for(i = (int)ps.count - 1; i >= 0 && !bk; i--)
-            {
-                lky_object *n = arr_get(&ps, i);
-                if(lobj_get_member(n, name))
-                {
-                    bk = n;
-                }
-            }
-
-            if(!bk)
-                bk = frame->bucket;
+            unsigned int idx = vmarg_();
 
-            lobj_set_member(bk, name, obj);
-            
+            mach_save_close(frame, frame->names[idx], obj);
         )
-        vmop(LOAD_CLOSE,
-            unsigned int idx = *(unsigned int *)(frame->ops + (++frame->pc));
-            frame->pc += 3;
-            char *name = frame->names[idx];
+        vmfast(BIND_CLOSE,
+            unsigned int lidx = vmarg_();
+            unsigned int idx = vmarg_();
 
-            lky_object *bk = NULL;
-            lky_object *obj = NULL;
-            arraylist ps = frame->parent_stack;
+            lobj_set_member_sym(mach_frame_bucket(frame), frame->names[idx], frame->locals[lidx]);
+        )
+        vmfast(LOAD_CLOSE,
+            unsigned int idx = vmarg_();
 
-            if(!(obj = lobj_get_member(frame->bucket, name)))
-            {
-                int i;
-                for(i = (int)ps.count - 1; i >= 0 && !bk; i--)
-                {
-                    lky_object *n = arr_get(&ps, i);
-                    if((obj = lobj_get_member(n, name)))
-                    {
-                        bk = n;
-                    }
-                }
-            }
+            lky_object *obj = mach_load_close(frame, frame->names[idx]);
+            if(!obj)
+                vmbreak_();
 
-            if(obj)
-                PUSH(obj);
-            else
-            {
-                char str[200 + strlen(name)];
-                sprintf(str, "Could not load closure variable '%s'.", name);
-                interp->error = lobjb_build_error("UndeclaredIdentifier", str, interp);
-            }
+            PUSH(obj);
         )
         vmop(MAKE_ARRAY,
-            unsigned int ct = *(unsigned int *)(frame->ops + (++frame->pc));
-            frame->pc += 3;
+            unsigned int ct = vmarg_();
 
             arraylist arr = arr_create(ct + 10);
 
@@ -811,9 +1313,20 @@ _opcode_whiplash_:
             PUSH(outobj);
 
         )
+        vmop(CONCAT,
+            unsigned int ct = vmarg_();
+
+            lky_object *obj = stlstr_concat((lky_object **)frame->data_stack + frame->stack_pointer - ct + 1, ct, interp);
+
+            int i;
+            for(i = 0; i < ct; i++)
+                frame->data_stack[frame->stack_pointer - i] = NULL;
+            frame->stack_pointer -= ct;
+
+            PUSH(obj);
+        )
         vmop(MAKE_TABLE,
-            unsigned int ct = *(unsigned int *)(frame->ops + (++frame->pc));
-            frame->pc += 3;
+            unsigned int ct = vmarg_();
 
             arraylist keys = arr_create(ct + 1);
             arraylist vals = arr_create(ct + 1);
@@ -840,42 +1353,41 @@ _opcode_whiplash_:
 
         )
         vmop(MAKE_OBJECT,
-            int ct = *(unsigned int *)(frame->ops + (++frame->pc));
-            frame->pc += 3;
+            int ct = vmarg_();
 
             lky_object *obj = POP();
 
             while(0 <=-- ct)
             {
                 lky_object *member = POP();
-                unsigned int idx = *(unsigned int *)(frame->ops + (++frame->pc));
-                frame->pc += 3;
+                unsigned int idx = vmarg_();
                 char *name = frame->names[idx];
-                lobj_set_member(obj, name, member);
+                lobj_set_member_sym(obj, name, member);
             }
              
             PUSH(obj);   
 
         )
-        vmop(LOAD_INDEX,
+        vmfast(LOAD_INDEX,
             lky_object *idx = POP();
             lky_object *targ = POP();
 
             PUSH(lobjb_unary_load_index(targ, idx, frame->interp));
+            vmraised_();
         )
-        vmop(SAVE_INDEX,
+        vmfast(SAVE_INDEX,
             lky_object *idx = POP();
             lky_object *targ = POP();
             lky_object *nobj = TOP();
 
             lobjb_unary_save_index(targ, idx, nobj, frame->interp);
-
+            vmraised_();
         )
-        vmop(SDUPLICATE,
+        vmfast(SDUPLICATE,
             PUSH(TOP());
             
         )
-        vmop(DDUPLICATE,
+        vmfast(DDUPLICATE,
             lky_object *topa = TOP();
             lky_object *topb = SECOND_TOP();
             
@@ -883,7 +1395,7 @@ _opcode_whiplash_:
             PUSH(topa);
             
         )
-        vmop(FLIP_TWO,
+        vmfast(FLIP_TWO,
             lky_object *topa = POP();
             lky_object *topb = POP();
             
@@ -891,7 +1403,7 @@ _opcode_whiplash_:
             PUSH(topb);
             
         )
-        vmop(SINK_FIRST,
+        vmfast(SINK_FIRST,
             lky_object *topa = POP();
             lky_object *topb = POP();
             lky_object *topc = POP();
@@ -908,36 +1420,32 @@ _opcode_whiplash_:
             PUSH(it);
 
         )
-        vmop(NEXT_ITER_OR_JUMP,
+        vmfast(NEXT_ITER_OR_JUMP,
             lky_object *it = TOP();
             lky_object *nxt = LKY_NEXT_ITERABLE(it);
 
             if(nxt)
             {
                 PUSH(nxt);
-                frame->pc += 4;
+                frame->pc++;
             }
             else
             {
-                unsigned int idx = *(unsigned int *)(frame->ops + (++frame->pc));
-                frame->pc += 3;
-
-                if(!idx)
-                    frame->pc = -1;
-                else
-                    frame->pc = idx < frame->pc ? idx - 1 : idx;
+                // Some iterators raise instead of ending (see stl_table.c).
+                vmraised_();
+                long idx = vmarg_();
+                frame->pc = idx;
             }
 
         )
-        vmop(ITER_INDEX,
+        vmfast(ITER_INDEX,
             lky_object *it = TOP();
             lky_object_iterable *i = (lky_object_iterable *)it;
             PUSH(lobjb_build_int(i->index - 1));
 
         )
         vmop(LOAD_MODULE,
-            unsigned int idx = *(unsigned int *)(frame->ops + (++frame->pc));
-            frame->pc += 3;
+            unsigned int idx = vmarg_();
             char *name = frame->names[idx];
 
             lky_object *bk = NULL;
@@ -964,24 +1472,171 @@ _opcode_whiplash_:
             PUSH(loaded);
 
         )
-        vmop(PUSH_CATCH,
-            unsigned int idx = *(unsigned int *)(frame->ops + (++frame->pc));
-            frame->pc += 3;
+        vmfast(PUSH_CATCH,
+            // The handler's pc and the depth of the data stack to restore
+            // before entering it (see mach_unwind_error).
+            int *entry = frame->catch_stack + 2 * frame->catch_pointer++;
+            entry[0] = vmarg_();
+            entry[1] = (int)frame->stack_pointer;
+        )
+        vmfast(POP_CATCH,
+            frame->catch_pointer--;
+        )
+        vmfast(REG_BINARY,
+            long at = frame->pc;
+            lky_instruction bop = vmarg_();
+            unsigned int lhs = vmarg_();
+            unsigned int rhs = vmarg_();
+            unsigned int dst = vmarg_();
+
+            lky_object *l = REG_OPERAND(lhs);
+            lky_object *r = REG_OPERAND(rhs);
+            lky_object *obj = mach_binary_op(bop, l, r, interp);
+            vmraised_();
+            vmquicken_(at, bop, l, r);
+
+            frame->locals[dst] = obj;
+        )
+        vmfast(REG_BINARY_INT,
+            long at = frame->pc;
+            lky_instruction bop = vmarg_();
+            unsigned int lhs = vmarg_();
+            unsigned int rhs = vmarg_();
+            unsigned int dst = vmarg_();
+
+            lky_object *l = REG_OPERAND(lhs);
+            lky_object *r = REG_OPERAND(rhs);
+            lky_object *obj;
+            if(!OBJ_IS_TAGGED_INT(l) || !OBJ_IS_TAGGED_INT(r) ||
+                    !(obj = lobjb_binary_int_op(bop, OBJ_INT_UNWRAP(l), OBJ_INT_UNWRAP(r))))
+                vmdeopt_(at, LI_REG_BINARY);
+
+            frame->locals[dst] = obj;
+        )
+        vmfast(REG_BINARY_FLOAT,
+            long at = frame->pc;
+            lky_instruction bop = vmarg_();
+            unsigned int lhs = vmarg_();
+            unsigned int rhs = vmarg_();
+            unsigned int dst = vmarg_();
+
+            lky_object *l = REG_OPERAND(lhs);
+            lky_object *r = REG_OPERAND(rhs);
+            lky_object *obj;
+            if(!OBJ_IS_FLONUM(l) || !OBJ_IS_FLONUM(r) ||
+                    !(obj = lobjb_binary_float_op(bop, OBJ_FLOAT_UNWRAP(l), OBJ_FLOAT_UNWRAP(r))))
+                vmdeopt_(at, LI_REG_BINARY);
+
+            frame->locals[dst] = obj;
+        )
+        vmfast(REG_BINARY_PUSH,
+            long at = frame->pc;
+            lky_instruction bop = vmarg_();
+            unsigned int lhs = vmarg_();
+            unsigned int rhs = vmarg_();
+
+            lky_object *l = REG_OPERAND(lhs);
+            lky_object *r = REG_OPERAND(rhs);
+            lky_object *obj = mach_binary_op(bop, l, r, interp);
 
-            frame->catch_stack[frame->catch_pointer++] = idx;
+            PUSH(obj);
+            vmraised_();
+            vmquicken_(at, bop, l, r);
+        )
+        vmfast(REG_BINARY_PUSH_INT,
+            long at = frame->pc;
+            lky_instruction bop = vmarg_();
+            unsigned int lhs = vmarg_();
+            unsigned int rhs = vmarg_();
+
+            lky_object *l = REG_OPERAND(lhs);
+            lky_object *r = REG_OPERAND(rhs);
+            lky_object *obj;
+            if(!OBJ_IS_TAGGED_INT(l) || !OBJ_IS_TAGGED_INT(r) ||
+                    !(obj = lobjb_binary_int_op(bop, OBJ_INT_UNWRAP(l), OBJ_INT_UNWRAP(r))))
+                vmdeopt_(at, LI_REG_BINARY_PUSH);
+
+            vmpush_or_branch_(obj);
+        )
+        vmfast(REG_BINARY_PUSH_FLOAT,
+            long at = frame->pc;
+            lky_instruction bop = vmarg_();
+            unsigned int lhs = vmarg_();
+            unsigned int rhs = vmarg_();
+
+            lky_object *l = REG_OPERAND(lhs);
+            lky_object *r = REG_OPERAND(rhs);
+            lky_object *obj;
+            if(!OBJ_IS_FLONUM(l) || !OBJ_IS_FLONUM(r) ||
+                    !(obj = lobjb_binary_float_op(bop, OBJ_FLOAT_UNWRAP(l), OBJ_FLOAT_UNWRAP(r))))
+                vmdeopt_(at, LI_REG_BINARY_PUSH);
+
+            vmpush_or_branch_(obj);
+        )
+        vmfast(FOR_RANGE,
+            lky_instruction cop = vmarg_();
+            unsigned int ctr = vmarg_();
+            unsigned int bound = vmarg_();
+            long idx = vmarg_();
+
+            lky_object *l = frame->locals[ctr];
+            lky_object *r = REG_OPERAND(bound);
+            lky_object *obj;
+            if(OBJ_IS_TAGGED_INT(l) && OBJ_IS_TAGGED_INT(r))
+                obj = lobjb_binary_int_op(cop, OBJ_INT_UNWRAP(l), OBJ_INT_UNWRAP(r));
+            else
+            {
+                obj = mach_binary_op(cop, l, r, interp);
+                vmraised_();
+            }
 
+            if(!LKY_CTEST_FAST(obj))
+                frame->pc = idx;
         )
-        vmop(POP_CATCH,
-            frame->catch_stack[frame->catch_pointer--] = 0;
+        vmfast(FOR_STEP,
+            lky_instruction sop = vmarg_();
+            lky_instruction cop = vmarg_();
+            unsigned int ctr = vmarg_();
+            unsigned int by = vmarg_();
+            unsigned int bound = vmarg_();
+            long idx = vmarg_();
+
+            // The counter stays a tagged integer as long as the step and
+            // the bound are; anything else takes the generic operations.
+            lky_object *l = frame->locals[ctr];
+            lky_object *k = REG_OPERAND(by);
+            lky_object *r = REG_OPERAND(bound);
+            lky_object *obj;
+            if(OBJ_IS_TAGGED_INT(l) && OBJ_IS_TAGGED_INT(k) && OBJ_IS_TAGGED_INT(r))
+            {
+                long x = sop == LI_BINARY_ADD ? OBJ_INT_UNWRAP(l) + OBJ_INT_UNWRAP(k) : OBJ_INT_UNWRAP(l) - OBJ_INT_UNWRAP(k);
+                frame->locals[ctr] = lobjb_build_int(x);
+                obj = lobjb_binary_int_op(cop, x, OBJ_INT_UNWRAP(r));
+            }
+            else
+            {
+                obj = mach_binary_op(sop, l, k, interp);
+                vmraised_();
+                frame->locals[ctr] = obj;
+                obj = mach_binary_op(cop, obj, r, interp);
+                vmraised_();
+            }
+
+            // Going round again closes the loop, so it is a safepoint.
+            if(LKY_CTEST_FAST(obj))
+            {
+                frame->pc = idx;
+                vmbreak_();
+            }
         )
         vmop(RAISE,
             interp->error = lobjb_build_error("", "", interp);
             lobj_set_member(interp->error, "custom_", POP());
         )
         // Unused...
-        vmop(IGNORE,
+        vmfast(IGNORE,
         )
-        vmop(JUMP_TRUE,
+        vmfast(JUMP_TRUE,
         )
     )
 }
@@ -21,8 +21,22 @@
 
 #include "lkyobj_builtin.h"
 #include "arraylist.h"
+#include "instruction_set.h"
 
 struct interp;
+struct lky_object_function;
+
+// The number of slots in a segment of the value stack (see
+// mach_stack_alloc).
+#define MACH_SEGMENT_SLOTS 65536
+
+typedef struct mach_stack_segment {
+    struct mach_stack_segment *prev;
+    struct mach_stack_segment *next;
+    long size;
+    long top;
+    void *slots[];
+} mach_stack_segment;
 
 typedef struct stackframe {
     struct stackframe *next;
@@ -36,8 +50,9 @@ typedef struct stackframe {
     void **data_stack;
     int *catch_stack;
     char **names;
+    lky_member_cache *member_caches;
     long pc;
-    unsigned char *ops;
+    int *ops; // The code's decoded tape (see decode_bytecode)
     long tape_len;
     
     struct interp *interp;
@@ -51,6 +66,10 @@ typedef struct stackframe {
     lky_object *thrown;
 
     char *impl_name;
+
+    struct lky_object_function *func;
+    long slot_count; // Slots taken from the value stack
+    int call_argc; // Arguments CALL_FUNC pops when an inline frame returns; -1 if called from C
 } stackframe;
 
 typedef struct interp {
@@ -58,16 +77,41 @@ typedef struct interp {
     hashtable stdlib;
     lky_object *error;
     void *rtime;
+
+    stackframe *free_frames;
+    mach_stack_segment *segment;
+    mach_stack_segment *spare;
+    int depth;
+    char *native_base; // Where the first frame was pushed on the native stack
 } mach_interp;
 
+extern int mach_max_depth_;
+extern int mach_quickening_;
+
 typedef struct lky_object_function lky_object_function;
 
 mach_interp mach_make_interp();
 
 lky_object *mach_interrupt_exec(lky_object_function *func);
 lky_object *mach_execute(lky_object_function *func);
+lky_object *mach_call(lky_object_function *func, int argc, lky_object **argv);
+lky_object *mach_frame_bucket(stackframe *frame);
 void mach_halt_with_err(lky_object *err);
 void mach_throw(lky_object *err, mach_interp *interp);
 arraylist mach_build_trace(mach_interp *interp);
 
+// Shared by mach_eval and the native code from mach_jit.c.
+void push_node(stackframe *frame, void *data);
+void *pop_node(stackframe *frame);
+void *top_node(stackframe *frame);
+int mach_unwind_error(stackframe *frame);
+lky_object *mach_binary_op(lky_instruction op, lky_object *a, lky_object *b, struct interp *interp);
+lky_object *mach_load_member(stackframe *frame, lky_object *obj, char *name, lky_member_cache *cache);
+lky_object *mach_load_close(stackframe *frame, char *name);
+void mach_save_close(stackframe *frame, char *name, lky_object *obj);
+
+#ifdef LKY_PROFILE_OPS
+void mach_profile_report();
+#endif
+
 #endif
@@ -23,13 +23,14 @@
 #include "stl_object.h"
 #include "stl_table.h"
 #include "aquarium.h"
+#include "lky_symbol.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-lky_object lky_nil = {LBI_NIL, 0, NULL, {0, 0, 0, NULL}, NULL, {0, NULL}};
-lky_object lky_yes = {LBI_BOOL, 1, NULL, {0, 0, 0, NULL}, NULL, {0, NULL}};
-lky_object lky_no = {LBI_BOOL, 1, NULL, {0, 0, 0, NULL}, NULL, {0, NULL}};
+lky_object lky_nil = {LBI_NIL, 0, NULL, {NULL, NULL, NULL}, NULL, {0, NULL}};
+lky_object lky_yes = {LBI_BOOL, 1, NULL, {NULL, NULL, NULL}, NULL, {0, NULL}};
+lky_object lky_no = {LBI_BOOL, 1, NULL, {NULL, NULL, NULL}, NULL, {0, NULL}};
 
 int alloced = 0;
 lky_object *lobj_alloc()
@@ -37,51 +38,253 @@ lky_object *lobj_alloc()
     lky_object *obj = aqua_request_next_block(sizeof(lky_object));
     obj->type = LBI_CUSTOM;
     obj->mem_count = 0;
-    obj->members = hst_create();
-    obj->members.duplicate_keys = 1;
+    shp_members_init(&obj->members);
     gc_add_object(obj);
 
     stlobj_seed(obj);
     return obj;
 }
 
+// The symbol for "proto_", which every member lookup may need.
+static char *lobj_proto_symbol()
+{
+    static char *sym = NULL;
+    if(!sym)
+        sym = sym_intern("proto_");
+
+    return sym;
+}
+
 void lobj_set_member(lky_object *obj, char *member, lky_object *val)
 {
-    if(((uintptr_t)(obj) & 1) || obj->type == LBI_FLOAT || obj->type == LBI_INTEGER)
+    if(OBJ_IS_TAGGED(obj) || obj->type == LBI_FLOAT || obj->type == LBI_INTEGER)
+        return;
+
+    shp_members_put(&obj->members, sym_intern(member), val);
+    GC_WRITE_BARRIER(obj, val);
+}
+
+// Like lobj_set_member, but 'member' must already be a symbol.
+void lobj_set_member_sym(lky_object *obj, char *member, lky_object *val)
+{
+    if(OBJ_IS_TAGGED(obj) || obj->type == LBI_FLOAT || obj->type == LBI_INTEGER)
         return;
 
-    hst_put(&obj->members, member, val, NULL, NULL);
+    shp_members_put(&obj->members, member, val);
+    GC_WRITE_BARRIER(obj, val);
+}
+
+lky_object *lobj_remove_member(lky_object *obj, char *member)
+{
+    if(OBJ_IS_TAGGED(obj) || obj->type == LBI_FLOAT || obj->type == LBI_INTEGER)
+        return NULL;
+
+    // A name that was never interned cannot be a member of anything.
+    char *sym = sym_find(member);
+    return sym ? shp_members_remove(&obj->members, sym) : NULL;
 }
 
 lky_object *lobj_get_member(lky_object *obj, char *member)
 {
-    if(!obj || ((uintptr_t)(obj) & 1) || obj->type == LBI_FLOAT || obj->type == LBI_INTEGER)
+    char *sym = sym_find(member);
+    return sym ? lobj_get_member_sym(obj, sym) : NULL;
+}
+
+// Like lobj_get_member, but 'member' must already be a symbol.
+lky_object *lobj_get_member_sym(lky_object *obj, char *member)
+{
+    if(!obj || OBJ_IS_TAGGED(obj) || obj->type == LBI_FLOAT || obj->type == LBI_INTEGER)
         return NULL;
     //if(obj->type != LBI_INTEGER || obj->type != LBI_FLOAT ||
     //        obj->type != LBI_SEQUENCE || obj->type != LBI_CODE || obj->type != LBI_ITERABLE || obj->type != LBI_BLOB)
     //    return NULL;
 
-    lky_object *val = hst_get(&obj->members, member, NULL, NULL);
-    if(!val && !!strcmp(member, "proto_"))
+    char *proto_sym = lobj_proto_symbol();
+    lky_object *val = shp_members_get(&obj->members, member);
+    if(!val && member != proto_sym)
     {
-        lky_object *proto = hst_get(&obj->members, "proto_", NULL, NULL);
+        lky_object *proto = shp_members_get(&obj->members, proto_sym);
         if(proto)
         {
-            lky_object *m = lobj_get_member(proto, member);
+            lky_object *m = lobj_get_member_sym(proto, member);
             if(!m)
                 return NULL;
-            if(!OBJ_IS_INTEGER(m) && m->type == LBI_FUNCTION)
+            if(!OBJ_IS_TAGGED(m) && m->type == LBI_FUNCTION)
+            {
                 ((lky_object_function *)m)->bound = obj;
+                GC_WRITE_BARRIER(m, obj);
+            }
 
             return m;
         }
     }
-    else if(val && !OBJ_IS_INTEGER(val) && val && val->type == LBI_FUNCTION)
+    else if(val && !OBJ_IS_TAGGED(val) && val && val->type == LBI_FUNCTION)
+    {
         ((lky_object_function *)val)->bound = obj;
+        GC_WRITE_BARRIER(val, obj);
+    }
 
     return val;
 }
 
+// True for object types that carry a member table.
+static int lobj_has_members(lky_object *obj)
+{
+    if(OBJ_IS_TAGGED(obj))
+        return 0;
+
+    switch(obj->type)
+    {
+        case LBI_FLOAT:
+        case LBI_INTEGER:
+        case LBI_SEQUENCE:
+        case LBI_CODE:
+        case LBI_ITERABLE:
+        case LBI_BLOB:
+            return 0;
+        default:
+            return 1;
+    }
+}
+
+// Remembers where 'member' was found on 'obj' so the next lookup at the
+// same site can skip the search. Only the receiver and its immediate
+// prototype are considered; members found deeper in the prototype chain
+// always take the slow path.
+void lobj_fill_load_cache(lky_object *obj, char *member, lky_member_cache *cache)
+{
+    lky_members *m = &obj->members;
+    int idx = shp_lookup(m->shape, member);
+    if(idx >= 0)
+    {
+        if(!m->slots[idx])
+            return;
+
+        lky_member_cache_entry *e = shp_cache_next(cache);
+        e->shape = m->shape;
+        e->transition = NULL;
+        e->holder_shape = NULL;
+        e->index = idx;
+        return;
+    }
+
+    int pidx = shp_lookup(m->shape, lobj_proto_symbol());
+    if(pidx < 0)
+        return;
+
+    lky_object *proto = m->slots[pidx];
+    if(!proto || !lobj_has_members(proto) || !proto->members.shape)
+        return;
+
+    idx = shp_lookup(proto->members.shape, member);
+    if(idx < 0)
+        return;
+
+    lky_member_cache_entry *e = shp_cache_next(cache);
+    e->shape = m->shape;
+    e->transition = NULL;
+    e->holder_shape = proto->members.shape;
+    e->proto_index = pidx;
+    e->index = idx;
+}
+
+// Equivalent to lobj_get_member_sym, but consults (and fills) the inline
+// cache belonging to the LOAD_MEMBER site doing the lookup.
+lky_object *lobj_get_member_cached(lky_object *obj, char *member, lky_member_cache *cache)
+{
+    if(!obj || OBJ_IS_TAGGED(obj) || obj->type == LBI_FLOAT || obj->type == LBI_INTEGER)
+        return NULL;
+
+    lky_shape *shape = obj->members.shape;
+    if(shape)
+    {
+        int i;
+        for(i = 0; i < SHP_CACHE_WAYS; i++)
+        {
+            lky_member_cache_entry *e = &cache->entries[i];
+            if(e->shape != shape)
+                continue;
+
+            lky_object *val;
+            if(!e->holder_shape)
+                val = obj->members.slots[e->index];
+            else
+            {
+                lky_object *proto = obj->members.slots[e->proto_index];
+                if(!proto || !lobj_has_members(proto) || proto->members.shape != e->holder_shape)
+                    continue;
+
+                val = proto->members.slots[e->index];
+            }
+
+            if(!val)
+                break;
+
+            if(!OBJ_IS_TAGGED(val) && val->type == LBI_FUNCTION)
+            {
+                ((lky_object_function *)val)->bound = obj;
+                GC_WRITE_BARRIER(val, obj);
+            }
+
+            return val;
+        }
+    }
+
+    lky_object *val = lobj_get_member_sym(obj, member);
+    if(val && shape && obj->members.shape == shape)
+        lobj_fill_load_cache(obj, member, cache);
+
+    return val;
+}
+
+// Equivalent to lobj_set_member_sym, but consults (and fills) the inline
+// cache belonging to the SAVE_MEMBER site doing the store.
+void lobj_set_member_cached(lky_object *obj, char *member, lky_object *val, lky_member_cache *cache)
+{
+    if(OBJ_IS_TAGGED(obj) || obj->type == LBI_FLOAT || obj->type == LBI_INTEGER)
+        return;
+
+    lky_members *m = &obj->members;
+    lky_shape *shape = m->shape;
+    if(shape)
+    {
+        int i;
+        for(i = 0; i < SHP_CACHE_WAYS; i++)
+        {
+            lky_member_cache_entry *e = &cache->entries[i];
+            if(e->shape != shape)
+                continue;
+
+            if(e->transition)
+                shp_members_append(m, e->transition, val);
+            else
+                m->slots[e->index] = val;
+
+            GC_WRITE_BARRIER(obj, val);
+            return;
+        }
+    }
+
+    shp_members_put(m, member, val);
+    GC_WRITE_BARRIER(obj, val);
+    if(!shape || !m->shape)
+        return;
+
+    lky_member_cache_entry *e = shp_cache_next(cache);
+    e->shape = shape;
+    e->holder_shape = NULL;
+    if(m->shape == shape)
+    {
+        e->transition = NULL;
+        e->index = shp_lookup(shape, member);
+    }
+    else
+    {
+        e->transition = m->shape;
+        e->index = m->shape->count - 1;
+    }
+}
+
 void lobj_set_class(lky_object *obj, lky_object *cls)
 {
     obj->cls = (struct lky_object *)cls;
@@ -92,6 +295,9 @@ char lobj_is_of_class(lky_object *obj, void *cls)
 {
     if(OBJ_IS_NUMBER(obj))
         return 0;
+    // Native objects with a class (strings, for one) record it in 'cls'.
+    if(obj->type == LBI_CUSTOM_EX)
+        return cls && obj->cls == cls;
     if(obj->type != LBI_CUSTOM)
         return 0;
     return lobj_get_member(obj, "class_") == cls;
@@ -132,7 +338,7 @@ void lobj_dealloc(lky_object *obj)
 
     if(obj->type != LBI_INTEGER && obj->type != LBI_FLOAT &&
             obj->type != LBI_SEQUENCE && obj->type != LBI_CODE && obj->type != LBI_ITERABLE && obj->type != LBI_BLOB)
-        hst_free(&obj->members);
+        shp_members_free(&obj->members);
 
     aqua_release(obj);
 }
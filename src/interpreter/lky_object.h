@@ -21,6 +21,7 @@
 
 #include <stdlib.h>
 #include "hashtable.h"
+#include "lky_shape.h"
 
 // #define INCREF(obj) (rc_decr(obj))
 struct lky_object_seq;
@@ -40,7 +41,8 @@ typedef enum {
     LBI_CUSTOM_EX,
     LBI_ERROR,
     LBI_BOOL,
-    LBI_BLOB
+    LBI_BLOB,
+    LBI_REGEX
 } lky_builtin_type;
 
 struct lky_func_bundle;
@@ -65,16 +67,23 @@ typedef struct {
     unsigned mem_count : 2;
     struct lky_object *gc_next;
 
-    hashtable members;
+    lky_members members;
 
     struct lky_object *cls;
 
     lky_callable callable;
 } lky_object;
 
+// The arguments of a call are passed as argc/argv; for calls made by the
+// interpreter argv points into the caller's data stack, so no memory is
+// allocated for them. 'args' holds the same arguments as a sequence for
+// functions that still walk one. It is only built (by BUW_ARGS) when such
+// a function asks for it.
 typedef struct lky_func_bundle {
     lky_object *func;
     lky_object_seq *args;
+    int argc;
+    struct lky_object **argv;
 
     struct interp *interp;
 } lky_func_bundle;
@@ -82,6 +91,11 @@ typedef struct lky_func_bundle {
 lky_object *lobj_alloc();
 void lobj_set_member(lky_object *obj, char *member, lky_object *val);
 lky_object *lobj_get_member(lky_object *obj, char *member);
+void lobj_set_member_sym(lky_object *obj, char *member, lky_object *val);
+lky_object *lobj_get_member_sym(lky_object *obj, char *member);
+lky_object *lobj_remove_member(lky_object *obj, char *member);
+void lobj_set_member_cached(lky_object *obj, char *member, lky_object *val, lky_member_cache *cache);
+lky_object *lobj_get_member_cached(lky_object *obj, char *member, lky_member_cache *cache);
 void lobj_dealloc(lky_object *obj);
 void print_alloced();
 void lobj_set_class(lky_object *obj, lky_object *cls);
@@ -93,14 +107,28 @@ extern lky_object lky_nil;
 extern lky_object lky_yes;
 extern lky_object lky_no;
 
+lky_object_seq *lobjb_bundle_args(lky_func_bundle *bundle);
+lky_object *lobjb_seq_get(lky_object_seq *seq, int idx);
+
 #define MAKE_BUNDLE(f, a, i) {\
     .func = (lky_object *)(f),\
     .args = (lky_object_seq *)(a),\
+    .argc = 0,\
+    .argv = NULL,\
+    .interp = i\
+}
+
+#define MAKE_ARGV_BUNDLE(f, c, v, i) {\
+    .func = (lky_object *)(f),\
+    .args = NULL,\
+    .argc = (c),\
+    .argv = (struct lky_object **)(v),\
     .interp = i\
 }
 
 #define BUW_FUNC(b) ((lky_object_function *)b->func)
-#define BUW_ARGS(b) ((lky_object_seq *)b->args)
+#define BUW_ARGS(b) lobjb_bundle_args(b)
+#define BUW_ARG(b, n) ((b)->argv ? ((n) < (b)->argc ? (lky_object *)(b)->argv[(n)] : NULL) : lobjb_seq_get((b)->args, (n)))
 #define BUW_INTERP(b) ((struct interp *)b->interp)
 
 #endif
@@ -0,0 +1,244 @@
+/* Lanky -- Scripting Language and Virtual Machine
+ * Copyright (C) 2014  Sam Olsen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <stdlib.h>
+#include "lky_shape.h"
+#include "lky_symbol.h"
+
+// Shapes with this many members or fewer are searched by walking the
+// parent chain; larger ones build a lookup table the first time.
+#define SHP_LINEAR_LOOKUP 8
+
+lky_shape *shp_make(lky_shape *parent, char *name)
+{
+    lky_shape *shape = malloc(sizeof(lky_shape));
+    shape->parent = parent;
+    shape->name = NULL;
+    shape->count = 0;
+    shape->transitions = hst_create();
+    shape->lookup = NULL;
+
+    if(name)
+    {
+        shape->name = name;
+        shape->count = parent->count + 1;
+    }
+
+    return shape;
+}
+
+lky_shape *shp_root()
+{
+    static lky_shape *root = NULL;
+    if(!root)
+        root = shp_make(NULL, NULL);
+
+    return root;
+}
+
+lky_shape *shp_transition(lky_shape *shape, char *name)
+{
+    lky_shape *next = hst_get(&shape->transitions, name, sym_hash, sym_equal);
+    if(next)
+        return next;
+
+    next = shp_make(shape, name);
+    hst_put(&shape->transitions, name, next, sym_hash, sym_equal);
+    return next;
+}
+
+// Returns the slot holding 'name' in objects with the given
+// shape, or -1 if the shape has no such member.
+int shp_lookup(lky_shape *shape, char *name)
+{
+    lky_shape *s;
+    if(shape->count <= SHP_LINEAR_LOOKUP)
+    {
+        for(s = shape; s->parent; s = s->parent)
+            if(s->name == name)
+                return s->count - 1;
+
+        return -1;
+    }
+
+    if(!shape->lookup)
+    {
+        shape->lookup = malloc(sizeof(hashtable));
+        *shape->lookup = hst_create();
+        for(s = shape; s->parent; s = s->parent)
+            hst_put(shape->lookup, s->name, (void *)(long)s->count, sym_hash, sym_equal);
+    }
+
+    return (int)(long)hst_get(shape->lookup, name, sym_hash, sym_equal) - 1;
+}
+
+int shp_capacity(int count)
+{
+    int cap = 4;
+    while(cap < count)
+        cap *= 2;
+
+    return cap;
+}
+
+void shp_members_init(lky_members *m)
+{
+    m->shape = shp_root();
+    m->slots = NULL;
+    m->dict = NULL;
+}
+
+// Moves an object's members out of its slots and into a hashtable. This is
+// a one-way trip; the object will not be given a shape again.
+void shp_members_to_dict(lky_members *m)
+{
+    hashtable *dict = malloc(sizeof(hashtable));
+    *dict = hst_create();
+
+    lky_shape *s;
+    for(s = m->shape; s && s->parent; s = s->parent)
+        hst_put(dict, s->name, m->slots[s->count - 1], sym_hash, sym_equal);
+
+    free(m->slots);
+    m->shape = NULL;
+    m->slots = NULL;
+    m->dict = dict;
+}
+
+void *shp_members_get(lky_members *m, char *name)
+{
+    if(m->shape)
+    {
+        int idx = shp_lookup(m->shape, name);
+        return idx < 0 ? NULL : m->slots[idx];
+    }
+
+    return m->dict ? hst_get(m->dict, name, sym_hash, sym_equal) : NULL;
+}
+
+// Adds a member to an object whose current shape transitions to 'next'.
+void shp_members_append(lky_members *m, lky_shape *next, void *val)
+{
+    int count = m->shape->count;
+    if(!m->slots || shp_capacity(count) < next->count)
+        m->slots = realloc(m->slots, shp_capacity(next->count) * sizeof(void *));
+
+    m->slots[next->count - 1] = val;
+    m->shape = next;
+}
+
+void shp_members_put(lky_members *m, char *name, void *val)
+{
+    if(!m->shape && !m->dict)
+        shp_members_init(m);
+
+    if(m->shape)
+    {
+        int idx = shp_lookup(m->shape, name);
+        if(idx >= 0)
+        {
+            m->slots[idx] = val;
+            return;
+        }
+
+        if(m->shape->count < SHP_MAX_MEMBERS)
+        {
+            shp_members_append(m, shp_transition(m->shape, name), val);
+            return;
+        }
+
+        shp_members_to_dict(m);
+    }
+
+    hst_put(m->dict, name, val, sym_hash, sym_equal);
+}
+
+void *shp_members_remove(lky_members *m, char *name)
+{
+    if(m->shape)
+    {
+        if(shp_lookup(m->shape, name) < 0)
+            return NULL;
+
+        shp_members_to_dict(m);
+    }
+
+    return m->dict ? hst_remove_key(m->dict, name, sym_hash, sym_equal) : NULL;
+}
+
+void shp_members_free(lky_members *m)
+{
+    free(m->slots);
+    if(m->dict)
+    {
+        hst_free(m->dict);
+        free(m->dict);
+    }
+
+    m->shape = NULL;
+    m->slots = NULL;
+    m->dict = NULL;
+}
+
+// Calls 'func' for every member; members held in slots are visited
+// in the order they were added.
+void shp_members_for_each(lky_members *m, hst_each_function func, void *data)
+{
+    if(m->dict)
+    {
+        hst_for_each(m->dict, func, data);
+        return;
+    }
+
+    if(!m->shape)
+        return;
+
+    char *names[SHP_MAX_MEMBERS];
+    lky_shape *s;
+    for(s = m->shape; s->parent; s = s->parent)
+        names[s->count - 1] = s->name;
+
+    int i;
+    for(i = 0; i < m->shape->count; i++)
+        func(names[i], m->slots[i], data);
+}
+
+int shp_members_count(lky_members *m)
+{
+    if(m->shape)
+        return m->shape->count;
+
+    return m->dict ? m->dict->count : 0;
+}
+
+void shp_members_add_each(void *key, void *val, void *data)
+{
+    shp_members_put((lky_members *)data, sym_intern((char *)key), val);
+}
+
+void shp_members_add_all_from(lky_members *m, hashtable *ht)
+{
+    hst_for_each(ht, shp_members_add_each, m);
+}
+
+// Picks the entry of a cache to overwrite after a miss.
+lky_member_cache_entry *shp_cache_next(lky_member_cache *cache)
+{
+    lky_member_cache_entry *e = &cache->entries[cache->next];
+    cache->next = (cache->next + 1) % SHP_CACHE_WAYS;
+    return e;
+}
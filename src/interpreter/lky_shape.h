@@ -0,0 +1,88 @@
+/* Lanky -- Scripting Language and Virtual Machine
+ * Copyright (C) 2014  Sam Olsen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef LKY_SHAPE_H
+#define LKY_SHAPE_H
+
+#include "hashtable.h"
+
+// A shape describes the layout of an object's members: which names it has
+// and which slot each one lives in. Objects that gain the same members in
+// the same order share a shape, so a (shape, slot) pair remembered at one
+// LOAD_MEMBER or SAVE_MEMBER site stays valid for every object with that
+// shape. Shapes form a tree rooted at shp_root(); adding a member follows
+// (or creates) the transition for that name. Shapes are never freed.
+//
+// Member names passed to the shp_ functions must be symbols (see
+// lky_symbol.h); they are compared by address.
+typedef struct lky_shape {
+    struct lky_shape *parent;
+    char *name;             // The symbol this shape adds (NULL for the root)
+    int count;              // Number of members; 'name' lives in slot count - 1
+    hashtable transitions;  // Symbol -> child shape
+    hashtable *lookup;      // Symbol -> slot + 1, built on demand
+} lky_shape;
+
+// The member storage of an object. While 'shape' is set the values live in
+// 'slots'; objects that have members removed, or that grow past
+// SHP_MAX_MEMBERS, fall back to a plain hashtable in 'dict' and are never
+// cached.
+typedef struct {
+    lky_shape *shape;
+    void **slots;
+    hashtable *dict;
+} lky_members;
+
+#define SHP_MAX_MEMBERS 64
+#define SHP_CACHE_WAYS 4
+
+// One remembered lookup. For loads, 'holder_shape' is set when the member
+// was found on the receiver's prototype (held in slot 'proto_index') rather
+// than on the receiver itself; for stores, 'transition' is set when the
+// store added the member.
+typedef struct {
+    lky_shape *shape;
+    lky_shape *transition;
+    lky_shape *holder_shape;
+    int proto_index;
+    int index;
+} lky_member_cache_entry;
+
+// A small polymorphic cache owned by a single member access site.
+typedef struct {
+    lky_member_cache_entry entries[SHP_CACHE_WAYS];
+    int next;
+} lky_member_cache;
+
+lky_shape *shp_root();
+lky_shape *shp_transition(lky_shape *shape, char *name);
+int shp_lookup(lky_shape *shape, char *name);
+
+void shp_members_init(lky_members *m);
+void *shp_members_get(lky_members *m, char *name);
+void shp_members_put(lky_members *m, char *name, void *val);
+void shp_members_append(lky_members *m, lky_shape *next, void *val);
+void *shp_members_remove(lky_members *m, char *name);
+void shp_members_free(lky_members *m);
+void shp_members_for_each(lky_members *m, hst_each_function func, void *data);
+int shp_members_count(lky_members *m);
+void shp_members_add_all_from(lky_members *m, hashtable *ht);
+
+lky_member_cache_entry *shp_cache_next(lky_member_cache *cache);
+
+#endif
@@ -0,0 +1,55 @@
+/* Lanky -- Scripting Language and Virtual Machine
+ * Copyright (C) 2014  Sam Olsen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lky_symbol.h"
+#include "hashtable.h"
+
+// Maps each name to its canonical copy.
+static hashtable sym_table_ = {0, 0, 0, 0, NULL};
+
+// Returns the symbol for 'name', or NULL if it has never been interned.
+char *sym_find(char *name)
+{
+    return hst_get(&sym_table_, name, NULL, NULL);
+}
+
+// Returns the symbol for 'name', interning it if necessary.
+char *sym_intern(char *name)
+{
+    char *sym = sym_find(name);
+    if(sym)
+        return sym;
+
+    sym = malloc(strlen(name) + 1);
+    strcpy(sym, name);
+    hst_put(&sym_table_, sym, sym, NULL, NULL);
+
+    return sym;
+}
+
+long sym_hash(void *sym, void *data)
+{
+    return (long)((uintptr_t)sym >> 3);
+}
+
+int sym_equal(void *a, void *b)
+{
+    return a == b;
+}
@@ -0,0 +1,36 @@
+/* Lanky -- Scripting Language and Virtual Machine
+ * Copyright (C) 2014  Sam Olsen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef LKY_SYMBOL_H
+#define LKY_SYMBOL_H
+
+// Symbols are interned strings: every distinct name has exactly one
+// canonical copy, so two symbols are the same name exactly when they are
+// the same pointer. Member names are interned when code is compiled or
+// loaded and when natives register members, which lets member tables and
+// shapes compare keys by address instead of hashing and strcmp'ing them.
+// Symbols are never freed.
+
+char *sym_intern(char *name);
+char *sym_find(char *name);
+
+// Hash and equality functions for hashtables keyed by symbols.
+long sym_hash(void *sym, void *data);
+int sym_equal(void *a, void *b);
+
+#endif
@@ -18,12 +18,14 @@
 
 #include "lkyobj_builtin.h"
 #include "lky_machine.h"
+#include "mach_jit.h"
 #include "lky_gc.h"
 #include "stl_string.h"
 #include "stl_object.h"
 #include "stl_array.h"
 #include "tools.h"
 #include "aquarium.h"
+#include "lky_symbol.h"
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
@@ -31,28 +33,68 @@
 
 int lobjb_uses_pointer_tags_ = 1;
 
+#define LOBJB_TAGGED_INT_MAX ((long)(INTPTR_MAX >> 1))
+#define LOBJB_TAGGED_INT_MIN ((long)(INTPTR_MIN >> 1))
+#define LOBJB_FLONUM_ZERO ((uintptr_t)0x8000000000000002ULL)
+#define LOBJB_ROTL(v, n) (((v) << (n)) | ((v) >> (64 - (n))))
+#define LOBJB_ROTR(v, n) (((v) >> (n)) | ((v) << (64 - (n))))
+
 lky_object *lobjb_try_render_tagged_pointer(long value)
 {
     if(!lobjb_uses_pointer_tags_)
         return NULL;
 
-    uintptr_t p = 0;
-    if(value < (long)0x00FFFFFF && value >= 0)
-    {
-        p = value << 8;
-        p |= 1;
-    }
+    if(value > LOBJB_TAGGED_INT_MAX || value < LOBJB_TAGGED_INT_MIN)
+        return NULL;
+
+    return (lky_object *)(((uintptr_t)value << 1) | 1);
+}
+
+// Doubles whose exponent lies roughly in [2^-255, 2^256) are stored in the
+// pointer: the bit pattern is rotated left by three so the top exponent bits
+// land at the bottom, one of them is dropped and the tag 0b10 takes its place.
+// +0.0 gets a dedicated encoding; everything else (NaN, infinities, huge or
+// tiny magnitudes, -0.0) stays boxed.
+lky_object *lobjb_try_render_flonum(double value)
+{
+    if(!lobjb_uses_pointer_tags_ || sizeof(uintptr_t) != sizeof(double))
+        return NULL;
+
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    int exp = (int)((bits >> 60) & 7);
+    if(bits != 0x3000000000000000ULL && !((exp - 3) & ~1))
+        return (lky_object *)(uintptr_t)((LOBJB_ROTL(bits, 3) & ~(uint64_t)1) | 2);
+
+    if(bits == 0)
+        return (lky_object *)LOBJB_FLONUM_ZERO;
+
+    return NULL;
+}
+
+double lobjb_flonum_value(lky_object *obj)
+{
+    uint64_t v = (uintptr_t)obj;
+    if(v == LOBJB_FLONUM_ZERO)
+        return 0.0;
+
+    uint64_t bits = LOBJB_ROTR((2 - (v >> 63)) | (v & ~(uint64_t)3), 3);
 
-    return (lky_object *)p;
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    return d;
 }
 
 lky_object *lobjb_alloc(lky_builtin_type t, lky_builtin_value v)
 {
-    if(t == LBI_INTEGER && v.i < 0x0FFFFFFF && v.i >= 0)
-    {
-        lky_object *attempt = lobjb_try_render_tagged_pointer(v.i);
-        if(attempt) return attempt;
-    }
+    lky_object *attempt = NULL;
+    if(t == LBI_INTEGER)
+        attempt = lobjb_try_render_tagged_pointer(v.i);
+    else if(t == LBI_FLOAT)
+        attempt = lobjb_try_render_flonum(v.d);
+
+    if(attempt) return attempt;
 
     lky_object_builtin *obj = aqua_request_next_block(sizeof(lky_object_builtin));
     obj->type = t;
@@ -66,9 +108,6 @@ lky_object *lobjb_alloc(lky_builtin_type t, lky_builtin_value v)
 
 lky_object *lobjb_build_int(long value)
 {
-    lky_object *attempt = lobjb_try_render_tagged_pointer(value);
-    if(attempt) return attempt;
-
     lky_builtin_value v;
     v.i = value;
     return lobjb_alloc(LBI_INTEGER, v);
@@ -137,8 +176,7 @@ lky_object *lobjb_build_error(char *name, char *text, struct interp *interp)
     lky_object_error *err = aqua_request_next_block(sizeof(lky_object_error));
     err->type = LBI_ERROR;
     err->mem_count = 0;
-    err->members = hst_create();
-    err->members.duplicate_keys = 1;
+    shp_members_init(&err->members);
     err->trace = mach_build_trace(interp);
 
     char *name_ = malloc(strlen(name) + 1);
@@ -184,11 +222,62 @@ lky_object *lobjb_get_exception_class()
     return lobjb_build_func_ex(NULL, 2, (lky_function_ptr)lobjb_make_exception);
 }
 
-lky_object *lobjb_build_iterable(lky_object *owner, struct interp *interp)
+// Makes an iterator whose items come from 'next'. The caller sets up the
+// iterator's state before it is used.
+lky_object_iterable *lobjb_build_iterator(lky_object *owner, lobjb_iterator_function next)
 {
     lky_object_iterable *it = aqua_request_next_block(sizeof(lky_object_iterable));
     it->type = LBI_ITERABLE;
     it->mem_count = 0;
+    it->index = 0;
+    it->next = next;
+    it->owner = owner;
+    memset(&it->state, 0, sizeof(it->state));
+
+    gc_add_object((lky_object *)it);
+
+    return it;
+}
+
+static lky_object *lobjb_array_next(lky_object_iterable *it)
+{
+    arraylist *store = it->state.walk.store;
+    return it->index < store->count ? store->items[it->index++] : NULL;
+}
+
+static lky_object *lobjb_range_next(lky_object_iterable *it)
+{
+    long at = it->state.range.at;
+    if(it->state.range.step > 0 ? at >= it->state.range.stop : at <= it->state.range.stop)
+        return NULL;
+
+    it->state.range.at += it->state.range.step;
+    it->index++;
+    return lobjb_build_int(at);
+}
+
+// An iterator over the integers from 'from' up to (or, with a negative
+// step, down to) but not including 'to'.
+lky_object *lobjb_build_range(long from, long to, long step)
+{
+    lky_object_iterable *it = lobjb_build_iterator(NULL, lobjb_range_next);
+    it->state.range.at = from;
+    it->state.range.stop = to;
+    it->state.range.step = step;
+
+    return (lky_object *)it;
+}
+
+// Returns the iterator a for-in loop over 'owner' walks. Arrays are walked
+// in place. Other objects are asked for one through their iterable_ method,
+// which returns either an iterator (see lobjb_build_iterator) or an Array.
+// An iterator is its own iterator, so the ones returned by methods such as
+// Table.eachKey can be looped over directly. Returns NULL if 'owner' cannot
+// be iterated.
+lky_object *lobjb_build_iterable(lky_object *owner, struct interp *interp)
+{
+    if(!OBJ_IS_TAGGED(owner) && owner->type == LBI_ITERABLE)
+        return owner;
 
     if(!lobj_is_of_class(owner, stlarr_get_class()))
     {
@@ -199,6 +288,10 @@ lky_object *lobjb_build_iterable(lky_object *owner, struct interp *interp)
                 return NULL;
 
             owner = lobjb_call(func, NULL, interp);
+            if(!OBJ_IS_TAGGED(owner) && owner->type == LBI_ITERABLE)
+                return owner;
+            if(!lobj_is_of_class(owner, stlarr_get_class()))
+                return NULL;
         }
         else
         {
@@ -206,22 +299,20 @@ lky_object *lobjb_build_iterable(lky_object *owner, struct interp *interp)
         }
     }
 
-    it->index = 0;
-    it->store = stlarr_get_store(owner);
-    it->owner = owner;
-
-    gc_add_object((lky_object *)it);
+    lky_object_iterable *it = lobjb_build_iterator(owner, lobjb_array_next);
+    it->state.walk.store = stlarr_get_store(owner);
 
     return (lky_object *)it;
 }
 
+// Makes a custom object followed by 'extra_size' bytes that are the
+// caller's to use (typically by pointing 'data' at them).
 lky_object_custom *lobjb_build_custom(size_t extra_size)
 {
-    lky_object_custom *obj = aqua_request_next_block(sizeof(lky_object_custom));
+    lky_object_custom *obj = aqua_request_next_block(sizeof(lky_object_custom) + extra_size);
     obj->type = LBI_CUSTOM_EX;
     obj->mem_count = 0;
-    obj->members = hst_create();
-    obj->members.duplicate_keys = 1;
+    shp_members_init(&obj->members);
     obj->data = NULL;
     obj->freefunc = NULL;
     obj->savefunc = NULL;
@@ -242,6 +333,7 @@ lky_object *lobjb_bind_func(lky_func_bundle *bundle)
 
     lky_object *obj = (lky_object *)args->value;
     func->bound = obj;
+    GC_WRITE_BARRIER(func, obj);
 
     return (lky_object *)func;
 }
@@ -273,8 +365,7 @@ lky_object *lobjb_get_func_proto()
     lobjb_func_proto_ = aqua_request_next_block(sizeof(lky_object));
     lobjb_func_proto_->type = LBI_CUSTOM;
     lobjb_func_proto_->mem_count = 0;
-    lobjb_func_proto_->members = hst_create();
-    lobjb_func_proto_->members.duplicate_keys = 1;
+    shp_members_init(&lobjb_func_proto_->members);
     gc_add_object(lobjb_func_proto_);
 
     stlobj_seed(lobjb_func_proto_);
@@ -283,8 +374,7 @@ lky_object *lobjb_get_func_proto()
     lky_object_function *func = aqua_request_next_block(sizeof(lky_object_function));
     func->type = LBI_FUNCTION;
     func->mem_count = 0;
-    func->members = hst_create();
-    func->members.duplicate_keys = 1;
+    shp_members_init(&func->members);
     func->owner = NULL;
     func->bound = NULL;
     func->refname = NULL;
@@ -317,8 +407,7 @@ lky_object *lobjb_build_func(lky_object_code *code, int argc, arraylist inherite
     lky_object_function *func = aqua_request_next_block(sizeof(lky_object_function));
     func->type = LBI_FUNCTION;
     func->mem_count = 0;
-    func->members = hst_create();
-    func->members.duplicate_keys = 1;
+    shp_members_init(&func->members);
     
     func->code = code;
     func->bucket = NULL;
@@ -350,8 +439,7 @@ lky_object *lobjb_build_func_ex(lky_object *owner, int argc, lky_function_ptr pt
     lky_object_function *func = aqua_request_next_block(sizeof(lky_object_function));
     func->type = LBI_FUNCTION;
     func->mem_count = 0;
-    func->members = hst_create();
-    func->members.duplicate_keys = 1;
+    shp_members_init(&func->members);
     func->bound = NULL;
     func->refname = NULL;
     
@@ -380,14 +468,25 @@ char *lobjb_stringify(lky_object *a, struct interp *interp)
 {
     char *ret = NULL;
 
-    if((uintptr_t)(a) & 1)
+    if(OBJ_IS_TAGGED_INT(a))
     {
-        long val = OBJ_NUM_UNWRAP(a);
+        long val = OBJ_INT_UNWRAP(a);
         ret = malloc(100);
         sprintf(ret, "%ld", val);
         return ret;
     }
 
+    if(OBJ_IS_FLONUM(a))
+    {
+        double val = OBJ_FLOAT_UNWRAP(a);
+        ret = malloc(100);
+        if(val < 0.0001 && val != 0)
+            sprintf(ret, "%e", val);
+        else
+            sprintf(ret, "%lf", val);
+        return ret;
+    }
+
     lky_object_builtin *b = (lky_object_builtin *)a;
 
     switch(b->type)
@@ -415,6 +514,14 @@ char *lobjb_stringify(lky_object *a, struct interp *interp)
         case LBI_CUSTOM_EX:
         case LBI_ERROR:
         {
+            if(lobj_is_of_class(a, stlstr_get_class()))
+            {
+                stlstr_data *d = stlstr_get_data(a);
+                ret = malloc(d->length + 1);
+                memcpy(ret, d->str, d->length + 1);
+                break;
+            }
+
             lky_object_function *func = (lky_object_function *)lobj_get_member(a, "stringify_");
             
             if(!func)
@@ -448,16 +555,18 @@ char *lobjb_stringify(lky_object *a, struct interp *interp)
         case LBI_CODE:
         {
             lky_object_code *code = (lky_object_code *)a;
-            ret = NULL;
+            auto_buffer buf = {NULL, 0, 0};
 
             int i;
             char ch[100];
             for(i = 0; i < code->op_len; i++)
             {
                 sprintf(ch, "\\0x%X", code->ops[i]);
-                auto_cat(&ret, ch);
+                auto_cat(&buf, ch);
             }
 
+            ret = buf.str;
+
             break;           
         }
         default:
@@ -490,15 +599,21 @@ lky_object *lobjb_num_to_string(lky_object *a)
     lky_object_builtin *b = (lky_object_builtin *)a;
     char str[100];
 
-    if((uintptr_t)(a) & 1)
-        sprintf(str, "%ld", (long)OBJ_NUM_UNWRAP(a));
+    if(OBJ_IS_TAGGED_INT(a))
+        sprintf(str, "%ld", OBJ_INT_UNWRAP(a));
+    else if(OBJ_IS_FLONUM(a))
+    {
+        lky_builtin_value v;
+        v.d = OBJ_FLOAT_UNWRAP(a);
+        str_print(LBI_FLOAT, v, str);
+    }
     else
         str_print(b->type, b->value, str);
     
     return stlstr_cinit(str);
 }
 
-lky_object *lobjb_call(lky_object *func, lky_object_seq *args, struct interp *interp)
+static lky_object *lobjb_invoke(lky_object *func, lky_object_seq *args, int argc, lky_object **argv, struct interp *interp)
 {
     if(func->type != LBI_FUNCTION && func->type != LBI_CLASS && func->type != LBI_CUSTOM_EX && func->type != LBI_CUSTOM)
         return NULL;
@@ -518,56 +633,73 @@ lky_object *lobjb_call(lky_object *func, lky_object_seq *args, struct interp *in
             return NULL;
     }
     
-    lky_func_bundle b = MAKE_BUNDLE(func, args, interp);
-    return (lky_object *)c.function(&b);
+    lky_func_bundle b = MAKE_ARGV_BUNDLE(func, argc, argv, interp);
+    b.args = args;
+
+    lky_object *ret = (lky_object *)c.function(&b);
+
+    // A sequence built on demand by BUW_ARGS was rooted until now.
+    if(!args && b.args)
+        gc_remove_root_object((lky_object *)b.args);
+
+    return ret;
 }
 
-lky_object *lobjb_default_callable(lky_func_bundle *bundle)
+// Calls 'func' with the 'argc' arguments in 'argv'. The caller keeps the
+// arguments reachable for the collector while the call runs.
+lky_object *lobjb_call_argv(lky_object *func, int argc, lky_object **argv, struct interp *interp)
 {
-    lky_object_function *func = BUW_FUNC(bundle);
-    lky_object_seq *args = BUW_ARGS(bundle);
-    lky_object_code *code = func->code;
+    return lobjb_invoke(func, NULL, argc, argv, interp);
+}
 
-    func->bucket = lobj_alloc();
+lky_object *lobjb_call(lky_object *func, lky_object_seq *args, struct interp *interp)
+{
+    int argc = 0;
+    lky_object_seq *seq;
+    for(seq = args; seq; seq = seq->next)
+        argc++;
 
-    long i;
-    for(i = 0; args && i < func->callable.argc; i++, args = args->next)
-    {
-        char *name = code->names[i];
-        lobj_set_member(func->bucket, name, (lky_object *)args->value);
-    }
+    lky_object *argv[argc + 1];
+    argc = 0;
+    for(seq = args; seq; seq = seq->next)
+        argv[argc++] = (lky_object *)seq->value;
 
-    if(func->bound && func->refname)
-    {
-        lobj_set_member(func->bucket, func->refname, func->bound);
-        func->bound = NULL;
-    }
+    return lobjb_invoke(func, args, argc, argv, interp);
+}
 
-    for(; i < func->callable.argc; i++)
-    {
-        char *name = code->names[i];
-        lobj_set_member(func->bucket, name, &lky_nil);
-    }
+// Returns the arguments of the call as a sequence, building (and rooting)
+// one from argv the first time it is asked for.
+lky_object_seq *lobjb_bundle_args(lky_func_bundle *bundle)
+{
+    if(bundle->args || !bundle->argv || !bundle->argc)
+        return bundle->args;
 
-    char needs_va_args = 0;
-    arraylist list = arr_create(10);
-    for(; args; args = args->next)
+    lky_object_seq *head = NULL;
+    int i;
+    for(i = bundle->argc - 1; i >= 0; i--)
     {
-        needs_va_args = 1;
-        arr_append(&list, args->value);
+        lky_object_seq *seq = lobjb_make_seq_node((lky_object *)bundle->argv[i]);
+        seq->next = head;
+        head = seq;
     }
 
-    if(needs_va_args)
-        lobj_set_member(func->bucket, "va_args_", stlarr_cinit(list));
-    else
-    {
-        lobj_set_member(func->bucket, "va_args_", &lky_nil);
-        arr_free(&list);
-    }
+    gc_add_root_object((lky_object *)head);
+    bundle->args = head;
+    return head;
+}
+
+lky_object *lobjb_seq_get(lky_object_seq *seq, int idx)
+{
+    for(; seq && idx; idx--)
+        seq = seq->next;
 
-    lky_object *ret = mach_execute(func);
+    return seq ? (lky_object *)seq->value : NULL;
+}
 
-    return ret;
+lky_object *lobjb_default_callable(lky_func_bundle *bundle)
+{
+    int argc = bundle->argv ? bundle->argc : 0;
+    return mach_call(BUW_FUNC(bundle), argc, (lky_object **)bundle->argv);
 }
 
 lky_object *lobjb_unary_load_index(lky_object *obj, lky_object *indexer, struct interp *interp)
@@ -580,10 +712,8 @@ lky_object *lobjb_unary_load_index(lky_object *obj, lky_object *indexer, struct
         return &lky_nil;
     }
 
-    lky_func_bundle b = MAKE_BUNDLE(func, lobjb_make_seq_node(indexer), interp);
-    lky_object *ret = (lky_object *)func->callable.function(&b);
-
-    return ret;
+    lky_object *argv[] = { indexer };
+    return lobjb_call_argv((lky_object *)func, 1, argv, interp);
 }
 
 lky_object *lobjb_unary_save_index(lky_object *obj, lky_object *indexer, lky_object *newobj, struct interp *interp)
@@ -596,19 +726,16 @@ lky_object *lobjb_unary_save_index(lky_object *obj, lky_object *indexer, lky_obj
         return &lky_nil;
     }
 
-    lky_object_seq *args = lobjb_make_seq_node(indexer);
-    args->next = lobjb_make_seq_node(newobj);
-
-    lky_func_bundle b = MAKE_BUNDLE(func, args, interp);
-    lky_object *ret = (lky_object *)func->callable.function(&b);
-
-    return ret;
+    lky_object *argv[] = { indexer, newobj };
+    return lobjb_call_argv((lky_object *)func, 2, argv, interp);
 }
 
 lky_object *lobjb_unary_negative(lky_object *obj)
 {
-    if((uintptr_t)(obj) & 1)
-        return lobjb_build_int(-(OBJ_NUM_UNWRAP(obj)));
+    if(OBJ_IS_TAGGED_INT(obj))
+        return lobjb_build_int(-OBJ_INT_UNWRAP(obj));
+    if(OBJ_IS_FLONUM(obj))
+        return lobjb_build_float(-OBJ_FLOAT_UNWRAP(obj));
     if(obj->type != LBI_FLOAT && obj->type != LBI_INTEGER)
         return &lky_nil;
 
@@ -617,7 +744,7 @@ lky_object *lobjb_unary_negative(lky_object *obj)
         case LBI_FLOAT:
             return lobjb_build_float(-OBJ_NUM_UNWRAP(obj));
         case LBI_INTEGER:
-            return lobjb_build_int(-OBJ_NUM_UNWRAP(obj));
+            return lobjb_build_int(-OBJ_INT_UNWRAP(obj));
         default: break;
     }
 
@@ -626,26 +753,13 @@ lky_object *lobjb_unary_negative(lky_object *obj)
 
 lky_object *lobjb_iterable_get_next(lky_object *obj)
 {
-    lky_object_iterable *it = (lky_object_iterable *)obj;
-    if(it->type != LBI_ITERABLE)
-    {
-        // TODO: Error
-        return NULL;
-    }
-
-    arraylist *store = it->store;
-    int idx = ++it->index;
-
-    if(idx < store->count)
-        return store->items[idx];
-
     // NULL is used to indicate end of iteration.
-    return NULL;
+    return LKY_NEXT_ITERABLE(obj);
 }
 
 char lobjb_quick_compare(lky_object *a, lky_object *b)
 {
-    if(((uintptr_t)(a) & 1) || ((uintptr_t)(b) & 1))
+    if(OBJ_IS_TAGGED(a) || OBJ_IS_TAGGED(b))
         return a == b;
 
     BI_CAST(a, ab);
@@ -656,7 +770,7 @@ char lobjb_quick_compare(lky_object *a, lky_object *b)
         if(!lobj_is_of_class(a, stlstr_get_class()) || !lobj_is_of_class(b, stlstr_get_class()))
             return 0;
 
-        return !strcmp(stlstr_unwrap(a), stlstr_unwrap(b));
+        return stlstr_equal(a, b);
     }
 
     if(a == &lky_nil || b == &lky_nil)
@@ -705,6 +819,24 @@ void lobjb_free_seq(lky_object_seq *seq)
     }
 }
 
+// Frees a code object nothing will run again (it is not collected). Its
+// constants are left to the collector, and the name stays because stack
+// traces point at it.
+void lobjb_free_code(lky_object_code *code)
+{
+    mach_jit_release(code);
+
+    free(code->ops);
+    free(code->indices);
+    free(code->tape);
+    free(code->tape_indices);
+    free(code->member_caches);
+    free(code->constants);
+    free(code->names);
+    free(code->refname);
+    free(code);
+}
+
 lky_object_seq *lobjb_build_args(lky_object *arg, ...)
 {
     lky_object *cur = arg;
@@ -19,16 +19,25 @@
 #ifndef LKYOBJ_BUILTIN_H
 #define LKYOBJ_BUILTIN_H
 
-#define OBJ_NUM_UNWRAP(obj) (((uintptr_t)(obj) & 1) ? ((long)(obj) >> 8 & 0x00FFFFFFF) : (((lky_object_builtin *)obj)->type == LBI_FLOAT ? ((lky_object_builtin *)obj)->value.d : ((lky_object_builtin *)obj)->value.i))
-#define OBJ_IS_NUMBER(obj) (((uintptr_t)(obj) & 1) || obj->type == LBI_FLOAT || obj->type == LBI_INTEGER)
-#define OBJ_IS_INTEGER(obj) (((uintptr_t)(obj) & 1) || obj->type == LBI_INTEGER)
+// Numbers are usually carried in the pointer itself rather than boxed:
+//   ...xxx1  63-bit integer, value in the upper bits
+//   ...xx10  double whose exponent fits the flonum range (see lobjb_try_render_flonum)
+// Anything else is a real pointer. Only boxed numbers carry a type field.
+#define OBJ_IS_TAGGED(obj) ((uintptr_t)(obj) & 3)
+#define OBJ_IS_TAGGED_INT(obj) ((uintptr_t)(obj) & 1)
+#define OBJ_IS_FLONUM(obj) (((uintptr_t)(obj) & 3) == 2)
+#define OBJ_INT_UNWRAP(obj) (OBJ_IS_TAGGED_INT(obj) ? (long)((intptr_t)(obj) >> 1) : ((lky_object_builtin *)(obj))->value.i)
+#define OBJ_FLOAT_UNWRAP(obj) (OBJ_IS_FLONUM(obj) ? lobjb_flonum_value((lky_object *)(obj)) : ((lky_object_builtin *)(obj))->value.d)
+#define OBJ_NUM_UNWRAP(obj) (OBJ_IS_TAGGED_INT(obj) ? (long)((intptr_t)(obj) >> 1) : OBJ_IS_FLONUM(obj) ? lobjb_flonum_value((lky_object *)(obj)) : (((lky_object_builtin *)obj)->type == LBI_FLOAT ? ((lky_object_builtin *)obj)->value.d : ((lky_object_builtin *)obj)->value.i))
+#define OBJ_IS_NUMBER(obj) (OBJ_IS_TAGGED(obj) || obj->type == LBI_FLOAT || obj->type == LBI_INTEGER)
+#define OBJ_IS_INTEGER(obj) (OBJ_IS_TAGGED_INT(obj) || (!OBJ_IS_TAGGED(obj) && obj->type == LBI_INTEGER))
+#define OBJ_IS_FLOAT(obj) (OBJ_IS_FLONUM(obj) || (!OBJ_IS_TAGGED(obj) && obj->type == LBI_FLOAT))
 #define BIN_ARGS lky_object *a, lky_object *b
 #define BI_CAST(o, n) lky_object_builtin * n = (lky_object_builtin *) o
 #define GET_VA_ARGS(func) (lobj_get_member((lky_object *)func->bucket, "_va_args"))
 #define MAKE_VA_ARGS(args, list, ct) do { lky_object_seq *ab = args; int i = 0; for(; args; i++, args = args->next) { if(i < ct) continue; arr_append(&list, args->value);} args = ab; } while(0)
 #define LKY_NEXT_ITERABLE(obj) (obj->type != LBI_ITERABLE ? NULL :\
-        (((lky_object_iterable *)(obj))->index < ((lky_object_iterable *)(obj))->store->count ?\
-         ((lky_object_iterable *)(obj))->store->items[((lky_object_iterable *)(obj))->index++] : NULL))
+        ((lky_object_iterable *)(obj))->next((lky_object_iterable *)(obj)))
 #define LKY_TEST_FAST(cond)\
     (!cond || cond == &lky_nil ? &lky_no : (OBJ_IS_NUMBER(cond) ? (!!OBJ_NUM_UNWRAP(cond) ? &lky_yes : &lky_no) :\
                                             (cond->type == LBI_BOOL ? cond : &lky_yes)))
@@ -70,14 +79,41 @@ typedef struct {
     lobjb_void_ptr_function on_gc;
 } lky_object_builtin;
 
-typedef struct {
+struct lky_object_iterable_;
+typedef lky_object *(*lobjb_iterator_function)(struct lky_object_iterable_ *it);
+
+// The iterator a for-in loop walks (see lobjb_build_iterable). Items come
+// from 'next' one at a time, so nothing is copied up front; it returns NULL
+// once there are none left and counts the ones it hands out in 'index'.
+// The collector keeps 'owner' (which may be NULL) alive; 'state' is where
+// 'next' keeps its place.
+typedef struct lky_object_iterable_ {
     unsigned type : 4;
     unsigned mem_count : 2;
     struct lky_object *gc_next;
 
-    int index;
-    arraylist *store;
+    long index;
+    lobjb_iterator_function next;
     lky_object *owner;
+
+    union {
+        struct {
+            void *store;
+            long pos;
+            long end;
+        } walk;
+        struct {
+            long at;
+            long stop;
+            long step;
+        } range;
+        struct {
+            void *store;
+            int pos;
+            unsigned mods; // The table's mods when the walk began
+            struct interp *interp;
+        } table;
+    } state;
 } lky_object_iterable;
 
 typedef struct {
@@ -85,7 +121,7 @@ typedef struct {
     unsigned mem_count : 2;
     struct lky_object *gc_next;
 
-    hashtable members;
+    lky_members members;
     lky_object *cls;
 
     lky_callable callable;
@@ -105,16 +141,23 @@ typedef struct {
     long num_names;
 
     void **constants;
-    void **locals;
     char **names;
     unsigned char *ops;
+    lky_member_cache *member_caches;
     long *indices;
     long op_len;
+    int *tape; // The decoded instructions mach_eval runs (see load_bytecode)
+    long *tape_indices;
+    long tape_len;
     int stack_size;
     int catch_size;
 
     char *refname;
     char *impl_name;
+
+    void *jit; // Native code (see mach_jit.c), or NULL
+    long jit_size; // Bytes mapped for it
+    long jit_calls; // Calls counted towards compiling it; -1 if it will not be
 } lky_object_code;
 
 // TODO: Is this necessary?
@@ -128,7 +171,7 @@ struct lky_object_function {
     unsigned mem_count : 2;
     struct lky_object *gc_next;
 
-    hashtable members;
+    lky_members members;
 
     lky_callable callable;
 
@@ -148,7 +191,7 @@ typedef struct {
     unsigned mem_count : 2;
     struct lky_object *gc_next;
 
-    hashtable members;
+    lky_members members;
 
     lky_callable callable;
 
@@ -163,7 +206,7 @@ typedef struct {
     unsigned mem_count : 2;
     struct lky_object *gc_next;
 
-    hashtable members;
+    lky_members members;
     lky_object *cls;
 
     char *name;
@@ -175,11 +218,17 @@ typedef struct {
 extern int lobjb_uses_pointer_tags_;
 
 lky_object *lobjb_call(lky_object *func, lky_object_seq *args, struct interp *interp);
+lky_object *lobjb_call_argv(lky_object *func, int argc, lky_object **argv, struct interp *interp);
 lky_object *lobjb_build_int(long value);
 lky_object *lobjb_build_float(double value);
+lky_object *lobjb_try_render_tagged_pointer(long value);
+lky_object *lobjb_try_render_flonum(double value);
+double lobjb_flonum_value(lky_object *obj);
 lky_object *lobjb_build_blob(void *ptr, lobjb_void_ptr_function gc);
 lky_object *lobjb_build_error(char *name, char *text, struct interp *interp);
 lky_object *lobjb_build_iterable(lky_object *owner, struct interp *interp);
+lky_object_iterable *lobjb_build_iterator(lky_object *owner, lobjb_iterator_function next);
+lky_object *lobjb_build_range(long from, long to, long step);
 lky_object_custom *lobjb_build_custom(size_t extra_size);
 lky_object *lobjb_build_func(lky_object_code *code, int argc, arraylist inherited, mach_interp *interp);
 lky_object *lobjb_build_func_ex(lky_object *owner, int argc, lky_function_ptr ptr);
@@ -198,6 +247,7 @@ lky_object *lobjb_iterable_get_next(lky_object *obj);
 
 lky_object_seq *lobjb_make_seq_node(lky_object *value);
 void lobjb_free_seq(lky_object_seq *seq);
+void lobjb_free_code(lky_object_code *code);
 lky_object_seq *lobjb_build_args(lky_object *arg, ...);
 
 void lobjb_print_object(lky_object *a, struct interp *interp);
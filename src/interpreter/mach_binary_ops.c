@@ -17,17 +17,18 @@
  */
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
 #include <math.h>
 #include "mach_binary_ops.h"
 #include "lky_machine.h"
 
-#define IS_TAGGED(a) ((uintptr_t)(a) & 1)
+#define IS_TAGGED(a) OBJ_IS_TAGGED(a)
 #define IS_SINGLETON(a) (a && (a == &lky_nil || a == &lky_yes || a == &lky_no))
 #define EITHER_SIGNLETONS(a, b) (IS_SINGLETON(a) || IS_SINGLETON(b))
 #define IS_NIL(a) (a == &lky_nil)
 #define EITHER_NIL(a, b) (IS_NIL(a) || IS_NIL(b))
-#define OBJ_NUM_PROMO(a, b) ((!((uintptr_t)(a) & 1) && a->type == LBI_FLOAT) || (!((uintptr_t)(b) & 1) && b->type == LBI_FLOAT ) ? LBI_FLOAT : LBI_INTEGER) 
+#define OBJ_NUM_PROMO(a, b) (OBJ_IS_FLOAT(a) || OBJ_IS_FLOAT(b) ? LBI_FLOAT : LBI_INTEGER)
 #define CHECK_EXEC_CUSTOM_IMPL(a, b, name, interp) \
     do { \
         if((!(IS_TAGGED(a)) && a->type == LBI_CUSTOM) || (!(IS_TAGGED(a)) && a->type == LBI_CUSTOM_EX) || (!(IS_TAGGED(b)) && b->type == LBI_CUSTOM) || (!(IS_TAGGED(b)) && b->type == LBI_CUSTOM_EX)) { \
@@ -43,21 +44,36 @@
         } \
     } while(0)
 
+#define IS_CUSTOM(a) (!(IS_TAGGED(a)) && (a->type == LBI_CUSTOM || a->type == LBI_CUSTOM_EX))
+
+// Compares two numbers the way the quickened instructions do: two integers
+// exactly, as longs (doubles cannot tell large ones apart), and anything
+// else through double.
+#define NUM_COMPARE(a, b, op) (OBJ_IS_INTEGER(a) && OBJ_IS_INTEGER(b) ? \
+    OBJ_INT_UNWRAP(a) op OBJ_INT_UNWRAP(b) : OBJ_NUM_UNWRAP(a) op OBJ_NUM_UNWRAP(b))
+
+// For the operators that only mean something for numbers: an object without
+// its own implementation is a type error rather than a number to unwrap.
+#define REQUIRE_CUSTOM_IMPL(a, b, name, interp) \
+    do { \
+        CHECK_EXEC_CUSTOM_IMPL(a, b, name, interp); \
+        if(IS_CUSTOM(a) || IS_CUSTOM(b)) { \
+            char msg_[100]; \
+            sprintf(msg_, "Operand does not implement %s.", name); \
+            interp->error = lobjb_build_error("MismatchedType", msg_, interp); \
+            return &lky_nil; \
+        } \
+    } while(0)
+
 lky_object *bin_op_exec_custom(lky_object_function *func, lky_object *other, char first, struct interp *interp)
 {
-    lky_object_seq *seq = lobjb_make_seq_node(other);
-    lky_callable c = func->callable;
-
-    if(c.argc == 2)
-        seq->next = lobjb_make_seq_node(lobjb_build_int(first));
-    
-    lky_func_bundle b = MAKE_BUNDLE(func, seq, interp);
-    return (lky_object *)c.function(&b);
+    lky_object *argv[] = { other, lobjb_build_int(first) };
+    return lobjb_call_argv((lky_object *)func, func->callable.argc, argv, interp);
 }
 
 lky_object *lobjb_binary_add(lky_object *a, lky_object *b, struct interp *interp)
 {
-    CHECK_EXEC_CUSTOM_IMPL(a, b, "op_add_", interp);
+    REQUIRE_CUSTOM_IMPL(a, b, "op_add_", interp);
     BI_CAST(a, ab);
     BI_CAST(b, bb);
 
@@ -72,7 +88,7 @@ lky_object *lobjb_binary_add(lky_object *a, lky_object *b, struct interp *interp
             v.d = OBJ_NUM_UNWRAP(ab) + OBJ_NUM_UNWRAP(bb);
             break;
         case LBI_INTEGER:
-            v.i = OBJ_NUM_UNWRAP(ab) + OBJ_NUM_UNWRAP(bb);
+            v.i = OBJ_INT_UNWRAP(ab) + OBJ_INT_UNWRAP(bb);
             break;
         default:
             break;
@@ -83,7 +99,7 @@ lky_object *lobjb_binary_add(lky_object *a, lky_object *b, struct interp *interp
 
 lky_object *lobjb_binary_subtract(lky_object *a, lky_object *b, struct interp *interp)
 {
-    CHECK_EXEC_CUSTOM_IMPL(a, b, "op_subtract_", interp);
+    REQUIRE_CUSTOM_IMPL(a, b, "op_subtract_", interp);
     BI_CAST(a, ab);
     BI_CAST(b, bb);
 
@@ -98,7 +114,7 @@ lky_object *lobjb_binary_subtract(lky_object *a, lky_object *b, struct interp *i
             v.d = OBJ_NUM_UNWRAP(ab) - OBJ_NUM_UNWRAP(bb);
             break;
         case LBI_INTEGER:
-            v.i = OBJ_NUM_UNWRAP(ab) - OBJ_NUM_UNWRAP(bb);
+            v.i = OBJ_INT_UNWRAP(ab) - OBJ_INT_UNWRAP(bb);
             break;
         default:
             break;
@@ -109,7 +125,7 @@ lky_object *lobjb_binary_subtract(lky_object *a, lky_object *b, struct interp *i
 
 lky_object *lobjb_binary_multiply(lky_object *a, lky_object *b, struct interp *interp)
 {
-    CHECK_EXEC_CUSTOM_IMPL(a, b, "op_multiply_", interp);
+    REQUIRE_CUSTOM_IMPL(a, b, "op_multiply_", interp);
     BI_CAST(a, ab);
     BI_CAST(b, bb);
 
@@ -126,7 +142,7 @@ lky_object *lobjb_binary_multiply(lky_object *a, lky_object *b, struct interp *i
             v.d = OBJ_NUM_UNWRAP(ab) * OBJ_NUM_UNWRAP(bb);
             break;
         case LBI_INTEGER:
-            v.i = OBJ_NUM_UNWRAP(ab) * OBJ_NUM_UNWRAP(bb);
+            v.i = OBJ_INT_UNWRAP(ab) * OBJ_INT_UNWRAP(bb);
             break;
         default:
             break;
@@ -137,7 +153,7 @@ lky_object *lobjb_binary_multiply(lky_object *a, lky_object *b, struct interp *i
 
 lky_object *lobjb_binary_divide(lky_object *a, lky_object *b, struct interp *interp)
 {
-    CHECK_EXEC_CUSTOM_IMPL(a, b, "op_divide_", interp);
+    REQUIRE_CUSTOM_IMPL(a, b, "op_divide_", interp);
     BI_CAST(a, ab);
     BI_CAST(b, bb);
 
@@ -152,7 +168,12 @@ lky_object *lobjb_binary_divide(lky_object *a, lky_object *b, struct interp *int
             v.d = OBJ_NUM_UNWRAP(ab) / OBJ_NUM_UNWRAP(bb);
             break;
         case LBI_INTEGER:
-            v.i = OBJ_NUM_UNWRAP(ab) / OBJ_NUM_UNWRAP(bb);
+            if(!OBJ_INT_UNWRAP(bb))
+            {
+                interp->error = lobjb_build_error("ZeroDivision", "Integer division by zero.", interp);
+                return &lky_nil;
+            }
+            v.i = OBJ_INT_UNWRAP(ab) / OBJ_INT_UNWRAP(bb);
             break;
         default:
             break;
@@ -163,7 +184,7 @@ lky_object *lobjb_binary_divide(lky_object *a, lky_object *b, struct interp *int
 
 lky_object *lobjb_binary_modulo(lky_object *a, lky_object *b, struct interp *interp)
 {
-    CHECK_EXEC_CUSTOM_IMPL(a, b, "op_modulo_", interp);
+    REQUIRE_CUSTOM_IMPL(a, b, "op_modulo_", interp);
     BI_CAST(a, ab);
     BI_CAST(b, bb);
 
@@ -178,7 +199,12 @@ lky_object *lobjb_binary_modulo(lky_object *a, lky_object *b, struct interp *int
             v.d = remainder(OBJ_NUM_UNWRAP(ab), OBJ_NUM_UNWRAP(bb));
             break;
         case LBI_INTEGER:
-            v.i = (long)(OBJ_NUM_UNWRAP(a)) % (long)(OBJ_NUM_UNWRAP(b));
+            if(!OBJ_INT_UNWRAP(bb))
+            {
+                interp->error = lobjb_build_error("ZeroDivision", "Integer modulo by zero.", interp);
+                return &lky_nil;
+            }
+            v.i = OBJ_INT_UNWRAP(ab) % OBJ_INT_UNWRAP(bb);
             break;
         default:
             break;
@@ -189,7 +215,7 @@ lky_object *lobjb_binary_modulo(lky_object *a, lky_object *b, struct interp *int
 
 lky_object *lobjb_binary_power(lky_object *a, lky_object *b, struct interp *interp)
 {
-    CHECK_EXEC_CUSTOM_IMPL(a, b, "op_power_", interp);
+    REQUIRE_CUSTOM_IMPL(a, b, "op_power_", interp);
     BI_CAST(a, ab);
     BI_CAST(b, bb);
 
@@ -215,26 +241,26 @@ lky_object *lobjb_binary_power(lky_object *a, lky_object *b, struct interp *inte
 
 lky_object *lobjb_binary_lessthan(lky_object *a, lky_object *b, struct interp *interp)
 {
-    CHECK_EXEC_CUSTOM_IMPL(a, b, "op_lt_", interp);
+    REQUIRE_CUSTOM_IMPL(a, b, "op_lt_", interp);
     BI_CAST(a, ab);
     BI_CAST(b, bb);
 
     if(EITHER_SIGNLETONS(a, b))
         return &lky_nil;
 
-    return LKY_TESTC_FAST(OBJ_NUM_UNWRAP(ab) < OBJ_NUM_UNWRAP(bb));
+    return LKY_TESTC_FAST(NUM_COMPARE(ab, bb, <));
 }
 
 lky_object *lobjb_binary_greaterthan(lky_object *a, lky_object *b, struct interp *interp)
 {
-    CHECK_EXEC_CUSTOM_IMPL(a, b, "op_gt_", interp);
+    REQUIRE_CUSTOM_IMPL(a, b, "op_gt_", interp);
     BI_CAST(a, ab);
     BI_CAST(b, bb);
 
     if(EITHER_SIGNLETONS(a, b))
         return &lky_nil;
 
-    return LKY_TESTC_FAST(OBJ_NUM_UNWRAP(ab) > OBJ_NUM_UNWRAP(bb));
+    return LKY_TESTC_FAST(NUM_COMPARE(ab, bb, >));
 }
 
 lky_object *lobjb_binary_equals(lky_object *a, lky_object *b, struct interp *interp)
@@ -252,7 +278,7 @@ lky_object *lobjb_binary_equals(lky_object *a, lky_object *b, struct interp *int
         if(!OBJ_IS_NUMBER(ab) || !OBJ_IS_NUMBER(bb))
             return &lky_nil;
 
-        return LKY_TESTC_FAST(OBJ_NUM_UNWRAP(ab) == OBJ_NUM_UNWRAP(bb));
+        return LKY_TESTC_FAST(NUM_COMPARE(ab, bb, ==));
     }
 
     if(a->type == LBI_BOOL || b->type == LBI_BOOL)
@@ -263,26 +289,26 @@ lky_object *lobjb_binary_equals(lky_object *a, lky_object *b, struct interp *int
 
 lky_object *lobjb_binary_lessequal(lky_object *a, lky_object *b, struct interp *interp)
 {
-    CHECK_EXEC_CUSTOM_IMPL(a, b, "op_lte_", interp);
+    REQUIRE_CUSTOM_IMPL(a, b, "op_lte_", interp);
     BI_CAST(a, ab);
     BI_CAST(b, bb);
 
     if(EITHER_SIGNLETONS(a, b))
         return &lky_nil;
 
-    return LKY_TESTC_FAST(OBJ_NUM_UNWRAP(ab) <= OBJ_NUM_UNWRAP(bb));
+    return LKY_TESTC_FAST(NUM_COMPARE(ab, bb, <=));
 }
 
 lky_object *lobjb_binary_greatequal(lky_object *a, lky_object *b, struct interp *interp)
 {
-    CHECK_EXEC_CUSTOM_IMPL(a, b, "op_gte_", interp);
+    REQUIRE_CUSTOM_IMPL(a, b, "op_gte_", interp);
     BI_CAST(a, ab);
     BI_CAST(b, bb);
 
     if(EITHER_SIGNLETONS(a, b))
         return &lky_nil;
 
-    return LKY_TESTC_FAST(OBJ_NUM_UNWRAP(ab) >= OBJ_NUM_UNWRAP(bb));
+    return LKY_TESTC_FAST(NUM_COMPARE(ab, bb, >=));
 }
 
 lky_object *lobjb_binary_notequal(lky_object *a, lky_object *b, struct interp *interp)
@@ -299,7 +325,7 @@ lky_object *lobjb_binary_notequal(lky_object *a, lky_object *b, struct interp *i
         if(!OBJ_IS_NUMBER(ab) || !OBJ_IS_NUMBER(bb))
             return &lky_nil;
 
-        return LKY_TESTC_FAST(OBJ_NUM_UNWRAP(ab) != OBJ_NUM_UNWRAP(bb));
+        return LKY_TESTC_FAST(NUM_COMPARE(ab, bb, !=));
     }
 
     if(a->type == LBI_BOOL || b->type == LBI_BOOL)
@@ -317,8 +343,8 @@ lky_object *lobjb_binary_and(lky_object *a, lky_object *b, struct interp *interp
     if(EITHER_SIGNLETONS(a, b))
         return lobjb_build_int(0);
 
-    int vala = a->type == LBI_INTEGER || a->type == LBI_FLOAT ? (int)OBJ_NUM_UNWRAP(ab) : 1;
-    int valb = b->type == LBI_INTEGER || b->type == LBI_FLOAT ? (int)OBJ_NUM_UNWRAP(bb) : 1;
+    int vala = OBJ_IS_NUMBER(a) ? (int)OBJ_NUM_UNWRAP(ab) : 1;
+    int valb = OBJ_IS_NUMBER(b) ? (int)OBJ_NUM_UNWRAP(bb) : 1;
 
     return lobjb_build_int(vala && valb);
 }
@@ -332,8 +358,8 @@ lky_object *lobjb_binary_or(lky_object *a, lky_object *b, struct interp *interp)
     if(EITHER_SIGNLETONS(a, b))
         return lobjb_build_int(0);
 
-    int vala = a->type == LBI_INTEGER || a->type == LBI_FLOAT ? (int)OBJ_NUM_UNWRAP(ab) : 1;
-    int valb = b->type == LBI_INTEGER || b->type == LBI_FLOAT ? (int)OBJ_NUM_UNWRAP(bb) : 1;
+    int vala = OBJ_IS_NUMBER(a) ? (int)OBJ_NUM_UNWRAP(ab) : 1;
+    int valb = OBJ_IS_NUMBER(b) ? (int)OBJ_NUM_UNWRAP(bb) : 1;
     vala = a == &lky_nil ? 0 : vala;
     valb = b == &lky_nil ? 0 : valb;
 
@@ -342,65 +368,65 @@ lky_object *lobjb_binary_or(lky_object *a, lky_object *b, struct interp *interp)
 
 lky_object *lobjb_binary_band(lky_object *a, lky_object *b, struct interp *interp)
 {
-    CHECK_EXEC_CUSTOM_IMPL(a, b, "op_bit_and_", interp);
+    REQUIRE_CUSTOM_IMPL(a, b, "op_bit_and_", interp);
 
     if(!OBJ_IS_INTEGER(a) || !OBJ_IS_INTEGER(b))
         return &lky_nil;
 
-    long vala = OBJ_NUM_UNWRAP(a);
-    long valb = OBJ_NUM_UNWRAP(b);
+    long vala = OBJ_INT_UNWRAP(a);
+    long valb = OBJ_INT_UNWRAP(b);
 
     return lobjb_build_int(vala & valb);
 }
 
 lky_object *lobjb_binary_bor(lky_object *a, lky_object *b, struct interp *interp)
 {
-    CHECK_EXEC_CUSTOM_IMPL(a, b, "op_bit_or_", interp);
+    REQUIRE_CUSTOM_IMPL(a, b, "op_bit_or_", interp);
 
     if(!OBJ_IS_INTEGER(a) || !OBJ_IS_INTEGER(b))
         return &lky_nil;
 
-    long vala = OBJ_NUM_UNWRAP(a);
-    long valb = OBJ_NUM_UNWRAP(b);
+    long vala = OBJ_INT_UNWRAP(a);
+    long valb = OBJ_INT_UNWRAP(b);
 
     return lobjb_build_int(vala | valb);
 }
 
 lky_object *lobjb_binary_bxor(lky_object *a, lky_object *b, struct interp *interp)
 {
-    CHECK_EXEC_CUSTOM_IMPL(a, b, "op_bit_xor_", interp);
+    REQUIRE_CUSTOM_IMPL(a, b, "op_bit_xor_", interp);
 
     if(!OBJ_IS_INTEGER(a) || !OBJ_IS_INTEGER(b))
         return &lky_nil;
 
-    long vala = OBJ_NUM_UNWRAP(a);
-    long valb = OBJ_NUM_UNWRAP(b);
+    long vala = OBJ_INT_UNWRAP(a);
+    long valb = OBJ_INT_UNWRAP(b);
 
     return lobjb_build_int(vala ^ valb);
 }
 
 lky_object *lobjb_binary_blshift(lky_object *a, lky_object *b, struct interp *interp)
 {
-    CHECK_EXEC_CUSTOM_IMPL(a, b, "op_bit_l_shift_", interp);
+    REQUIRE_CUSTOM_IMPL(a, b, "op_bit_l_shift_", interp);
 
     if(!OBJ_IS_INTEGER(a) || !OBJ_IS_INTEGER(b))
         return &lky_nil;
 
-    long vala = OBJ_NUM_UNWRAP(a);
-    long valb = OBJ_NUM_UNWRAP(b);
+    long vala = OBJ_INT_UNWRAP(a);
+    long valb = OBJ_INT_UNWRAP(b);
 
     return lobjb_build_int(vala << valb);
 }
 
 lky_object *lobjb_binary_brshift(lky_object *a, lky_object *b, struct interp *interp)
 {
-    CHECK_EXEC_CUSTOM_IMPL(a, b, "op_bit_r_shift_", interp);
+    REQUIRE_CUSTOM_IMPL(a, b, "op_bit_r_shift_", interp);
 
     if(!OBJ_IS_INTEGER(a) || !OBJ_IS_INTEGER(b))
         return &lky_nil;
 
-    long vala = OBJ_NUM_UNWRAP(a);
-    long valb = OBJ_NUM_UNWRAP(b);
+    long vala = OBJ_INT_UNWRAP(a);
+    long valb = OBJ_INT_UNWRAP(b);
 
     return lobjb_build_int(vala >> valb);
 }
@@ -409,3 +435,92 @@ lky_object *lobjb_binary_nc(lky_object *a, lky_object *b, struct interp *interp)
 {
     return a == &lky_nil ? b : a;
 }
+
+// The fast paths below back the quickened instructions (see mach_quicken in
+// lky_machine.c). They skip the custom operator lookup and the type checks
+// of the generic functions above, so the caller must already have checked
+// the operand tags. They return NULL when the generic function has to
+// handle the operation after all (division by zero, for instance).
+int lobjb_binary_has_int_op(lky_instruction op)
+{
+    switch(op)
+    {
+        case LI_BINARY_ADD:
+        case LI_BINARY_SUBTRACT:
+        case LI_BINARY_MULTIPLY:
+        case LI_BINARY_DIVIDE:
+        case LI_BINARY_MODULO:
+        case LI_BINARY_LT:
+        case LI_BINARY_GT:
+        case LI_BINARY_EQUAL:
+        case LI_BINARY_LTE:
+        case LI_BINARY_GTE:
+        case LI_BINARY_NE:
+        case LI_BINARY_BAND:
+        case LI_BINARY_BOR:
+        case LI_BINARY_BXOR:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+lky_object *lobjb_binary_int_op(lky_instruction op, long x, long y)
+{
+    switch(op)
+    {
+        case LI_BINARY_ADD: return lobjb_build_int(x + y);
+        case LI_BINARY_SUBTRACT: return lobjb_build_int(x - y);
+        case LI_BINARY_MULTIPLY: return lobjb_build_int(x * y);
+        case LI_BINARY_DIVIDE: return y ? lobjb_build_int(x / y) : NULL;
+        case LI_BINARY_MODULO: return y ? lobjb_build_int(x % y) : NULL;
+        case LI_BINARY_LT: return LKY_TESTC_FAST(x < y);
+        case LI_BINARY_GT: return LKY_TESTC_FAST(x > y);
+        case LI_BINARY_EQUAL: return LKY_TESTC_FAST(x == y);
+        case LI_BINARY_LTE: return LKY_TESTC_FAST(x <= y);
+        case LI_BINARY_GTE: return LKY_TESTC_FAST(x >= y);
+        case LI_BINARY_NE: return LKY_TESTC_FAST(x != y);
+        case LI_BINARY_BAND: return lobjb_build_int(x & y);
+        case LI_BINARY_BOR: return lobjb_build_int(x | y);
+        case LI_BINARY_BXOR: return lobjb_build_int(x ^ y);
+        default: return NULL;
+    }
+}
+
+int lobjb_binary_has_float_op(lky_instruction op)
+{
+    switch(op)
+    {
+        case LI_BINARY_ADD:
+        case LI_BINARY_SUBTRACT:
+        case LI_BINARY_MULTIPLY:
+        case LI_BINARY_DIVIDE:
+        case LI_BINARY_LT:
+        case LI_BINARY_GT:
+        case LI_BINARY_EQUAL:
+        case LI_BINARY_LTE:
+        case LI_BINARY_GTE:
+        case LI_BINARY_NE:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+lky_object *lobjb_binary_float_op(lky_instruction op, double x, double y)
+{
+    switch(op)
+    {
+        case LI_BINARY_ADD: return lobjb_build_float(x + y);
+        case LI_BINARY_SUBTRACT: return lobjb_build_float(x - y);
+        case LI_BINARY_MULTIPLY: return lobjb_build_float(x * y);
+        case LI_BINARY_DIVIDE: return lobjb_build_float(x / y);
+        case LI_BINARY_LT: return LKY_TESTC_FAST(x < y);
+        case LI_BINARY_GT: return LKY_TESTC_FAST(x > y);
+        case LI_BINARY_EQUAL: return LKY_TESTC_FAST(x == y);
+        case LI_BINARY_LTE: return LKY_TESTC_FAST(x <= y);
+        case LI_BINARY_GTE: return LKY_TESTC_FAST(x >= y);
+        case LI_BINARY_NE: return LKY_TESTC_FAST(x != y);
+        default: return NULL;
+    }
+}
@@ -20,6 +20,7 @@
 #define MACH_BINARY_OPS
 
 #include "lkyobj_builtin.h"
+#include "instruction_set.h"
 
 lky_object *lobjb_binary_add(lky_object *a, lky_object *b, struct interp *interp);
 lky_object *lobjb_binary_subtract(lky_object *a, lky_object *b, struct interp *interp);
@@ -44,4 +45,10 @@ lky_object *lobjb_binary_bxor(lky_object *a, lky_object *b, struct interp *inter
 lky_object *lobjb_binary_blshift(lky_object *a, lky_object *b, struct interp *interp);
 lky_object *lobjb_binary_brshift(lky_object *a, lky_object *b, struct interp *interp);
 
+// Specialized forms for operands known to be tagged integers or flonums
+lky_object *lobjb_binary_int_op(lky_instruction op, long x, long y);
+lky_object *lobjb_binary_float_op(lky_instruction op, double x, double y);
+int lobjb_binary_has_int_op(lky_instruction op);
+int lobjb_binary_has_float_op(lky_instruction op);
+
 #endif
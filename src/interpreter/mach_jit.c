@@ -0,0 +1,1205 @@
+/* Lanky -- Scripting Language and Virtual Machine
+ * Copyright (C) 2014  Sam Olsen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// mach_jit.c
+// ===================================
+//
+// A baseline compiler from bytecode to x86-64 machine code. Once the JIT is
+// turned on (--jit) and a function has been called MACH_JIT_THRESHOLD times,
+// its tape is translated one instruction at a time into a straight line of
+// native code. The instructions that only move values between the locals,
+// the constants and the data stack are emitted inline; every other one
+// becomes a call to a helper below that does the same work as its body in
+// mach_eval. Jumps become native jumps, so there is no dispatch at all.
+//
+// The native code works on the same stackframe the interpreter would (it
+// keeps the frame in rbx) and stores the pc before each instruction, so the
+// collector, error traces and calls in and out of it see no difference.
+// Functions that use an instruction the compiler does not handle (catch
+// blocks, nested function, class and object definitions, modules) are left
+// to mach_eval.
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // For MAP_ANONYMOUS
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "mach_jit.h"
+#include "instruction_set.h"
+#include "bytecode_analyzer.h"
+#include "mach_binary_ops.h"
+#include "mach_unary_ops.h"
+#include "lky_object.h"
+#include "lky_gc.h"
+#include "stl_array.h"
+#include "stl_string.h"
+
+#if MACH_JIT_SUPPORTED
+#include <sys/mman.h>
+#endif
+
+// Set by the --jit flag.
+int mach_jit_enabled_ = 0;
+
+typedef void (*mach_jit_entry)(stackframe *frame);
+
+void mach_jit_run(stackframe *frame)
+{
+    mach_interp *interp = frame->interp;
+
+    // The same checks mach_eval makes before its first instruction.
+    if(interp->error && mach_unwind_error(frame))
+        return;
+
+    gc_gc();
+
+    ((mach_jit_entry)frame->func->code->jit)(frame);
+}
+
+#if !MACH_JIT_SUPPORTED
+
+void mach_jit_compile(lky_object_code *code)
+{
+    code->jit_calls = -1;
+}
+
+void mach_jit_release(lky_object_code *code)
+{
+    code->jit = NULL;
+}
+
+#else
+
+// Helpers
+// -----------------------------------
+// Called from the native code with the frame and the instruction's operands.
+// Unless noted they return non-zero when an error was raised, in which case
+// the native code unwinds with mach_unwind_error.
+
+#define jit_status_(frame) ((frame)->interp->error != NULL)
+
+static lky_object *jit_binary_op_(stackframe *frame, lky_instruction bop, lky_object *l, lky_object *r)
+{
+    lky_object *obj = NULL;
+    if(OBJ_IS_TAGGED_INT(l) && OBJ_IS_TAGGED_INT(r) && lobjb_binary_has_int_op(bop))
+        obj = lobjb_binary_int_op(bop, OBJ_INT_UNWRAP(l), OBJ_INT_UNWRAP(r));
+    else if(OBJ_IS_FLONUM(l) && OBJ_IS_FLONUM(r) && lobjb_binary_has_float_op(bop))
+        obj = lobjb_binary_float_op(bop, OBJ_FLOAT_UNWRAP(l), OBJ_FLOAT_UNWRAP(r));
+
+    return obj ? obj : mach_binary_op(bop, l, r, frame->interp);
+}
+
+static int jit_binary(stackframe *frame, lky_instruction bop)
+{
+    lky_object *a = pop_node(frame);
+    lky_object *b = pop_node(frame);
+
+    push_node(frame, jit_binary_op_(frame, bop, b, a));
+    return jit_status_(frame);
+}
+
+// Returns -1 on error, otherwise whether the branch is taken.
+static int jit_binary_jump_false(stackframe *frame, lky_instruction bop)
+{
+    lky_object *a = pop_node(frame);
+    lky_object *b = pop_node(frame);
+
+    lky_object *obj = jit_binary_op_(frame, bop, b, a);
+    if(jit_status_(frame))
+        return -1;
+
+    return !LKY_CTEST_FAST(obj);
+}
+
+#define jit_reg_operand_(frame, r) ((r) & LKY_REG_CONST ? (lky_object *)(frame)->constants[(r) & ~LKY_REG_CONST] : (frame)->locals[(r)])
+
+static int jit_reg_binary(stackframe *frame, lky_instruction bop, unsigned int lhs, unsigned int rhs, unsigned int dst)
+{
+    lky_object *obj = jit_binary_op_(frame, bop, jit_reg_operand_(frame, lhs), jit_reg_operand_(frame, rhs));
+    if(jit_status_(frame))
+        return 1;
+
+    frame->locals[dst] = obj;
+    return 0;
+}
+
+static int jit_reg_binary_push(stackframe *frame, lky_instruction bop, unsigned int lhs, unsigned int rhs)
+{
+    push_node(frame, jit_binary_op_(frame, bop, jit_reg_operand_(frame, lhs), jit_reg_operand_(frame, rhs)));
+    return jit_status_(frame);
+}
+
+// Returns -1 on error, otherwise whether the test fails (and so the branch
+// is taken).
+static int jit_for_range(stackframe *frame, lky_instruction cop, unsigned int ctr, unsigned int bound)
+{
+    lky_object *obj = jit_binary_op_(frame, cop, frame->locals[ctr], jit_reg_operand_(frame, bound));
+    if(jit_status_(frame))
+        return -1;
+
+    return !LKY_CTEST_FAST(obj);
+}
+
+// Returns -1 on error, otherwise whether the test holds (and so the branch
+// is taken). 'ops' carries the step's operation in its upper byte and the
+// test's in its lower one.
+static int jit_for_step(stackframe *frame, unsigned int ops, unsigned int ctr, unsigned int by, unsigned int bound)
+{
+    lky_object *obj = jit_binary_op_(frame, ops >> 8, frame->locals[ctr], jit_reg_operand_(frame, by));
+    if(jit_status_(frame))
+        return -1;
+
+    frame->locals[ctr] = obj;
+    obj = jit_binary_op_(frame, ops & 0xFF, obj, jit_reg_operand_(frame, bound));
+    if(jit_status_(frame))
+        return -1;
+
+    return LKY_CTEST_FAST(obj);
+}
+
+static int jit_unary_not(stackframe *frame)
+{
+    push_node(frame, lobjb_unary_not(pop_node(frame), frame->interp));
+    return jit_status_(frame);
+}
+
+static int jit_unary_negative(stackframe *frame)
+{
+    push_node(frame, lobjb_unary_negative(pop_node(frame)));
+    return jit_status_(frame);
+}
+
+static int jit_print(stackframe *frame)
+{
+    lobjb_print(pop_node(frame), frame->interp);
+    return jit_status_(frame);
+}
+
+// The conditional jumps return whether the branch is taken.
+static int jit_jump_false(stackframe *frame)
+{
+    lky_object *obj = pop_node(frame);
+    return !LKY_CTEST_FAST(obj);
+}
+
+static int jit_jump_false_else_pop(stackframe *frame)
+{
+    lky_object *obj = top_node(frame);
+    if(!LKY_CTEST_FAST(obj))
+        return 1;
+
+    pop_node(frame);
+    return 0;
+}
+
+static int jit_jump_true_else_pop(stackframe *frame)
+{
+    lky_object *obj = top_node(frame);
+    if(LKY_CTEST_FAST(obj))
+        return 1;
+
+    pop_node(frame);
+    return 0;
+}
+
+// Run where mach_eval has a safepoint.
+static int jit_safepoint(stackframe *frame)
+{
+    gc_gc();
+    return 0;
+}
+
+static int jit_overflow(stackframe *frame)
+{
+    frame->interp->error = lobjb_build_error("StackOverflow", "Data stack overflow.", frame->interp);
+    return 1;
+}
+
+static int jit_call_func(stackframe *frame, int ct)
+{
+    mach_interp *interp = frame->interp;
+    lky_object *obj = pop_node(frame);
+
+    // As in mach_eval, the arguments stay on the stack during the call.
+    lky_object **argv = (lky_object **)frame->data_stack + frame->stack_pointer - ct + 1;
+
+    // Lanky functions skip the call bundle and go straight to mach_call.
+    lky_object *ret;
+    if(!OBJ_IS_TAGGED(obj) && obj->type == LBI_FUNCTION &&
+            ((lky_object_function *)obj)->callable.function == (lky_function_ptr)lobjb_default_callable)
+        ret = mach_call((lky_object_function *)obj, ct, argv);
+    else
+        ret = lobjb_call_argv(obj, ct, argv, interp);
+
+    frame->stack_pointer -= ct;
+    if(frame->thrown)
+    {
+        interp->error = frame->thrown;
+        frame->thrown = NULL;
+        return 1;
+    }
+
+    push_node(frame, ret);
+    return jit_status_(frame) || jit_safepoint(frame);
+}
+
+static int jit_return(stackframe *frame)
+{
+    frame->ret = pop_node(frame);
+    return 0;
+}
+
+static int jit_push_new_object(stackframe *frame)
+{
+    push_node(frame, lobj_alloc());
+    return jit_status_(frame) || jit_safepoint(frame);
+}
+
+static int jit_load_member(stackframe *frame, unsigned int idx, unsigned int cidx)
+{
+    lky_object *obj = pop_node(frame);
+    lky_object *val = mach_load_member(frame, obj, frame->names[idx], frame->member_caches + cidx);
+    if(!val)
+        return 1;
+
+    push_node(frame, val);
+    return jit_status_(frame);
+}
+
+static int jit_load_local_member(stackframe *frame, unsigned int lidx, unsigned int idx, unsigned int cidx)
+{
+    lky_object *val = mach_load_member(frame, frame->locals[lidx], frame->names[idx], frame->member_caches + cidx);
+    if(!val)
+        return 1;
+
+    push_node(frame, val);
+    return jit_status_(frame);
+}
+
+static int jit_save_member(stackframe *frame, unsigned int idx, unsigned int cidx)
+{
+    lky_object *obj = pop_node(frame);
+    lky_object *val = top_node(frame);
+
+    lobj_set_member_cached(obj, frame->names[idx], val, frame->member_caches + cidx);
+    return jit_status_(frame);
+}
+
+static int jit_save_close(stackframe *frame, unsigned int idx)
+{
+    mach_save_close(frame, frame->names[idx], top_node(frame));
+    return jit_status_(frame);
+}
+
+static int jit_bind_close(stackframe *frame, unsigned int lidx, unsigned int idx)
+{
+    lobj_set_member_sym(mach_frame_bucket(frame), frame->names[idx], frame->locals[lidx]);
+    return jit_status_(frame);
+}
+
+static int jit_load_close(stackframe *frame, unsigned int idx)
+{
+    lky_object *obj = mach_load_close(frame, frame->names[idx]);
+    if(!obj)
+        return 1;
+
+    push_node(frame, obj);
+    return jit_status_(frame);
+}
+
+static int jit_make_array(stackframe *frame, unsigned int ct)
+{
+    arraylist arr = arr_create(ct + 10);
+
+    int i;
+    for(i = ct - 1; i >= 0; i--)
+    {
+        lky_object *obj = frame->data_stack[frame->stack_pointer - i];
+        frame->data_stack[frame->stack_pointer - i] = NULL;
+        arr_append(&arr, obj);
+    }
+
+    frame->stack_pointer -= ct;
+
+    push_node(frame, stlarr_cinit(arr));
+    return jit_status_(frame) || jit_safepoint(frame);
+}
+
+static int jit_concat(stackframe *frame, unsigned int ct)
+{
+    lky_object *obj = stlstr_concat((lky_object **)frame->data_stack + frame->stack_pointer - ct + 1, ct, frame->interp);
+
+    int i;
+    for(i = 0; i < ct; i++)
+        frame->data_stack[frame->stack_pointer - i] = NULL;
+    frame->stack_pointer -= ct;
+
+    push_node(frame, obj);
+    return jit_status_(frame) || jit_safepoint(frame);
+}
+
+static int jit_load_index(stackframe *frame)
+{
+    lky_object *idx = pop_node(frame);
+    lky_object *targ = pop_node(frame);
+
+    push_node(frame, lobjb_unary_load_index(targ, idx, frame->interp));
+    return jit_status_(frame);
+}
+
+static int jit_save_index(stackframe *frame)
+{
+    lky_object *idx = pop_node(frame);
+    lky_object *targ = pop_node(frame);
+
+    lobjb_unary_save_index(targ, idx, top_node(frame), frame->interp);
+    return jit_status_(frame);
+}
+
+static int jit_dduplicate(stackframe *frame)
+{
+    lky_object *topa = top_node(frame);
+    lky_object *topb = frame->data_stack[frame->stack_pointer - 1];
+
+    push_node(frame, topb);
+    push_node(frame, topa);
+    return jit_status_(frame);
+}
+
+static int jit_flip_two(stackframe *frame)
+{
+    lky_object *topa = pop_node(frame);
+    lky_object *topb = pop_node(frame);
+
+    push_node(frame, topa);
+    push_node(frame, topb);
+    return 0;
+}
+
+static int jit_sink_first(stackframe *frame)
+{
+    lky_object *topa = pop_node(frame);
+    lky_object *topb = pop_node(frame);
+    lky_object *topc = pop_node(frame);
+
+    push_node(frame, topa);
+    push_node(frame, topc);
+    push_node(frame, topb);
+    return 0;
+}
+
+static int jit_make_iter(stackframe *frame)
+{
+    lky_object *obj = pop_node(frame);
+
+    push_node(frame, lobjb_build_iterable(obj, frame->interp));
+    return jit_status_(frame) || jit_safepoint(frame);
+}
+
+// Returns -1 on error, otherwise whether the iterator is done (and so the
+// branch is taken).
+static int jit_next_iter_or_jump(stackframe *frame)
+{
+    lky_object *it = top_node(frame);
+    lky_object *nxt = LKY_NEXT_ITERABLE(it);
+    if(!nxt)
+        return jit_status_(frame) ? -1 : 1;
+
+    push_node(frame, nxt);
+    return jit_status_(frame) ? -1 : 0;
+}
+
+static int jit_iter_index(stackframe *frame)
+{
+    lky_object_iterable *it = (lky_object_iterable *)top_node(frame);
+
+    push_node(frame, lobjb_build_int(it->index - 1));
+    return jit_status_(frame);
+}
+
+static int jit_raise(stackframe *frame)
+{
+    mach_interp *interp = frame->interp;
+
+    interp->error = lobjb_build_error("", "", interp);
+    lobj_set_member(interp->error, "custom_", pop_node(frame));
+    return 1;
+}
+
+// Code generation
+// -----------------------------------
+
+typedef struct {
+    unsigned char *bytes;
+    long count;
+    long size;
+} jit_buffer;
+
+// A rel32 jump operand at 'at' that is resolved to 'target' once the whole
+// tape has been emitted: a location in the tape or one of the labels below.
+typedef struct {
+    long at;
+    long target;
+} jit_fixup;
+
+#define JIT_LABEL_ERROR -1
+#define JIT_LABEL_OVERFLOW -2
+#define JIT_LABEL_EXIT -3
+
+// Registers, numbered as in the instruction encoding.
+#define JIT_RAX 0
+#define JIT_RCX 1
+#define JIT_RDX 2
+#define JIT_RSI 6
+#define JIT_RDI 7
+
+#define JIT_FIELD(name) ((unsigned int)offsetof(stackframe, name))
+
+static void jit_emit(jit_buffer *buf, const unsigned char *bytes, int n)
+{
+    if(buf->count + n > buf->size)
+    {
+        buf->size = (buf->size + n) * 2;
+        buf->bytes = realloc(buf->bytes, buf->size);
+    }
+
+    memcpy(buf->bytes + buf->count, bytes, n);
+    buf->count += n;
+}
+
+#define jit_bytes_(buf, ...) do {\
+    const unsigned char b_[] = { __VA_ARGS__ };\
+    jit_emit(buf, b_, sizeof(b_));\
+} while(0)
+
+static void jit_emit_u32(jit_buffer *buf, unsigned int v)
+{
+    jit_emit(buf, (unsigned char *)&v, 4);
+}
+
+static void jit_emit_u64(jit_buffer *buf, uint64_t v)
+{
+    jit_emit(buf, (unsigned char *)&v, 8);
+}
+
+// Emits the jump opcode in 'op' (one or two bytes) with a zero operand and
+// returns where the operand is. Jumps within an instruction's code are
+// patched with jit_patch_here once their target has been emitted.
+static long jit_emit_local_jump(jit_buffer *buf, unsigned int op)
+{
+    if(op > 0xFF)
+        jit_bytes_(buf, op >> 8, op & 0xFF);
+    else
+        jit_bytes_(buf, op);
+
+    long at = buf->count;
+    jit_emit_u32(buf, 0);
+    return at;
+}
+
+static void jit_patch_here(jit_buffer *buf, long at)
+{
+    int rel = (int)(buf->count - (at + 4));
+    memcpy(buf->bytes + at, &rel, 4);
+}
+
+// Emits the jump opcode in 'op' towards 'target', which is resolved once
+// the whole tape has been emitted.
+static void jit_emit_jump(jit_buffer *buf, jit_fixup *fixups, long *nfixups, unsigned int op, long target)
+{
+    fixups[*nfixups].at = jit_emit_local_jump(buf, op);
+    fixups[*nfixups].target = target;
+    (*nfixups)++;
+}
+
+#define JIT_JMP 0xE9
+#define JIT_JNZ 0x0F85
+#define JIT_JS 0x0F88
+#define JIT_JGE 0x0F8D
+#define JIT_JZ 0x0F84
+#define JIT_JO 0x0F80
+
+// The conditional jump on condition code 'cc'.
+#define JIT_JCC(cc) (0x0F80 | (cc))
+
+// mov reg, [rbx + field]
+static void jit_emit_load(jit_buffer *buf, int reg, unsigned int field)
+{
+    jit_bytes_(buf, 0x48, 0x8B, 0x83 | (reg << 3));
+    jit_emit_u32(buf, field);
+}
+
+// mov [rbx + field], reg
+static void jit_emit_store(jit_buffer *buf, int reg, unsigned int field)
+{
+    jit_bytes_(buf, 0x48, 0x89, 0x83 | (reg << 3));
+    jit_emit_u32(buf, field);
+}
+
+// Calls fn(frame, a, b, c, d); only the first 'argc' operands are passed.
+static void jit_emit_call(jit_buffer *buf, void *fn, int argc, unsigned int a, unsigned int b, unsigned int c, unsigned int d)
+{
+    jit_bytes_(buf, 0x48, 0x89, 0xDF); // mov rdi, rbx
+    if(argc > 0)
+    {
+        jit_bytes_(buf, 0xBE); // mov esi, imm32
+        jit_emit_u32(buf, a);
+    }
+    if(argc > 1)
+    {
+        jit_bytes_(buf, 0xBA); // mov edx, imm32
+        jit_emit_u32(buf, b);
+    }
+    if(argc > 2)
+    {
+        jit_bytes_(buf, 0xB9); // mov ecx, imm32
+        jit_emit_u32(buf, c);
+    }
+    if(argc > 3)
+    {
+        jit_bytes_(buf, 0x41, 0xB8); // mov r8d, imm32
+        jit_emit_u32(buf, d);
+    }
+
+    jit_bytes_(buf, 0x48, 0xB8); // mov rax, imm64
+    jit_emit_u64(buf, (uint64_t)(uintptr_t)fn);
+    jit_bytes_(buf, 0xFF, 0xD0); // call rax
+}
+
+// test eax, eax
+static void jit_emit_test(jit_buffer *buf)
+{
+    jit_bytes_(buf, 0x85, 0xC0);
+}
+
+// Pushes rax onto the data stack, raising a StackOverflow as push_node does.
+static void jit_emit_push(jit_buffer *buf, jit_fixup *fixups, long *nfixups)
+{
+    jit_emit_load(buf, JIT_RDX, JIT_FIELD(stack_pointer));
+    jit_bytes_(buf, 0x48, 0xFF, 0xC2); // inc rdx
+    jit_bytes_(buf, 0x48, 0x3B, 0x93); // cmp rdx, [rbx + stack_size]
+    jit_emit_u32(buf, JIT_FIELD(stack_size));
+    jit_emit_jump(buf, fixups, nfixups, JIT_JGE, JIT_LABEL_OVERFLOW);
+    jit_emit_load(buf, JIT_RCX, JIT_FIELD(data_stack));
+    jit_bytes_(buf, 0x48, 0x89, 0x04, 0xD1); // mov [rcx + rdx * 8], rax
+    jit_emit_store(buf, JIT_RDX, JIT_FIELD(stack_pointer));
+}
+
+// Loads the top of the data stack into rax; if 'pop' is set the slot is
+// cleared and popped.
+static void jit_emit_top(jit_buffer *buf, int pop)
+{
+    jit_emit_load(buf, JIT_RDX, JIT_FIELD(stack_pointer));
+    jit_emit_load(buf, JIT_RCX, JIT_FIELD(data_stack));
+    jit_bytes_(buf, 0x48, 0x8B, 0x04, 0xD1); // mov rax, [rcx + rdx * 8]
+
+    if(!pop)
+        return;
+
+    jit_bytes_(buf, 0x48, 0xC7, 0x04, 0xD1, 0, 0, 0, 0); // mov qword [rcx + rdx * 8], 0
+    jit_bytes_(buf, 0x48, 0xFF, 0xCA); // dec rdx
+    jit_emit_store(buf, JIT_RDX, JIT_FIELD(stack_pointer));
+}
+
+// Tagged integer fast paths
+// -----------------------------------
+// The arithmetic and comparison instructions most loops are made of check
+// inline whether both operands are tagged integers and, if so, compute the
+// result without leaving the native code. When the check fails (or the
+// result would not fit in a tagged integer) they jump to their slow path,
+// the call to the helper for the instruction.
+
+// Jumps to an instruction's slow path, patched once it has been emitted.
+typedef struct {
+    long at[4];
+    int count;
+} jit_slow_jumps;
+
+// Returns the condition code under which the comparison 'bop' is true, -1
+// for the arithmetic operations with a fast path and -2 for the rest.
+static int jit_condition(lky_instruction bop)
+{
+    switch(bop)
+    {
+        case LI_BINARY_LT: return 0xC;
+        case LI_BINARY_GTE: return 0xD;
+        case LI_BINARY_LTE: return 0xE;
+        case LI_BINARY_GT: return 0xF;
+        case LI_BINARY_EQUAL: return 0x4;
+        case LI_BINARY_NE: return 0x5;
+        case LI_BINARY_ADD:
+        case LI_BINARY_SUBTRACT:
+        case LI_BINARY_MULTIPLY:
+            return -1;
+        default:
+            return -2;
+    }
+}
+
+// Loads the two values on top of the data stack: the left operand into rax
+// and the right one into rsi. The stack pointer is left in rdx and the
+// stack in rcx.
+static void jit_emit_stack_operands(jit_buffer *buf)
+{
+    jit_emit_load(buf, JIT_RDX, JIT_FIELD(stack_pointer));
+    jit_emit_load(buf, JIT_RCX, JIT_FIELD(data_stack));
+    jit_bytes_(buf, 0x48, 0x8B, 0x44, 0xD1, 0xF8); // mov rax, [rcx + rdx * 8 - 8]
+    jit_bytes_(buf, 0x48, 0x8B, 0x34, 0xD1); // mov rsi, [rcx + rdx * 8]
+}
+
+// Loads the register form operand 'r' (see REG_OPERAND in lky_machine.c)
+// into 'reg'.
+static void jit_emit_reg_operand(jit_buffer *buf, int reg, unsigned int r)
+{
+    jit_emit_load(buf, reg, r & LKY_REG_CONST ? JIT_FIELD(constants) : JIT_FIELD(locals));
+    jit_bytes_(buf, 0x48, 0x8B, 0x80 | (reg << 3) | reg); // mov reg, [reg + idx * 8]
+    jit_emit_u32(buf, (r & ~LKY_REG_CONST) * 8);
+}
+
+// Jumps to the slow path unless rax and rsi are both tagged integers.
+static void jit_emit_int_check(jit_buffer *buf, jit_slow_jumps *slow)
+{
+    jit_bytes_(buf, 0x49, 0x89, 0xC0); // mov r8, rax
+    jit_bytes_(buf, 0x49, 0x21, 0xF0); // and r8, rsi
+    jit_bytes_(buf, 0x41, 0xF6, 0xC0, 0x01); // test r8b, 1
+    slow->at[slow->count++] = jit_emit_local_jump(buf, JIT_JZ);
+}
+
+// Computes rax 'bop' rsi into rax for two tagged integers, jumping to the
+// slow path if the result overflows. Comparisons give lky_yes or lky_no.
+static void jit_emit_int_result(jit_buffer *buf, lky_instruction bop, jit_slow_jumps *slow)
+{
+    int cc = jit_condition(bop);
+    if(cc >= 0)
+    {
+        jit_bytes_(buf, 0x48, 0x39, 0xF0); // cmp rax, rsi
+        jit_bytes_(buf, 0x48, 0xB8); // mov rax, imm64
+        jit_emit_u64(buf, (uintptr_t)&lky_no);
+        jit_bytes_(buf, 0x48, 0xBF); // mov rdi, imm64
+        jit_emit_u64(buf, (uintptr_t)&lky_yes);
+        jit_bytes_(buf, 0x48, 0x0F, 0x40 | cc, 0xC7); // cmovcc rax, rdi
+        return;
+    }
+
+    // With x and y tagged as 2x + 1 and 2y + 1.
+    switch(bop)
+    {
+        case LI_BINARY_ADD:
+            jit_bytes_(buf, 0x48, 0x83, 0xEE, 0x01); // sub rsi, 1
+            jit_bytes_(buf, 0x48, 0x01, 0xF0); // add rax, rsi
+            slow->at[slow->count++] = jit_emit_local_jump(buf, JIT_JO);
+            break;
+        case LI_BINARY_SUBTRACT:
+            jit_bytes_(buf, 0x48, 0x29, 0xF0); // sub rax, rsi
+            slow->at[slow->count++] = jit_emit_local_jump(buf, JIT_JO);
+            jit_bytes_(buf, 0x48, 0x83, 0xC0, 0x01); // add rax, 1
+            break;
+        case LI_BINARY_MULTIPLY:
+            jit_bytes_(buf, 0x48, 0xD1, 0xF8); // sar rax, 1
+            jit_bytes_(buf, 0x48, 0x83, 0xEE, 0x01); // sub rsi, 1
+            jit_bytes_(buf, 0x48, 0x0F, 0xAF, 0xC6); // imul rax, rsi
+            slow->at[slow->count++] = jit_emit_local_jump(buf, JIT_JO);
+            jit_bytes_(buf, 0x48, 0x83, 0xC8, 0x01); // or rax, 1
+            break;
+        default:
+            break;
+    }
+}
+
+static void jit_patch_slow(jit_buffer *buf, jit_slow_jumps *slow)
+{
+    int i;
+    for(i = 0; i < slow->count; i++)
+        jit_patch_here(buf, slow->at[i]);
+}
+
+// Maps the quickened forms of the stack binary instructions back to the
+// operation they perform; the helpers have their own fast paths.
+static lky_instruction jit_generic_binary(lky_instruction op)
+{
+    switch(op)
+    {
+        case LI_BINARY_ADD_INT:
+        case LI_BINARY_ADD_FLOAT:
+            return LI_BINARY_ADD;
+        case LI_BINARY_SUBTRACT_INT:
+        case LI_BINARY_SUBTRACT_FLOAT:
+            return LI_BINARY_SUBTRACT;
+        case LI_BINARY_MULTIPLY_INT:
+        case LI_BINARY_MULTIPLY_FLOAT:
+            return LI_BINARY_MULTIPLY;
+        default:
+            return op;
+    }
+}
+
+// Emits the native code for the instruction at ops[i], a word in the decoded
+// tape (see decode_bytecode). Returns 0 if the instruction is not supported.
+static int jit_emit_instruction(jit_buffer *buf, jit_fixup *fixups, long *nfixups, int *ops, long i)
+{
+    lky_instruction op = ops[i];
+
+    // Instructions that cannot raise (other than by overflowing the data
+    // stack, which the inline pushes check for) skip the status check.
+    int check = 1;
+
+    // Instructions with a fast path jump over their slow path from 'done'.
+    jit_slow_jumps slow;
+    slow.count = 0;
+    long done = -1;
+
+    switch(op)
+    {
+        case LI_LOAD_CONST:
+        case LI_LOAD_LOCAL:
+        {
+            unsigned int idx = ops[i + 1];
+            if(idx > 0xFFFFFFF)
+                return 0;
+
+            jit_emit_load(buf, JIT_RAX, op == LI_LOAD_CONST ? JIT_FIELD(constants) : JIT_FIELD(locals));
+            jit_bytes_(buf, 0x48, 0x8B, 0x80); // mov rax, [rax + idx * 8]
+            jit_emit_u32(buf, idx * 8);
+            jit_emit_push(buf, fixups, nfixups);
+            return 1;
+        }
+        case LI_SAVE_LOCAL:
+        case LI_SAVE_LOCAL_POP:
+        {
+            unsigned int idx = ops[i + 1];
+            if(idx > 0xFFFFFFF)
+                return 0;
+
+            jit_emit_top(buf, op == LI_SAVE_LOCAL_POP);
+            jit_emit_load(buf, JIT_RCX, JIT_FIELD(locals));
+            jit_bytes_(buf, 0x48, 0x89, 0x81); // mov [rcx + idx * 8], rax
+            jit_emit_u32(buf, idx * 8);
+            return 1;
+        }
+        case LI_POP:
+            jit_emit_top(buf, 1);
+            return 1;
+        case LI_SDUPLICATE:
+            jit_emit_top(buf, 0);
+            jit_emit_push(buf, fixups, nfixups);
+            return 1;
+        case LI_PUSH_NIL:
+        case LI_PUSH_BOOL:
+            jit_bytes_(buf, 0x48, 0xB8); // mov rax, imm64
+            jit_emit_u64(buf, (uintptr_t)(op == LI_PUSH_NIL ? &lky_nil : LKY_TESTC_FAST(ops[i + 1])));
+            jit_emit_push(buf, fixups, nfixups);
+            return 1;
+        case LI_IGNORE:
+            return 1;
+        case LI_JUMP:
+            // Backward jumps close loops, so they are safepoints.
+            if(ops[i + 1] < i)
+                jit_emit_call(buf, jit_safepoint, 0, 0, 0, 0, 0);
+            jit_emit_jump(buf, fixups, nfixups, JIT_JMP, ops[i + 1] + 1L);
+            return 1;
+        case LI_JUMP_FALSE:
+        case LI_JUMP_FALSE_ELSE_POP:
+        case LI_JUMP_TRUE_ELSE_POP:
+            jit_emit_call(buf, op == LI_JUMP_FALSE ? (void *)jit_jump_false :
+                    op == LI_JUMP_FALSE_ELSE_POP ? (void *)jit_jump_false_else_pop : (void *)jit_jump_true_else_pop, 0, 0, 0, 0, 0);
+            jit_emit_test(buf);
+            jit_emit_jump(buf, fixups, nfixups, JIT_JNZ, ops[i + 1] + 1L);
+            return 1;
+        case LI_BINARY_JUMP_FALSE:
+        case LI_BINARY_JUMP_FALSE_INT:
+        case LI_BINARY_JUMP_FALSE_FLOAT:
+        {
+            int cc = jit_condition(ops[i + 1]);
+            long target = ops[i + 2] + 1L;
+            if(cc >= 0)
+            {
+                jit_emit_stack_operands(buf);
+                jit_emit_int_check(buf, &slow);
+                jit_bytes_(buf, 0x48, 0xC7, 0x04, 0xD1, 0, 0, 0, 0); // mov qword [rcx + rdx * 8], 0
+                jit_bytes_(buf, 0x48, 0xC7, 0x44, 0xD1, 0xF8, 0, 0, 0, 0); // mov qword [rcx + rdx * 8 - 8], 0
+                jit_bytes_(buf, 0x48, 0x83, 0xEA, 0x02); // sub rdx, 2
+                jit_emit_store(buf, JIT_RDX, JIT_FIELD(stack_pointer));
+                jit_bytes_(buf, 0x48, 0x39, 0xF0); // cmp rax, rsi
+                jit_emit_jump(buf, fixups, nfixups, JIT_JCC(cc ^ 1), target);
+                done = jit_emit_local_jump(buf, JIT_JMP);
+                jit_patch_slow(buf, &slow);
+            }
+
+            jit_emit_call(buf, jit_binary_jump_false, 1, ops[i + 1], 0, 0, 0);
+            jit_emit_test(buf);
+            jit_emit_jump(buf, fixups, nfixups, JIT_JS, JIT_LABEL_ERROR);
+            jit_emit_jump(buf, fixups, nfixups, JIT_JNZ, target);
+            if(done >= 0)
+                jit_patch_here(buf, done);
+            return 1;
+        }
+        case LI_NEXT_ITER_OR_JUMP:
+            jit_emit_call(buf, jit_next_iter_or_jump, 0, 0, 0, 0, 0);
+            jit_emit_test(buf);
+            jit_emit_jump(buf, fixups, nfixups, JIT_JS, JIT_LABEL_ERROR);
+            jit_emit_jump(buf, fixups, nfixups, JIT_JNZ, ops[i + 1] + 1L);
+            return 1;
+        case LI_RETURN:
+            jit_emit_call(buf, jit_return, 0, 0, 0, 0, 0);
+            jit_emit_jump(buf, fixups, nfixups, JIT_JMP, JIT_LABEL_EXIT);
+            return 1;
+        case LI_BINARY_ADD:
+        case LI_BINARY_ADD_INT:
+        case LI_BINARY_ADD_FLOAT:
+        case LI_BINARY_SUBTRACT:
+        case LI_BINARY_SUBTRACT_INT:
+        case LI_BINARY_SUBTRACT_FLOAT:
+        case LI_BINARY_MULTIPLY:
+        case LI_BINARY_MULTIPLY_INT:
+        case LI_BINARY_MULTIPLY_FLOAT:
+        case LI_BINARY_DIVIDE:
+        case LI_BINARY_MODULO:
+        case LI_BINARY_POWER:
+        case LI_BINARY_LT:
+        case LI_BINARY_GT:
+        case LI_BINARY_LTE:
+        case LI_BINARY_GTE:
+        case LI_BINARY_EQUAL:
+        case LI_BINARY_NE:
+        case LI_BINARY_AND:
+        case LI_BINARY_OR:
+        case LI_BINARY_NC:
+        case LI_BINARY_BAND:
+        case LI_BINARY_BOR:
+        case LI_BINARY_BXOR:
+        case LI_BINARY_BLSHIFT:
+        case LI_BINARY_BRSHIFT:
+        {
+            lky_instruction bop = jit_generic_binary(op);
+            if(jit_condition(bop) > -2)
+            {
+                jit_emit_stack_operands(buf);
+                jit_emit_int_check(buf, &slow);
+                jit_emit_int_result(buf, bop, &slow);
+                jit_bytes_(buf, 0x48, 0xC7, 0x04, 0xD1, 0, 0, 0, 0); // mov qword [rcx + rdx * 8], 0
+                jit_bytes_(buf, 0x48, 0x89, 0x44, 0xD1, 0xF8); // mov [rcx + rdx * 8 - 8], rax
+                jit_bytes_(buf, 0x48, 0xFF, 0xCA); // dec rdx
+                jit_emit_store(buf, JIT_RDX, JIT_FIELD(stack_pointer));
+                done = jit_emit_local_jump(buf, JIT_JMP);
+                jit_patch_slow(buf, &slow);
+            }
+
+            jit_emit_call(buf, jit_binary, 1, bop, 0, 0, 0);
+            break;
+        }
+        case LI_REG_BINARY:
+        case LI_REG_BINARY_INT:
+        case LI_REG_BINARY_FLOAT:
+        case LI_REG_BINARY_PUSH:
+        case LI_REG_BINARY_PUSH_INT:
+        case LI_REG_BINARY_PUSH_FLOAT:
+        {
+            int push = op == LI_REG_BINARY_PUSH || op == LI_REG_BINARY_PUSH_INT || op == LI_REG_BINARY_PUSH_FLOAT;
+            lky_instruction bop = ops[i + 1];
+            unsigned int lhs = ops[i + 2];
+            unsigned int rhs = ops[i + 3];
+            unsigned int dst = push ? 0 : ops[i + 4];
+
+            if(jit_condition(bop) > -2 && (lhs & ~LKY_REG_CONST) <= 0xFFFFFFF &&
+                    (rhs & ~LKY_REG_CONST) <= 0xFFFFFFF && dst <= 0xFFFFFFF)
+            {
+                jit_emit_reg_operand(buf, JIT_RAX, lhs);
+                jit_emit_reg_operand(buf, JIT_RSI, rhs);
+                jit_emit_int_check(buf, &slow);
+                jit_emit_int_result(buf, bop, &slow);
+                if(push)
+                    jit_emit_push(buf, fixups, nfixups);
+                else
+                {
+                    jit_emit_load(buf, JIT_RCX, JIT_FIELD(locals));
+                    jit_bytes_(buf, 0x48, 0x89, 0x81); // mov [rcx + dst * 8], rax
+                    jit_emit_u32(buf, dst * 8);
+                }
+                done = jit_emit_local_jump(buf, JIT_JMP);
+                jit_patch_slow(buf, &slow);
+            }
+
+            if(push)
+                jit_emit_call(buf, jit_reg_binary_push, 3, bop, lhs, rhs, 0);
+            else
+                jit_emit_call(buf, jit_reg_binary, 4, bop, lhs, rhs, dst);
+            break;
+        }
+        case LI_FOR_RANGE:
+        {
+            lky_instruction cop = ops[i + 1];
+            unsigned int ctr = ops[i + 2];
+            unsigned int bound = ops[i + 3];
+            long target = ops[i + 4] + 1L;
+            if(jit_condition(cop) >= 0 && ctr <= 0xFFFFFFF && (bound & ~LKY_REG_CONST) <= 0xFFFFFFF)
+            {
+                jit_emit_reg_operand(buf, JIT_RAX, ctr);
+                jit_emit_reg_operand(buf, JIT_RSI, bound);
+                jit_emit_int_check(buf, &slow);
+                jit_bytes_(buf, 0x48, 0x39, 0xF0); // cmp rax, rsi
+                jit_emit_jump(buf, fixups, nfixups, JIT_JCC(jit_condition(cop) ^ 1), target);
+                done = jit_emit_local_jump(buf, JIT_JMP);
+                jit_patch_slow(buf, &slow);
+            }
+
+            jit_emit_call(buf, jit_for_range, 3, cop, ctr, bound, 0);
+            jit_emit_test(buf);
+            jit_emit_jump(buf, fixups, nfixups, JIT_JS, JIT_LABEL_ERROR);
+            jit_emit_jump(buf, fixups, nfixups, JIT_JNZ, target);
+            if(done >= 0)
+                jit_patch_here(buf, done);
+            return 1;
+        }
+        case LI_FOR_STEP:
+        {
+            lky_instruction sop = ops[i + 1];
+            lky_instruction cop = ops[i + 2];
+            unsigned int ctr = ops[i + 3];
+            unsigned int by = ops[i + 4];
+            unsigned int bound = ops[i + 5];
+
+            // Both paths end up either falling out of the loop (the jumps
+            // in 'out') or at the safepoint before going round again.
+            jit_slow_jumps out;
+            out.count = 0;
+            long again = -1;
+            if(jit_condition(cop) >= 0 && ctr <= 0xFFFFFFF && (by & ~LKY_REG_CONST) <= 0xFFFFFFF &&
+                    (bound & ~LKY_REG_CONST) <= 0xFFFFFFF)
+            {
+                jit_emit_reg_operand(buf, JIT_RAX, ctr);
+                jit_emit_reg_operand(buf, JIT_RSI, by);
+                jit_emit_int_check(buf, &slow);
+                jit_emit_reg_operand(buf, JIT_RDI, bound);
+                jit_bytes_(buf, 0x40, 0xF6, 0xC7, 0x01); // test dil, 1
+                slow.at[slow.count++] = jit_emit_local_jump(buf, JIT_JZ);
+                jit_emit_int_result(buf, sop, &slow);
+                jit_emit_load(buf, JIT_RCX, JIT_FIELD(locals));
+                jit_bytes_(buf, 0x48, 0x89, 0x81); // mov [rcx + ctr * 8], rax
+                jit_emit_u32(buf, ctr * 8);
+                jit_bytes_(buf, 0x48, 0x39, 0xF8); // cmp rax, rdi
+                again = jit_emit_local_jump(buf, JIT_JCC(jit_condition(cop)));
+                out.at[out.count++] = jit_emit_local_jump(buf, JIT_JMP);
+                jit_patch_slow(buf, &slow);
+            }
+
+            jit_emit_call(buf, jit_for_step, 4, sop << 8 | cop, ctr, by, bound);
+            jit_emit_test(buf);
+            jit_emit_jump(buf, fixups, nfixups, JIT_JS, JIT_LABEL_ERROR);
+            out.at[out.count++] = jit_emit_local_jump(buf, JIT_JZ);
+
+            if(again >= 0)
+                jit_patch_here(buf, again);
+            jit_emit_call(buf, jit_safepoint, 0, 0, 0, 0, 0);
+            jit_emit_jump(buf, fixups, nfixups, JIT_JMP, ops[i + 6] + 1L);
+            jit_patch_slow(buf, &out);
+            return 1;
+        }
+        case LI_UNARY_NOT:
+            jit_emit_call(buf, jit_unary_not, 0, 0, 0, 0, 0);
+            break;
+        case LI_UNARY_NEGATIVE:
+            jit_emit_call(buf, jit_unary_negative, 0, 0, 0, 0, 0);
+            break;
+        case LI_PRINT:
+            jit_emit_call(buf, jit_print, 0, 0, 0, 0, 0);
+            break;
+        case LI_CALL_FUNC:
+            jit_emit_call(buf, jit_call_func, 1, ops[i + 1], 0, 0, 0);
+            break;
+        case LI_PUSH_NEW_OBJECT:
+            jit_emit_call(buf, jit_push_new_object, 0, 0, 0, 0, 0);
+            break;
+        case LI_LOAD_MEMBER:
+            jit_emit_call(buf, jit_load_member, 2, ops[i + 1], ops[i + 2], 0, 0);
+            break;
+        case LI_LOAD_LOCAL_MEMBER:
+            jit_emit_call(buf, jit_load_local_member, 3, ops[i + 1], ops[i + 2],
+                    ops[i + 3], 0);
+            break;
+        case LI_SAVE_MEMBER:
+            jit_emit_call(buf, jit_save_member, 2, ops[i + 1], ops[i + 2], 0, 0);
+            break;
+        case LI_SAVE_CLOSE:
+            jit_emit_call(buf, jit_save_close, 1, ops[i + 1], 0, 0, 0);
+            break;
+        case LI_BIND_CLOSE:
+            jit_emit_call(buf, jit_bind_close, 2, ops[i + 1], ops[i + 2], 0, 0);
+            break;
+        case LI_LOAD_CLOSE:
+            jit_emit_call(buf, jit_load_close, 1, ops[i + 1], 0, 0, 0);
+            break;
+        case LI_MAKE_ARRAY:
+            jit_emit_call(buf, jit_make_array, 1, ops[i + 1], 0, 0, 0);
+            break;
+        case LI_CONCAT:
+            jit_emit_call(buf, jit_concat, 1, ops[i + 1], 0, 0, 0);
+            break;
+        case LI_LOAD_INDEX:
+            jit_emit_call(buf, jit_load_index, 0, 0, 0, 0, 0);
+            break;
+        case LI_SAVE_INDEX:
+            jit_emit_call(buf, jit_save_index, 0, 0, 0, 0, 0);
+            break;
+        case LI_DDUPLICATE:
+            jit_emit_call(buf, jit_dduplicate, 0, 0, 0, 0, 0);
+            break;
+        case LI_FLIP_TWO:
+            jit_emit_call(buf, jit_flip_two, 0, 0, 0, 0, 0);
+            check = 0;
+            break;
+        case LI_SINK_FIRST:
+            jit_emit_call(buf, jit_sink_first, 0, 0, 0, 0, 0);
+            check = 0;
+            break;
+        case LI_MAKE_ITER:
+            jit_emit_call(buf, jit_make_iter, 0, 0, 0, 0, 0);
+            break;
+        case LI_ITER_INDEX:
+            jit_emit_call(buf, jit_iter_index, 0, 0, 0, 0, 0);
+            break;
+        case LI_RAISE:
+            jit_emit_call(buf, jit_raise, 0, 0, 0, 0, 0);
+            break;
+        default:
+            return 0;
+    }
+
+    if(check)
+    {
+        jit_emit_test(buf);
+        jit_emit_jump(buf, fixups, nfixups, JIT_JNZ, JIT_LABEL_ERROR);
+    }
+
+    if(done >= 0)
+        jit_patch_here(buf, done);
+
+    return 1;
+}
+
+// Compiles code to native code and stores it in code->jit. Code that cannot
+// be compiled is marked so (with a jit_calls of -1) and stays interpreted.
+void mach_jit_compile(lky_object_code *code)
+{
+    code->jit_calls = -1;
+
+    int *ops = code->tape;
+    long len = code->tape_len;
+
+    // Where each tape location starts in the native code, or -1 if it is
+    // not the start of an instruction. The end of the tape is the exit.
+    long *native = malloc(sizeof(long) * (len + 1));
+    jit_fixup *fixups = malloc(sizeof(jit_fixup) * (len * 2 + 4));
+    long nfixups = 0;
+
+    jit_buffer buf;
+    buf.size = len * 16 + 64;
+    buf.count = 0;
+    buf.bytes = malloc(buf.size);
+
+    long i;
+    for(i = 0; i <= len; i++)
+        native[i] = -1;
+
+    jit_bytes_(&buf, 0x53); // push rbx
+    jit_bytes_(&buf, 0x48, 0x89, 0xFB); // mov rbx, rdi
+
+    int ok = 1;
+    for(i = 0; i < len && ok; i += tape_instruction_length(ops, i))
+    {
+        native[i] = buf.count;
+
+        // Errors are traced from the pc, which mach_eval leaves on the
+        // instruction's last word.
+        jit_bytes_(&buf, 0x48, 0xC7, 0x83); // mov qword [rbx + pc], imm32
+        jit_emit_u32(&buf, JIT_FIELD(pc));
+        jit_emit_u32(&buf, (unsigned int)(i + tape_instruction_length(ops, i) - 1));
+
+        ok = jit_emit_instruction(&buf, fixups, &nfixups, ops, i);
+    }
+
+    // Falling off the end of the tape returns, as RETURN does.
+    long exit = native[len] = buf.count;
+    jit_bytes_(&buf, 0x5B); // pop rbx
+    jit_bytes_(&buf, 0xC3); // ret
+
+    long error = buf.count;
+    jit_emit_call(&buf, mach_unwind_error, 0, 0, 0, 0, 0);
+    jit_emit_jump(&buf, fixups, &nfixups, JIT_JMP, JIT_LABEL_EXIT);
+
+    long overflow = buf.count;
+    jit_emit_call(&buf, jit_overflow, 0, 0, 0, 0, 0);
+    jit_emit_jump(&buf, fixups, &nfixups, JIT_JMP, JIT_LABEL_ERROR);
+
+    for(i = 0; i < nfixups && ok; i++)
+    {
+        long target = fixups[i].target;
+        long to;
+        if(target == JIT_LABEL_EXIT)
+            to = exit;
+        else if(target == JIT_LABEL_ERROR)
+            to = error;
+        else if(target == JIT_LABEL_OVERFLOW)
+            to = overflow;
+        else if(target >= 0 && target <= len && native[target] >= 0)
+            to = native[target];
+        else
+        {
+            // A jump into the middle of an instruction.
+            ok = 0;
+            break;
+        }
+
+        int rel = (int)(to - (fixups[i].at + 4));
+        memcpy(buf.bytes + fixups[i].at, &rel, 4);
+    }
+
+    void *mem = MAP_FAILED;
+    if(ok)
+        mem = mmap(NULL, buf.count, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if(mem != MAP_FAILED)
+    {
+        memcpy(mem, buf.bytes, buf.count);
+        if(mprotect(mem, buf.count, PROT_READ | PROT_EXEC) == 0)
+        {
+            code->jit = mem;
+            code->jit_size = buf.count;
+        }
+        else
+            munmap(mem, buf.count);
+    }
+
+    free(buf.bytes);
+    free(fixups);
+    free(native);
+}
+
+// Unmaps the native code compiled for 'code', if any.
+void mach_jit_release(lky_object_code *code)
+{
+    if(code->jit)
+        munmap(code->jit, code->jit_size);
+
+    code->jit = NULL;
+    code->jit_size = 0;
+}
+
+#endif
@@ -0,0 +1,44 @@
+/* Lanky -- Scripting Language and Virtual Machine
+ * Copyright (C) 2014  Sam Olsen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MACH_JIT_H
+#define MACH_JIT_H
+
+#include "lkyobj_builtin.h"
+#include "lky_machine.h"
+
+// The number of calls after which a function is compiled to native code.
+#ifndef MACH_JIT_THRESHOLD
+#define MACH_JIT_THRESHOLD 10
+#endif
+
+// The native code is only generated on x86-64 Linux; elsewhere
+// mach_jit_compile always declines and everything is interpreted.
+#if defined(__x86_64__) && defined(__linux__)
+#define MACH_JIT_SUPPORTED 1
+#else
+#define MACH_JIT_SUPPORTED 0
+#endif
+
+extern int mach_jit_enabled_;
+
+void mach_jit_compile(lky_object_code *code);
+void mach_jit_release(lky_object_code *code);
+void mach_jit_run(stackframe *frame);
+
+#endif
@@ -18,7 +18,7 @@
 
 #include "mach_unary_ops.h"
 
-#define IS_TAGGED(a) ((uintptr_t)(a) & 1)
+#define IS_TAGGED(a) OBJ_IS_TAGGED(a)
 #define CHECK_EXEC_CUSTOM_IMPL(a, name, interp) \
     do { \
         if((!(IS_TAGGED(a)) && a->type == LBI_CUSTOM) || (!(IS_TAGGED(a)) && a->type == LBI_CUSTOM_EX)) {\
@@ -20,7 +20,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include "stl_string.h"
+#include "stl_regex.h"
 #include "serialize.h"
+#include "bytecode_analyzer.h"
+#include "lky_symbol.h"
 
 void srl_int32_to_bytes(int32_t i, char *buf)
 {
@@ -79,7 +82,11 @@ int32_t srl_read_int32_from_file(FILE *f)
 
 void srl_render_shared_info(lky_object *obj, unsigned char *buf, size_t len)
 {   
-    buf[0] = (char)obj->type;
+    // Tagged numbers have no header to read the type from.
+    if(OBJ_IS_TAGGED(obj))
+        buf[0] = (char)(OBJ_IS_FLONUM(obj) ? LBI_FLOAT : LBI_INTEGER);
+    else
+        buf[0] = (char)obj->type;
 
     char lbts[4];
     srl_int32_to_bytes(len, lbts);
@@ -104,14 +111,14 @@ char *srl_serialize_number(lky_object *obj, size_t *len)
 
     srl_render_shared_info(obj, (unsigned char *)data, *len);
 
-    if(obj->type == LBI_INTEGER)
+    if(OBJ_IS_INTEGER(obj))
     {
-        long val = OBJ_NUM_UNWRAP(obj);
+        long val = OBJ_INT_UNWRAP(obj);
         srl_int64_to_bytes(val, buf);   
     }
-    else if(obj->type == LBI_FLOAT)
+    else
     {
-        double val = OBJ_NUM_UNWRAP(obj);
+        double val = OBJ_FLOAT_UNWRAP(obj);
         char *vall = (char *)(&val);
         memcpy(buf, vall, 8);
     }
@@ -125,19 +132,18 @@ char *srl_serialize_number(lky_object *obj, size_t *len)
 
 char *srl_serialize_string(lky_object *obj, size_t *len)
 {
-    char *tex = lobjb_stringify(obj, NULL);    
-    *len = 5 + strlen(tex);
+    stlstr_data *d = stlstr_get_data(obj);
+    char *tex = d->str;
+    *len = 5 + d->length;
     char *data = malloc(*len);
 
     srl_render_shared_info(obj, (unsigned char *)data, *len);
-    data[0] = (char)LBI_STRING; // Standard library strings normally have type 'LBI_CUSTOM'
+    data[0] = (char)LBI_STRING; // Standard library strings normally have type 'LBI_CUSTOM_EX'
 
     int i;
     for(i = 0; i < *len - 5; i++)
         data[i + 5] = tex[i];
 
-    free(tex);
-
     return data;
 }
 
@@ -230,11 +236,33 @@ char *srl_serialize_code(lky_object *obj, size_t *len)
     return data;
 }
 
+// Regexes are stored as their pattern and flags and compiled again when
+// they are loaded: [type][length][pattern length][pattern][flags]
+char *srl_serialize_regex(lky_object *obj, size_t *len)
+{
+    stlstr_data *pattern = stlstr_get_data(lobj_get_member(obj, "pattern"));
+    stlstr_data *flags = stlstr_get_data(lobj_get_member(obj, "flags"));
+    *len = 9 + pattern->length + flags->length;
+    char *data = malloc(*len);
+
+    srl_render_shared_info(obj, (unsigned char *)data, *len);
+    data[0] = (char)LBI_REGEX; // Regexes are 'LBI_CUSTOM' objects of the Regex class
+
+    srl_copy_int32_to_index(data, pattern->length, 5);
+    srl_copy_bytes_to_index(data, pattern->str, 9, pattern->length);
+    srl_copy_bytes_to_index(data, flags->str, 9 + pattern->length, flags->length);
+
+    return data;
+}
+
 char *srl_serialize_object(lky_object *obj, size_t *len)
 {   
     size_t throwaway;
     size_t *targ_len = len ? len : &throwaway;
 
+    if(OBJ_IS_TAGGED(obj))
+        return srl_serialize_number(obj, targ_len);
+
     switch(obj->type)
     {
         case LBI_INTEGER:
@@ -243,6 +271,9 @@ char *srl_serialize_object(lky_object *obj, size_t *len)
         case LBI_CODE:
             return srl_serialize_code(obj, targ_len);
         case LBI_CUSTOM:
+        case LBI_CUSTOM_EX:
+            if(lobj_is_of_class(obj, stlrgx_get_class()))
+                return srl_serialize_regex(obj, targ_len);
             return srl_serialize_string(obj, targ_len);
         default: break;
     }
@@ -266,11 +297,25 @@ lky_object *srl_deserialize_number(char *bytes)
 lky_object *srl_deserialize_string(char *bytes)
 {
     int len = srl_bytes_to_int32((unsigned char *)bytes, 1) - 5;
-    char tex[len + 1];
-    memcpy(tex, bytes + 5, len);
-    tex[len] = 0;
 
-    return stlstr_cinit(tex);
+    return stlstr_cinit_ex(bytes + 5, len, 1);
+}
+
+lky_object *srl_deserialize_regex(unsigned char *bytes)
+{
+    int len = srl_bytes_to_int32(bytes, 1);
+    int plen = srl_bytes_to_int32(bytes, 5);
+    if(plen < 0 || plen > len - 9)
+        return NULL;
+
+    char pattern[plen + 1];
+    char flags[len - 9 - plen + 1];
+    memcpy(pattern, bytes + 9, plen);
+    pattern[plen] = '\0';
+    memcpy(flags, bytes + 9 + plen, len - 9 - plen);
+    flags[len - 9 - plen] = '\0';
+
+    return stlrgx_cinit(pattern, flags);
 }
 
 lky_object *srl_deserialize_code(unsigned char *bytes)
@@ -285,9 +330,9 @@ lky_object *srl_deserialize_code(unsigned char *bytes)
 
     void **cons = malloc(sizeof(void *) * ncs);
     char **names = malloc(sizeof(char *) * nnm);
-    void **locs = calloc(sizeof(void *) * nlc, 1);
 
     char *refname = NULL;
+    int bad_constant = 0;
 
     int i;
     for(i = 0; i < ncs; i++)
@@ -295,6 +340,7 @@ lky_object *srl_deserialize_code(unsigned char *bytes)
         size_t len;
         srl_parse_shared_info(bytes, NULL, &len);
         cons[i] = srl_deserialize_object((char *)bytes);
+        bad_constant |= !cons[i];
         bytes += len;
     }
 
@@ -302,8 +348,10 @@ lky_object *srl_deserialize_code(unsigned char *bytes)
     {
         int len = srl_bytes_to_int32(bytes, 0);
         bytes += 4;
-        names[i] = calloc(len + 1, 1);
-        memcpy(names[i], bytes, len);
+        char name[len + 1];
+        memcpy(name, bytes, len);
+        name[len] = '\0';
+        names[i] = sym_intern(name);
         bytes += len;
     }
 
@@ -324,7 +372,6 @@ lky_object *srl_deserialize_code(unsigned char *bytes)
     code->mem_count = 0;
     code->ops = ops;
     code->constants = cons;
-    code->locals = locs;
     code->names = names;
     code->op_len = nop;
     code->num_constants = ncs;
@@ -332,6 +379,24 @@ lky_object *srl_deserialize_code(unsigned char *bytes)
     code->num_names = nnm;
     code->stack_size = sss;
     code->refname = refname;
+    code->indices = NULL;
+    code->impl_name = "Deserialized Function";
+    code->tape = NULL;
+    code->tape_indices = NULL;
+    code->jit = NULL;
+    code->jit_size = 0;
+    code->jit_calls = 0;
+
+    // The bytes may have come from anywhere, so nothing runs until it has
+    // been verified.
+    const char *err = bad_constant ? "bad constant" : load_bytecode(code);
+    if(err)
+    {
+        printf("Invalid bytecode: %s\n", err);
+        return NULL;
+    }
+
+    code->member_caches = calloc(calculate_member_cache_count(ops, (int)nop), sizeof(lky_member_cache));
 
     return (lky_object *)code;
 }
@@ -348,6 +413,8 @@ lky_object *srl_deserialize_object(char *bytes)
             return srl_deserialize_code((unsigned char *)bytes);
         case LBI_STRING:
             return srl_deserialize_string(bytes);
+        case LBI_REGEX:
+            return srl_deserialize_regex((unsigned char *)bytes);
     }
 
     return NULL;
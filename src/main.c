@@ -27,6 +27,7 @@
 #include "tools.h"
 #include "ast_compiler.h"
 #include "lky_machine.h"
+#include "mach_jit.h"
 #include "lky_object.h"
 #include "lkyobj_builtin.h"
 #include "lky_gc.h"
@@ -78,10 +79,24 @@ hashtable parse_args(int argc, char *argv[])
             hst_put(&tab, "-S", (void *)1, NULL, NULL);
         else if(strcmp(argv[i], "-e") == 0)
             hst_put(&tab, "-e", (void *)1, NULL, NULL);
+        else if(strcmp(argv[i], "-O") == 0)
+            hst_put(&tab, "-O", (void *)1, NULL, NULL);
         else if(strcmp(argv[i], "--no-tagged-ints") == 0)
             hst_put(&tab, "--no-tagged-ints", (void *)1, NULL, NULL);
         else if(strcmp(argv[i], "--use-system-malloc") == 0)
             hst_put(&tab, "--use-system-malloc", (void *)1, NULL, NULL);
+        else if(strcmp(argv[i], "--register-ops") == 0)
+            hst_put(&tab, "--register-ops", (void *)1, NULL, NULL);
+        else if(strcmp(argv[i], "--no-superinstructions") == 0)
+            hst_put(&tab, "--no-superinstructions", (void *)1, NULL, NULL);
+        else if(strcmp(argv[i], "--no-quickening") == 0)
+            hst_put(&tab, "--no-quickening", (void *)1, NULL, NULL);
+        else if(strcmp(argv[i], "--jit") == 0)
+            hst_put(&tab, "--jit", (void *)1, NULL, NULL);
+        else if(strcmp(argv[i], "--no-jit") == 0)
+            hst_put(&tab, "--no-jit", (void *)1, NULL, NULL);
+        else if(strcmp(argv[i], "--max-depth") == 0 && i < argc - 1)
+            hst_put(&tab, "--max-depth", argv[++i], NULL, NULL);
         else if(strcmp(argv[i], "-b") == 0) 
         {
             hst_put(&tab, "-b", (void *)1, NULL, NULL);
@@ -130,10 +145,14 @@ void exec_in_repl()
     frame.bucket = lobj_alloc();
     frame.parent_stack = list;
     frame.stack_size = 0;
+    frame.stack_pointer = -1;
     frame.locals_count = 0;
     frame.thrown = NULL;
     frame.prev = NULL;
+    frame.next = NULL;
     frame.indices = NULL;
+    frame.func = NULL;
+    frame.call_argc = -1;
 
     runtime rt = rt_make();
     
@@ -146,7 +165,7 @@ void exec_in_repl()
     getcwd(path, 1000);
 
     lobj_set_member(frame.bucket, "dirname_", stlstr_cinit(path));
-    hst_add_all_from(&frame.bucket->members, &stdl, NULL, NULL); 
+    shp_members_add_all_from(&frame.bucket->members, &stdl); 
     
     run_repl(&interp);
     printf("\nGoodbye!\n");
@@ -222,6 +241,28 @@ int main(int argc, char *argv[])
     if(hst_contains_key(&args, "--no-tagged-ints", NULL, NULL))
         lobjb_uses_pointer_tags_ = 0;
 
+    if(hst_contains_key(&args, "--register-ops", NULL, NULL))
+        compile_register_ops_ = 1;
+
+    if(hst_contains_key(&args, "--no-superinstructions", NULL, NULL))
+        compile_superinstructions_ = 0;
+
+    if(hst_contains_key(&args, "-O", NULL, NULL))
+        compile_optimize_ = 1;
+
+    if(hst_contains_key(&args, "--no-quickening", NULL, NULL))
+        mach_quickening_ = 0;
+
+    if(hst_contains_key(&args, "--jit", NULL, NULL) && !hst_contains_key(&args, "--no-jit", NULL, NULL))
+        mach_jit_enabled_ = 1;
+
+    if(hst_contains_key(&args, "--max-depth", NULL, NULL))
+        mach_max_depth_ = atoi(hst_get(&args, "--max-depth", NULL, NULL));
+
+#ifdef LKY_PROFILE_OPS
+    atexit(mach_profile_report);
+#endif
+
     un_setup();   
     md_init();
     stlos_init(argc - 1, argv + 1);
@@ -233,6 +274,8 @@ int main(int argc, char *argv[])
         if(bin)
         {
             code = render_from_file(argv[1]);
+            if(!code)
+                goto cleanup;
         }
         else
         {
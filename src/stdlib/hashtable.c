@@ -15,14 +15,17 @@
  * with this program; if not, write to the Free Software Foundation, Inc.,
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
-
 #include <stdlib.h>
 #include <string.h>
 #include "hashtable.h"
 
 // If we have an equals function, use it; otherwise use pointer equality
 #define EQU_CHECK(a, b, f) (f ? (f(a, b)) : (!strcmp(a, b)))
-#define NO_RESIZE
+
+// Tables start with this many slots and double once they are more than
+// four fifths full.
+#define HST_MIN_SIZE 8
+#define HST_NEEDS_GROW(ht) (((ht)->count + 1) * 5 > (ht)->size * 4)
 
 long hst_djb2(void *val, void *data)
 {
@@ -38,117 +41,159 @@ long hst_djb2(void *val, void *data)
 
 hashtable hst_create()
 {
-    hst_node **buckets = calloc(8, sizeof(hst_node *));
-
-    hashtable ht = {0, 8, 0, buckets};
+    hashtable ht = {0, 0, 0, 0, NULL};
 
     return ht;
 }
 
-hst_node *hst_make_node(long hash, void *key, void *val, char dup)
+// The preferred slot for a hash. The hash is scrambled first so that
+// hash functions with poor low bits (small integers, pointers) still
+// spread across the table.
+static unsigned long hst_home(long hash, int size)
+{
+    unsigned long h = (unsigned long)hash * 0x9E3779B97F4A7C15UL;
+    return (h ^ (h >> 32)) & (unsigned long)(size - 1);
+}
+
+// How far the entry in slot i is from its preferred slot.
+static unsigned long hst_distance(hst_entry *e, unsigned long i, int size)
+{
+    return (i - hst_home(e->hash, size)) & (unsigned long)(size - 1);
+}
+
+// Places an entry whose key is known not to be in the table. Robin hood
+// placement: an entry travelling further from home than the one occupying
+// a slot takes that slot, and the displaced entry carries on looking.
+static void hst_place(hst_entry *entries, int size, hst_entry e)
 {
-    hst_node *n = malloc(sizeof(hst_node));
+    unsigned long mask = size - 1;
+    unsigned long i = hst_home(e.hash, size);
+    unsigned long dist = 0;
 
-    if(dup)
+    for(;; i = (i + 1) & mask, dist++)
     {
-        char *k = (char *)key;
-        n->key = malloc(strlen(k) + 1);
-        strcpy(n->key, k);
+        hst_entry *cur = &entries[i];
+        if(!cur->key)
+        {
+            *cur = e;
+            return;
+        }
+
+        unsigned long cd = hst_distance(cur, i, size);
+        if(cd < dist)
+        {
+            hst_entry tmp = *cur;
+            *cur = e;
+            e = tmp;
+            dist = cd;
+        }
     }
-    else
-        n->key = key;
-    n->hash = hash;
-    n->val = val;
-    n->next = NULL;
-    return n;
 }
 
-void hst_resize(hashtable *ht)
+static void hst_resize(hashtable *ht, int size)
 {
-    int ns = ht->size > 1000 ? ht->size + 1000 : ht->size * 2;
-    hst_node **buckets = calloc(ns, sizeof(hst_node *));   
+    hst_entry *entries = calloc(size, sizeof(hst_entry));
 
     int i;
-    hst_node *n;
-    hst_node *p;
     for(i = 0; i < ht->size; i++)
+        if(ht->entries[i].key)
+            hst_place(entries, size, ht->entries[i]);
+
+    free(ht->entries);
+    ht->entries = entries;
+    ht->size = size;
+    ht->mods++;
+}
+
+// Returns the slot holding key, or -1. The search can stop as soon as it
+// reaches an entry closer to home than the key would be, since robin hood
+// placement would have put the key before it.
+static long hst_find(hashtable *ht, void *key, long hash, hst_equa_function equfunc)
+{
+    if(!ht->size)
+        return -1;
+
+    unsigned long mask = ht->size - 1;
+    unsigned long i = hst_home(hash, ht->size);
+    unsigned long dist = 0;
+
+    for(;; i = (i + 1) & mask, dist++)
     {
-        for(n = ht->buckets[i]; n;)
-        {
-            p = n->next;
-            int mod = (unsigned long)n->hash % ns;
-            if(!buckets[mod])
-            {
-                buckets[mod] = n;
-                n->next = NULL;
-                n = p;
-                continue;
-            }
-
-            hst_node *x = buckets[mod];
-            for(; x->next; x = x->next);
-            x->next = n;
-            n->next = NULL;
-
-            n = p;
-        }
+        hst_entry *e = &ht->entries[i];
+        if(!e->key || hst_distance(e, i, ht->size) < dist)
+            return -1;
+
+        if(e->hash == hash && EQU_CHECK(e->key, key, equfunc))
+            return (long)i;
+    }
+}
+
+// Empties slot i, shifting the entries after it back towards their
+// preferred slots. This keeps probe sequences unbroken without leaving
+// tombstones behind.
+static void hst_remove_at(hashtable *ht, unsigned long i)
+{
+    unsigned long mask = ht->size - 1;
+
+    if(ht->duplicate_keys)
+        free(ht->entries[i].key);
+
+    for(;;)
+    {
+        unsigned long next = (i + 1) & mask;
+        hst_entry *n = &ht->entries[next];
+        if(!n->key || hst_distance(n, next, ht->size) == 0)
+            break;
+
+        ht->entries[i] = *n;
+        i = next;
     }
 
-    free(ht->buckets);
-    ht->buckets = buckets;
-    ht->size = ns;
+    memset(&ht->entries[i], 0, sizeof(hst_entry));
+    ht->count--;
+    ht->mods++;
 }
 
 void hst_put(hashtable *ht, void *key, void *val, hst_hash_function hashfunc, hst_equa_function equfunc)
 {
-#ifndef NO_RESIZE
-    if(ht->count + 1 > ht->size * (0.66))
-        hst_resize(ht);
-#endif
-
     if(!hashfunc)
         hashfunc = hst_djb2;    
 
     long hash = hashfunc(key, NULL);
-    unsigned long mod = ((unsigned long)hash) % ht->size;
-
-    if(!ht->buckets[mod])
+    long idx = hst_find(ht, key, hash, equfunc);
+    if(idx >= 0)
     {
-        ht->buckets[mod] = hst_make_node(hash, key, val, ht->duplicate_keys);
-        ht->count++;
+        ht->entries[idx].val = val;
         return;
     }
 
-    hst_node *last;
-    hst_node *prev = NULL;
-    for(last = ht->buckets[mod]; last; last = last->next)
-    {
-        if(EQU_CHECK(last->key, key, equfunc))
-        {
-            last->val = val;
-            return;
-        }
+    if(HST_NEEDS_GROW(ht))
+        hst_resize(ht, ht->size ? ht->size * 2 : HST_MIN_SIZE);
 
-        prev = last;
+    hst_entry e = {hash, key, val};
+    if(ht->duplicate_keys)
+    {
+        char *k = (char *)key;
+        e.key = malloc(strlen(k) + 1);
+        strcpy(e.key, k);
     }
 
+    hst_place(ht->entries, ht->size, e);
     ht->count++;
-    prev->next = hst_make_node(hash, key, val, ht->duplicate_keys);
+    ht->mods++;
 } 
 
 void *hst_get(hashtable *ht, void *key, hst_hash_function hashfunc, hst_equa_function equfunc)
 {
+    if(!ht->count)
+        return NULL;
+
     if(!hashfunc)
         hashfunc = hst_djb2;
 
-    long hash = hashfunc(key, NULL);
-    long mod = (unsigned long)hash % ht->size;
-
-    hst_node *n = ht->buckets[mod];
-
-    for(; n; n = n->next) if(EQU_CHECK(n->key, key, equfunc)) return n->val;
+    long idx = hst_find(ht, key, hashfunc(key, NULL), equfunc);
 
-    return NULL;
+    return idx < 0 ? NULL : ht->entries[idx].val;
 }
 
 void hst_add_all_from(hashtable *ht, hashtable *ot, hst_hash_function hashfunc, hst_equa_function equfunc)
@@ -158,11 +203,8 @@ void hst_add_all_from(hashtable *ht, hashtable *ot, hst_hash_function hashfunc,
 
     int i;
     for(i = 0; i < ot->size; i++)
-    {
-        hst_node *n;
-        for(n = ot->buckets[i]; n; n = n->next)
-            hst_put(ht, n->key, n->val, hashfunc, equfunc);
-    }
+        if(ot->entries[i].key)
+            hst_put(ht, ot->entries[i].key, ot->entries[i].val, hashfunc, equfunc);
 }
 
 int hst_contains_key(hashtable *ht, void *key, hst_hash_function hashfunc, hst_equa_function equfunc)
@@ -173,47 +215,27 @@ int hst_contains_key(hashtable *ht, void *key, hst_hash_function hashfunc, hst_e
 int hst_contains_value(hashtable *ht, void *val, hst_equa_function equfunc)
 {
     int i;
-    hst_node *n = NULL;
     for(i = 0; i < ht->size; i++)
-        for(n = ht->buckets[i]; n; n = n->next)
-            if(EQU_CHECK(n->val, val, equfunc))
-                return 1;
+        if(ht->entries[i].key && EQU_CHECK(ht->entries[i].val, val, equfunc))
+            return 1;
 
     return 0;
 }
 
 void *hst_remove_key(hashtable *ht, void *key, hst_hash_function hashfunc, hst_equa_function equfunc)
 {
-    void *ret = NULL;
+    if(!ht->count)
+        return NULL;
 
     if(!hashfunc)
         hashfunc = hst_djb2;
 
-    long hash = hashfunc(key, NULL);
-    long mod = (unsigned long)hash % ht->size;
+    long idx = hst_find(ht, key, hashfunc(key, NULL), equfunc);
+    if(idx < 0)
+        return NULL;
 
-    hst_node *n = ht->buckets[mod];
-    hst_node *p = NULL;
-
-    for(; n; n = n->next)
-    {
-        if(EQU_CHECK(n->key, key, equfunc))
-        {
-            ret = n->val;
-            if(p)
-                p->next = n->next;
-            else
-                ht->buckets[mod] = n->next;
-
-            if(ht->duplicate_keys)
-                free(n->key);
-            free(n);
-            ht->count--;
-            break;
-        }
-
-        p = n;
-    }
+    void *ret = ht->entries[idx].val;
+    hst_remove_at(ht, idx);
 
     return ret;
 }
@@ -221,56 +243,32 @@ void *hst_remove_key(hashtable *ht, void *key, hst_hash_function hashfunc, hst_e
 void hst_remove_val(hashtable *ht, void *val, hst_equa_function equfunc)
 {
     int i;
-    hst_node *n = NULL;
     for(i = 0; i < ht->size; i++)
     {
-        hst_node *p = NULL;
-        for(n = ht->buckets[i]; n; n = n->next)
-        {
-            if(EQU_CHECK(n->val, val, equfunc))
-            {
-                if(p)
-                    p->next = n->next;
-                else
-                    ht->buckets[i] = n->next;
-
-                if(ht->duplicate_keys)
-                    free(n->key);
-                free(n);
-                ht->count--;
-            }
-
-            p = n;
-        }
+        // Removing shifts the following entries back a slot, so look at
+        // this slot again before moving on.
+        while(ht->entries[i].key && EQU_CHECK(ht->entries[i].val, val, equfunc))
+            hst_remove_at(ht, i);
     }
 }
 
 void hst_free(hashtable *ht)
 {
     int i;
-    for(i = 0; i < ht->size; i++)
-    {
-        hst_node *n = ht->buckets[i];
-        while(n)
-        {
-            hst_node *next = n->next;
-            if(ht->duplicate_keys)
-                free(n->key);
-            free(n);
-            n = next;
-        }
-    }
-
-    free(ht->buckets);
+    if(ht->duplicate_keys)
+        for(i = 0; i < ht->size; i++)
+            free(ht->entries[i].key);
+
+    free(ht->entries);
+    ht->entries = NULL;
+    ht->size = 0;
+    ht->count = 0;
 }
 
 void hst_for_each(hashtable *ht, hst_each_function func, void *data)
 {
     int i;
-    hst_node *n;
     for(i = 0; i < ht->size; i++)
-        for(n = ht->buckets[i]; n; n = n->next)
-            func(n->key, n->val, data);
+        if(ht->entries[i].key)
+            func(ht->entries[i].key, ht->entries[i].val, data);
 }
-
-
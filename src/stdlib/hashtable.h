@@ -23,18 +23,23 @@ typedef long (*hst_hash_function)(void *key, void *data);
 typedef int  (*hst_equa_function)(void *key, void *data);
 typedef void (*hst_each_function)(void *key, void *val, void *data);
 
-typedef struct hst_node_s {
+// Tables use open addressing with linear probing and robin hood placement:
+// every entry lives in one flat array along with the hash of its key, so
+// lookups touch few cache lines and growing never needs to call the hash
+// function again. A NULL key marks an empty slot, so NULL cannot be used as
+// a key. The entry array is allocated on the first put.
+typedef struct hst_entry_s {
     long hash;
     void *key;
     void *val;
-    struct hst_node_s *next;
-} hst_node;
+} hst_entry;
 
 typedef struct hashtable_s {
     int count;
     int size;
     char duplicate_keys;
-    hst_node **buckets;
+    unsigned mods; // Bumped whenever entries move: a new key, a removal or a resize
+    hst_entry *entries;
 } hashtable;
 
 hashtable hst_create();
@@ -85,7 +85,7 @@ struct state {
     struct char_class_node *chrcls;
     struct state *out;
     struct state *out_alt;
-    int listit;
+    int id;
 };
 
 union dangling_pointers {
@@ -109,27 +109,54 @@ typedef struct {
     dangling_pointers *out;
 } rgx_fragment;
 
+// A DFA state stands for a set of NFA states, kept as a bitset over state
+// ids. Its transitions, one per byte class, are filled in the first time
+// they are taken.
+typedef struct dfa_state {
+    struct dfa_state *chain;
+    unsigned long *set;
+    int match;
+    int dead;
+    struct dfa_state *next[];
+} rgx_dstate;
+
 typedef struct {
-    rgx_state **mem;
-    int ct;
-} rgxr_list;
+    rgx_dstate **buckets;
+    rgx_dstate *start;
+    lky_mempool pool;
+    size_t size;
+    int anchored;
+    int full;
+} rgx_dfa;
 
 struct regex {
     rgx_state *start;
-    rgx_state **l1;
-    rgx_state **l2;
-
-    rgxr_list *curr_list;
-    rgxr_list *next_list;
-
-    int listgen;
-    int matched;
 
     int state_count;
     lky_mempool state_mempool;
     lky_mempool class_mempool;
 
     unsigned flags;
+    int refs;
+
+    // Everything below is built by rgx_prepare the first time the regex is
+    // run, and thrown away by rgx_unprepare when the flags change.
+    int prepared;
+    int words;
+    int match_id;
+    rgx_state **states;
+    unsigned long *closures;
+    unsigned long *start_set;
+    unsigned long *search_set;
+    unsigned long *accept;
+    unsigned long *scratch;
+    unsigned char classes[256];
+    unsigned char first[256];
+    int class_count;
+
+    rgx_dfa anchored;
+    rgx_dfa unanchored;
+    int flushes;
 };
 
 static rgx_ast_node rgx_ast_blank = {RAN_BLANK};
@@ -142,8 +169,12 @@ rgx_fragment rgxb_build(rgx_ast_node *head, rgx_regex *regex);
 rgx_state *rgxb_build_state(int c, rgx_state *outa, rgx_state *outb, rgx_regex *regex);
 void rgxb_patch(dangling_pointers *p, rgx_state *s);
 
+void rgx_unprepare(rgx_regex *regex);
+
 void rgx_set_flags(rgx_regex *regex, unsigned flags)
 {
+    if(flags != regex->flags)
+        rgx_unprepare(regex);
     regex->flags = flags;
 }
 
@@ -204,8 +235,9 @@ rgx_regex *rgx_compile(char *input)
     rgx_compiler compiler = rgxc_make_compiler(input);
     rgx_regex *regex = malloc(sizeof(*regex));
     regex->state_count = 0;
-    regex->listgen = 0;
     regex->flags = 0;
+    regex->refs = 1;
+    regex->prepared = 0;
     regex->state_mempool = pool_create();
     regex->class_mempool = pool_create();
     compiler.regex = regex;
@@ -503,7 +535,7 @@ rgx_state *rgxb_build_state(int c, rgx_state *outa, rgx_state *outb, rgx_regex *
     state->chrcls = NULL;
     state->out = outa;
     state->out_alt = outb;
-    state->listit = -1;
+    state->id = -1;
 
     regex->state_count++;
     pool_add(&regex->state_mempool, state);
@@ -603,29 +635,6 @@ rgx_fragment rgxb_build(rgx_ast_node *head, rgx_regex *regex)
     }
 }
 
-void rgx_add_state(rgx_regex *regex, rgxr_list *list, rgx_state *state)
-{
-    if(state->listit == regex->listgen)
-        return;
-
-    state->listit = regex->listgen;
-    if(state->c == SPLIT)
-    {
-        rgx_add_state(regex, list, state->out);
-        rgx_add_state(regex, list, state->out_alt);
-        return;
-    }
-    else if(state->c == NONE)
-    {
-        rgx_add_state(regex, list, state->out);
-        return;
-    }
-
-    list->mem[list->ct++] = state;
-    if(state->c == MATCH)
-        regex->matched = 1;
-}
-
 int rgx_test_class(rgx_charclass *cls, char c)
 {
     int ret;
@@ -666,228 +675,506 @@ int rgx_test(rgx_state *s, char c, unsigned flags)
     return rgx_test_class(s->chrcls, c);
 }
 
-void rgx_step(rgx_regex *regex, char c)
+// Matching runs a DFA built lazily from the NFA: each DFA state is a set of
+// NFA states, and a transition is worked out the first time it is taken and
+// cached from then on, so a pass over the input costs a table lookup per byte
+// instead of a walk over every live NFA state. Bytes that no state in the
+// NFA tells apart share a byte class and so share transitions.
+//
+// Each regex keeps two caches: an anchored one, which matches from a fixed
+// starting point, and an unanchored one, which restarts the NFA at every byte
+// and so finds where the earliest match ends in a single pass. A cache is
+// bounded by RGX_DFA_CACHE_SIZE bytes; a run that needs more carries on by
+// simulating the NFA directly, the cache is flushed before the next run, and
+// after RGX_DFA_MAX_FLUSHES flushes the regex sticks to the NFA for good.
+
+#ifndef RGX_DFA_CACHE_SIZE
+#define RGX_DFA_CACHE_SIZE (512 * 1024)
+#endif
+
+#define RGX_DFA_MAX_FLUSHES 8
+#define RGX_DFA_BUCKETS 256
+#define RGX_WORD_BITS (8 * (int)sizeof(unsigned long))
+
+#define RGX_SET_HAS(set, id) ((set)[(id) / RGX_WORD_BITS] & (1UL << ((id) % RGX_WORD_BITS)))
+#define RGX_SET_ADD(set, id) ((set)[(id) / RGX_WORD_BITS] |= (1UL << ((id) % RGX_WORD_BITS)))
+
+typedef struct {
+    rgx_regex *regex;
+    rgx_dfa *dfa;
+    rgx_dstate *state;
+    unsigned long *set;
+    unsigned long *next;
+    int match;
+    int dead;
+} rgx_cursor;
+
+// Adds the states reachable from s without consuming anything to set.
+void rgx_closure(rgx_state *s, unsigned long *set, unsigned long *seen)
 {
-    regex->listgen++;
-    regex->matched = 0;
-    rgxr_list *cur = regex->curr_list;
-    rgxr_list *nex = regex->next_list;
+    if(!s || RGX_SET_HAS(seen, s->id))
+        return;
 
-    nex->ct = 0;
-    int i;
-    for(i = 0; i < cur->ct; i++)
+    RGX_SET_ADD(seen, s->id);
+    if(s->c == SPLIT)
     {
-        rgx_state *s = cur->mem[i];
-        if(rgx_test(s, c, regex->flags))
-            rgx_add_state(regex, nex, s->out);
+        rgx_closure(s->out, set, seen);
+        rgx_closure(s->out_alt, set, seen);
+        return;
+    }
+    else if(s->c == NONE)
+    {
+        rgx_closure(s->out, set, seen);
+        return;
     }
-}
 
-void rgx_reset_all(lky_mempool *state_pool)
-{
-    struct poolnode *node = state_pool->head;
-    for(; node; node = node->next)
-        ((rgx_state *)node->data)->listit = 0;
+    RGX_SET_ADD(set, s->id);
 }
 
-rgx_result_wrapper rgx_wrapper_make()
+int rgx_consumes(rgx_state *s)
 {
-    rgx_result_wrapper wrapper;
-    wrapper.indices = malloc(sizeof(int) * 10);
-    wrapper.ct = 0;
-    wrapper.alloced = 10;
-
-    return wrapper;
+    return s->c != SPLIT && s->c != NONE && s->c != MATCH;
 }
 
-void rgx_wrapper_append(rgx_result_wrapper *w, int c)
+int rgx_set_empty(unsigned long *set, int words)
 {
-    if(w->ct == w->alloced)
-    { 
-        w->alloced += 10;
-        w->indices = realloc(w->indices, sizeof(int) * w->alloced);
+    int i;
+    for(i = 0; i < words; i++)
+    {
+        if(set[i])
+            return 0;
     }
 
-    w->indices[w->ct++] = c;
+    return 1;
 }
 
-int *rgx_wrapper_finalize(rgx_result_wrapper *w)
+void rgx_dfa_init(rgx_dfa *dfa, int anchored)
 {
-    rgx_wrapper_append(w, -1);
-    return w->indices;
+    dfa->buckets = NULL;
+    dfa->start = NULL;
+    dfa->pool = pool_create();
+    dfa->size = 0;
+    dfa->anchored = anchored;
+    dfa->full = 0;
 }
 
-int *rgx_collect_matches(rgx_regex *regex, char *input)
+void rgx_dfa_flush(rgx_dfa *dfa)
 {
-    rgx_state *l1[regex->state_count];
-    rgx_state *l2[regex->state_count];
+    pool_drain(&dfa->pool);
+    if(dfa->buckets)
+        memset(dfa->buckets, 0, sizeof(rgx_dstate *) * RGX_DFA_BUCKETS);
+    dfa->start = NULL;
+    dfa->size = 0;
+    dfa->full = 0;
+}
 
-    rgxr_list lista;
-    rgxr_list listb;
+void rgx_prepare(rgx_regex *regex)
+{
+    if(regex->prepared)
+        return;
 
-    lista.ct = 0;
-    lista.mem = l1;
+    int count = regex->state_count;
+    int words = (count + RGX_WORD_BITS - 1) / RGX_WORD_BITS;
+    regex->words = words;
+    regex->states = malloc(sizeof(rgx_state *) * count);
 
-    listb.ct = 0;
-    listb.mem = l2;
+    int id = 0;
+    struct poolnode *node = regex->state_mempool.head;
+    for(; node; node = node->next)
+    {
+        rgx_state *s = node->data;
+        s->id = id;
+        regex->states[id++] = s;
+        if(s->c == MATCH)
+            regex->match_id = s->id;
+    }
 
-    regex->l1 = l1;
-    regex->l2 = l2;
+    size_t setsize = sizeof(unsigned long) * words;
+    unsigned long seen[words];
 
-    regex->curr_list = &lista;
-    regex->next_list = &listb;
+    regex->closures = calloc(count, setsize);
+    int i;
+    for(i = 0; i < count; i++)
+    {
+        if(!rgx_consumes(regex->states[i]))
+            continue;
+        memset(seen, 0, setsize);
+        rgx_closure(regex->states[i]->out, regex->closures + i * words, seen);
+    }
 
-    rgx_add_state(regex, regex->curr_list, regex->start);
+    regex->start_set = calloc(1, setsize);
+    memset(seen, 0, setsize);
+    rgx_closure(regex->start, regex->start_set, seen);
 
-    rgx_result_wrapper res = rgx_wrapper_make();
+    // The unanchored machine restarts the NFA at every byte, but a match has
+    // to consume something, so the match state is left out of what it adds.
+    regex->search_set = malloc(setsize);
+    memcpy(regex->search_set, regex->start_set, setsize);
+    regex->search_set[regex->match_id / RGX_WORD_BITS] &= ~(1UL << (regex->match_id % RGX_WORD_BITS));
 
-    int idx;
-    for(idx = 0; *input; input++, idx++)
+    // A byte's class is decided by which states accept it.
+    unsigned long *accept = calloc(256, setsize);
+    int b;
+    regex->class_count = 0;
+    for(b = 0; b < 256; b++)
     {
-        char *start = input;
-        rgx_reset_all(&regex->state_mempool);
-        rgx_add_state(regex, regex->curr_list, regex->start);
-        int len;
-        int lasti, lastlen;
-        lasti = lastlen = -1;
-        for(len = 0; *start; start++, len++)
+        unsigned long *sig = accept + regex->class_count * words;
+        for(i = 0; i < count; i++)
         {
-            char c = start[0];
-            rgx_step(regex, c);
-            rgxr_list *temp = regex->curr_list; regex->curr_list = regex->next_list; regex->next_list = temp;
-
-            if(regex->matched)
-            {
-                lasti = idx;
-                lastlen = len;
-                /*input += len;
-                rgx_wrapper_append(&res, idx);
-                rgx_wrapper_append(&res, len);
-                idx += len;
-                break;*/
-            }
-            if(regex->curr_list->ct == 0)
-            {
-                if(lasti < 0)
-                    break;
-                input += len - 1;
-                rgx_wrapper_append(&res, idx);
-                rgx_wrapper_append(&res, len);
-                idx += len - 1;
-                lasti = -1;
-
-                if(!(regex->flags & RGX_GLOBAL))
-                    return rgx_wrapper_finalize(&res);
+            if(rgx_consumes(regex->states[i]) && rgx_test(regex->states[i], (char)b, regex->flags))
+                RGX_SET_ADD(sig, i);
+        }
 
+        int cls;
+        for(cls = 0; cls < regex->class_count; cls++)
+        {
+            if(!memcmp(accept + cls * words, sig, setsize))
                 break;
-            }
         }
 
-        if(lasti >= 0)
+        if(cls == regex->class_count)
+            regex->class_count++;
+        else
+            memset(sig, 0, setsize);
+        regex->classes[b] = cls;
+    }
+
+    regex->accept = realloc(accept, regex->class_count * setsize);
+
+    for(b = 0; b < 256; b++)
+    {
+        unsigned long *acc = regex->accept + regex->classes[b] * words;
+        regex->first[b] = 0;
+        for(i = 0; i < words; i++)
         {
-            input += len - 1;
-            rgx_wrapper_append(&res, idx);
-            rgx_wrapper_append(&res, len);
-            idx += len;
+            if(acc[i] & regex->start_set[i])
+                regex->first[b] = 1;
         }
     }
 
-    return rgx_wrapper_finalize(&res);
+    regex->scratch = malloc(2 * setsize);
+
+    rgx_dfa_init(&regex->anchored, 1);
+    rgx_dfa_init(&regex->unanchored, 0);
+    regex->flushes = 0;
+    regex->prepared = 1;
 }
 
-int rgx_search(rgx_regex *regex, char *input)
+void rgx_unprepare(rgx_regex *regex)
+{
+    if(!regex->prepared)
+        return;
+
+    rgx_dfa_flush(&regex->anchored);
+    rgx_dfa_flush(&regex->unanchored);
+    free(regex->anchored.buckets);
+    free(regex->unanchored.buckets);
+
+    free(regex->states);
+    free(regex->closures);
+    free(regex->start_set);
+    free(regex->search_set);
+    free(regex->accept);
+    free(regex->scratch);
+    regex->prepared = 0;
+}
+
+// Works out the set of states reached from 'from' on a byte of class cls.
+void rgx_advance(rgx_regex *regex, unsigned long *from, int cls, int anchored, unsigned long *to)
+{
+    int words = regex->words;
+    unsigned long *accept = regex->accept + cls * words;
+
+    if(anchored)
+        memset(to, 0, sizeof(unsigned long) * words);
+    else
+        memcpy(to, regex->search_set, sizeof(unsigned long) * words);
+
+    int i, j;
+    for(i = 0; i < words; i++)
+    {
+        unsigned long live = from[i] & accept[i];
+        while(live)
+        {
+            int id = i * RGX_WORD_BITS + __builtin_ctzl(live);
+            live &= live - 1;
+
+            unsigned long *closure = regex->closures + id * words;
+            for(j = 0; j < words; j++)
+                to[j] |= closure[j];
+        }
+    }
+}
+
+// Returns the DFA state for a set of NFA states, adding it if it is new, or
+// NULL if the cache has no room left for it.
+rgx_dstate *rgx_dfa_find(rgx_regex *regex, rgx_dfa *dfa, unsigned long *set)
 {
-    rgx_state *l1[regex->state_count];
-    rgx_state *l2[regex->state_count];
+    int words = regex->words;
+    size_t setsize = sizeof(unsigned long) * words;
+
+    unsigned long hash = 5381;
+    int i;
+    for(i = 0; i < words; i++)
+        hash = hash * 33 ^ set[i];
+    hash ^= hash >> 17;
+
+    if(!dfa->buckets)
+        dfa->buckets = calloc(RGX_DFA_BUCKETS, sizeof(rgx_dstate *));
+
+    rgx_dstate **bucket = &dfa->buckets[hash % RGX_DFA_BUCKETS];
+    rgx_dstate *d;
+    for(d = *bucket; d; d = d->chain)
+    {
+        if(!memcmp(d->set, set, setsize))
+            return d;
+    }
+
+    size_t size = sizeof(*d) + sizeof(rgx_dstate *) * regex->class_count + setsize;
+    if(dfa->size + size > RGX_DFA_CACHE_SIZE)
+    {
+        dfa->full = 1;
+        return NULL;
+    }
+
+    d = calloc(1, size);
+    d->set = (unsigned long *)(d->next + regex->class_count);
+    memcpy(d->set, set, setsize);
+    d->match = RGX_SET_HAS(set, regex->match_id) != 0;
+    d->dead = rgx_set_empty(set, words);
 
-    rgxr_list lista;
-    rgxr_list listb;
+    d->chain = *bucket;
+    *bucket = d;
+    pool_add(&dfa->pool, d);
+    dfa->size += size;
 
-    lista.ct = 0;
-    lista.mem = l1;
+    return d;
+}
+
+void rgx_cursor_start(rgx_cursor *cur, rgx_regex *regex, rgx_dfa *dfa)
+{
+    size_t setsize = sizeof(unsigned long) * regex->words;
+
+    cur->regex = regex;
+    cur->dfa = dfa;
+    cur->set = regex->scratch;
+    cur->next = regex->scratch + regex->words;
+    cur->match = 0;
+    cur->dead = 0;
+    cur->state = NULL;
+    memcpy(cur->set, dfa->anchored ? regex->start_set : regex->search_set, setsize);
+
+    if(dfa->full && regex->flushes <= RGX_DFA_MAX_FLUSHES)
+    {
+        regex->flushes++;
+        rgx_dfa_flush(dfa);
+    }
 
-    listb.ct = 0;
-    listb.mem = l2;
+    if(regex->flushes > RGX_DFA_MAX_FLUSHES)
+        return;
 
-    regex->l1 = l1;
-    regex->l2 = l2;
+    if(!dfa->start)
+        dfa->start = rgx_dfa_find(regex, dfa, cur->set);
+    cur->state = dfa->start;
+}
 
-    regex->curr_list = &lista;
-    regex->next_list = &listb;
+// Takes a transition that is not in the cache yet, or steps the NFA once the
+// cache has run out of room.
+void rgx_cursor_slow_step(rgx_cursor *cur, int cls)
+{
+    rgx_regex *regex = cur->regex;
+    unsigned long *from = cur->state ? cur->state->set : cur->set;
+    rgx_advance(regex, from, cls, cur->dfa->anchored, cur->next);
 
-    rgx_add_state(regex, regex->curr_list, regex->start);
+    unsigned long *temp = cur->set;
+    cur->set = cur->next;
+    cur->next = temp;
 
-    int idx;
-    for(idx = 0; *input; input++, idx++)
+    if(cur->state)
     {
-        char *start = input;
-        rgx_add_state(regex, regex->curr_list, regex->start);
-        for(; *start; start++)
+        rgx_dstate *n = rgx_dfa_find(regex, cur->dfa, cur->set);
+        if(n)
         {
-            char c = start[0];
-            rgx_step(regex, c);
-            rgxr_list *temp = regex->curr_list; regex->curr_list = regex->next_list; regex->next_list = temp;
+            cur->state->next[cls] = n;
+            cur->state = n;
+            cur->match = n->match;
+            cur->dead = n->dead;
+            return;
+        }
 
-            if(regex->matched)
-            {
-                rgx_reset_all(&regex->state_mempool);
-                return idx;
-            }
-            if(regex->curr_list->ct == 0)
+        cur->state = NULL;
+    }
+
+    cur->match = RGX_SET_HAS(cur->set, regex->match_id) != 0;
+    cur->dead = rgx_set_empty(cur->set, regex->words);
+}
+
+static inline void rgx_cursor_step(rgx_cursor *cur, char c)
+{
+    int cls = cur->regex->classes[(unsigned char)c];
+    rgx_dstate *n;
+    if(cur->state && (n = cur->state->next[cls]))
+    {
+        cur->state = n;
+        cur->match = n->match;
+        cur->dead = n->dead;
+    }
+    else
+        rgx_cursor_slow_step(cur, cls);
+}
+
+// Returns the end of the longest match starting at 'at' (or of the shortest
+// when 'shortest' is set), or -1 if no match starts there.
+long rgx_match_at(rgx_regex *regex, char *input, long at, int shortest)
+{
+    rgx_cursor cur;
+    rgx_cursor_start(&cur, regex, &regex->anchored);
+
+    long end = -1;
+    for(; input[at]; at++)
+    {
+        rgx_cursor_step(&cur, input[at]);
+        if(cur.dead)
+            break;
+        if(cur.match)
+        {
+            end = at + 1;
+            if(shortest)
                 break;
         }
     }
 
-    rgx_reset_all(&regex->state_mempool);
+    return end;
+}
+
+// Returns the end of the earliest-ending match at or after 'at', or -1.
+long rgx_first_end(rgx_regex *regex, char *input, long at)
+{
+    rgx_cursor cur;
+    rgx_cursor_start(&cur, regex, &regex->unanchored);
 
-//    int res = rgx_list_contains_final(regex->curr_list);
-//    regex->curr_list = regex->next_list = NULL;
-//    regex->l1 = regex->l2 = NULL;
+    for(; input[at]; at++)
+    {
+        rgx_cursor_step(&cur, input[at]);
+        if(cur.match)
+            return at + 1;
+        if(cur.dead)
+            break;
+    }
 
     return -1;
 }
 
-int rgx_matches(rgx_regex *regex, char *input)
+// Finds the leftmost match starting at or after 'at'; returns its start and
+// stores its end, or returns -1 if there is none. Every match is at least one
+// byte long.
+long rgx_next_match(rgx_regex *regex, char *input, long at, long *end, int shortest)
+{
+    long first_end = rgx_first_end(regex, input, at);
+    if(first_end < 0)
+        return -1;
+
+    // The match that ends first starts before first_end, so the leftmost one
+    // does too; the first place the anchored machine matches from is it.
+    for(; at < first_end; at++)
+    {
+        if(!regex->first[(unsigned char)input[at]])
+            continue;
+
+        long e = rgx_match_at(regex, input, at, shortest);
+        if(e >= 0)
+        {
+            *end = e;
+            return at;
+        }
+    }
+
+    return -1;
+}
+
+rgx_result_wrapper rgx_wrapper_make()
+{
+    rgx_result_wrapper wrapper;
+    wrapper.indices = malloc(sizeof(int) * 10);
+    wrapper.ct = 0;
+    wrapper.alloced = 10;
+
+    return wrapper;
+}
+
+void rgx_wrapper_append(rgx_result_wrapper *w, int c)
+{
+    if(w->ct == w->alloced)
+    { 
+        w->alloced += 10;
+        w->indices = realloc(w->indices, sizeof(int) * w->alloced);
+    }
+
+    w->indices[w->ct++] = c;
+}
+
+int *rgx_wrapper_finalize(rgx_result_wrapper *w)
+{
+    rgx_wrapper_append(w, -1);
+    return w->indices;
+}
+
+int *rgx_collect_matches(rgx_regex *regex, char *input)
 {
-    rgx_state *l1[regex->state_count];
-    rgx_state *l2[regex->state_count];
+    rgx_prepare(regex);
+    rgx_result_wrapper res = rgx_wrapper_make();
 
-    rgxr_list lista;
-    rgxr_list listb;
+    long at = 0, start, end;
+    while((start = rgx_next_match(regex, input, at, &end, 0)) >= 0)
+    {
+        rgx_wrapper_append(&res, (int)start);
+        rgx_wrapper_append(&res, (int)(end - start));
 
-    lista.ct = 0;
-    lista.mem = l1;
+        if(!(regex->flags & RGX_GLOBAL))
+            break;
+        at = end;
+    }
 
-    listb.ct = 0;
-    listb.mem = l2;
+    return rgx_wrapper_finalize(&res);
+}
 
-    regex->l1 = l1;
-    regex->l2 = l2;
+int rgx_search(rgx_regex *regex, char *input)
+{
+    rgx_prepare(regex);
 
-    regex->curr_list = &lista;
-    regex->next_list = &listb;
+    long end;
+    return (int)rgx_next_match(regex, input, 0, &end, 1);
+}
 
-    rgx_add_state(regex, regex->curr_list, regex->start);
-    regex->matched = 0;
+int rgx_matches(rgx_regex *regex, char *input)
+{
+    rgx_prepare(regex);
 
+    rgx_cursor cur;
+    rgx_cursor_start(&cur, regex, &regex->anchored);
     for(; *input; input++)
     {
-        char c = input[0];
-        rgx_step(regex, c);
-        rgxr_list *temp = regex->curr_list; regex->curr_list = regex->next_list; regex->next_list = temp;
+        rgx_cursor_step(&cur, *input);
+        if(cur.dead)
+            return 0;
     }
 
-    int res = regex->matched;
-    regex->curr_list = regex->next_list = NULL;
-    regex->l1 = regex->l2 = NULL;
-
-    rgx_reset_all(&regex->state_mempool);
+    return cur.match;
+}
 
-    return res;
+rgx_regex *rgx_retain(rgx_regex *regex)
+{
+    regex->refs++;
+    return regex;
 }
 
+// Drops a reference to the regex, freeing it along with the last one.
 void rgx_free(rgx_regex *regex)
 {
+    if(--regex->refs > 0)
+        return;
+
+    rgx_unprepare(regex);
     pool_drain(&regex->state_mempool);
     pool_drain(&regex->class_mempool);
     free(regex);
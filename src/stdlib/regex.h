@@ -41,6 +41,7 @@ unsigned rgx_get_flags(rgx_regex *regex);
 int *rgx_collect_matches(rgx_regex *regex, char *input);
 int rgx_matches(rgx_regex *regex, char *input);
 int rgx_search(rgx_regex *regex, char *input);
+rgx_regex *rgx_retain(rgx_regex *regex);
 void rgx_free(rgx_regex *regex);
 
 #endif //REGEX_H
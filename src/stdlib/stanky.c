@@ -27,6 +27,7 @@
 #include "stl_os.h"
 #include "stl_string.h"
 #include "stl_table.h"
+#include "stl_builder.h"
 #include "stl_regex.h"
 #include "testnew.h"
 #include "lky_gc.h"
@@ -46,6 +47,7 @@ hashtable get_stdlib_objects()
     hst_put(&t, "Object", stlobj_get_class(), NULL, NULL);
     hst_put(&t, "OS", stlos_get_class(), NULL, NULL);
     hst_put(&t, "Table", stltab_get_class(), NULL, NULL);
+    hst_put(&t, "StringBuilder", stlsb_get_class(), NULL, NULL);
     hst_put(&t, "Regex", stlrgx_get_class(), NULL, NULL);
     hst_put(&t, "Error", lobjb_get_exception_class(), NULL, NULL);
     hst_put(&t, "TN", tn_get_class(), NULL, NULL);
@@ -54,7 +56,7 @@ hashtable get_stdlib_objects()
 
 void register_stdlib_prototypes()
 {
-    gc_add_object(stlarr_get_proto());
-    gc_add_object(stlobj_get_proto());
+    gc_add_root_object(stlarr_get_proto());
+    gc_add_root_object(stlobj_get_proto());
 }
 
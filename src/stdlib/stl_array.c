@@ -29,7 +29,7 @@
 #include "stl_string.h"
 #include "mach_binary_ops.h"
 
-#define IS_TAGGED(a) ((uintptr_t)(a) & 1)
+#define IS_TAGGED(a) OBJ_IS_TAGGED(a)
 #define FAIL_CHECK(check, name, text) do { if(check) { mach_halt_with_err(lobjb_build_error(name, text)); return &lky_nil; } }while(0);
 
 static lky_object *stlarr_class = NULL;
@@ -89,7 +89,7 @@ lky_object *stlarr_add(lky_func_bundle *bundle)
     arraylist list = data->container;
 
     lky_object *obj = (lky_object *)args->value;
-    if(!((uintptr_t)(obj) & 1) && obj->type != LBI_FLOAT && obj->type != LBI_INTEGER)
+    if(!OBJ_IS_TAGGED(obj) && obj->type != LBI_FLOAT && obj->type != LBI_INTEGER)
         return &lky_nil;
 
     long offset = OBJ_NUM_UNWRAP(obj);
@@ -642,7 +642,7 @@ lky_object *stlarr_get_class()
 #include "mach_binary_ops.h"
 #include "class_builder.h"
 
-#define IS_TAGGED(a) ((uintptr_t)(a) & 1)
+#define IS_TAGGED(a) OBJ_IS_TAGGED(a)
 
 static lky_object *stlarr_class_ = NULL;
 
@@ -686,6 +686,7 @@ lky_object *stlarr_cinit(arraylist list)
 
 CLASS_MAKE_METHOD_EX(stlarr_append, self, stlarr_bl *, ab_, 
     arr_append(&ab_->container, $1);
+    GC_WRITE_BARRIER(raw_blob_, $1);
     lobj_set_member(self, "count", lobjb_build_int(ab_->container.count));
     return self;
 )
@@ -694,6 +695,7 @@ CLASS_MAKE_METHOD_EX(stlarr_insert, self, stlarr_bl *, ab_,
     int idx = OBJ_NUM_UNWRAP($2);
     CLASS_ERROR_ASSERT(idx < ab_->container.count, "OutOfBounds", "The specified index is out of bounds.");
     arr_insert(&ab_->container, $1, idx);
+    GC_WRITE_BARRIER(raw_blob_, $1);
     lobj_set_member(self, "count", lobjb_build_int(ab_->container.count));
     return self;
 )
@@ -703,6 +705,7 @@ CLASS_MAKE_METHOD_EX(stlarr_set, self, stlarr_bl *, ab_,
     int idx = (int)OBJ_NUM_UNWRAP($1);
     CLASS_ERROR_ASSERT(idx < list->count, "OutOfBounds", "The specified index is out of bounds.");
     list->items[idx] = $2;
+    GC_WRITE_BARRIER(raw_blob_, $2);
 )
 
 CLASS_MAKE_METHOD_EX(stlarr_get, self, stlarr_bl *, ab_,
@@ -884,7 +887,8 @@ CLASS_MAKE_METHOD(stlarr_stringify, self,
     $1 = stlstr_cinit(", ");
     lky_object_function *func = (lky_object_function *)lobjb_build_func_ex(NULL, 0, NULL);
     func->bound = self;
-    lky_func_bundle b = MAKE_BUNDLE(func, LKY_ARGS($1, &lky_yes), interp_);
+    lky_object *argv[] = { $1, &lky_yes };
+    lky_func_bundle b = MAKE_ARGV_BUNDLE(func, 2, argv, interp_);
     lky_object *res = stlarr_joined(&b);
     char *tmp = lobjb_stringify(res, interp_);
     char *out = malloc(strlen(tmp) + 5);
@@ -915,6 +919,7 @@ CLASS_MAKE_METHOD(stlarr_memcpy, self,
     CLASS_ERROR_TEST(size > bl->count, "OutOfBounds", "The source does not have enough elements to copy");
 
     memcpy(al->items, bl->items, size * sizeof(void *));
+    gc_remember(lobj_get_member($1, "ab_"));
 
     al->count = al->count < size ? size : al->count;
     lobj_set_member($1, "count", lobjb_build_int(al->count));
@@ -0,0 +1,137 @@
+/* Lanky -- Scripting Language and Virtual Machine
+ * Copyright (C) 2014  Sam Olsen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <string.h>
+#include "stl_builder.h"
+#include "stl_string.h"
+#include "stl_array.h"
+#include "lky_gc.h"
+#include "tools.h"
+#include "class_builder.h"
+
+// A string built up a piece at a time. Appending copies only the new
+// bytes, so building a string of n pieces is linear rather than the
+// quadratic cost of s = s + piece.
+//
+// toString hands 'buf' to the string it makes instead of copying it.
+// The builder keeps that string in 'shared' and copies the bytes back
+// out the next time it is appended to.
+typedef struct {
+    auto_buffer buf;
+    lky_object *shared;
+} stlsb_data;
+
+static lky_object *stlsb_class_ = NULL;
+
+CLASS_MAKE_BLOB_FUNCTION(stlsb_blob_func, stlsb_data *, data, how,
+    if(how == CGC_FREE)
+    {
+        if(!data->shared)
+            free(data->buf.str);
+        free(data);
+        return;
+    }
+
+    if(data->shared)
+        gc_mark_object(data->shared);
+)
+
+static void stlsb_unshare(stlsb_data *data)
+{
+    if(!data->shared)
+        return;
+
+    auto_buffer own = {NULL, 0, 0};
+    auto_cat_len(&own, data->buf.str, data->buf.length);
+    data->buf = own;
+    data->shared = NULL;
+}
+
+static void stlsb_append_object(stlsb_data *data, lky_object *obj, mach_interp *interp)
+{
+    if(lobj_is_of_class(obj, stlstr_get_class()))
+    {
+        stlstr_data *sd = stlstr_get_data(obj);
+        stlsb_unshare(data);
+        auto_cat_len(&data->buf, sd->str, sd->length);
+        return;
+    }
+
+    // Stringifying may run toString on this very builder (sb.append(sb)),
+    // which shares 'buf' again, so only unshare once it is done.
+    char *str = lobjb_stringify(obj, interp);
+    stlsb_unshare(data);
+    auto_cat(&data->buf, str);
+    free(str);
+}
+
+CLASS_MAKE_INIT(stlsb_init,
+    stlsb_data *data = calloc(1, sizeof(*data));
+    CLASS_SET_BLOB(self_, "sb_", data, stlsb_blob_func);
+
+    if($1)
+        stlsb_append_object(data, $1, interp_);
+
+    lobj_set_member(self_, "length", lobjb_build_int(data->buf.length));
+)
+
+CLASS_MAKE_METHOD_EX(stlsb_append, self, stlsb_data *, sb_,
+    stlsb_append_object(sb_, $1, interp_);
+    lobj_set_member(self, "length", lobjb_build_int(sb_->buf.length));
+    return self;
+)
+
+CLASS_MAKE_METHOD_EX(stlsb_append_all, self, stlsb_data *, sb_,
+    CLASS_ERROR_ASSERT(lobj_is_of_class($1, stlarr_get_class()), "MismatchedType", "Parameter 1 to appendAll not an array");
+
+    arraylist *list = stlarr_get_store($1);
+    long i;
+    for(i = 0; i < list->count; i++)
+        stlsb_append_object(sb_, list->items[i], interp_);
+
+    lobj_set_member(self, "length", lobjb_build_int(sb_->buf.length));
+    return self;
+)
+
+CLASS_MAKE_METHOD_EX(stlsb_to_string, self, stlsb_data *, sb_,
+    if(sb_->shared)
+        return sb_->shared;
+
+    if(!sb_->buf.str)
+        auto_cat_len(&sb_->buf, "", 0);
+
+    sb_->shared = stlstr_adopt(sb_->buf.str, sb_->buf.length, sb_->buf.capacity);
+    GC_WRITE_BARRIER(raw_blob_, sb_->shared);
+    return sb_->shared;
+)
+
+lky_object *stlsb_get_class()
+{
+    if(stlsb_class_)
+        return stlsb_class_;
+
+    CLASS_MAKE(cls, NULL, stlsb_init, 1,
+        CLASS_PROTO("length", lobjb_build_int(-1));
+        CLASS_PROTO_METHOD("append", stlsb_append, 1);
+        CLASS_PROTO_METHOD("appendAll", stlsb_append_all, 1);
+        CLASS_PROTO_METHOD("toString", stlsb_to_string, 0);
+        CLASS_PROTO_METHOD("stringify_", stlsb_to_string, 0);
+    );
+
+    stlsb_class_ = cls;
+    return cls;
+}
@@ -15,13 +15,11 @@
  * with this program; if not, write to the Free Software Foundation, Inc.,
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
+#ifndef STL_BUILDER_H
+#define STL_BUILDER_H
 
-#ifndef LKY_GC_MK2_H
-#define LKY_GC_MK2_H
+#include "lkyobj_builtin.h"
 
-#include "lky_object.h"
-
-void gc2_add_object(lky_object *obj);
-void gc2_gc();
+lky_object *stlsb_get_class();
 
 #endif
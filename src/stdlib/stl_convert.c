@@ -22,18 +22,16 @@
 #include "stl_string.h"
 #include "stl_array.h"
 
-#define IS_TAGGED(a) ((uintptr_t)(a) & 1)
-
 lky_object *stlcon_to_int(lky_func_bundle *bundle)
 {
     lky_object_seq *args = BUW_ARGS(bundle);
 
     lky_object *from = (lky_object *)args->value;
 
-    if(IS_TAGGED(from) || from->type == LBI_INTEGER)
+    if(OBJ_IS_INTEGER(from))
         return from;
-    if(from->type == LBI_FLOAT)
-        return lobjb_build_int(OBJ_NUM_UNWRAP(from));
+    if(OBJ_IS_FLOAT(from))
+        return lobjb_build_int(OBJ_FLOAT_UNWRAP(from));
 
     long val;
     sscanf(stlstr_unwrap(from), "%ld", &val);
@@ -47,10 +45,10 @@ lky_object *stlcon_to_float(lky_func_bundle *bundle)
 
     lky_object *from = (lky_object *)args->value;
 
-    if(IS_TAGGED(from) || from->type == LBI_INTEGER)
-        return lobjb_build_float(OBJ_NUM_UNWRAP(from));
+    if(OBJ_IS_INTEGER(from))
+        return lobjb_build_float(OBJ_INT_UNWRAP(from));
 
-    if(from->type == LBI_FLOAT)
+    if(OBJ_IS_FLOAT(from))
         return from;
 
     double val;
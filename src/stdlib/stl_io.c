@@ -178,6 +178,44 @@ CLASS_MAKE_METHOD_EX(stlio_file_writeline, self, stlio_blob *, fb_,
     free(line);
 )
 
+// Reads the next line of the file for a for-in loop over it. The loop ends
+// at the end of the file (setting EOF, as getln does) or when the file is
+// closed under it.
+static lky_object *stlio_file_line_next(lky_object_iterable *it)
+{
+    stlio_blob *b = it->state.walk.store;
+    if(!b->open)
+        return NULL;
+
+    char *line = NULL;
+    size_t sz = 0;
+    ssize_t len = getline(&line, &sz, b->f);
+    if(len < 0)
+    {
+        lobj_set_member(it->owner, "EOF", &lky_yes);
+        free(line);
+        return NULL;
+    }
+
+    if(len && line[len - 1] == '\n')
+        line[len - 1] = '\0';
+
+    lky_object *ret = stlstr_cinit(line);
+    free(line);
+    it->index++;
+    return ret;
+}
+
+CLASS_MAKE_METHOD_EX(stlio_file_lines, self, stlio_blob *, fb_,
+    CLASS_ERROR_ASSERT(fb_->read, "FileModeInvalid", "Attempted to read from write-only file.");
+    CLASS_ERROR_ASSERT(fb_->open, "FileStreamClosed", "The file stream has already been closed");
+
+    lky_object_iterable *it = lobjb_build_iterator(self, stlio_file_line_next);
+    it->state.walk.store = fb_;
+
+    return (lky_object *)it;
+)
+
 CLASS_MAKE_METHOD_EX(stlio_file_close, self, stlio_blob *, fb_,
     fclose(fb_->f);
     fb_->f = NULL;
@@ -200,6 +238,8 @@ lky_object *stlio_get_file_class()
         CLASS_PROTO_METHOD("put", stlio_file_write, 1);
         CLASS_PROTO_METHOD("putln", stlio_file_writeline, 1);
         CLASS_PROTO_METHOD("rewind", stlio_file_rewind, 0);
+        CLASS_PROTO_METHOD("eachLine", stlio_file_lines, 0);
+        CLASS_PROTO_METHOD("iterable_", stlio_file_lines, 0);
     );
 
     stlio_file_class_ = cls;
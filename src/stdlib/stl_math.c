@@ -33,7 +33,7 @@
 #endif
 
 #define TOKENPASTE(x, y) x ## y
-#define IS_NUMBER(obj) (((uintptr_t)(obj) & 1) || obj->type == LBI_FLOAT || obj->type == LBI_INTEGER)
+#define IS_NUMBER(obj) (OBJ_IS_TAGGED(obj) || obj->type == LBI_FLOAT || obj->type == LBI_INTEGER)
 
 // Here we are shooting for rough templating. Lots of the cmath functions
 // take one value as input and we want to wrap all of them. The below
@@ -107,6 +107,32 @@ lky_object *stlmath_range(lky_func_bundle *bundle)
     return stlarr_cinit(list);
 }
 
+// Math.span(from, to[, step]) counts from 'from' up to (or, with a negative
+// step, down to) but not including 'to', handing the numbers out as the
+// loop asks for them rather than building an Array as range does.
+lky_object *stlmath_span(lky_func_bundle *bundle)
+{
+    mach_interp *interp = BUW_INTERP(bundle);
+    lky_object *from = BUW_ARG(bundle, 0);
+    lky_object *to = BUW_ARG(bundle, 1);
+    lky_object *step = BUW_ARG(bundle, 2);
+
+    if(!from || !to || !OBJ_IS_NUMBER(from) || !OBJ_IS_NUMBER(to) || (step && !OBJ_IS_NUMBER(step)))
+    {
+        interp->error = lobjb_build_error("MismatchedType", "Math.span takes two or three numbers.", interp);
+        return &lky_nil;
+    }
+
+    long by = step ? (long)OBJ_NUM_UNWRAP(step) : 1;
+    if(!by)
+    {
+        interp->error = lobjb_build_error("InvalidArgument", "Math.span cannot step by zero.", interp);
+        return &lky_nil;
+    }
+
+    return lobjb_build_range((long)OBJ_NUM_UNWRAP(from), (long)OBJ_NUM_UNWRAP(to), by);
+}
+
 lky_object *stlmath_rand_int(lky_func_bundle *bundle)
 {
     lky_object_seq *args = BUW_ARGS(bundle);
@@ -229,6 +255,7 @@ lky_object *stlmath_get_class()
     lobj_set_member(obj, "quad", lobjb_build_func_ex(obj, 3, (lky_function_ptr)stlmath_quad));
     lobj_set_member(obj, "shuffle", lobjb_build_func_ex(obj, 1, (lky_function_ptr)stlmath_shuffle));
     lobj_set_member(obj, "range", lobjb_build_func_ex(obj, 1, (lky_function_ptr)stlmath_range));
+    lobj_set_member(obj, "span", lobjb_build_func_ex(obj, 3, (lky_function_ptr)stlmath_span));
     lobj_set_member(obj, "atan2", lobjb_build_func_ex(obj, 2, (lky_function_ptr)stlmath_atan2));
     lobj_set_member(obj, "abs", lobjb_build_func_ex(obj, 1, (lky_function_ptr)stlmath_wrap_fabs));
     STLMATH_WRAP_MEMBER(obj, sin);
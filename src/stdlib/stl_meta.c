@@ -22,8 +22,12 @@
 #include "parser.h"
 #include "tools.h"
 #include "ast_compiler.h"
+#include "bytecode_analyzer.h"
 #include "arraylist.h"
 #include "lky_gc.h"
+#include "aquarium.h"
+#include "stl_array.h"
+#include "stl_regex.h"
 #include "instruction_set.h"
 #include "colors.h"
 #include "info.h"
@@ -108,7 +112,13 @@ lky_object *compile_and_exec(char *str, mach_interp *interp)
     {
         if(code->ops[i] == LI_POP || code->ops[i] == LI_IGNORE)
         {
+            // The value stays on the stack; reloading the code sizes the
+            // stack for it. If that leaves the stack unbalanced (the POP
+            // was inside a loop, say) we do without the value.
+            unsigned char was = code->ops[i];
             code->ops[i] = LI_IGNORE;
+            if(was == LI_POP && load_bytecode(code))
+                code->ops[i] = LI_POP;
             break;
         }
     }
@@ -117,6 +127,10 @@ lky_object *compile_and_exec(char *str, mach_interp *interp)
     lky_object_function *tor = (lky_object_function *)lobjb_build_func(code, 0, t, interp);
     
     lky_object *ret = mach_interrupt_exec(tor);
+
+    // Nothing refers to this code once it has run; the functions it made
+    // hold on to their own.
+    lobjb_free_code(code);
     
     return ret;
 }
@@ -285,7 +299,6 @@ lky_object *stlmeta_gc_pass(lky_func_bundle *bundle)
 
 lky_object *stlmeta_gc_collect(lky_func_bundle *bundle)
 {
-    gc_mark();
     gc_collect();
     return &lky_nil;
 }
@@ -295,6 +308,41 @@ lky_object *stlmeta_gc_alloced(lky_func_bundle *bundle)
     return lobjb_build_int((long)gc_alloced());
 }
 
+// Returns one object per aquarium size class with its block size, the
+// number of pools backing it and how many blocks are used and free.
+lky_object *stlmeta_pool_stats(lky_func_bundle *bundle)
+{
+    arraylist list = arr_create(aqua_size_class_count() + 1);
+
+    int i;
+    for(i = 0; i < aqua_size_class_count(); i++)
+    {
+        aqua_class_stats stats = aqua_stats_for_class(i);
+        lky_object *obj = lobj_alloc();
+        lobj_set_member(obj, "size", lobjb_build_int((long)stats.block_size));
+        lobj_set_member(obj, "pools", lobjb_build_int((long)stats.pools));
+        lobj_set_member(obj, "used", lobjb_build_int((long)stats.used));
+        lobj_set_member(obj, "free", lobjb_build_int((long)stats.free));
+        arr_append(&list, obj);
+    }
+
+    return stlarr_cinit(list);
+}
+
+// Returns an object with the hit and miss counts of the compiled regex cache
+// and how many of its slots are in use.
+lky_object *stlmeta_regex_cache_stats(lky_func_bundle *bundle)
+{
+    stlrgx_regex_cache_stats stats = stlrgx_cache_stats();
+    lky_object *obj = lobj_alloc();
+    lobj_set_member(obj, "hits", lobjb_build_int(stats.hits));
+    lobj_set_member(obj, "misses", lobjb_build_int(stats.misses));
+    lobj_set_member(obj, "count", lobjb_build_int(stats.count));
+    lobj_set_member(obj, "capacity", lobjb_build_int(stats.capacity));
+
+    return obj;
+}
+
 int stlmeta_space_count_for_idx(int idx)
 {
     if(idx < 10)
@@ -313,110 +361,34 @@ int stlmeta_space_count_for_idx(int idx)
     return 0;
 }
 
+#define STLMETA_INSTRUCTION_CASE_(name) case LI_ ## name: return #name;
+
 char *stlmeta_string_for_instruction(lky_instruction instr)
 {
-    // Switch statement generated using "instrgen.lky".
+    // Cases are generated from the instruction list in instruction_set.h.
     switch(instr)
     {
-        case LI_BINARY_ADD:
-            return "BINARY_ADD";
-        case LI_BINARY_SUBTRACT:
-            return "BINARY_SUBTRACT";
-        case LI_BINARY_MULTIPLY:
-            return "BINARY_MULTIPLY";
-        case LI_BINARY_DIVIDE:
-            return "BINARY_DIVIDE";
-        case LI_BINARY_MODULO:
-            return "BINARY_MODULO";
-        case LI_BINARY_LT:
-            return "BINARY_LT";
-        case LI_BINARY_GT:
-            return "BINARY_GT";
-        case LI_BINARY_EQUAL:
-            return "BINARY_EQUAL";
-        case LI_BINARY_LTE:
-            return "BINARY_LTE";
-        case LI_BINARY_GTE:
-            return "BINARY_GTE";
-        case LI_BINARY_NE:
-            return "BINARY_NE";
-        case LI_BINARY_AND:
-            return "BINARY_AND";
-        case LI_BINARY_OR:
-            return "BINARY_OR";
-        case LI_LOAD_CONST:
-            return "LOAD_CONST";
-        case LI_PRINT:
-            return "PRINT";
-        case LI_POP:
-            return "POP";
-        case LI_JUMP_FALSE:
-            return "JUMP_FALSE";
-        case LI_JUMP_TRUE:
-            return "JUMP_TRUE";
-        case LI_JUMP:
-            return "JUMP";
-        case LI_JUMP_TRUE_ELSE_POP:
-            return "JUMP_TRUE_ELSE_POP";
-        case LI_JUMP_FALSE_ELSE_POP:
-            return "JUMP_FALSE_ELSE_POP";
-        case LI_IGNORE:
-            return "IGNORE";
-        case LI_SAVE_LOCAL:
-            return "SAVE_LOCAL";
-        case LI_LOAD_LOCAL:
-            return "LOAD_LOCAL";
-        case LI_PUSH_NIL:
-            return "PUSH_NIL";
-        case LI_PUSH_NEW_OBJECT:
-            return "PUSH_NEW_OBJECT";
-        case LI_CALL_FUNC:
-            return "CALL_FUNC";
-        case LI_RETURN:
-            return "RETURN";
-        case LI_LOAD_MEMBER:
-            return "LOAD_MEMBER";
-        case LI_SAVE_MEMBER:
-            return "SAVE_MEMBER";
-        case LI_MAKE_FUNCTION:
-            return "MAKE_FUNCTION";
-        case LI_MAKE_CLASS:
-            return "MAKE_CLASS";
-        case LI_SAVE_CLOSE:
-            return "SAVE_CLOSE";
-        case LI_LOAD_CLOSE:
-            return "LOAD_CLOSE";
-        case LI_MAKE_ARRAY:
-            return "MAKE_ARRAY";
-        case LI_MAKE_TABLE:
-            return "MAKE_TABLE";
-        case LI_MAKE_OBJECT:
-            return "MAKE_OBJECT";
-        case LI_LOAD_INDEX:
-            return "LOAD_INDEX";
-        case LI_SAVE_INDEX:
-            return "SAVE_INDEX";
-        case LI_DDUPLICATE:
-            return "DDUPLICATE";
-        case LI_SINK_FIRST:
-            return "SINK_FIRST";
-        case LI_MAKE_ITER:
-            return "MAKE_ITER";
-        case LI_NEXT_ITER_OR_JUMP:
-            return "NEXT_ITER_OR_JUMP";
-        case LI_UNARY_NOT:
-            return "UNARY_NOT";
-        case LI_UNARY_NEGATIVE:
-            return "UNARY_NEGATIVE";
-        case LI_PUSH_CATCH:
-            return "PUSH_CATCH";
-        case LI_POP_CATCH:
-            return "POP_CATCH";
+        LKY_INSTRUCTION_LIST(STLMETA_INSTRUCTION_CASE_)
         default:
             return "";
     }
 }
 
+// Prints a register operand as either a local slot or a constant.
+void stlmeta_print_register(lky_object_code *code, unsigned int reg)
+{
+    if(!(reg & LKY_REG_CONST))
+    {
+        printf("local %u", reg);
+        return;
+    }
+
+    reg &= ~LKY_REG_CONST;
+    printf("const %u (", reg);
+    lobjb_print_object(code->constants[reg], NULL);
+    printf(")");
+}
+
 void stlmeta_print_dissassembly(lky_object_code *code)
 {
     long i, j;
@@ -441,8 +413,6 @@ void stlmeta_print_dissassembly(lky_object_code *code)
             }
             case LI_LOAD_CLOSE:
             case LI_SAVE_CLOSE:
-            case LI_LOAD_MEMBER:
-            case LI_SAVE_MEMBER:
             {
                 unsigned int idx = *(unsigned int *)(code->ops + (++i));
                 printf("\t%d\t", idx);
@@ -450,6 +420,17 @@ void stlmeta_print_dissassembly(lky_object_code *code)
                 //printf("\t%d\t(\"%s\")", code->ops[++i], code->names[code->ops[i]]);
                 break;
             }
+            case LI_LOAD_MEMBER:
+            case LI_SAVE_MEMBER:
+            {
+                unsigned int idx = *(unsigned int *)(code->ops + (++i));
+                printf("\t%u\t", idx);
+                i += 3;
+                idx = *(unsigned int *)(code->ops + (++i));
+                printf("\t%u\t[cache]", idx);
+                i += 3;
+                break;
+            }
             case LI_CALL_FUNC:
                 printf("\t%d\t[argc]", code->ops[++i]);
                 break;
@@ -469,6 +450,7 @@ void stlmeta_print_dissassembly(lky_object_code *code)
             }
             case LI_LOAD_LOCAL:
             case LI_SAVE_LOCAL:
+            case LI_SAVE_LOCAL_POP:
             {
                 unsigned int idx = *(unsigned int *)(code->ops + (++i));
                 printf("\t%d\t[local index]", idx);
@@ -484,6 +466,7 @@ void stlmeta_print_dissassembly(lky_object_code *code)
                 break;
             }
             case LI_MAKE_TABLE:
+            case LI_CONCAT:
             {
                 unsigned int idx = *(unsigned int *)(code->ops + (++i));
                 printf("\t%u\t[item count]", idx);
@@ -503,6 +486,86 @@ void stlmeta_print_dissassembly(lky_object_code *code)
 
                 break;
             }
+            case LI_BINARY_JUMP_FALSE:
+            case LI_BINARY_JUMP_FALSE_INT:
+            case LI_BINARY_JUMP_FALSE_FLOAT:
+            {
+                printf("\t%s", stlmeta_string_for_instruction(code->ops[++i]));
+                unsigned int idx = *(unsigned int *)(code->ops + (++i));
+                printf("\t%u\t[jump location]", idx);
+                i += 3;
+                break;
+            }
+            case LI_BIND_CLOSE:
+            {
+                unsigned int idx = *(unsigned int *)(code->ops + (++i));
+                printf("\t%u\t[local index]", idx);
+                i += 3;
+                idx = *(unsigned int *)(code->ops + (++i));
+                printf("\t%u\t", idx);
+                i += 3;
+                break;
+            }
+            case LI_LOAD_LOCAL_MEMBER:
+            {
+                unsigned int idx = *(unsigned int *)(code->ops + (++i));
+                printf("\t%u\t[local index]", idx);
+                i += 3;
+                idx = *(unsigned int *)(code->ops + (++i));
+                printf("\t%u\t", idx);
+                i += 3;
+                idx = *(unsigned int *)(code->ops + (++i));
+                printf("\t%u\t[cache]", idx);
+                i += 3;
+                break;
+            }
+            case LI_REG_BINARY:
+            case LI_REG_BINARY_PUSH:
+            case LI_REG_BINARY_INT:
+            case LI_REG_BINARY_PUSH_INT:
+            case LI_REG_BINARY_FLOAT:
+            case LI_REG_BINARY_PUSH_FLOAT:
+            {
+                printf("\t%s\t", stlmeta_string_for_instruction(code->ops[++i]));
+                stlmeta_print_register(code, *(unsigned int *)(code->ops + (++i)));
+                i += 3;
+                printf(", ");
+                stlmeta_print_register(code, *(unsigned int *)(code->ops + (++i)));
+                i += 3;
+
+                if(instr == LI_REG_BINARY || instr == LI_REG_BINARY_INT || instr == LI_REG_BINARY_FLOAT)
+                {
+                    printf(" -> local %u", *(unsigned int *)(code->ops + (++i)));
+                    i += 3;
+                }
+                else
+                    printf(" -> stack");
+
+                break;
+            }
+            case LI_FOR_RANGE:
+            case LI_FOR_STEP:
+            {
+                if(instr == LI_FOR_STEP)
+                    printf("\t%s", stlmeta_string_for_instruction(code->ops[++i]));
+                printf("\t%s", stlmeta_string_for_instruction(code->ops[++i]));
+                printf("\t%u\t[local index] ", *(unsigned int *)(code->ops + (++i)));
+                i += 3;
+
+                if(instr == LI_FOR_STEP)
+                {
+                    printf("by ");
+                    stlmeta_print_register(code, *(unsigned int *)(code->ops + (++i)));
+                    i += 3;
+                    printf(", ");
+                }
+
+                stlmeta_print_register(code, *(unsigned int *)(code->ops + (++i)));
+                i += 3;
+                printf("\t%u\t[jump location]", *(unsigned int *)(code->ops + (++i)));
+                i += 3;
+                break;
+            }
             default: break;
         }
         
@@ -516,7 +579,7 @@ lky_object *stlmeta_examine(lky_func_bundle *bundle)
 
     lky_object_function *obj = (lky_object_function *)args->value;
 
-    if((uintptr_t)(obj) & 1)
+    if(OBJ_IS_TAGGED(obj))
     {
         printf("Lanky tagged pointer.\n");
         return &lky_nil;
@@ -658,6 +721,8 @@ lky_object *stlmeta_get_class(mach_interp *interp)
     lobj_set_member(obj, "gc_pass", lobjb_build_func_ex(obj, 0, (lky_function_ptr)stlmeta_gc_pass));
     lobj_set_member(obj, "gc_collect", lobjb_build_func_ex(obj, 0, (lky_function_ptr)stlmeta_gc_collect));
     lobj_set_member(obj, "gc_alloced", lobjb_build_func_ex(obj, 0, (lky_function_ptr)stlmeta_gc_alloced));
+    lobj_set_member(obj, "poolStats", lobjb_build_func_ex(obj, 0, (lky_function_ptr)stlmeta_pool_stats));
+    lobj_set_member(obj, "regexCacheStats", lobjb_build_func_ex(obj, 0, (lky_function_ptr)stlmeta_regex_cache_stats));
     lobj_set_member(obj, "gc_halt", lobjb_build_func_ex(obj, 0, (lky_function_ptr)stlmeta_gc_halt));
     lobj_set_member(obj, "addressOf", lobjb_build_func_ex(obj, 1, (lky_function_ptr)stlmeta_address_of));
     lobj_set_member(obj, "allowIntTags", lobjb_build_func_ex(obj, 1, (lky_function_ptr)stlmeta_allow_int_tags));
@@ -66,8 +66,8 @@ lky_object *stlobj_responds_to(lky_func_bundle *bundle)
     if(!o)
         return &lky_no;
 
-    // Help avoid tagged integer problems
-    if(OBJ_IS_INTEGER(o))
+    // Help avoid tagged number problems
+    if(OBJ_IS_TAGGED(o))
         return &lky_no;
 
     return LKY_TESTC_FAST(o->type == LBI_FUNCTION);
@@ -97,7 +97,7 @@ lky_object *stlobj_remove(lky_func_bundle *bundle)
 
     char *str = lobjb_stringify((lky_object *)args->value, BUW_INTERP(bundle));
 
-    hst_remove_key(&self->members, str, NULL, NULL);
+    lobj_remove_member(self, str);
 
     free(str);
 
@@ -157,8 +157,8 @@ lky_object *stlobj_set_members(lky_func_bundle *bundle)
 
     if(!append)
     {
-        hst_free(&self->members);
-        self->members = hst_create();
+        shp_members_free(&self->members);
+        shp_members_init(&self->members);
         stlobj_seed(self);
     }
 
@@ -177,10 +177,10 @@ lky_object *stlobj_members(lky_func_bundle *bundle)
     lky_object *self = func->bound ? func->bound : _stlobj_proto;
     
     struct stlobj_members m;
-    m.keys = arr_create(self->members.count + 1);
-    m.vals = arr_create(self->members.count + 1);
+    m.keys = arr_create(shp_members_count(&self->members) + 1);
+    m.vals = arr_create(shp_members_count(&self->members) + 1);
 
-    hst_for_each(&self->members, stlobj_members_each, &m);
+    shp_members_for_each(&self->members, stlobj_members_each, &m);
     lky_object *ret = stltab_cinit(&m.keys, &m.vals);
 
     arr_free(&m.keys);
@@ -211,8 +211,7 @@ lky_object *stlobj_get_proto()
     lky_object *obj = aqua_request_next_block(sizeof(lky_object));
     obj->type = LBI_CUSTOM;
     obj->mem_count = 0;
-    obj->members = hst_create();
-    obj->members.duplicate_keys = 1;
+    shp_members_init(&obj->members);
     gc_add_object(obj);
 
     lobj_set_member(obj, "stringify_", lobjb_build_func_ex(obj, 0, (lky_function_ptr)stlobj_stringify));
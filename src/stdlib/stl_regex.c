@@ -1,3 +1,4 @@
+#include <stdlib.h>
 #include <string.h>
 #include "stl_regex.h"
 #include "stl_string.h"
@@ -8,13 +9,99 @@ CLASS_MAKE_BLOB_FUNCTION(stlrgx_blob_func, rgx_regex *, regex, how,
         rgx_free(regex);
 )
 
-void stlrgx_common_init(lky_object *obj, char *pattern, char *flags)
+// Compiled regexes are kept in a small LRU cache keyed on the pattern and
+// flags, so that a pattern built from strings in a loop is only compiled
+// once, and so that its DFA cache carries over between uses. Entries hold a
+// reference to the regex; each Regex object holds one of its own.
+typedef struct stlrgx_cached {
+    char *pattern;
+    unsigned flags;
+    rgx_regex *regex;
+    struct stlrgx_cached *prev;
+    struct stlrgx_cached *next;
+} stlrgx_cached;
+
+static stlrgx_cached *stlrgx_cache_head_ = NULL;
+static stlrgx_cached *stlrgx_cache_tail_ = NULL;
+static stlrgx_regex_cache_stats stlrgx_cache_stats_ = {0, 0, 0, STLRGX_CACHE_SIZE};
+
+void stlrgx_cache_unlink(stlrgx_cached *entry)
+{
+    if(entry->prev)
+        entry->prev->next = entry->next;
+    else
+        stlrgx_cache_head_ = entry->next;
+
+    if(entry->next)
+        entry->next->prev = entry->prev;
+    else
+        stlrgx_cache_tail_ = entry->prev;
+}
+
+void stlrgx_cache_push(stlrgx_cached *entry)
 {
+    entry->prev = NULL;
+    entry->next = stlrgx_cache_head_;
+    if(stlrgx_cache_head_)
+        stlrgx_cache_head_->prev = entry;
+    else
+        stlrgx_cache_tail_ = entry;
+    stlrgx_cache_head_ = entry;
+}
+
+rgx_regex *stlrgx_compile(char *pattern, unsigned flags)
+{
+    stlrgx_cached *entry;
+    for(entry = stlrgx_cache_head_; entry; entry = entry->next)
+    {
+        if(entry->flags == flags && !strcmp(entry->pattern, pattern))
+        {
+            stlrgx_cache_stats_.hits++;
+            if(entry != stlrgx_cache_head_)
+            {
+                stlrgx_cache_unlink(entry);
+                stlrgx_cache_push(entry);
+            }
+
+            return rgx_retain(entry->regex);
+        }
+    }
+
+    stlrgx_cache_stats_.misses++;
+
     rgx_regex *regex = rgx_compile(pattern);
+    rgx_set_flags(regex, flags);
+
+    entry = malloc(sizeof(*entry));
+    entry->pattern = malloc(strlen(pattern) + 1);
+    strcpy(entry->pattern, pattern);
+    entry->flags = flags;
+    entry->regex = regex;
+    stlrgx_cache_push(entry);
+
+    if(++stlrgx_cache_stats_.count > STLRGX_CACHE_SIZE)
+    {
+        stlrgx_cached *last = stlrgx_cache_tail_;
+        stlrgx_cache_unlink(last);
+        rgx_free(last->regex);
+        free(last->pattern);
+        free(last);
+        stlrgx_cache_stats_.count--;
+    }
+
+    return rgx_retain(regex);
+}
 
+stlrgx_regex_cache_stats stlrgx_cache_stats()
+{
+    return stlrgx_cache_stats_;
+}
+
+void stlrgx_common_init(lky_object *obj, char *pattern, char *flags)
+{
+    unsigned f = 0;
     if(flags)
     {
-        unsigned f = 0;
         int ct = strlen(flags);
         int i;
         for(i = 0; i < ct; i++)
@@ -22,12 +109,14 @@ void stlrgx_common_init(lky_object *obj, char *pattern, char *flags)
             if(flags[i] == 'i') f |= RGX_IGNORE_CASE;
             if(flags[i] == 'g') f |= RGX_GLOBAL;
         }
-
-        rgx_set_flags(regex, f);
     }
 
+    rgx_regex *regex = stlrgx_compile(pattern, f);
+
+    // The pattern is kept as it was compiled, escapes and all, so that it
+    // compiles to the same regex when it is serialized and loaded again.
     CLASS_SET_BLOB(obj, "rb_", regex, stlrgx_blob_func);
-    lobj_set_member(obj, "pattern", stlstr_cinit(pattern));
+    lobj_set_member(obj, "pattern", stlstr_cinit_ex(pattern, strlen(pattern), 0));
     lobj_set_member(obj, "flags", stlstr_cinit(flags ? flags : ""));
 }
 
@@ -98,7 +187,7 @@ CLASS_MAKE_METHOD_EX(stlrgx_stringify, self, rgx_regex *, rb_,
     sprintf(name, "(lky_regex | /%s/)", ptt);
     free(ptt);
 
-    return stlstr_cinit(name);
+    return stlstr_cinit_ex(name, strlen(name), 0);
 )
 
 static lky_object *stlrgx_class_ = NULL;
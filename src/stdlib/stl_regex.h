@@ -4,6 +4,18 @@
 #include "lky_object.h"
 #include "regex.h"
 
+// The number of compiled regexes kept for reuse by stlrgx_compile.
+#define STLRGX_CACHE_SIZE 64
+
+typedef struct {
+    long hits;
+    long misses;
+    long count;
+    long capacity;
+} stlrgx_regex_cache_stats;
+
+rgx_regex *stlrgx_compile(char *pattern, unsigned flags);
+stlrgx_regex_cache_stats stlrgx_cache_stats();
 lky_object *stlrgx_cinit(char *pattern, char *flags);
 lky_object *stlrgx_get_class();
 rgx_regex *stlrgx_unwrap(lky_object *obj);
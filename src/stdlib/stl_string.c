@@ -5,12 +5,12 @@
  * it under the terms of the GNU General Public License as published by
  * the Free Software Foundation; either version 2 of the License, or
  * (at your option) any later version.
- * 
+ *
  * This program is distributed in the hope that it will be useful,
  * but WITHOUT ANY WARRANTY; without even the implied warranty of
  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
  * GNU General Public License for more details.
- * 
+ *
  * You should have received a copy of the GNU General Public License along
  * with this program; if not, write to the Free Software Foundation, Inc.,
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
@@ -22,121 +22,220 @@
 #include "stl_array.h"
 #include "stl_regex.h"
 #include "hashtable.h"
+#include "aquarium.h"
+#include "strscan.h"
+#include "mach_binary_ops.h"
+#include "lky_symbol.h"
 #include "class_builder.h"
 
-CLASS_MAKE_BLOB_FUNCTION(stlstr_blob_func, char *, str, how,
-    if(how == CGC_FREE)
-        free(str);
-)
+// Like CLASS_MAKE_METHOD, with the receiver's bytes in 'sd_'. Methods
+// called on something that is not a string (String.model_, say) see the
+// empty string.
+#define STLSTR_MAKE_METHOD(name, code...) CLASS_MAKE_METHOD(name, self,\
+    stlstr_data *sd_ ATTRIB_NO_USE = stlstr_get_data(self);\
+    char *sb_ ATTRIB_NO_USE = sd_->str;\
+    code)
 
-CLASS_MAKE_INIT(stlstr_init,
-    char *str = NULL; 
-    if($1)
-        str = lobjb_stringify($1, interp_);
-    else
-        str = calloc(1, 1);
+static lky_object *stlstr_class_ = NULL;
+static lky_object *stlstr_model_ = NULL;
+static char *stlstr_proto_sym_ = NULL;
+static char *stlstr_class_sym_ = NULL;
+static char *stlstr_length_sym_ = NULL;
+
+static stlstr_data stlstr_empty_ = { 0, 1, 0, "" };
+
+static void stlstr_dealloc(lky_object *o)
+{
+    stlstr_data *d = ((lky_object_custom *)o)->data;
+    if(d->str != d->small)
+        free(d->str);
+}
+
+// Makes a string with room for 'len' bytes, which the caller fills in
+// before passing it to stlstr_settle. If 'str' is given the string takes
+// it over instead, as a malloc'd block of 'capacity' bytes.
+static lky_object_custom *stlstr_alloc_ex(long len, char *str, long capacity)
+{
+    int fits = !str && sizeof(lky_object_custom) + sizeof(stlstr_data) + len + 1 <= AQUA_MAX_SIZE;
+
+    lky_object *cls = stlstr_get_class();
+    lky_object_custom *obj = lobjb_build_custom(sizeof(stlstr_data) + (fits ? len + 1 : 0));
+    stlstr_data *d = (stlstr_data *)(obj + 1);
+    d->length = len;
+    d->capacity = str ? capacity : len + 1;
+    d->hash = 0;
+    d->str = str ? str : fits ? d->small : malloc(len + 1);
+    d->str[len] = '\0';
+
+    obj->cls = cls;
+    obj->data = d;
+    obj->freefunc = stlstr_dealloc;
+    lobj_set_member_sym((lky_object *)obj, stlstr_proto_sym_, stlstr_model_);
+    lobj_set_member_sym((lky_object *)obj, stlstr_class_sym_, cls);
+
+    return obj;
+}
+
+static lky_object_custom *stlstr_alloc(long len)
+{
+    return stlstr_alloc_ex(len, NULL, 0);
+}
+
+char stlstr_escape_for(char i);
+
+// Replaces the escape sequences in the 'len' bytes at 'str' with the
+// characters they stand for and returns the new length.
+static long stlstr_unescape(char *str, long len)
+{
+    long i, o;
+    for(i = o = 0; i < len; ++i, ++o)
+    {
+        if(str[i] != '\\')
+        {
+            str[o] = str[i];
+            continue;
+        }
 
-    CLASS_SET_BLOB(self_, "sb_", str, stlstr_blob_func);
-    lobj_set_member(self_, "length", lobjb_build_int(strlen(str)));
+        char e = stlstr_escape_for(str[i + 1]);
+        if(e > 1)
+        {
+            i++;
+            str[o] = e;
+        }
+        else
+            str[o] = str[i];
+    }
+
+    str[o] = '\0';
+    return o;
+}
+
+// Finishes a string made by stlstr_alloc, processing its escapes if
+// 'unescape' is set (as stlstr_cinit always does).
+static lky_object *stlstr_settle(lky_object_custom *obj, char unescape)
+{
+    stlstr_data *d = obj->data;
+    if(unescape && memchr(d->str, '\\', d->length))
+        d->length = stlstr_unescape(d->str, d->length);
+
+    lobj_set_member_sym((lky_object *)obj, stlstr_length_sym_, lobjb_build_int(d->length));
+    return (lky_object *)obj;
+}
+
+// Orders two strings byte by byte, as strcmp would if neither held a NUL.
+static int stlstr_compare(lky_object *a, lky_object *b)
+{
+    stlstr_data *x = stlstr_get_data(a);
+    stlstr_data *y = stlstr_get_data(b);
+
+    long n = x->length < y->length ? x->length : y->length;
+    int c = memcmp(x->str, y->str, n);
+    if(c)
+        return c;
+
+    return (x->length > y->length) - (x->length < y->length);
+}
+
+// Strings are made by String.new rather than by running init_ on a plain
+// object, which has nowhere to keep the bytes; objects of classes built on
+// String only get a length, and String's methods see them as empty.
+CLASS_MAKE_INIT(stlstr_init,
+    char *str = $1 ? lobjb_stringify($1, interp_) : NULL;
+    lobj_set_member(self_, "length", lobjb_build_int(str ? strlen(str) : 0));
+    free(str);
 )
 
+lky_object *stlstr_build(lky_func_bundle *bundle)
+{
+    lky_object *from = BUW_ARG(bundle, 0);
+    if(!from)
+        return stlstr_cinit_ex("", 0, 0);
+
+    char *str = lobjb_stringify(from, BUW_INTERP(bundle));
+    lky_object *ret = stlstr_cinit_ex(str, strlen(str), 0);
+    free(str);
+
+    return ret;
+}
+
 CLASS_MAKE_METHOD(stlstr_stringify, self,
     return self;
 )
 
-CLASS_MAKE_METHOD_EX(stlstr_get_index, self, char *, sb_,
+STLSTR_MAKE_METHOD(stlstr_get_index,
     long idx = OBJ_NUM_UNWRAP($1);
-    
-    char s[2];
-    sprintf(s, "%c", sb_[idx]);
-    
-    return stlstr_cinit(s);
+    if(idx < 0 || idx >= sd_->length)
+        return stlstr_cinit_ex("", 0, 0);
+
+    return stlstr_cinit_ex(sb_ + idx, 1, 1);
 )
 
-CLASS_MAKE_METHOD_EX(stlstr_hash, self, char *, sb_,
-    return lobjb_build_int(hst_djb2(sb_, NULL));
+CLASS_MAKE_METHOD(stlstr_hash, self,
+    return lobjb_build_int(stlstr_hash_of(self));
 )
 
-CLASS_MAKE_METHOD_EX(stlstr_equals, self, char *, sb_,
+CLASS_MAKE_METHOD(stlstr_equals, self,
     if(!lobj_is_of_class($1, stlstr_get_class()))
         return &lky_nil;
 
-    char *stra = sb_;
-    char *strb = CLASS_GET_BLOB($1, "sb_", char *);
-    
-    return LKY_TESTC_FAST(!strcmp(stra, strb));
+    return LKY_TESTC_FAST(stlstr_equal(self, $1));
 )
 
-CLASS_MAKE_METHOD_EX(stlstr_reverse, self, char *, sb_,
-    char *str = sb_;
-    size_t len = strlen(str);
+STLSTR_MAKE_METHOD(stlstr_reverse,
+    long len = sd_->length;
+    lky_object_custom *ret = stlstr_alloc(len);
+    char *nstr = ((stlstr_data *)ret->data)->str;
 
-    char nstr[len + 1];
-    int i = 0;
+    long i;
     for(i = 0; i < len; i++)
-    {
-        nstr[i] = str[len - i - 1];
-    }
+        nstr[i] = sb_[len - i - 1];
 
-    nstr[i] = 0;
-
-    return stlstr_cinit(nstr);
+    return stlstr_settle(ret, 1);
 )
 
-CLASS_MAKE_METHOD_EX(stlstr_not_equals, self, char *, sb_,
+CLASS_MAKE_METHOD(stlstr_not_equals, self,
     if(!lobj_is_of_class($1, stlstr_get_class()))
         return &lky_nil;
 
-    char *stra = sb_;
-    char *strb = CLASS_GET_BLOB($1, "sb_", char *);
-
-    return LKY_TESTC_FAST(!!strcmp(stra, strb));
+    return LKY_TESTC_FAST(!stlstr_equal(self, $1));
 )
 
-CLASS_MAKE_METHOD_EX(stlstr_greater_than, self, char *, sb_,
+CLASS_MAKE_METHOD(stlstr_greater_than, self,
     if(!lobj_is_of_class($1, stlstr_get_class()))
         return &lky_nil;
 
-    char *stra = sb_;
-    char *strb = CLASS_GET_BLOB($1, "sb_", char *);
-
-    return LKY_TESTC_FAST(strcmp(stra, strb) > 0);
+    return LKY_TESTC_FAST(stlstr_compare(self, $1) > 0);
 )
 
-CLASS_MAKE_METHOD_EX(stlstr_lesser_than, self, char *, sb_,
+CLASS_MAKE_METHOD(stlstr_lesser_than, self,
     if(!lobj_is_of_class($1, stlstr_get_class()))
         return &lky_nil;
 
-    char *stra = sb_;
-    char *strb = CLASS_GET_BLOB($1, "sb_", char *);
-
-    return LKY_TESTC_FAST(strcmp(stra, strb) < 0);
+    return LKY_TESTC_FAST(stlstr_compare(self, $1) < 0);
 )
 
-CLASS_MAKE_METHOD_EX(stlstr_multiply, self, char *, sb_,
+STLSTR_MAKE_METHOD(stlstr_multiply,
     lky_object *other = $1;
 
-    if(!((uintptr_t)(other) & 1) && other->type != LBI_INTEGER)
+    if(!OBJ_IS_INTEGER(other))
     {
         // TODO: Type error
         return &lky_nil;
     }
 
-    char *str = sb_;
     long ct = OBJ_NUM_UNWRAP(other);
 
     // If the count is 0, we should just
     // return the empty string.
-    if(!ct)
-        return stlstr_cinit("");
-
-    int len = strlen(str);
-    int targ = len * ct;
+    if(ct <= 0)
+        return stlstr_cinit_ex("", 0, 0);
 
-    char *nstr = malloc(len * ct + 1);
-    nstr[targ] = 0;
+    long len = sd_->length;
+    long targ = len * ct;
 
-    strcpy(nstr, str);
+    lky_object_custom *ret = stlstr_alloc(targ);
+    char *nstr = ((stlstr_data *)ret->data)->str;
+    memcpy(nstr, sb_, len);
 
     long done = len;
     while(done < targ)
@@ -146,69 +245,79 @@ CLASS_MAKE_METHOD_EX(stlstr_multiply, self, char *, sb_,
         done += n;
     }
 
-    lky_object *ret = stlstr_cinit(nstr);
-    free(nstr);
-
-    return ret;
+    return stlstr_settle(ret, 1);
 )
 
-CLASS_MAKE_METHOD_EX(stlstr_set_index, self, char *, sb_,
+STLSTR_MAKE_METHOD(stlstr_set_index,
     long i = OBJ_NUM_UNWRAP($1);
-    
-    char ch = (CLASS_GET_BLOB($2, "sb_", char *))[0];
-    
-    sb_[i] = ch;
-    
+    CLASS_ERROR_ASSERT(i >= 0 && i < sd_->length, "IndexOutOfBounds", "The given index is not valid for the string.");
+
+    sb_[i] = stlstr_get_data($2)->str[0];
+    sd_->hash = 0;
+
     return &lky_nil;
 )
 
-CLASS_MAKE_METHOD_EX(stlstr_copy, self, char *, sb_,
-    return stlstr_cinit(sb_);
+STLSTR_MAKE_METHOD(stlstr_copy,
+    return stlstr_cinit_ex(sb_, sd_->length, 1);
 )
 
-lky_object *stlstr_replacing_generic(char *me, lky_object *replo, int *indcs, struct interp *interp)
+// Replaces the matches listed in 'indcs' (start and length pairs, ending
+// with -1) with 'replo', a string or a function called with each match.
+lky_object *stlstr_replacing_generic(char *me, long melen, lky_object *replo, int *indcs, struct interp *interp)
 {
-    char *repl = NULL;
-    size_t repllen = -1;
+    int *m;
     if(OBJ_IS_NUMBER(replo) || replo->type != LBI_FUNCTION)
     {
-        repl = lobjb_stringify(replo, interp);
-        repllen = strlen(repl);
-    }
+        char *repl = lobjb_stringify(replo, interp);
+        long repllen = strlen(repl);
+
+        // Every match turns into the same string, so the length of the
+        // result is known before any of it is written.
+        long outlen = melen;
+        for(m = indcs; *m > -1; m += 2)
+            outlen += repllen - m[1];
+
+        lky_object_custom *ret = stlstr_alloc(outlen);
+        char *out = ((stlstr_data *)ret->data)->str;
+        long cur = 0;
+        for(m = indcs; *m > -1; m += 2)
+        {
+            memcpy(out, me + cur, m[0] - cur);
+            out += m[0] - cur;
+            memcpy(out, repl, repllen);
+            out += repllen;
+            cur = m[0] + m[1];
+        }
 
-    size_t melen = strlen(me);
+        memcpy(out, me + cur, melen - cur);
+        free(repl);
+
+        return stlstr_settle(ret, 1);
+    }
 
     struct {
         char *ptr;
-        int alloced;
-        int ct;
+        long alloced;
+        long ct;
     } builder;
 
-    builder.ptr = calloc(melen * 2 + 1, 1);
-    builder.alloced = melen * 2;
+    builder.ptr = malloc(melen + 1);
+    builder.alloced = melen + 1;
     builder.ct = 0;
 
-    int cur = 0;
+    long cur = 0;
 
-    while(*indcs > -1)
+    for(m = indcs; *m > -1; m += 2)
     {
-        int start = *indcs;
-        int len = *(++indcs);
-        indcs++;
+        int start = m[0];
+        int len = m[1];
 
-        int clen = start - cur;
+        long clen = start - cur;
 
-        char *out = repl;
-        size_t outlen = repllen;
-        if(!out)
-        {
-            char temp[len + 1];
-            memcpy(temp, me + start, len);
-            temp[len] = '\0';
-            lky_object *ff = lobjb_call(replo, LKY_ARGS(stlstr_cinit(temp)), interp);
-            out = lobjb_stringify(ff, interp);
-            outlen = strlen(out);
-        }
+        lky_object *ff = lobjb_call(replo, LKY_ARGS(stlstr_cinit_ex(me + start, len, 1)), interp);
+        char *out = lobjb_stringify(ff, interp);
+        size_t outlen = strlen(out);
 
         if(outlen + clen > builder.alloced - builder.ct)
         {
@@ -224,8 +333,7 @@ lky_object *stlstr_replacing_generic(char *me, lky_object *replo, int *indcs, st
 
         cur = start + len;
 
-        if(!repl)
-            free(out);
+        free(out);
     }
 
     if(melen - cur > builder.alloced - builder.ct)
@@ -236,47 +344,42 @@ lky_object *stlstr_replacing_generic(char *me, lky_object *replo, int *indcs, st
 
     memcpy(builder.ptr + builder.ct, me + cur, melen - cur);
     builder.ct += melen - cur;
-    builder.ptr[builder.ct] = '\0';
-    if(repl) free(repl);
-    lky_object *o = stlstr_cinit(builder.ptr);
+    lky_object *o = stlstr_cinit_ex(builder.ptr, builder.ct, 1);
     free(builder.ptr);
 
     return o;
 }
 
-CLASS_MAKE_METHOD_EX(stlstr_replacing, self, char *, sb_,
+STLSTR_MAKE_METHOD(stlstr_replacing,
 
     if(lobj_is_of_class($1, stlrgx_get_class()))
     {
         rgx_regex *regex = stlrgx_unwrap($1);
         int *i = rgx_collect_matches(regex, sb_);
-        lky_object *o = stlstr_replacing_generic(sb_, $2, i, interp_);
+        lky_object *o = stlstr_replacing_generic(sb_, sd_->length, $2, i, interp_);
         free(i);
         return o;
     }
 
     char *search = lobjb_stringify($1, interp_);
-    char *loc, *prev;
-    loc = prev = sb_;
+    long slen = strlen(search);
 
-    size_t slen = strlen(search);
-    rgx_result_wrapper wrapper = rgx_wrapper_make();
+    scn_matches found = {NULL, 0, 0};
+    scn_find_all(sb_, sd_->length, search, slen, &found);
+    free(search);
 
-    while(*loc)
+    int *i = malloc(sizeof(int) * (found.count * 2 + 1));
+    long j;
+    for(j = 0; j < found.count; j++)
     {
-        loc = strstr(loc, search);
-        if(!loc)
-            break;    
-
-        rgx_wrapper_append(&wrapper, loc - sb_);
-        rgx_wrapper_append(&wrapper, slen);
-        loc = loc + slen;
+        i[j * 2] = found.at[j];
+        i[j * 2 + 1] = slen;
     }
-    
-    int *i = rgx_wrapper_finalize(&wrapper);
-    lky_object *o = stlstr_replacing_generic(sb_, $2, i, interp_);
+    i[found.count * 2] = -1;
+    scn_matches_free(&found);
+
+    lky_object *o = stlstr_replacing_generic(sb_, sd_->length, $2, i, interp_);
     free(i);
-    free(search);
     return o;
 
     /*
@@ -340,7 +443,7 @@ CLASS_MAKE_METHOD_EX(stlstr_replacing, self, char *, sb_,
 )
 
 lky_object *stlstr_split_regex(char *me, lky_object *regex)
-{ 
+{
     arraylist list = arr_create(10);
     rgx_regex *r = stlrgx_unwrap(regex);
     int *idcs = rgx_collect_matches(r, me);
@@ -352,14 +455,8 @@ lky_object *stlstr_split_regex(char *me, lky_object *regex)
         int len = idcs[1];
         int tot = top - idx;
 
-        char cur[tot + 1];
-        int i;
-        for(i = 0; i < tot; i++)
-            cur[i] = me[i + idx];
-        cur[tot] = '\0';
-
+        arr_append(&list, stlstr_cinit_ex(me + idx, tot, 1));
         idx += tot + len;
-        arr_append(&list, stlstr_cinit(cur));
     }
 
     if(head != idcs)
@@ -378,7 +475,7 @@ lky_object *stlstr_split_regex(char *me, lky_object *regex)
     return stlarr_cinit(list);
 }
 
-CLASS_MAKE_METHOD_EX(stlstr_split, self, char *, sb_,
+STLSTR_MAKE_METHOD(stlstr_split,
     if(!$1)
     {
         arraylist list = arr_create(10);
@@ -388,99 +485,185 @@ CLASS_MAKE_METHOD_EX(stlstr_split, self, char *, sb_,
 
     if(lobj_is_of_class($1, stlrgx_get_class()))
         return stlstr_split_regex(sb_, $1);
-        
-    lky_object_function *strf = (lky_object_function *)lobj_get_member($1, "stringify_");
-    if(!strf)
-    {
-        // TODO: Error
-    }
-    
-    lky_func_bundle b = MAKE_BUNDLE(strf, NULL, interp_);
-    lky_object *ostr = (lky_object *)(strf->callable.function)(&b);
 
+    lky_object *ostr = $1;
     if(!lobj_is_of_class(ostr, stlstr_get_class()))
-        return &lky_nil;
+    {
+        lky_object_function *strf = (lky_object_function *)lobj_get_member($1, "stringify_");
+        if(!strf)
+        {
+            // TODO: Error
+        }
 
-    char *delim = CLASS_GET_BLOB(ostr, "sb_", char *);
+        lky_func_bundle b = MAKE_BUNDLE(strf, NULL, interp_);
+        ostr = (lky_object *)(strf->callable.function)(&b);
 
-    char *loc = sb_;
-    size_t delen = strlen(delim);
-    
-    arraylist list = arr_create(10);
+        if(!lobj_is_of_class(ostr, stlstr_get_class()))
+            return &lky_nil;
+    }
+
+    stlstr_data *delim = stlstr_get_data(ostr);
+
+    long delen = delim->length;
 
     if(delen == 0)
     {
-        while(*loc)
-        {
-            char nc[2];
-            nc[0] = *loc;
-            nc[1] = '\0';
-            arr_append(&list, stlstr_cinit(nc));
-            loc++;
-        }
+        arraylist list = arr_create(sd_->length + 1);
+
+        long i;
+        for(i = 0; i < sd_->length; i++)
+            arr_append(&list, stlstr_cinit_ex(sb_ + i, 1, 1));
 
         return stlarr_cinit(list);
     }
-    
-    while(loc)
+
+    scn_matches found = {NULL, 0, 0};
+    scn_find_all(sb_, sd_->length, delim->str, delen, &found);
+
+    arraylist list = arr_create(found.count + 1);
+
+    long i, at = 0;
+    for(i = 0; i < found.count; i++)
     {
-        char *next = strstr(loc, delim);
-        size_t nlen = (next ? next : strlen(loc) + loc) - loc + 1;
-        char *str = malloc(nlen);
-        memcpy(str, loc, nlen - 1);
-        str[nlen - 1] = '\0';
-        
-        arr_append(&list, stlstr_cinit(str));
-        free(str);
-        
-        loc = next ? next + delen : NULL;
+        arr_append(&list, stlstr_cinit_ex(sb_ + at, found.at[i] - at, 1));
+        at = found.at[i] + delen;
     }
-    
+
+    arr_append(&list, stlstr_cinit_ex(sb_ + at, sd_->length - at, 1));
+    scn_matches_free(&found);
+
     return stlarr_cinit(list);
 )
 
-CLASS_MAKE_METHOD_EX(stlstr_iterable, self, char *, sb_,
-    char *mestr = sb_;
-    int i;
-    size_t len = strlen(mestr);
-    arraylist list = arr_create(len + 1);
-    
-    for(i = 0; i < len; i++)
-    {
-        char c[2];
-        c[0] = mestr[i];
-        c[1] = '\0';
+// Hands out the characters of a string one at a time as single character
+// strings. The owner, whose bytes these are, is kept alive with it; a
+// string's length never changes, though its characters can be set.
+static lky_object *stlstr_iterator_next(lky_object_iterable *it)
+{
+    stlstr_data *d = it->state.walk.store;
+    long pos = it->state.walk.pos;
+    if(pos >= d->length)
+        return NULL;
+
+    it->state.walk.pos++;
+    it->index++;
+    return stlstr_cinit_ex(d->str + pos, 1, 1);
+}
 
-        arr_append(&list, stlstr_cinit(c));
-    }
+STLSTR_MAKE_METHOD(stlstr_iterable,
+    lky_object_iterable *it = lobjb_build_iterator(self, stlstr_iterator_next);
+    it->state.walk.store = sd_;
 
-    return stlarr_cinit(list);
+    return (lky_object *)it;
 )
 
-CLASS_MAKE_METHOD_EX(stlstr_add, self, char *, sb_,
-    char *mestr = sb_;
-    
+STLSTR_MAKE_METHOD(stlstr_add,
     lky_object *other = $1;
     char sbf = OBJ_NUM_UNWRAP($2);
-    
-    char *chr = lobjb_stringify(other, interp_);
-    
-    size_t len = strlen(chr) + strlen(mestr) + 1;
-    char *newstr = malloc(len);
-    
-    char *first = sbf ? mestr : chr;
-    char *second = first == mestr ? chr : mestr;
-    
-    strcpy(newstr, first);
-    strcat(newstr, second);
-    
-    lky_object *ret = stlstr_cinit(newstr);
-    free(newstr);
+
+    char *chr = NULL;
+    char *ostr;
+    long olen;
+    if(lobj_is_of_class(other, stlstr_get_class()))
+    {
+        stlstr_data *od = stlstr_get_data(other);
+        ostr = od->str;
+        olen = od->length;
+    }
+    else
+    {
+        ostr = chr = lobjb_stringify(other, interp_);
+        olen = strlen(chr);
+    }
+
+    lky_object_custom *ret = stlstr_alloc(sd_->length + olen);
+    char *newstr = ((stlstr_data *)ret->data)->str;
+
+    if(sbf)
+    {
+        memcpy(newstr, sb_, sd_->length);
+        memcpy(newstr + sd_->length, ostr, olen);
+    }
+    else
+    {
+        memcpy(newstr, ostr, olen);
+        memcpy(newstr + olen, sb_, sd_->length);
+    }
+
     free(chr);
-    
-    return ret;
+
+    return stlstr_settle(ret, 1);
 )
 
+// Works out items[0] + items[1] + ... + items[count - 1] for a string
+// items[0], as CONCAT does. Each addition would stringify the next item
+// and then process the escapes in the whole result, so the pieces are
+// copied straight into one string and the escapes processed again only
+// while it holds a backslash. If op_add_ has been replaced the additions are made
+// one at a time.
+lky_object *stlstr_concat(lky_object **items, int count, struct interp *interp)
+{
+    lky_object *add = lobj_is_of_class(items[0], stlstr_get_class()) ? lobj_get_member(items[0], "op_add_") : NULL;
+    if(!add || add->type != LBI_FUNCTION || ((lky_object_function *)add)->callable.function != (lky_function_ptr)stlstr_add)
+    {
+        lky_object *ret = items[0];
+        int i;
+        for(i = 1; i < count && !(interp && interp->error); i++)
+            ret = lobjb_binary_add(ret, items[i], interp);
+        return ret;
+    }
+
+    char **chrs = calloc(count, sizeof(char *));
+    long total = 0;
+    int i;
+    for(i = 0; i < count; i++)
+    {
+        if(!lobj_is_of_class(items[i], stlstr_get_class()))
+        {
+            chrs[i] = lobjb_stringify(items[i], interp);
+            if(interp && interp->error)
+                break;
+        }
+
+        total += chrs[i] ? strlen(chrs[i]) : stlstr_get_data(items[i])->length;
+    }
+
+    lky_object *ret = &lky_nil;
+    if(i == count)
+    {
+        lky_object_custom *obj = stlstr_alloc(total);
+        stlstr_data *od = obj->data;
+        long at = 0;
+        char dirty = 0;
+        for(i = 0; i < count; i++)
+        {
+            stlstr_data *d = stlstr_get_data(items[i]);
+            char *bytes = chrs[i] ? chrs[i] : d->str;
+            long len = chrs[i] ? strlen(chrs[i]) : d->length;
+
+            memcpy(od->str + at, bytes, len);
+            at += len;
+            od->str[at] = '\0';
+
+            dirty = dirty || memchr(bytes, '\\', len);
+            if(i > 0 && dirty)
+            {
+                at = stlstr_unescape(od->str, at);
+                dirty = !!memchr(od->str, '\\', at);
+            }
+        }
+
+        od->length = at;
+        ret = stlstr_settle(obj, 0);
+    }
+
+    for(i = 0; i < count; i++)
+        free(chrs[i]);
+    free(chrs);
+
+    return ret;
+}
+
 char stlstr_escape_for(char i)
 {
     switch(i)
@@ -503,69 +686,64 @@ char stlstr_escape_for(char i)
 char *stlstr_copy_and_escape(char *str)
 {
     unsigned long len = strlen(str);
-    unsigned long i, o;
-
-    char *cop = calloc(len + 1, sizeof(char));
-    for(i = o = 0; i < len; ++i, ++o)
-    {
-        if(str[i] != '\\')
-        {
-            cop[o] = str[i];
-            continue;
-        }
-
-        char e = stlstr_escape_for(str[i + 1]);
-        if(e > 1)
-        {
-            i++;
-            cop[o] = e;
-        }
-        else
-            cop[o] = str[i];
-    }
+    char *cop = malloc(len + 1);
+    memcpy(cop, str, len + 1);
+    stlstr_unescape(cop, len);
 
     return cop;
 }
 
-CLASS_MAKE_METHOD_EX(stlstr_to_lower, self, char *, sb_,
-    char *me = sb_;
-    size_t len = strlen(me);
-    char n[len + 1];
-    int i;
+STLSTR_MAKE_METHOD(stlstr_to_lower,
+    long len = sd_->length;
+    lky_object_custom *ret = stlstr_alloc(len);
+    char *n = ((stlstr_data *)ret->data)->str;
+    long i;
     for(i = 0; i < len; i++)
     {
-        char c = me[i];
+        char c = sb_[i];
         if(c >= 'A' && c <= 'Z')
             c = (c - 'A') + 'a';
 
         n[i] = c;
     }
 
-    n[i] = '\0';
-
-    return stlstr_cinit(n);
+    return stlstr_settle(ret, 1);
 )
 
-CLASS_MAKE_METHOD_EX(stlstr_to_upper, self, char *, sb_,
-    char *me = sb_;
-    size_t len = strlen(me);
-    char n[len + 1];
-    int i;
+STLSTR_MAKE_METHOD(stlstr_to_upper,
+    long len = sd_->length;
+    lky_object_custom *ret = stlstr_alloc(len);
+    char *n = ((stlstr_data *)ret->data)->str;
+    long i;
     for(i = 0; i < len; i++)
     {
-        char c = me[i];
+        char c = sb_[i];
         if(c >= 'a' && c <= 'z')
             c = (c - 'a') + 'A';
 
         n[i] = c;
     }
 
-    n[i] = '\0';
+    return stlstr_settle(ret, 1);
+)
+
+STLSTR_MAKE_METHOD(stlstr_index_of,
+    CLASS_ERROR_ASSERT(lobj_is_of_class($1, stlstr_get_class()), "MismatchedType", "Parameter 1 to indexOf not a string");
+    stlstr_data *nd = stlstr_get_data($1);
+
+    long from = $2 ? OBJ_NUM_UNWRAP($2) : 0;
+    if(from < 0)
+        from = 0;
+    if(from > sd_->length)
+        return lobjb_build_int(-1);
+    if(!nd->length)
+        return lobjb_build_int(from);
 
-    return stlstr_cinit(n);
+    long at = scn_find(sb_ + from, sd_->length - from, nd->str, nd->length);
+    return lobjb_build_int(at < 0 ? -1 : at + from);
 )
 
-CLASS_MAKE_METHOD_EX(stlstr_find, self, char *, sb_,
+STLSTR_MAKE_METHOD(stlstr_find,
     char *me = sb_;
     if(!$1) return &lky_nil;
     CLASS_ERROR_ASSERT(lobj_is_of_class($1, stlrgx_get_class()), "MismatchedType", "Parameter 1 to find not regular expression");
@@ -582,11 +760,8 @@ CLASS_MAKE_METHOD_EX(stlstr_find, self, char *, sb_,
         {
             int idx = *pts;
             int len = *(++pts);
-            char temp[len + 1];
-            memcpy(temp, me + idx, len);
-            temp[len] = '\0';
-            arr_append(&list, stlstr_cinit(temp));
-            
+            arr_append(&list, stlstr_cinit_ex(me + idx, len, 1));
+
             pts++;
         }
 
@@ -603,46 +778,96 @@ CLASS_MAKE_METHOD_EX(stlstr_find, self, char *, sb_,
         }
 
         int len = pts[1];
-        char temp[len + 1];
-        memcpy(temp, me + idx, len);
-        temp[len] = '\0';
-
         free(head);
-        return stlstr_cinit(temp);
+        return stlstr_cinit_ex(me + idx, len, 1);
     }
 )
 
-void stlstr_manual_init(lky_object *nobj, lky_object *cls, void *data)
+// Makes a string of the 'len' bytes at 'bytes', which may include NULs.
+// Escape sequences in them are processed if 'unescape' is set.
+lky_object *stlstr_cinit_ex(char *bytes, long len, char unescape)
+{
+    lky_object_custom *obj = stlstr_alloc(len);
+    memcpy(((stlstr_data *)obj->data)->str, bytes, len);
+
+    return stlstr_settle(obj, unescape);
+}
+
+// Makes a string of the 'len' bytes at 'str' without copying them. 'str'
+// must be a malloc'd block of 'capacity' bytes, which the string frees
+// when it is collected. Escape sequences are left alone.
+lky_object *stlstr_adopt(char *str, long len, long capacity)
 {
-    char *copied = stlstr_copy_and_escape((char *)data);
-    CLASS_SET_BLOB(nobj, "sb_", copied, stlstr_blob_func);
-    lobj_set_member(nobj, "length", lobjb_build_int(strlen(copied)));
+    return stlstr_settle(stlstr_alloc_ex(len, str, capacity), 0);
 }
 
 lky_object *stlstr_cinit(char *str)
 {
-    return clb_instantiate(stlstr_get_class(), stlstr_manual_init, str);
+    return stlstr_cinit_ex(str, strlen(str), 1);
+}
+
+stlstr_data *stlstr_get_data(lky_object *o)
+{
+    if(!lobj_is_of_class(o, stlstr_get_class()))
+        return &stlstr_empty_;
+
+    return ((lky_object_custom *)o)->data;
 }
 
 char *stlstr_unwrap(lky_object *o)
 {
-    return CLASS_GET_BLOB(o, "sb_", char *);
+    return stlstr_get_data(o)->str;
+}
+
+// The same hash hst_djb2 gives a string without NULs. It is worked out
+// once and kept until the string is changed.
+long stlstr_hash_of(lky_object *o)
+{
+    stlstr_data *d = stlstr_get_data(o);
+    if(d->hash)
+        return d->hash;
+
+    unsigned long hash = 5381;
+    long i;
+    for(i = 0; i < d->length; i++)
+        hash = ((hash << 5) + hash) + d->str[i];
+
+    d->hash = hash;
+    return d->hash;
+}
+
+// Compares the bytes of two strings. Strings of different lengths, or
+// whose hashes are known and differ, are told apart without looking at
+// them.
+char stlstr_equal(lky_object *a, lky_object *b)
+{
+    stlstr_data *x = stlstr_get_data(a);
+    stlstr_data *y = stlstr_get_data(b);
+
+    if(x == y)
+        return 1;
+    if(x->length != y->length)
+        return 0;
+    if(x->hash && y->hash && x->hash != y->hash)
+        return 0;
+
+    return !memcmp(x->str, y->str, x->length);
 }
 
-static lky_object *stlstr_class_ = NULL;
 lky_object *stlstr_get_class()
 {
     if(stlstr_class_)
         return stlstr_class_;
 
-    char *proto_bl = calloc(1, 1);
-    lky_object *proto_blob = lobjb_build_blob(proto_bl, stlstr_blob_func);
+    stlstr_proto_sym_ = sym_intern("proto_");
+    stlstr_class_sym_ = sym_intern("class_");
+    stlstr_length_sym_ = sym_intern("length");
 
     CLASS_MAKE(cls, NULL, stlstr_init, 1,
         CLASS_PROTO("length", lobjb_build_int(-1));
-        CLASS_PROTO("sb_", proto_blob);
         CLASS_PROTO_METHOD("reverse", stlstr_reverse, 0);
         CLASS_PROTO_METHOD("find", stlstr_find, 1);
+        CLASS_PROTO_METHOD("indexOf", stlstr_index_of, 2);
         CLASS_PROTO_METHOD("stringify_", stlstr_stringify, 0);
         CLASS_PROTO_METHOD("split", stlstr_split, 1);
         CLASS_PROTO_METHOD("replacing", stlstr_replacing, 2);
@@ -661,6 +886,9 @@ lky_object *stlstr_get_class()
         CLASS_PROTO_METHOD("iterable_", stlstr_iterable, 0);
     );
 
+    lobj_set_member(cls, "new", lobjb_build_func_ex(cls, 1, (lky_function_ptr)stlstr_build));
+
     stlstr_class_ = cls;
+    stlstr_model_ = lobj_get_member(cls, "model_");
     return cls;
 }
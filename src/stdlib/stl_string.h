@@ -21,13 +21,31 @@
 
 #include "lkyobj_builtin.h"
 
-void stlstr_blob_func(void *data, lky_class_gc_type how);
+// The bytes of a string. A string is a custom object with this right
+// behind it in the same block, followed by the bytes themselves when
+// they are short enough to fit too (otherwise 'str' is malloc'd). 'str' is
+// always NUL terminated, but may also hold NULs before 'length'.
+typedef struct {
+    long length;
+    long capacity; // Bytes available at 'str', the terminator included
+    long hash; // 0 until stlstr_hash_of needs it
+    char *str;
+    char small[];
+} stlstr_data;
+
 lky_object *stlstr_cinit(char *str);
+lky_object *stlstr_cinit_ex(char *bytes, long len, char unescape);
+lky_object *stlstr_adopt(char *str, long len, long capacity);
+lky_object *stlstr_concat(lky_object **items, int count, struct interp *interp);
+stlstr_data *stlstr_get_data(lky_object *o);
+long stlstr_hash_of(lky_object *o);
+char stlstr_equal(lky_object *a, lky_object *b);
 //lky_object *stlstr_fmt_ext(char *mestr, arraylist list);
 //lky_object *stltab_cget(lky_object *table, lky_object *key);
 //void stltab_cput(lky_object *table, lky_object *key, lky_object *val);
 lky_object *stlstr_get_class();
 char *stlstr_unwrap(lky_object *o);
+char *stlstr_copy_and_escape(char *str);
 
 //lky_object *stlstr_get_class();
 
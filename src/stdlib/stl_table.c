@@ -49,7 +49,7 @@ long stltab_autohash(void *key, void *data)
     // Even though string has a hash function, we want
     // to quickly be able to perform this calculation
     if(lobj_is_of_class(k, stlstr_get_class()))
-        return hst_djb2(stlstr_unwrap(k), NULL);
+        return stlstr_hash_of(k);
 
     lky_object *hf = lobj_get_member((lky_object *)key, "hash_");
     
@@ -68,12 +68,16 @@ long stltab_autohash(void *key, void *data)
 
 int stltab_autoequ(void *a, void *b)
 {
+    lky_object *str = stlstr_get_class();
+    if(lobj_is_of_class(a, str) && lobj_is_of_class(b, str))
+        return stlstr_equal(a, b);
+
     return (int)LKY_CTEST_FAST(lobjb_binary_equals((lky_object *)a, (lky_object *)b, NULL));
 }
 
 void stltab_cat_each(void *key, void *val, void *data)
 {
-    char **buf = (char **)data;
+    auto_buffer *buf = (auto_buffer *)data;
     lky_object *k = (lky_object *)key;
     lky_object *v = (lky_object *)val;
 
@@ -126,7 +130,7 @@ void stltab_common_init(lky_object *obj, arraylist *keys, arraylist *vals)
     if(!keys)
     {
         lobj_set_member(obj, "count", lobjb_build_int(0));
-        lobj_set_member(obj, "size_", lobjb_build_int(8));
+        lobj_set_member(obj, "size_", lobjb_build_int(ht.size));
         data->ht = ht;
 
         CLASS_SET_BLOB(obj, "hb_", data, stltab_blob_func);
@@ -175,15 +179,15 @@ lky_object *stltab_stringify(lky_func_bundle *bundle)
     lky_object_custom *tab = (lky_object_custom *)func->owner;
     stltab_data *d = tab->data;
 
-    char *buf = NULL;
-    auto_cat(&buf, "[\n");   
+    auto_buffer buf = {NULL, 0, 0};
+    auto_cat(&buf, "[\n");
 
     hst_for_each(&d->ht, stltab_cat_each, &buf);
 
     auto_cat(&buf, "]");
 
-    lky_object *ret = stlstr_cinit(buf);
-    free(buf);
+    lky_object *ret = stlstr_cinit(buf.str);
+    free(buf.str);
 
     return ret;
 }
@@ -214,6 +218,63 @@ CLASS_MAKE_METHOD_EX(stltab_values, self, stltab_data *, hb_,
     return stlarr_cinit(list);
 )
 
+// Walks the table's entry array from the slot after the last one handed
+// out. Adding or removing keys moves entries around the array, so a walk
+// that finds the table modified (see hashtable.mods) raises TableModified
+// and stops rather than skip or repeat items.
+static hst_entry *stltab_iterator_step(lky_object_iterable *it)
+{
+    hashtable *ht = it->state.table.store;
+    if(ht->mods != it->state.table.mods)
+    {
+        mach_interp *interp = it->state.table.interp;
+        interp->error = lobjb_build_error("TableModified", "The table was changed while it was being iterated.", interp);
+        return NULL;
+    }
+
+    while(it->state.table.pos < ht->size)
+    {
+        hst_entry *e = ht->entries + it->state.table.pos++;
+        if(e->key)
+        {
+            it->index++;
+            return e;
+        }
+    }
+
+    return NULL;
+}
+
+static lky_object *stltab_key_next(lky_object_iterable *it)
+{
+    hst_entry *e = stltab_iterator_step(it);
+    return e ? e->key : NULL;
+}
+
+static lky_object *stltab_value_next(lky_object_iterable *it)
+{
+    hst_entry *e = stltab_iterator_step(it);
+    return e ? e->val : NULL;
+}
+
+static lky_object *stltab_build_iterator(lky_object *table, stltab_data *d, lobjb_iterator_function next, mach_interp *interp)
+{
+    lky_object_iterable *it = lobjb_build_iterator(table, next);
+    it->state.table.store = &d->ht;
+    it->state.table.mods = d->ht.mods;
+    it->state.table.interp = interp;
+
+    return (lky_object *)it;
+}
+
+CLASS_MAKE_METHOD_EX(stltab_each_key, self, stltab_data *, hb_,
+    return stltab_build_iterator(self, hb_, stltab_key_next, interp_);
+)
+
+CLASS_MAKE_METHOD_EX(stltab_each_value, self, stltab_data *, hb_,
+    return stltab_build_iterator(self, hb_, stltab_value_next, interp_);
+)
+
 lky_object *stltab_cget(lky_object *table, lky_object *key)
 {
     stltab_data *d = CLASS_GET_BLOB(table, "hb_", stltab_data *);
@@ -223,9 +284,12 @@ lky_object *stltab_cget(lky_object *table, lky_object *key)
 
 void stltab_cput(lky_object *table, lky_object *key, lky_object *val)
 {
-    stltab_data *d = CLASS_GET_BLOB(table, "hb_", stltab_data *);
+    lky_object *blob = lobj_get_member(table, "hb_");
+    stltab_data *d = ((lky_object_builtin *)blob)->value.b;
     
     hst_put(&d->ht, key, val, stltab_autohash, stltab_autoequ);
+    GC_WRITE_BARRIER(blob, key);
+    GC_WRITE_BARRIER(blob, val);
 }
 
 CLASS_MAKE_METHOD_EX(stltab_put, self, stltab_data *, hb_,
@@ -235,6 +299,8 @@ CLASS_MAKE_METHOD_EX(stltab_put, self, stltab_data *, hb_,
     lky_object *v = $2;
 
     hst_put(&d->ht, k, v, stltab_autohash, stltab_autoequ);
+    GC_WRITE_BARRIER(raw_blob_, k);
+    GC_WRITE_BARRIER(raw_blob_, v);
 
     lobj_set_member(self, "count", lobjb_build_int(d->ht.count));
     lobj_set_member(self, "size_", lobjb_build_int(d->ht.size));
@@ -250,6 +316,7 @@ CLASS_MAKE_METHOD_EX(stltab_add_all, self, stltab_data *, hb_,
     stltab_data *o = CLASS_GET_BLOB(other, "hb_", stltab_data *);
 
     hst_add_all_from(&d->ht, &o->ht, stltab_autohash, stltab_autoequ);
+    gc_remember((lky_object *)raw_blob_);
     lobj_set_member(self, "count", lobjb_build_int(d->ht.count));
     lobj_set_member(self, "size_", lobjb_build_int(d->ht.size));
 
@@ -314,6 +381,9 @@ lky_object *stltab_get_class()
         CLASS_PROTO_METHOD("hasValue", stltab_has_value, 1);
         CLASS_PROTO_METHOD("keys", stltab_keys, 0);
         CLASS_PROTO_METHOD("values", stltab_values, 0);
+        CLASS_PROTO_METHOD("eachKey", stltab_each_key, 0);
+        CLASS_PROTO_METHOD("eachValue", stltab_each_value, 0);
+        CLASS_PROTO_METHOD("iterable_", stltab_each_key, 0);
         CLASS_PROTO_METHOD("removeValue", stltab_remove_value, 1);
         CLASS_PROTO_METHOD("remove", stltab_remove, 1);
         CLASS_PROTO_METHOD("addAll", stltab_add_all, 1);
@@ -0,0 +1,206 @@
+/* Lanky -- Scripting Language and Virtual Machine
+ * Copyright (C) 2014  Sam Olsen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "strscan.h"
+
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(SCN_NO_SIMD)
+#define SCN_X86 1
+#include <immintrin.h>
+#else
+#define SCN_X86 0
+#endif
+
+// The level in use, or -1 until scn_get_level has looked at the CPU.
+static int scn_level_ = -1;
+
+static int scn_push(scn_matches *out, long at)
+{
+    if(out->count == out->alloced)
+    {
+        long alloced = out->alloced ? out->alloced * 2 : 16;
+        long *next = realloc(out->at, alloced * sizeof(long));
+        if(!next)
+            return 0;
+
+        out->at = next;
+        out->alloced = alloced;
+    }
+
+    out->at[out->count++] = at;
+    return 1;
+}
+
+// Finds up to 'limit' matches of the 'm' byte needle that start at or
+// after hay + i, and none that start before 'next' (the end of the last
+// match), adding them to 'out'. Returns the number of matches so far,
+// 'found' included.
+static long scn_scan_scalar(const char *hay, long n, const char *needle, long m, scn_matches *out, long limit, long i, long next, long found)
+{
+    if(i < next)
+        i = next;
+
+    while(found < limit && i + m <= n)
+    {
+        const char *p = memchr(hay + i, needle[0], n - m + 1 - i);
+        if(!p)
+            break;
+
+        i = p - hay;
+        if(memcmp(p + 1, needle + 1, m - 1))
+        {
+            i++;
+            continue;
+        }
+
+        if(!scn_push(out, i))
+            break;
+
+        found++;
+        i += m;
+    }
+
+    return found;
+}
+
+#if SCN_X86
+
+// The byte of the needle checked along with the first: the last one that
+// differs from it, so that a needle like "/api/" is not filtered on '/'
+// twice. Zero for a one byte needle.
+static long scn_second_byte(const char *needle, long m)
+{
+    long k = m - 1;
+    while(k > 0 && needle[k] == needle[0])
+        k--;
+
+    return k ? k : m - 1;
+}
+
+// Defines the block at a time scan for one instruction set. Each set bit
+// in 'bits' is a position where both the first byte of the needle and the
+// one at 'k' (see scn_second_byte) match; the rest of the needle is
+// compared only there. Whatever is left at the end, less than a block,
+// goes to scn_scan_scalar.
+#define SCN_DEFINE_SCAN(name, isa, width, vec, load, set1, eq, and, mask) \
+    __attribute__((target(isa))) \
+    static long name(const char *hay, long n, const char *needle, long m, scn_matches *out, long limit) \
+    { \
+        long k = scn_second_byte(needle, m); \
+        vec first = set1(needle[0]); \
+        vec second = set1(needle[k]); \
+        long i, next = 0, found = 0; \
+        for(i = 0; i + m - 1 + width <= n; i += width) \
+        { \
+            vec block = eq(load((vec *)(hay + i)), first); \
+            if(k) \
+                block = and(block, eq(load((vec *)(hay + i + k)), second)); \
+            unsigned int bits = mask(block); \
+            while(bits) \
+            { \
+                long at = i + __builtin_ctz(bits); \
+                bits &= bits - 1; \
+                if(at < next || (m > 2 && memcmp(hay + at + 1, needle + 1, m - 1))) \
+                    continue; \
+                if(!scn_push(out, at) || ++found == limit) \
+                    return found; \
+                next = at + m; \
+            } \
+        } \
+        return scn_scan_scalar(hay, n, needle, m, out, limit, i, next, found); \
+    }
+
+SCN_DEFINE_SCAN(scn_scan_sse2, "sse2", 16, __m128i, _mm_loadu_si128, _mm_set1_epi8,
+        _mm_cmpeq_epi8, _mm_and_si128, _mm_movemask_epi8)
+SCN_DEFINE_SCAN(scn_scan_avx2, "avx2", 32, __m256i, _mm256_loadu_si256, _mm256_set1_epi8,
+        _mm256_cmpeq_epi8, _mm256_and_si256, _mm256_movemask_epi8)
+
+#endif
+
+static long scn_scan(const char *hay, long n, const char *needle, long m, scn_matches *out, long limit)
+{
+    if(m <= 0 || m > n)
+        return 0;
+
+    switch(scn_get_level())
+    {
+#if SCN_X86
+        case SCN_AVX2:
+            return scn_scan_avx2(hay, n, needle, m, out, limit);
+        case SCN_SSE2:
+            return scn_scan_sse2(hay, n, needle, m, out, limit);
+#endif
+        default:
+            return scn_scan_scalar(hay, n, needle, m, out, limit, 0, 0, 0);
+    }
+}
+
+// The best level the CPU supports, unless scn_set_level chose another.
+scn_level scn_get_level()
+{
+    if(scn_level_ >= 0)
+        return scn_level_;
+
+#if SCN_X86
+    __builtin_cpu_init();
+    scn_level_ = __builtin_cpu_supports("avx2") ? SCN_AVX2 : SCN_SSE2;
+#else
+    scn_level_ = SCN_SCALAR;
+#endif
+
+    return scn_level_;
+}
+
+// Uses 'level', or the best one the CPU supports if it is higher. Returns
+// the level now in use.
+scn_level scn_set_level(scn_level level)
+{
+    scn_level_ = -1;
+    if(level < scn_get_level())
+        scn_level_ = level;
+
+    return scn_level_;
+}
+
+// The index in 'hay' of the first match of the needle, or -1.
+long scn_find(char *hay, long hlen, char *needle, long nlen)
+{
+    long at;
+    scn_matches one = {&at, 0, 1};
+
+    return scn_scan(hay, hlen, needle, nlen, &one, 1) ? at : -1;
+}
+
+// Adds the start of every match of the needle in 'hay' to 'out', reading
+// from left to right; matches do not overlap. An empty needle matches
+// nowhere. Returns the number of matches added.
+long scn_find_all(char *hay, long hlen, char *needle, long nlen, scn_matches *out)
+{
+    long before = out->count;
+    scn_scan(hay, hlen, needle, nlen, out, LONG_MAX);
+
+    return out->count - before;
+}
+
+void scn_matches_free(scn_matches *m)
+{
+    free(m->at);
+    m->at = NULL;
+    m->count = m->alloced = 0;
+}
@@ -0,0 +1,48 @@
+/* Lanky -- Scripting Language and Virtual Machine
+ * Copyright (C) 2014  Sam Olsen
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef STRSCAN_H
+#define STRSCAN_H
+
+// Substring search for the string library. On x86-64 the scan compares a
+// whole block of the haystack against two bytes of the needle at once (16
+// bytes with SSE2, or 32 with AVX2 when the CPU has it): its first byte and
+// the last byte that differs from the first. The rest of the needle is only
+// checked where both match. Elsewhere, or
+// when built with -DSCN_NO_SIMD, a portable version built on memchr is
+// used. Every version gives the same results.
+
+typedef enum {
+    SCN_SCALAR,
+    SCN_SSE2,
+    SCN_AVX2
+} scn_level;
+
+// Where the matches of a needle start, in order. Start it zeroed.
+typedef struct {
+    long *at;
+    long count;
+    long alloced;
+} scn_matches;
+
+scn_level scn_get_level();
+scn_level scn_set_level(scn_level level);
+long scn_find(char *hay, long hlen, char *needle, long nlen);
+long scn_find_all(char *hay, long hlen, char *needle, long nlen, scn_matches *out);
+void scn_matches_free(scn_matches *m);
+
+#endif